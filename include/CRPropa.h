@@ -12,23 +12,32 @@
 #include "crpropa/Logging.h"
 #include "crpropa/Module.h"
 #include "crpropa/ModuleList.h"
+#include "crpropa/ParticleBatch.h"
 #include "crpropa/ParticleID.h"
 #include "crpropa/ParticleMass.h"
 #include "crpropa/ParticleState.h"
+#include "crpropa/PerThread.h"
 #include "crpropa/PhotonBackground.h"
 #include "crpropa/PhotonPropagation.h"
+#include "crpropa/PopulationControl.h"
 #include "crpropa/Random.h"
 #include "crpropa/Referenced.h"
+#include "crpropa/SharedMemory.h"
 #include "crpropa/Source.h"
 #include "crpropa/Units.h"
 #include "crpropa/Variant.h"
 #include "crpropa/Vector3.h"
+#include "crpropa/Vector3x4.h"
 #include "crpropa/Version.h"
 
 #include "crpropa/module/AdiabaticCooling.h"
 #include "crpropa/module/Acceleration.h"
 #include "crpropa/module/Boundary.h"
 #include "crpropa/module/BreakCondition.h"
+#include "crpropa/module/ColumnarOutput.h"
+#include "crpropa/module/MemoryOutput.h"
+#include "crpropa/module/HistogramOutput.h"
+#include "crpropa/module/ContinuousLosses.h"
 #include "crpropa/module/DiffusionSDE.h"
 #include "crpropa/module/EMCascade.h"
 #include "crpropa/module/EMDoublePairProduction.h"
@@ -38,6 +47,7 @@
 #include "crpropa/module/ElasticScattering.h"
 #include "crpropa/module/ElectronPairProduction.h"
 #include "crpropa/module/HDF5Output.h"
+#include "crpropa/module/InteractionScheduler.h"
 #include "crpropa/module/NuclearDecay.h"
 #include "crpropa/module/Observer.h"
 #include "crpropa/module/OutputShell.h"
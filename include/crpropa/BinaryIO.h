@@ -0,0 +1,64 @@
+#ifndef CRPROPA_BINARYIO_H
+#define CRPROPA_BINARYIO_H
+
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace crpropa {
+
+/**
+ @namespace binary
+ @brief Helpers for the binary file formats (candidates, histograms, columnar output).
+
+ Values are written with the byte order of the machine, strings as their
+ length (uint32) followed by the characters.
+ */
+namespace binary {
+
+template<typename T>
+inline void write(std::ostream &out, const T &value) {
+	out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/** Read a value, throws at the end of the stream */
+template<typename T>
+inline T read(std::istream &in) {
+	T value;
+	if (!in.read(reinterpret_cast<char *>(&value), sizeof(T)))
+		throw std::runtime_error("crpropa: unexpected end of binary stream");
+	return value;
+}
+
+inline void writeString(std::ostream &out, const std::string &s) {
+	write<uint32_t>(out, s.size());
+	out.write(s.data(), s.size());
+}
+
+inline std::string readString(std::istream &in) {
+	uint32_t n = read<uint32_t>(in);
+	std::string s(n, ' ');
+	if (n > 0 && !in.read(&s[0], n))
+		throw std::runtime_error("crpropa: unexpected end of binary stream");
+	return s;
+}
+
+/** Append the bytes of a value to a buffer */
+template<typename T>
+inline void put(std::vector<char> &buffer, const T &value) {
+	const char *p = reinterpret_cast<const char *>(&value);
+	buffer.insert(buffer.end(), p, p + sizeof(T));
+}
+
+inline void putString(std::vector<char> &buffer, const std::string &s) {
+	put<uint32_t>(buffer, s.size());
+	buffer.insert(buffer.end(), s.begin(), s.end());
+}
+
+} // namespace binary
+} // namespace crpropa
+
+#endif // CRPROPA_BINARYIO_H
@@ -5,10 +5,12 @@
 #include "crpropa/Referenced.h"
 #include "crpropa/AssocVector.h"
 #include "crpropa/Variant.h"
+#include "crpropa/PopulationControl.h"
 
 #include <vector>
 #include <map>
 #include <sstream>
+#include <iosfwd>
 #include <stdint.h>
 
 namespace crpropa {
@@ -35,6 +37,7 @@ public:
 
 	typedef Loki::AssocVector<std::string, Variant> PropertyMap;
 	PropertyMap properties; /**< Map of property names and their values. */
+	std::vector<uint64_t> slots; /**< Values of the interned slots, see registerSlot */
 
 	/** Parent candidate. 0 if no parent (initial particle). Must not be a ref_ptr to prevent circular referencing. */
 	Candidate *parent;
@@ -47,9 +50,12 @@ private:
 	double currentStep; /**< Size of the currently performed step in [m] comoving units */
 	double nextStep; /**< Proposed size of the next propagation step in [m] comoving units */
 	std::string tagOrigin; /**< Name of interaction/source process which created this candidate*/
+	ref_ptr<PopulationControl> populationControl; /**< Thinning and splitting of the secondaries, inherited by them */
 
 	static uint64_t nextSerialNumber;
 	uint64_t serialNumber;
+	uint64_t sourceSerialNumber; /**< Serial number at source after detaching from the parent, 0 otherwise */
+	uint64_t createdSerialNumber; /**< Serial number at creation after detaching from the parent, 0 otherwise */
 
 public:
 	Candidate(
@@ -105,6 +111,13 @@ public:
 	void setTagOrigin(std::string tagOrigin);
 	std::string getTagOrigin() const;
 
+	/**
+	 Sets the population control applied to new secondaries.
+	 It is inherited by the secondaries, null for none.
+	 */
+	void setPopulationControl(ref_ptr<PopulationControl> control);
+	ref_ptr<PopulationControl> getPopulationControl() const;
+
 	/**
 	 Make a bid for the next step size: the lowest wins.
 	 */
@@ -115,6 +128,21 @@ public:
 	bool removeProperty(const std::string &name);
 	bool hasProperty(const std::string &name) const;
 
+	/**
+	 Interned slot for integer state of modules, e.g. the detection index
+	 of ObserverTimeEvolution. Slots are read and written by index without
+	 the string lookup of a property. They are copied by clone, serialized
+	 by name and not inherited by secondaries.
+	 @param name	name of the slot, the same name always gives the same slot
+	 */
+	static size_t registerSlot(const std::string &name);
+	static std::string getSlotName(size_t slot);
+	/** Value of a slot, 0 if never set */
+	inline uint64_t getSlot(size_t slot) const {
+		return (slot < slots.size()) ? slots[slot] : 0;
+	}
+	void setSlot(size_t slot, uint64_t value);
+
 	/**
 	 Add a new candidate to the list of secondaries.
 	 @param c Candidate
@@ -128,6 +156,8 @@ public:
 	inline void addSecondary(ref_ptr<Candidate> c) { addSecondary(c.get()); };
 	/**
 	 Add a new candidate to the list of secondaries.
+	 If a population control is set, the secondary may be discarded or split
+	 and its weight is adapted accordingly.
 	 @param id			particle ID of the secondary
 	 @param energy		energy of the secondary
 	 @param w			weight of the secondary
@@ -135,7 +165,7 @@ public:
 	 */
 	void addSecondary(int id, double energy, double w = 1., std::string tagOrigin = "SEC");
 	/**
-	 Add a new candidate to the list of secondaries.
+	 Add a new candidate to the list of secondaries, see above.
 	 @param id			particle ID of the secondary
 	 @param energy		energy of the secondary
 	 @param position	start position of the secondary
@@ -157,6 +187,12 @@ public:
 	/** Serial number of candidate at creation */
 	uint64_t getCreatedSerialNumber() const;
 
+	/**
+	 Remove the link to the parent, keeping the source and creation serial numbers.
+	 Used when the parent is released before the candidate.
+	 */
+	void detachParent();
+
 	/** Set the next serial number to use */
 	static void setNextSerialNumber(uint64_t snr);
 
@@ -174,6 +210,25 @@ public:
 	 and activate it if inactive, e.g. restart it
 	*/
 	void restart();
+
+	/**
+	 Write the complete candidate in binary form to a stream.
+	 All four particle states, weight, redshift, trajectory length, step sizes,
+	 activity, tag, serial numbers (own, at source and at creation, also if
+	 the parent is not written), the properties and the slots are stored
+	 with full precision. The record format is versioned by serializationVersion.
+	 @param out			output stream, should be opened in binary mode
+	 @param recursive	also write the tree of secondaries
+	 */
+	void serialize(std::ostream &out, bool recursive = false) const;
+	/**
+	 Read a candidate written by serialize.
+	 Secondaries are restored including their parent links.
+	 @param in			input stream, should be opened in binary mode
+	 @param version		record format version of the stream, has to be serializationVersion
+	 */
+	static ref_ptr<Candidate> deserialize(std::istream &in, uint16_t version = serializationVersion);
+	static const uint16_t serializationVersion = 1;
 };
 
 /** @}*/
@@ -3,6 +3,10 @@
 
 #include "Referenced.h"
 #include "Candidate.h"
+#include "PerThread.h"
+
+#include <atomic>
+#include <mutex>
 
 namespace crpropa {
 
@@ -18,9 +22,6 @@ private:
 	std::vector<double> pdf;
 	mutable std::vector<double> cdf;
 
-	/** Calculate the cdf from the pdf */
-	void updateCdf() const;
-
 public:
 	CylindricalProjectionMap();
 	/** constructur
@@ -46,6 +47,9 @@ public:
 
 	const std::vector<double>& getCdf() const;
 
+	/** Calculate the cdf from the pdf, if the pdf was changed */
+	void updateCdf() const;
+
 	size_t getNPhi();
 	size_t getNTheta();
 
@@ -97,6 +101,13 @@ public:
 	void fillMap(int pid, double energy, const Vector3d& direction, double weight = 1.);
 	/** Increment the value for the particle state by weight. */
 	void fillMap(const ParticleState& state, double weight = 1.);
+	/** Increment the value for the particle state by weight, thread safe without
+	 locking: every thread fills its own maps, which are added to the maps on the
+	 next access (or with mergeThreadMaps). */
+	void fillMapConcurrent(const ParticleState& state, double weight = 1.);
+	/** Add the maps filled with fillMapConcurrent.
+	 Must not be called while other threads are filling. */
+	void mergeThreadMaps() const;
 
 	/** Draw a random vector from the distribution. */
 	bool drawDirection(int pid, double energy, Vector3d& direction) const;
@@ -125,10 +136,32 @@ public:
 	/** Merge maps from file */
 	void merge(const std::string &filename);
 
+	/** Create an empty EmissionMap with the same binning */
+	EmissionMap *createEmpty() const;
+
+	/** Calculate the cdfs of all maps, in parallel if OpenMP is available.
+	 Otherwise the cdfs are calculated on the first draw from each map.
+	 */
+	void updateCdf() const;
+
 protected:
+	/** Get the map for the specified pid and energy bin */
+	ref_ptr<CylindricalProjectionMap> getMapForKey(const key_t &key);
+
 	double minEnergy, maxEnergy, logStep;
 	size_t nPhi, nTheta, nEnergy;
 	map_t maps;
+
+private:
+	/** Maps filled by fillMapConcurrent */
+	struct ThreadMaps: public Referenced {
+		PerThread<ref_ptr<EmissionMap> > maps;
+		std::atomic<bool> filled; ///< some thread map was created since the last merge
+		std::mutex mutex;
+		ThreadMaps() : filled(false) {
+		}
+	};
+	ref_ptr<ThreadMaps> threadMaps;
 };
 
 } // namespace crpropa
@@ -1,6 +1,7 @@
 #ifndef CRPROPA_GEOMETRY_H
 #define CRPROPA_GEOMETRY_H
 
+#include <atomic>
 #include <vector>
 #include <string>
 
@@ -32,6 +33,12 @@ public:
 	 @param point	vector corresponding to the point to which compute the normal vector
 	 */
 	virtual Vector3d normal(const Vector3d& point) const = 0;
+	/** Axis aligned box enclosing the region of negative distance.
+	 Returns false for unbounded surfaces, which is the default.
+	 @param lower	lower corner of the box
+	 @param upper	upper corner of the box
+	 */
+	virtual bool getBoundingBox(Vector3d &lower, Vector3d &upper) const {return false;};
 	virtual std::string getDescription() const {return "Surface without description.";};
 };
 
@@ -64,6 +71,7 @@ public:
 	Sphere(const Vector3d& center, double radius);
 	virtual double distance(const Vector3d &point) const;
 	virtual Vector3d normal(const Vector3d& point) const;
+	virtual bool getBoundingBox(Vector3d &lower, Vector3d &upper) const;
 	virtual std::string getDescription() const;
 };
 
@@ -79,10 +87,57 @@ public:
 	ParaxialBox(const Vector3d& corner, const Vector3d& size);
 	virtual double distance(const Vector3d &point) const;
 	virtual Vector3d normal(const Vector3d& point) const;
+	virtual bool getBoundingBox(Vector3d &lower, Vector3d &upper) const;
 	virtual std::string getDescription() const;
 };
 
 
+/**
+ @class SurfaceIndex
+ @brief Bounding volume hierarchy over many closed surfaces.
+
+ Answers the queries of an observer with many surfaces, e.g. a catalogue of
+ spheres, in logarithmic instead of linear time: the surfaces crossed
+ between two points and the distance to the nearest surface.
+ The surfaces need a bounding box (see Surface::getBoundingBox), the
+ hierarchy is built on the first query after adding surfaces.
+ */
+class SurfaceIndex: public Referenced {
+private:
+	struct Node {
+		Vector3d lower, upper;
+		size_t begin, end; ///< range in order, for leaves
+		int left, right; ///< children, -1 for leaves
+	};
+	std::vector<ref_ptr<Surface> > surfaces;
+	std::vector<Vector3d> lowers, uppers;
+	std::vector<size_t> order;
+	std::vector<Node> nodes;
+	std::atomic<bool> built; ///< set with release order after building
+
+	void buildIfNeeded() const;
+	int buildNode(size_t begin, size_t end);
+
+public:
+	SurfaceIndex();
+	/** Add a surface, returns its index */
+	size_t add(Surface *surface);
+	size_t size() const;
+	Surface *get(size_t i) const;
+	/** Build the hierarchy, done automatically on the first query */
+	void build();
+
+	/** Index of a surface crossed from previous to current position, -1 for none.
+	 Same criterion as ObserverSurface: the distance changes sign and the
+	 previous position is not on the surface.
+	 */
+	int findCrossing(const Vector3d &previous, const Vector3d &current) const;
+	/** Smallest absolute distance of the point to any surface, infinity if empty */
+	double distance(const Vector3d &point) const;
+	std::string getDescription() const;
+};
+
+
 /** @}*/
 } // namespace crpropa
 
@@ -3,16 +3,14 @@
 
 #include "crpropa/Referenced.h"
 #include "crpropa/Vector3.h"
+#include "crpropa/Vector3x4.h"
 
 #include "kiss/string.h"
 #include "kiss/logger.h"
 
 #include <vector>
 #include <type_traits>
-#if HAVE_SIMD
-#include <immintrin.h>
-#include <smmintrin.h>
-#endif // HAVE_SIMD
+#include <stdexcept>
 
 namespace crpropa {
 
@@ -124,6 +122,87 @@ public:
 	}
 };
 
+/**
+ @class GridStorage
+ @brief Values of a Grid, owned in a vector or in external memory.
+
+ External memory (e.g. shared memory or a memory mapped file) is not copied;
+ an optional owner object is kept alive as long as the values are used.
+ External memory can be read-only, e.g. a shared memory segment mapped without
+ write permission.
+ */
+template<typename T>
+class GridStorage {
+	std::vector<T> owned;
+	T *values;
+	bool external;
+	bool readOnly;
+	ref_ptr<Referenced> owner;
+public:
+	GridStorage() : values(NULL), external(false), readOnly(false) {
+	}
+
+	GridStorage(const GridStorage<T> &s) : owned(s.owned), external(s.external),
+			readOnly(s.readOnly), owner(s.owner) {
+		values = external ? s.values : owned.data();
+	}
+
+	GridStorage<T> &operator=(const GridStorage<T> &s) {
+		owned = s.owned;
+		external = s.external;
+		readOnly = s.readOnly;
+		owner = s.owner;
+		values = external ? s.values : owned.data();
+		return *this;
+	}
+
+	/** Use owned memory of n (zero initialized) values */
+	void resize(size_t n) {
+		if (external) {
+			external = false;
+			readOnly = false;
+			owner = NULL;
+			owned.clear();
+		}
+		owned.resize(n);
+		values = owned.data();
+	}
+
+	void setExternal(T *values, Referenced *owner, bool readOnly) {
+		std::vector<T>().swap(owned);
+		this->values = values;
+		this->owner = owner;
+		this->readOnly = readOnly;
+		external = true;
+	}
+
+	bool isExternal() const {
+		return external;
+	}
+
+	bool isReadOnly() const {
+		return readOnly;
+	}
+
+	std::vector<T> &getVector() {
+		if (external)
+			throw std::runtime_error("Grid: the values are stored externally, use getData");
+		return owned;
+	}
+
+	T *data() const {
+		return values;
+	}
+
+	T &operator[](size_t i) {
+		return values[i];
+	}
+
+	const T &operator[](size_t i) const {
+		return values[i];
+	}
+};
+
 /**
  @class Grid
  @brief Template class for fields on a periodic grid with trilinear interpolation
@@ -135,7 +214,7 @@ public:
  */
 template<typename T>
 class Grid: public Referenced {
-	std::vector<T> grid;
+	GridStorage<T> grid; /**< Grid values, x-index changing slowest */
 	size_t Nx, Ny, Nz; /**< Number of grid points */
 	Vector3d origin; /**< Origin of the volume that is represented by the grid. */
 	Vector3d gridOrigin; /**< Grid origin */
@@ -143,6 +222,7 @@ class Grid: public Referenced {
 	bool clipVolume; /**< If set to true, all values outside of the grid will be 0*/
 	bool reflective; /**< If set to true, the grid is repeated reflectively instead of periodically */
 	interpolationType ipolType; /**< Type of interpolation between the grid points */
+	double valueScale; /**< Factor applied to the interpolated values */
 
 public:
 	/** Constructor for cubic grid
@@ -150,7 +230,7 @@ public:
 	 @param	N		Number of grid points in one direction
 	 @param spacing	Spacing between grid points
 	 */
-	Grid(Vector3d origin, size_t N, double spacing) {
+	Grid(Vector3d origin, size_t N, double spacing) : ipolType(TRILINEAR), valueScale(1) {
 		setOrigin(origin);
 		setGridSize(N, N, N);
 		setSpacing(Vector3d(spacing));
@@ -165,7 +245,7 @@ public:
 	 @param	Nz		Number of grid points in z-direction
 	 @param spacing	Spacing between grid points
 	 */
-	Grid(Vector3d origin, size_t Nx, size_t Ny, size_t Nz, double spacing) {
+	Grid(Vector3d origin, size_t Nx, size_t Ny, size_t Nz, double spacing) : ipolType(TRILINEAR), valueScale(1) {
 		setOrigin(origin);
 		setGridSize(Nx, Ny, Nz);
 		setSpacing(Vector3d(spacing));
@@ -180,7 +260,7 @@ public:
 	 @param	Nz		Number of grid points in z-direction
 	 @param spacing	Spacing vector between grid points
 	*/
-	Grid(Vector3d origin, size_t Nx, size_t Ny, size_t Nz, Vector3d spacing) {
+	Grid(Vector3d origin, size_t Nx, size_t Ny, size_t Nz, Vector3d spacing) : ipolType(TRILINEAR), valueScale(1) {
 		setOrigin(origin);
 		setGridSize(Nx, Ny, Nz);
 		setSpacing(spacing);
@@ -192,8 +272,24 @@ public:
 	 @param p	GridProperties instance
      */
 	Grid(const GridProperties &p) :
-		origin(p.origin), spacing(p.spacing), reflective(p.reflective), ipolType(p.ipol) {
+		origin(p.origin), spacing(p.spacing), clipVolume(false), reflective(p.reflective),
+		ipolType(p.ipol), valueScale(1) {
 		setGridSize(p.Nx, p.Ny, p.Nz);
+		setInterpolationType(p.ipol);
+	}
+
+	/** Constructor for GridProperties with externally owned values (see setExternalStorage)
+	 @param p			GridProperties instance
+	 @param values		p.Nx * p.Ny * p.Nz values, z-index changing fastest
+	 @param owner		optional object owning the memory, kept alive by the grid
+	 @param readOnly	the memory must not be written
+	 */
+	Grid(const GridProperties &p, T *values, Referenced *owner = NULL, bool readOnly = false) :
+		Nx(p.Nx), Ny(p.Ny), Nz(p.Nz), origin(p.origin), spacing(p.spacing),
+		clipVolume(false), reflective(p.reflective), ipolType(p.ipol), valueScale(1) {
+		setOrigin(origin);
+		setInterpolationType(p.ipol);
+		grid.setExternal(values, owner, readOnly);
 	}
 
 	void setOrigin(Vector3d origin) {
@@ -225,9 +321,14 @@ public:
 	}
 
 	/** Change the interpolation type to the routine specified by the user. Check if this routine is
-		contained in the enum interpolationType and thus supported by CRPropa.*/
+		contained in the enum interpolationType and thus supported by CRPropa.
+		Tricubic interpolation of vector grids requires SIMD_EXTENSIONS.*/
 	void setInterpolationType(interpolationType ipolType) {
 		if (ipolType == TRILINEAR || ipolType == TRICUBIC || ipolType == NEAREST_NEIGHBOUR) {
+#ifndef HAVE_SIMD
+			if ((ipolType == TRICUBIC) && not std::is_arithmetic<T>::value)
+				throw std::runtime_error("Grid: tricubic interpolation of vector grids requires SIMD_EXTENSIONS");
+#endif
 			this->ipolType = ipolType;
 			if ((ipolType == TRICUBIC) && (std::is_same<T, Vector3d>::value)) {
 				KISS_LOG_WARNING << "Tricubic interpolation on Grid3d works only with float-precision, doubles will be downcasted";
@@ -256,7 +357,7 @@ public:
 
 	/** Calculates the total size of the grid in bytes */
 	size_t getSizeOf() const {
-		return sizeof(grid) + (sizeof(grid[0]) * grid.size());
+		return sizeof(grid) + (sizeof(T) * Nx * Ny * Nz);
 	}
 
 	Vector3d getSpacing() const {
@@ -267,6 +368,25 @@ public:
 		return reflective;
 	}
 
+	bool getClipVolume() const {
+		return clipVolume;
+	}
+
+	interpolationType getInterpolationType() const {
+		return ipolType;
+	}
+
+	/** Factor multiplied to the interpolated values, e.g. a unit conversion of
+	 values that are not copied (see loadGridMapped). get and getValue return
+	 the stored values. */
+	void setValueScale(double scale) {
+		valueScale = scale;
+	}
+
+	double getValueScale() const {
+		return valueScale;
+	}
+
 	/** Choose the interpolation algorithm based on the set interpolation type.
 	  By default this it the trilinear interpolation. The user can change the
 	  routine with the setInterpolationType function.*/
@@ -281,16 +401,21 @@ public:
 				return T(0.);
 		} 
 
+		T value;
 		if (ipolType == TRICUBIC)
-			return tricubicInterpolate(T(), position);
+			value = tricubicInterpolate(T(), position);
 		else if (ipolType == NEAREST_NEIGHBOUR)
-			return closestValue(position);
+			value = closestValue(position);
 		else
-			return trilinearInterpolate(position);
+			value = trilinearInterpolate(position);
+		if (valueScale != 1)
+			value *= valueScale;
+		return value;
 	}
 
-	/** Inspector & Mutator */
+	/** Inspector & Mutator, throws for read-only values */
 	T &get(size_t ix, size_t iy, size_t iz) {
+		checkWritable();
 		return grid[ix * Ny * Nz + iy * Nz + iz];
 	}
 
@@ -313,17 +438,56 @@ public:
 		return grid[ix * Ny * Nz + iy * Nz + iz];
 	}
 
-	T getValue(size_t ix, size_t iy, size_t iz) {
+	T getValue(size_t ix, size_t iy, size_t iz) const {
 		return grid[ix * Ny * Nz + iy * Nz + iz];
 	}
 
+	/** Mutator, throws for read-only values */
 	void setValue(size_t ix, size_t iy, size_t iz, T value) {
+		checkWritable();
 		grid[ix * Ny * Nz + iy * Nz + iz] = value;
 	}
 
-	/** Return a reference to the grid values */
+	/** Return a reference to the grid values, not available for external storage */
 	std::vector<T> &getGrid() {
-		return grid;
+		return grid.getVector();
+	}
+
+	/** Pointer to the Nx * Ny * Nz contiguous grid values, z-index changing
+	 fastest; must not be written if isReadOnly */
+	T *getData() {
+		return grid.data();
+	}
+
+	const T *getData() const {
+		return grid.data();
+	}
+
+	/** Use external memory for the grid values instead of copying them, e.g.
+	 shared memory (see shareGrid) or a memory mapped file.
+	 @param values	Nx * Ny * Nz values, z-index changing fastest; the memory has
+					to stay valid as long as the grid uses it
+	 @param owner	optional object owning the memory, kept alive by the grid
+	 @param readOnly	the memory must not be written, e.g. a read-only mapping;
+					get, setValue and loadGrid throw instead
+	 */
+	void setExternalStorage(T *values, Referenced *owner = NULL, bool readOnly = false) {
+		grid.setExternal(values, owner, readOnly);
+	}
+
+	bool hasExternalStorage() const {
+		return grid.isExternal();
+	}
+
+	/** True if the values are external memory that must not be written */
+	bool isReadOnly() const {
+		return grid.isReadOnly();
+	}
+
+	/** Throws if the values must not be written */
+	void checkWritable() const {
+		if (grid.isReadOnly())
+			throw std::runtime_error("Grid: the values are read-only (e.g. shared memory)");
 	}
 
 	/** Position of the grid point of a given index */
@@ -365,26 +529,14 @@ private:
 		ix = periodicBoundary(ix, Nx);
 		iy = periodicBoundary(iy, Ny);
 		iz = periodicBoundary(iz, Nz);
-		return convertVector3fToSimd(grid[ix * Ny * Nz + iy * Nz + iz]);
+		return Vector3f4(grid[ix * Ny * Nz + iy * Nz + iz]).simd;
 	}
 
 	__m128 simdreflectiveGet(size_t ix, size_t iy, size_t iz) const {
 		ix = reflectiveBoundary(ix, Nx);
 		iy = reflectiveBoundary(iy, Ny);
 		iz = reflectiveBoundary(iz, Nz);
-		return convertVector3fToSimd(grid[ix * Ny * Nz + iy * Nz + iz]);
-	}
-
-	__m128 convertVector3fToSimd(const Vector3f v) const {
-		__m128 simdVar = _mm_set_ps(0,v.z,v.y,v.x);
-		return simdVar;
-	}
-	
-	Vector3f convertSimdToVector3f(__m128 res) const {
-		float vec[4];	
-		_mm_store_ps(&vec[0], res);
-		Vector3f result = Vector3f(vec[0], vec[1], vec[2]);
-		return result;
+		return Vector3f4(grid[ix * Ny * Nz + iy * Nz + iz]).simd;
 	}
 
 	/** Vectorized cubic Interpolator in 1D */
@@ -444,7 +596,7 @@ private:
 			interpolateVaryX[iLoopX+1] = CubicInterpolate(interpolateVaryY[0], interpolateVaryY[1], interpolateVaryY[2], interpolateVaryY[3], fY);
 		}
 		__m128 result = CubicInterpolate(interpolateVaryX[0], interpolateVaryX[1], interpolateVaryX[2], interpolateVaryX[3], fX);
-		return convertSimdToVector3f(result);
+		return Vector3f4(result).toVector3();
 		#else // HAVE_SIMD
 		throw std::runtime_error( "Tried to use tricubic Interpolation without SIMD_EXTENSION. SIMD Optimization is necessary for tricubic interpolation of vector grids.\n");
 		#endif // HAVE_SIMD	
@@ -523,19 +675,30 @@ private:
 		double fZ1 = 1 - fZ0;
 
 		/** trilinear interpolation (see http://paulbourke.net/miscellaneous/interpolation) */
-		T b(0.);
-		b += get(iX0, iY0, iZ0) * fX1 * fY1 * fZ1;
-		b += get(iX1, iY0, iZ0) * fX0 * fY1 * fZ1;
-		b += get(iX0, iY1, iZ0) * fX1 * fY0 * fZ1;
-		b += get(iX0, iY0, iZ1) * fX1 * fY1 * fZ0;
-		b += get(iX1, iY0, iZ1) * fX0 * fY1 * fZ0;
-		b += get(iX0, iY1, iZ1) * fX1 * fY0 * fZ0;
-		b += get(iX1, iY1, iZ0) * fX0 * fY0 * fZ1;
-		b += get(iX1, iY1, iZ1) * fX0 * fY0 * fZ0;
-
+		const T *corners[8] = {&get(iX0, iY0, iZ0), &get(iX1, iY0, iZ0), &get(iX0, iY1, iZ0), &get(iX0, iY0, iZ1),
+				&get(iX1, iY0, iZ1), &get(iX0, iY1, iZ1), &get(iX1, iY1, iZ0), &get(iX1, iY1, iZ1)};
+		const double weights[8] = {fX1 * fY1 * fZ1, fX0 * fY1 * fZ1, fX1 * fY0 * fZ1, fX1 * fY1 * fZ0,
+				fX0 * fY1 * fZ0, fX1 * fY0 * fZ0, fX0 * fY0 * fZ1, fX0 * fY0 * fZ0};
+		return weightedSum(T(), corners, weights);
+	}
+
+	/** Weighted sum of the corner values of the trilinear interpolation */
+	template<typename U>
+	U weightedSum(U, const U *const corners[8], const double weights[8]) const {
+		U b(0.);
+		for (int i = 0; i < 8; i++)
+			b += *corners[i] * weights[i];
 		return b;
 	}
 
+	/** Weighted sum of the corner values, vectorised for Vector3f */
+	Vector3f weightedSum(Vector3f, const Vector3f *const corners[8], const double weights[8]) const {
+		Vector3f4 b;
+		for (int i = 0; i < 8; i++)
+			b += Vector3f4(*corners[i]) * float(weights[i]);
+		return b.toVector3();
+	}
+
 }; // class Grid
 
 typedef Grid<double> Grid1d;
@@ -5,6 +5,7 @@
 #include "crpropa/magneticField/MagneticField.h"
 #include <string>
 #include <array>
+#include <functional>
 
 #ifdef CRPROPA_HAVE_FFTW3F
 #include "fftw3.h"
@@ -15,6 +16,7 @@
  @brief Grid related functions: load, dump, save, retrieve grid properties ...
 
  This file contains a number of functions related to scalar and vector grids (Grid.h).
+ The functions evaluating or writing grid values include the value scale of the grid (Grid::setValueScale).
 
  Dump/load functions are available for saving/loading grids to/from and binary and plain text files.
  In the files the grid points are stored from (0, 0, 0) to (Nx, Ny, Nz) with the z-index changing the fastest.
@@ -63,11 +65,15 @@ double rmsFieldStrength(ref_ptr<Grid3f> grid);
 std::array<float, 3> rmsFieldStrengthPerAxis(ref_ptr<Grid3f> grid);
 
 /** Multiply all grid values by a given factor.
+ Grids with external storage (e.g. loadGridMapped, shareGrid) are not modified,
+ instead the factor is multiplied to their value scale.
  @param grid		a scalar grid (Grid1f)
  @param a			scaling factor that will be used to multiply all points in grid
  */
 void scaleGrid(ref_ptr<Grid1f> grid, double a);
 /** Multiply all grid values by a given factor.
+ Grids with external storage (e.g. loadGridMapped, shareGrid) are not modified,
+ instead the factor is multiplied to their value scale.
  @param grid		a vector grid (Grid3f)
  @param a			scaling factor that will be used to multiply all points in grid
  */
@@ -149,6 +155,60 @@ void dumpGridToTxt(ref_ptr<Grid3f> grid, std::string filename,
 void dumpGridToTxt(ref_ptr<Grid1f> grid, std::string filename,
 		double conversion = 1);
 
+/** Map a binary file (as written by dumpGrid) into a Grid3f instead of reading it.
+ The file is paged in on demand, so that large grids open instantly and
+ processes on one host share the file pages. The conversion is applied to the
+ interpolated values (Grid::setValueScale), the stored values are unchanged.
+ Modified grid points are private to the process and not written to the file.
+ @param grid		a vector grid (Grid3f) with the size of the file
+ @param filename	name of input file
+ @param conversion	factor multiplied to the interpolated values
+ */
+void loadGridMapped(ref_ptr<Grid3f> grid, std::string filename,
+		double conversion = 1);
+
+/** Map a binary file into a Grid1f, see loadGridMapped for Grid3f.
+ @param grid		a scalar grid (Grid1f) with the size of the file
+ @param filename	name of input file
+ @param conversion	factor multiplied to the interpolated values
+ */
+void loadGridMapped(ref_ptr<Grid1f> grid, std::string filename,
+		double conversion = 1);
+
+/** Vector grid in a named shared memory segment (see SharedMemorySegment).
+ The first process calling this for the name fills the grid, all other processes
+ on the host wait for it and map the same memory read-only instead of building
+ their own copy. The values of the returned grid must not be modified.
+ @param name		name of the shared memory segment
+ @param p			properties of the grid, identical in all processes
+ @param fill		called by the creating process to set the values, e.g. loadGrid
+ @param timeout		maximum time in seconds to wait for the creating process
+ @param key			identifies the content, e.g. the input file; an existing segment
+ 					with a different key is not reused but reported as an error
+ */
+ref_ptr<Grid3f> sharedGrid3f(const std::string &name, const GridProperties &p,
+		std::function<void(ref_ptr<Grid3f>)> fill, double timeout = 600,
+		const std::string &key = "");
+
+/** Scalar grid in a named shared memory segment, see sharedGrid3f */
+ref_ptr<Grid1f> sharedGrid1f(const std::string &name, const GridProperties &p,
+		std::function<void(ref_ptr<Grid1f>)> fill, double timeout = 600,
+		const std::string &key = "");
+
+/** Copy a vector grid into a named shared memory segment, or attach to the
+ segment if another process already did so.
+ @param grid		a vector grid (Grid3f), only read if the segment is created
+ @param name		name of the shared memory segment
+ @param key			identifies the content, see sharedGrid3f
+ @returns A read-only grid using the shared memory
+ */
+ref_ptr<Grid3f> shareGrid(ref_ptr<Grid3f> grid, const std::string &name,
+		const std::string &key = "");
+
+/** Copy a scalar grid into a named shared memory segment, see shareGrid */
+ref_ptr<Grid1f> shareGrid(ref_ptr<Grid1f> grid, const std::string &name,
+		const std::string &key = "");
+
 #ifdef CRPROPA_HAVE_FFTW3F
 /**
  Calculate the omnidirectional power spectrum E(k) for a given turbulent field
@@ -4,8 +4,10 @@
 #include "crpropa/Candidate.h"
 #include "crpropa/Referenced.h"
 #include "crpropa/Common.h"
+#include "crpropa/ParticleBatch.h"
 
 #include <string>
+#include <vector>
 
 namespace crpropa {
 
@@ -30,6 +32,46 @@ public:
 };
 
 
+/**
+ @class StochasticInteraction
+ @brief Abstract base class for modules with stochastic interactions.
+
+ In addition to sampling the interactions in process, these modules provide
+ their total interaction rate and perform single interactions on request,
+ so that the interactions of several modules can be sampled together
+ (see InteractionScheduler).
+ */
+class StochasticInteraction: public Module {
+public:
+	/** Total interaction rate per comoving distance [1/m] in the current state of the candidate, 0 if it cannot interact */
+	virtual double interactionRate(const Candidate *candidate) const = 0;
+	/** Perform a single interaction, the channel is sampled for the current state of the candidate */
+	virtual void interact(Candidate *candidate) const = 0;
+};
+
+/**
+ @class BatchModule
+ @brief Abstract base class for modules processing many candidates at once.
+
+ Intended for modules implemented in Python, which otherwise cross into the
+ interpreter once per candidate and step. A ModuleList with a batch size
+ (ModuleList::setBatchSize) propagates the candidates of a batch in lock step
+ and calls processCandidates once per step for all active candidates. The
+ current states are copied into a ParticleBatch (with the current step and
+ the trajectory length), which is available as NumPy arrays in Python.
+ Changes to the id, energy, position and direction and deactivated particles
+ are written back to the candidates. Outside of a batched ModuleList,
+ process handles a batch of one candidate.
+ */
+class BatchModule: public Module {
+public:
+	/** Process the states of a batch of candidates */
+	virtual void processBatch(ParticleBatch &batch) const = 0;
+	/** Copy the candidates into a batch, call processBatch and copy the results back */
+	virtual void processCandidates(const std::vector<Candidate*> &candidates) const;
+	void process(Candidate *candidate) const;
+};
+
 /**
  @class AbstractCondition
  @brief Abstract Module providing common features for conditional modules.
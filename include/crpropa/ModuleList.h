@@ -4,6 +4,7 @@
 #include "crpropa/Candidate.h"
 #include "crpropa/Module.h"
 #include "crpropa/Source.h"
+#include "crpropa/Units.h"
 
 #include <list>
 #include <sstream>
@@ -13,6 +14,20 @@ namespace crpropa {
 /**
  @class ModuleList
  @brief The simulation itself: A list of simulation modules
+
+ With setReleaseSecondaries, the secondaries of a candidate are released as
+ soon as their subtree is finished, instead of keeping the whole tree of a
+ primary in memory. Secondaries still referenced elsewhere, e.g. by a
+ ParticleCollector, are detached from their parent (Candidate::detachParent).
+ With a maximum number of live candidates, the secondaries are propagated
+ depth-first after each step of their parent while the limit is exceeded,
+ which bounds the size of the tree.
+
+ With a batch size (setBatchSize), the candidates are propagated in batches
+ in lock step: per step, each BatchModule is called once for all active
+ candidates of the batch while the other modules run in parallel over the
+ candidates. The secondaries of a batch are propagated generation by
+ generation afterwards; secondariesFirst is not supported in this mode.
  */
 class ModuleList: public Module {
 public:
@@ -36,6 +51,22 @@ public:
 	void run(const candidate_vector_t *candidates, bool recursive = true, bool secondariesFirst = false); ///< run simulation for a candidate vector
 	void run(SourceInterface* source, size_t count, bool recursive = true, bool secondariesFirst = false); ///< run simulation for a number of candidates from the given source
 
+	/** Release finished secondaries during recursive runs, the candidates then have no secondaries afterwards */
+	void setReleaseSecondaries(bool release);
+	bool getReleaseSecondaries() const;
+	/** Number of live secondaries of a primary above which they are propagated depth-first, 0 for no limit; requires setReleaseSecondaries */
+	void setMaximumLiveCandidates(size_t n);
+	size_t getMaximumLiveCandidates() const;
+	/** Largest number of live secondaries of a single primary (of a batch with setBatchSize) since the last reset */
+	size_t getPeakLiveCandidates() const;
+	void resetStatistics();
+
+	/** Propagate the candidates of run(candidates) and run(source, count) in batches of this size, 0 to disable */
+	void setBatchSize(size_t n);
+	size_t getBatchSize() const;
+	/** Propagate the candidates of a batch in lock step until all are finished */
+	void runBatch(const std::vector<Candidate*> &candidates, bool recursive = true);
+
 	std::string getDescription() const;
 	void showModules() const;
 	
@@ -50,6 +81,22 @@ public:
 private:
 	module_list_t modules;
 	bool showProgress;
+	bool releaseSecondaries;
+	size_t maxLive;
+	size_t peakLive;
+	size_t batchSize;
+
+	// propagate a candidate and its secondaries, counting the live secondaries of the tree
+	void runTree(Candidate* candidate, bool recursive, bool secondariesFirst, size_t &live, size_t &peak);
+	// release all secondaries of a candidate
+	void release(Candidate* candidate, size_t &live);
+	void updatePeakLive(size_t peak);
+	// propagate a batch and its secondaries, counting the live secondaries
+	void runBatch(const std::vector<Candidate*> &candidates, bool recursive, size_t &live, size_t &peak);
+	// call all modules for a step of the active candidates of a batch
+	void processBatch(const std::vector<Candidate*> &candidates) const;
+	// run one batch, stopping the run on exceptions
+	void runBatches(const candidate_vector_t &candidates, bool recursive);
 };
 
 /**
@@ -66,6 +113,118 @@ public:
 	std::string getDescription() const;
 };
 
+/**
+ @class ModuleList1D
+ @brief Specialised simulation of 1D rectilinear propagation.
+
+ Replaces a ModuleList made of SimplePropagation, an Observer with
+ Observer1D, the break conditions MinimumEnergy and MaximumTrajectoryLength
+ and the interaction modules. The particles move towards the observer at
+ x = 0, starting at the x component of their position. Only the interaction
+ modules (e.g. PhotoPionProduction, PhotoDisintegration, NuclearDecay,
+ ElectronPairProduction, ContinuousLosses, Redshift) are added to the list.
+
+ Waiting particles are stored in a compact form (Particle1D) instead of a
+ tree of candidates. For each thread, one candidate is reused to call the
+ interaction modules; the secondaries it collects are converted and
+ propagated afterwards. Propagation, observer and break conditions are
+ evaluated inline.
+
+ Detected particles are passed to the detection action, e.g. an Output
+ with the Event1D columns. Since the candidate is reused, the action
+ receives a clone by default. Properties of candidates and serial numbers
+ of the source and parent particles are not kept between steps.
+ */
+class ModuleList1D: public Referenced {
+public:
+	/** compact particle state: 1D position, energy, id, redshift, weight */
+	struct Particle1D {
+		int id;
+		double energy;
+		double position; ///< distance to the observer [m]
+		double redshift;
+		double weight;
+		double trajectoryLength;
+		int sourceId;
+		double sourceEnergy;
+		double sourcePosition;
+		int createdId;
+		double createdEnergy;
+		double createdPosition;
+		uint64_t serialNumber;
+		size_t tagOrigin; ///< index into the tag table of the propagating thread
+	};
+
+	/** Constructor
+	 @param minStep		minimum step size
+	 @param maxStep		maximum step size
+	 */
+	ModuleList1D(double minStep = (0.1 * kpc), double maxStep = (1 * Gpc));
+
+	void setShowProgress(bool show = true); ///< activate a progress bar
+
+	/** add an interaction module */
+	void add(Module* module);
+	std::size_t size() const;
+	ref_ptr<Module> operator[](const std::size_t i);
+
+	void setMinimumStep(double minStep);
+	void setMaximumStep(double maxStep);
+	double getMinimumStep() const;
+	double getMaximumStep() const;
+
+	/** Particles below this energy are discarded (cf. MinimumEnergy) */
+	void setMinimumEnergy(double energy);
+	double getMinimumEnergy() const;
+	/** Particles are discarded after this trajectory length (cf. MaximumTrajectoryLength) */
+	void setMaximumTrajectoryLength(double length);
+	double getMaximumTrajectoryLength() const;
+
+	/** Module called for particles reaching the observer at x = 0
+	 @param action	detection action, e.g. an Output
+	 @param clone	pass a clone of the candidate to the action
+	 */
+	void onDetection(Module *action, bool clone = true);
+
+	/** run simulation for a single candidate; the final state of the primary is stored in the candidate */
+	void run(Candidate* candidate, bool recursive = true);
+	/** run simulation for a number of candidates from the given source */
+	void run(SourceInterface* source, size_t count, bool recursive = true);
+
+	std::string getDescription() const;
+	void showModules() const;
+
+	/** @return number of detected particles */
+	size_t getDetectedCount() const;
+
+private:
+	std::vector<ref_ptr<Module> > modules;
+	ref_ptr<Module> detectionAction;
+	bool clone;
+	bool showProgress;
+	double minStep, maxStep;
+	double minEnergy;
+	double maxLength;
+	size_t detected;
+
+	// state of a propagating thread
+	struct Worker {
+		ref_ptr<Candidate> candidate; // reused for all particles
+		std::vector<Particle1D> stack; // waiting secondaries
+		std::vector<std::string> tags; // indexed by Particle1D::tagOrigin
+		size_t detected;
+		Worker();
+		size_t tagIndex(const std::string &tag);
+	};
+
+	static Particle1D toParticle(const Candidate &candidate, Worker &worker);
+	static void load(const Particle1D &particle, Worker &worker);
+	// propagate the candidate of the worker until it is finished
+	void propagate(Worker &worker, bool recursive) const;
+	// propagate the waiting secondaries of the worker
+	void propagateStack(Worker &worker, bool recursive) const;
+};
+
 } // namespace crpropa
 
 #endif // CRPROPA_MODULE_LIST_H
@@ -0,0 +1,84 @@
+#ifndef CRPROPA_PARTICLEBATCH_H
+#define CRPROPA_PARTICLEBATCH_H
+
+#include "crpropa/ParticleState.h"
+#include "crpropa/Referenced.h"
+#include "crpropa/Vector3.h"
+
+#include <vector>
+
+namespace crpropa {
+/**
+ * \addtogroup Core
+ * @{
+ */
+
+/**
+ @class ParticleBatch
+ @brief Many particles in structure of arrays (SoA) storage.
+
+ Holds the phase space of charged particles in one contiguous array per
+ component, for the batch propagation with PropagationBP::propagate.
+ Every particle has its own fixed step, e.g. scaled with its rigidity
+ (setRigidityScaledSteps). Particles leaving the escape sphere are
+ deactivated.
+ While views on the arrays exist (e.g. NumPy arrays from
+ getColumn_numpyArray) the number of particles cannot be changed, so
+ that the arrays are not reallocated under them.
+ */
+class ParticleBatch: public Referenced {
+public:
+	std::vector<int> id;
+	std::vector<double> energy;
+	std::vector<double> charge;
+	std::vector<double> x, y, z; ///< position
+	std::vector<double> ux, uy, uz; ///< direction
+	std::vector<double> step; ///< fixed step of the particle
+	std::vector<double> trajectoryLength;
+	std::vector<char> active;
+
+private:
+	Vector3d escapeCenter;
+	double escapeRadius;
+	size_t views;
+
+	void checkResizable() const;
+
+public:
+	ParticleBatch();
+
+	/** Add a particle, returns its index */
+	size_t add(const ParticleState &state, double step);
+	/** Particle state of the i-th particle */
+	ParticleState get(size_t i) const;
+	void set(size_t i, const ParticleState &state);
+	size_t size() const;
+	/** Number of active particles */
+	size_t countActive() const;
+	void reserve(size_t n);
+	/** Resize all arrays, new particles are inactive with zero step */
+	void resize(size_t n);
+	void clear();
+
+	/**
+	 Set the step of every particle proportional to its rigidity E / Z
+	 @param step		step of a particle with the reference rigidity
+	 @param rigidity	reference rigidity in [V]
+	 */
+	void setRigidityScaledSteps(double step, double rigidity);
+
+	/** Particles at a larger distance to the center are deactivated, radius 0 for none */
+	void setEscapeSphere(const Vector3d &center, double radius);
+	Vector3d getEscapeCenter() const;
+	double getEscapeRadius() const;
+
+	/** Register a view on the arrays, add, reserve, resize and clear throw until it is removed */
+	void addView();
+	void removeView();
+	size_t getViewCount() const;
+};
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_PARTICLEBATCH_H
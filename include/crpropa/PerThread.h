@@ -0,0 +1,135 @@
+#ifndef CRPROPA_PERTHREAD_H
+#define CRPROPA_PERTHREAD_H
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace crpropa {
+/**
+ * \addtogroup Core
+ * @{
+ */
+
+/**
+ @class PerThread
+ @brief One value of type T for every thread using it, e.g. to fill partial results without locking.
+
+ The value of the calling thread is found by the thread itself, not by its
+ OpenMP thread number, so that nested parallel regions and threads started
+ outside of OpenMP get their own values. The values of different threads are
+ kept on separate cache lines. Iterating over the values (size, operator[])
+ is only allowed while no thread calls local.
+ Copies start without values.
+ */
+template<typename T>
+class PerThread {
+	struct Slot {
+		T value;
+		char padding[64]; // no false sharing with the next slot
+	};
+
+	std::vector<Slot *> slots;
+	std::mutex mutex;
+	uint64_t id;
+	size_t index;
+
+	static uint64_t nextId() {
+		static std::atomic<uint64_t> next(0);
+		return ++next;
+	}
+
+	// indices of the live objects, reused after destruction
+	struct Indices {
+		std::mutex mutex;
+		std::vector<size_t> free;
+		size_t count;
+		Indices() : count(0) {
+		}
+	};
+
+	static Indices &indices() {
+		static Indices i;
+		return i;
+	}
+
+	static size_t acquireIndex() {
+		Indices &i = indices();
+		std::lock_guard<std::mutex> lock(i.mutex);
+		if (i.free.empty())
+			return i.count++;
+		size_t index = i.free.back();
+		i.free.pop_back();
+		return index;
+	}
+
+	static void releaseIndex(size_t index) {
+		Indices &i = indices();
+		std::lock_guard<std::mutex> lock(i.mutex);
+		i.free.push_back(index);
+	}
+
+public:
+	PerThread() : id(nextId()), index(acquireIndex()) {
+	}
+
+	PerThread(const PerThread<T> &) : id(nextId()), index(acquireIndex()) {
+	}
+
+	PerThread<T> &operator=(const PerThread<T> &) {
+		return *this;
+	}
+
+	~PerThread() {
+		releaseIndex(index);
+		for (size_t i = 0; i < slots.size(); i++)
+			delete slots[i];
+	}
+
+	/** Value of the calling thread, default constructed on first use */
+	T &local() {
+		// ids are never reused, so a destroyed object is never hit here
+		static thread_local uint64_t lastId = 0;
+		static thread_local T *last = NULL;
+		if (lastId == id)
+			return *last;
+
+		// one entry per live object: the index is recycled, the id tells
+		// whether the entry belongs to this object or to a destroyed one
+		static thread_local std::vector<std::pair<uint64_t, T *> > cache;
+		if (index >= cache.size())
+			cache.resize(index + 1, std::pair<uint64_t, T *>(0, NULL));
+		std::pair<uint64_t, T *> &entry = cache[index];
+		if (entry.first != id) {
+			Slot *slot = new Slot();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slots.push_back(slot);
+			}
+			entry = std::pair<uint64_t, T *>(id, &slot->value);
+		}
+		lastId = id;
+		last = entry.second;
+		return *last;
+	}
+
+	/** Number of threads that used local */
+	size_t size() const {
+		return slots.size();
+	}
+
+	T &operator[](size_t i) {
+		return slots[i]->value;
+	}
+
+	const T &operator[](size_t i) const {
+		return slots[i]->value;
+	}
+};
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_PERTHREAD_H
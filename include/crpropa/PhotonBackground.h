@@ -31,6 +31,19 @@ public:
 	 @param z			redshift (if redshift dependent, default = 0.)
 	 */
 	virtual double getPhotonDensity(double ePhoton, double z = 0.) const = 0;
+	/**
+	 comoving photon densities [1/m^3] for many photon energies at the same
+	 redshift. Calls getPhotonDensity for each energy unless overridden.
+	 @param ePhotons	photon energies [J]
+	 @param densities	resized and filled with the photon densities
+	 @param z			redshift (if redshift dependent, default = 0.)
+	 */
+	virtual void getPhotonDensities(const std::vector<double> &ePhotons,
+			std::vector<double> &densities, double z = 0.) const {
+		densities.resize(ePhotons.size());
+		for (size_t i = 0; i < ePhotons.size(); i++)
+			densities[i] = getPhotonDensity(ePhotons[i], z);
+	}
 	virtual double getMinimumPhotonEnergy(double z) const = 0;
 	virtual double getMaximumPhotonEnergy(double z) const = 0;
 	virtual std::string getFieldName() const {
@@ -67,12 +80,19 @@ protected:
  The first file must be a list of photon energies [J], named fieldName_photonEnergy.txt
  The second file must be a list of comoving photon field densities [1/m^3], named fieldName_photonDensity.txt
  Optionally, a third file contains redshifts, named fieldName_redshift.txt
+
+ The densities are interpolated (bi)linearly between the tabulated values.
+ The interval of a photon energy is found in constant time through a lookup
+ on a log-uniform grid (and a uniform grid in redshift), so that the
+ evaluation in the sampling loops of the interactions needs no binary search.
  */
 class TabularPhotonField: public PhotonField {
 public:
 	TabularPhotonField(const std::string fieldName, const bool isRedshiftDependent = true);
 	
 	double getPhotonDensity(double ePhoton, double z = 0.) const;
+	void getPhotonDensities(const std::vector<double> &ePhotons,
+			std::vector<double> &densities, double z = 0.) const;
 	double getRedshiftScaling(double z) const;
 	double getMinimumPhotonEnergy(double z) const;
 	double getMaximumPhotonEnergy(double z) const;
@@ -82,12 +102,26 @@ protected:
 	void readPhotonDensity(std::string filePath);
 	void readRedshift(std::string filePath);
 	void initRedshiftScaling();
+	void initLookup();
 	void checkInputData() const;
 
+	/** Index i of the interval photonEnergies[i] <= ePhoton < photonEnergies[i+1] */
+	size_t findEnergyBin(double ePhoton) const;
+	/** Index j of the interval redshifts[j] <= z < redshifts[j+1] */
+	size_t findRedshiftBin(double z) const;
+	/** Density of an energy inside the table, linear in redshift between j and j+1 */
+	double interpolateDensity(double ePhoton, size_t j, double wz) const;
+
 	std::vector<double> photonEnergies;
-	std::vector<double> photonDensity;
+	std::vector<double> photonDensity; ///< index iE * nRedshifts + iz
 	std::vector<double> redshifts;
 	std::vector<double> redshiftScalings;
+
+	std::vector<size_t> energyLookup; ///< first energy bin of each log-uniform lookup cell
+	double energyLookupMin; ///< log of the lowest photon energy
+	double energyLookupScale; ///< lookup cells per unit of log(E)
+	std::vector<size_t> redshiftLookup; ///< first redshift bin of each uniform lookup cell
+	double redshiftLookupScale; ///< lookup cells per unit of redshift
 };
 
 /**
@@ -243,6 +277,8 @@ class BlackbodyPhotonField: public PhotonField {
 public:
 	BlackbodyPhotonField(const std::string fieldName, const double blackbodyTemperature);
 	double getPhotonDensity(double ePhoton, double z = 0.) const;
+	void getPhotonDensities(const std::vector<double> &ePhotons,
+			std::vector<double> &densities, double z = 0.) const;
 	double getMinimumPhotonEnergy(double z) const;
 	double getMaximumPhotonEnergy(double z) const;
 	void setQuantile(double q);
@@ -250,6 +286,8 @@ public:
 protected:
 	double blackbodyTemperature;
 	double quantile;
+	double densityFactor; ///< 8 pi / (h c)^3
+	double inverseThermalEnergy; ///< 1 / (k T)
 };
 
 /**
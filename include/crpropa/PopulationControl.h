@@ -0,0 +1,101 @@
+#ifndef CRPROPA_POPULATIONCONTROL_H
+#define CRPROPA_POPULATIONCONTROL_H
+
+#include "crpropa/Referenced.h"
+
+#include <string>
+#include <vector>
+
+namespace crpropa {
+/**
+ * \addtogroup Core
+ * @{
+ */
+
+/**
+ @class PopulationControl
+ @brief Weight-aware thinning, Russian roulette and splitting of secondaries.
+
+ A PopulationControl attached to a candidate (Candidate::setPopulationControl
+ or SourcePopulationControl) is applied whenever a secondary is created with
+ Candidate::addSecondary and is inherited by the secondaries, so that it acts
+ on the whole cascade of a primary. Per species (0 for all species) the
+ following rules can be set:
+ - thinning: below the energy eThin a secondary of energy E is kept with
+   probability (E / eThin)^alpha
+ - Russian roulette: below the energy eMin a secondary is kept with the
+   fixed probability survivalProbability
+ - splitting: above the energy eSplit a secondary is replaced by n copies,
+   which generalises the ParticleSplitting module to interactions
+ Surviving secondaries get their weight divided by the survival probability and
+ split secondaries share the weight, so that all distributions are unbiased
+ when weighted. With a maximum weight the survival probability is increased
+ such that the weight of a secondary does not exceed it, and secondaries
+ that are heavier already are split into copies within the maximum weight.
+ */
+class PopulationControl: public Referenced {
+public:
+	struct Rule {
+		int id; ///< PDG particle ID, 0 for all species
+		double eThin; ///< thinning below this energy
+		double alpha; ///< exponent of the energy dependent survival probability
+		double eMin; ///< Russian roulette below this energy
+		double survivalProbability; ///< survival probability of the Russian roulette
+		double eSplit; ///< splitting above this energy
+		size_t nSplit; ///< number of copies when splitting
+		Rule(int id = 0);
+	};
+
+private:
+	std::vector<Rule> rules;
+	double maxWeight;
+
+	Rule &rule(int id);
+
+public:
+	PopulationControl();
+
+	/**
+	 Energy dependent thinning
+	 @param id		PDG particle ID, 0 for all species
+	 @param eThin	secondaries below this energy are thinned
+	 @param alpha	survival probability (E / eThin)^alpha, e.g. 1 for survival proportional to the energy
+	 */
+	void setThinning(int id, double eThin, double alpha = 1.);
+	/**
+	 Russian roulette with fixed survival probability
+	 @param id					PDG particle ID, 0 for all species
+	 @param eMin				secondaries below this energy take part
+	 @param survivalProbability	probability to keep a secondary
+	 */
+	void setRussianRoulette(int id, double eMin, double survivalProbability);
+	/**
+	 Splitting of high energy secondaries
+	 @param id		PDG particle ID, 0 for all species
+	 @param eSplit	secondaries above this energy are split
+	 @param n		number of copies
+	 */
+	void setSplitting(int id, double eSplit, size_t n);
+	/** Upper limit of the secondary weight, 0 for none; heavier secondaries are split */
+	void setMaximumWeight(double w);
+	double getMaximumWeight() const;
+	/** Remove all rules */
+	void clear();
+	const std::vector<Rule> &getRules() const;
+
+	/**
+	 Apply the rules to a new secondary.
+	 @param id		PDG particle ID of the secondary
+	 @param energy	energy of the secondary
+	 @param weight	weight of the secondary, modified accordingly
+	 @returns		number of copies of the secondary to create, 0 if discarded
+	 */
+	size_t sample(int id, double energy, double &weight) const;
+
+	std::string getDescription() const;
+};
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_POPULATIONCONTROL_H
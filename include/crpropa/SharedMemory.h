@@ -0,0 +1,69 @@
+#ifndef CRPROPA_SHAREDMEMORY_H
+#define CRPROPA_SHAREDMEMORY_H
+
+#include "crpropa/Referenced.h"
+
+#include <functional>
+#include <string>
+
+namespace crpropa {
+/**
+ * \addtogroup Core
+ * @{
+ */
+
+/**
+ @class SharedMemorySegment
+ @brief Named, read-only block of memory shared by all processes on a host.
+
+ Large read-only assets (e.g. magnetic field grids) are built once and then
+ mapped by every process that attaches to the same name, instead of each
+ process holding its own copy. The first process to attach creates the
+ segment and fills it, all others wait until it is ready and map it
+ read-only. The segment exists until it is removed or the host reboots, so
+ subsequent jobs attach without rebuilding.
+ Uses POSIX shared memory (shm_open), visible in /dev/shm on Linux.
+ */
+class SharedMemorySegment: public Referenced {
+private:
+	std::string name;
+	void *map;
+	size_t mapSize;
+	size_t size;
+	bool creator;
+
+	SharedMemorySegment(const std::string &name);
+	static std::string systemName(const std::string &name);
+	void mapFile(int fd, bool writable);
+
+public:
+	typedef std::function<void(void *data, size_t size)> Initializer;
+
+	~SharedMemorySegment();
+
+	/** Attach to the segment with the given name, creating it if it does not exist.
+	 @param name	name of the segment, without slashes
+	 @param size	size in bytes, has to match an existing segment
+	 @param init	called by the creating process to fill the segment
+	 @param timeout	maximum time in seconds to wait for another process filling the segment
+	 @param key		identifies the content (e.g. input file and version), has to match an existing segment
+	 */
+	static ref_ptr<SharedMemorySegment> attach(const std::string &name,
+			size_t size, Initializer init, double timeout = 600,
+			const std::string &key = "");
+	/** Attach to an existing segment, NULL if there is none (or it is not ready) */
+	static ref_ptr<SharedMemorySegment> find(const std::string &name);
+	/** Remove the name of the segment; processes attached to it keep their mapping */
+	static bool remove(const std::string &name);
+
+	const void *getData() const;
+	size_t getSize() const;
+	std::string getName() const;
+	/** True if this process created and filled the segment */
+	bool isCreator() const;
+};
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_SHAREDMEMORY_H
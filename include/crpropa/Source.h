@@ -880,6 +880,21 @@ public:
 	void setTag(std::string tag);
 };
 
+/**
+ @class SourcePopulationControl
+ @brief Attach a population control (thinning, Russian roulette, splitting) to the candidates
+
+ The population control is inherited by all secondaries of the candidate, see PopulationControl.
+ */
+class SourcePopulationControl: public SourceFeature {
+private:
+	ref_ptr<PopulationControl> control;
+public:
+	SourcePopulationControl(ref_ptr<PopulationControl> control);
+	void prepareCandidate(Candidate &candidate) const;
+	void setDescription();
+};
+
 /**
 	@class SourceMassDistribution
 	@brief	Source position follows a given mass distribution
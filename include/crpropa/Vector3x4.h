@@ -0,0 +1,314 @@
+#ifndef CRPROPA_VECTOR3X4_H
+#define CRPROPA_VECTOR3X4_H
+
+#include "crpropa/Vector3.h"
+
+#include <cmath>
+
+#if HAVE_SIMD
+#include <immintrin.h>
+#include <smmintrin.h>
+#endif // HAVE_SIMD
+
+namespace crpropa {
+
+/**
+ * \addtogroup Core
+ * @{
+ */
+
+/**
+ @class Vector3d4
+ @brief 3-vector of doubles in aligned 4-lane storage for SIMD arithmetic.
+
+ The fourth lane is kept zero. With SIMD_EXTENSIONS set to an AVX capable
+ value the operations use 256 bit registers, otherwise scalar code.
+ Intended for the inner loops of the propagation and field interpolation;
+ use Vector3d for everything else and convert at the boundaries.
+ Note that std::vector does not honour the alignment before C++17, keep
+ instances on the stack or in static arrays.
+ */
+class alignas(32) Vector3d4 {
+public:
+#if defined(HAVE_SIMD) && defined(__AVX__)
+	union {
+		__m256d simd;
+		double data[4];
+	};
+
+	explicit Vector3d4(__m256d v) : simd(v) {
+	}
+#else
+	double data[4];
+#endif
+
+	Vector3d4() : data{0., 0., 0., 0.} {
+	}
+
+	Vector3d4(double x, double y, double z) : data{x, y, z, 0.} {
+	}
+
+	explicit Vector3d4(const Vector3d &v) : data{v.x, v.y, v.z, 0.} {
+	}
+
+	Vector3d toVector3() const {
+		return Vector3d(data[0], data[1], data[2]);
+	}
+
+	double x() const {
+		return data[0];
+	}
+
+	double y() const {
+		return data[1];
+	}
+
+	double z() const {
+		return data[2];
+	}
+
+#if defined(HAVE_SIMD) && defined(__AVX__)
+	Vector3d4 operator +(const Vector3d4 &v) const {
+		return Vector3d4(_mm256_add_pd(simd, v.simd));
+	}
+
+	Vector3d4 operator -(const Vector3d4 &v) const {
+		return Vector3d4(_mm256_sub_pd(simd, v.simd));
+	}
+
+	Vector3d4 operator *(double f) const {
+		return Vector3d4(_mm256_mul_pd(simd, _mm256_set1_pd(f)));
+	}
+
+	Vector3d4 operator /(double f) const {
+		return Vector3d4(_mm256_div_pd(simd, _mm256_set1_pd(f)));
+	}
+
+	double dot(const Vector3d4 &v) const {
+		__m256d p = _mm256_mul_pd(simd, v.simd);
+		__m128d s = _mm_add_pd(_mm256_castpd256_pd128(p), _mm256_extractf128_pd(p, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+
+	Vector3d4 cross(const Vector3d4 &v) const {
+#ifdef __AVX2__
+		// (y, z, x) * (z, x, y) - (z, x, y) * (y, z, x)
+		__m256d a1 = _mm256_permute4x64_pd(simd, _MM_SHUFFLE(3, 0, 2, 1));
+		__m256d b2 = _mm256_permute4x64_pd(v.simd, _MM_SHUFFLE(3, 1, 0, 2));
+		__m256d a2 = _mm256_permute4x64_pd(simd, _MM_SHUFFLE(3, 1, 0, 2));
+		__m256d b1 = _mm256_permute4x64_pd(v.simd, _MM_SHUFFLE(3, 0, 2, 1));
+		return Vector3d4(_mm256_sub_pd(_mm256_mul_pd(a1, b2), _mm256_mul_pd(a2, b1)));
+#else
+		return Vector3d4(data[1] * v.data[2] - v.data[1] * data[2],
+				data[2] * v.data[0] - v.data[2] * data[0],
+				data[0] * v.data[1] - v.data[0] * data[1]);
+#endif
+	}
+#else
+	Vector3d4 operator +(const Vector3d4 &v) const {
+		return Vector3d4(data[0] + v.data[0], data[1] + v.data[1], data[2] + v.data[2]);
+	}
+
+	Vector3d4 operator -(const Vector3d4 &v) const {
+		return Vector3d4(data[0] - v.data[0], data[1] - v.data[1], data[2] - v.data[2]);
+	}
+
+	Vector3d4 operator *(double f) const {
+		return Vector3d4(data[0] * f, data[1] * f, data[2] * f);
+	}
+
+	Vector3d4 operator /(double f) const {
+		return Vector3d4(data[0] / f, data[1] / f, data[2] / f);
+	}
+
+	double dot(const Vector3d4 &v) const {
+		return data[0] * v.data[0] + data[1] * v.data[1] + data[2] * v.data[2];
+	}
+
+	Vector3d4 cross(const Vector3d4 &v) const {
+		return Vector3d4(data[1] * v.data[2] - v.data[1] * data[2],
+				data[2] * v.data[0] - v.data[2] * data[0],
+				data[0] * v.data[1] - v.data[0] * data[1]);
+	}
+#endif
+
+	Vector3d4 &operator +=(const Vector3d4 &v) {
+		return *this = *this + v;
+	}
+
+	Vector3d4 &operator -=(const Vector3d4 &v) {
+		return *this = *this - v;
+	}
+
+	Vector3d4 &operator *=(double f) {
+		return *this = *this * f;
+	}
+
+	double getR2() const {
+		return dot(*this);
+	}
+
+	double getR() const {
+		return std::sqrt(getR2());
+	}
+
+	Vector3d4 getUnitVector() const {
+		return *this / getR();
+	}
+
+	/** Rotation around the normalized axis by the angle (Rodrigues' formula) */
+	Vector3d4 getRotated(const Vector3d4 &axis, double angle) const {
+		double c = std::cos(angle);
+		double s = std::sin(angle);
+		return *this * c + axis.cross(*this) * s + axis * (axis.dot(*this) * (1 - c));
+	}
+};
+
+inline Vector3d4 operator *(double f, const Vector3d4 &v) {
+	return v * f;
+}
+
+/**
+ @class Vector3f4
+ @brief 3-vector of floats in aligned 4-lane storage for SIMD arithmetic.
+
+ The fourth lane is kept zero. With SIMD_EXTENSIONS enabled the operations use
+ 128 bit SSE registers, otherwise scalar code. Used for the interpolation of
+ Grid3f.
+ */
+class alignas(16) Vector3f4 {
+public:
+#ifdef HAVE_SIMD
+	union {
+		__m128 simd;
+		float data[4];
+	};
+
+	explicit Vector3f4(__m128 v) : simd(v) {
+	}
+#else
+	float data[4];
+#endif
+
+	Vector3f4() : data{0.f, 0.f, 0.f, 0.f} {
+	}
+
+	Vector3f4(float x, float y, float z) : data{x, y, z, 0.f} {
+	}
+
+	explicit Vector3f4(const Vector3f &v) : data{v.x, v.y, v.z, 0.f} {
+	}
+
+	Vector3f toVector3() const {
+		return Vector3f(data[0], data[1], data[2]);
+	}
+
+	float x() const {
+		return data[0];
+	}
+
+	float y() const {
+		return data[1];
+	}
+
+	float z() const {
+		return data[2];
+	}
+
+#ifdef HAVE_SIMD
+	Vector3f4 operator +(const Vector3f4 &v) const {
+		return Vector3f4(_mm_add_ps(simd, v.simd));
+	}
+
+	Vector3f4 operator -(const Vector3f4 &v) const {
+		return Vector3f4(_mm_sub_ps(simd, v.simd));
+	}
+
+	Vector3f4 operator *(float f) const {
+		return Vector3f4(_mm_mul_ps(simd, _mm_set1_ps(f)));
+	}
+
+	Vector3f4 operator /(float f) const {
+		return Vector3f4(_mm_div_ps(simd, _mm_set1_ps(f)));
+	}
+
+	float dot(const Vector3f4 &v) const {
+		return _mm_cvtss_f32(_mm_dp_ps(simd, v.simd, 0x71));
+	}
+
+	Vector3f4 cross(const Vector3f4 &v) const {
+		// (y, z, x) * (z, x, y) - (z, x, y) * (y, z, x)
+		__m128 a1 = _mm_shuffle_ps(simd, simd, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 b2 = _mm_shuffle_ps(v.simd, v.simd, _MM_SHUFFLE(3, 1, 0, 2));
+		__m128 a2 = _mm_shuffle_ps(simd, simd, _MM_SHUFFLE(3, 1, 0, 2));
+		__m128 b1 = _mm_shuffle_ps(v.simd, v.simd, _MM_SHUFFLE(3, 0, 2, 1));
+		return Vector3f4(_mm_sub_ps(_mm_mul_ps(a1, b2), _mm_mul_ps(a2, b1)));
+	}
+#else
+	Vector3f4 operator +(const Vector3f4 &v) const {
+		return Vector3f4(data[0] + v.data[0], data[1] + v.data[1], data[2] + v.data[2]);
+	}
+
+	Vector3f4 operator -(const Vector3f4 &v) const {
+		return Vector3f4(data[0] - v.data[0], data[1] - v.data[1], data[2] - v.data[2]);
+	}
+
+	Vector3f4 operator *(float f) const {
+		return Vector3f4(data[0] * f, data[1] * f, data[2] * f);
+	}
+
+	Vector3f4 operator /(float f) const {
+		return Vector3f4(data[0] / f, data[1] / f, data[2] / f);
+	}
+
+	float dot(const Vector3f4 &v) const {
+		return data[0] * v.data[0] + data[1] * v.data[1] + data[2] * v.data[2];
+	}
+
+	Vector3f4 cross(const Vector3f4 &v) const {
+		return Vector3f4(data[1] * v.data[2] - v.data[1] * data[2],
+				data[2] * v.data[0] - v.data[2] * data[0],
+				data[0] * v.data[1] - v.data[0] * data[1]);
+	}
+#endif
+
+	Vector3f4 &operator +=(const Vector3f4 &v) {
+		return *this = *this + v;
+	}
+
+	Vector3f4 &operator -=(const Vector3f4 &v) {
+		return *this = *this - v;
+	}
+
+	Vector3f4 &operator *=(float f) {
+		return *this = *this * f;
+	}
+
+	float getR2() const {
+		return dot(*this);
+	}
+
+	float getR() const {
+		return std::sqrt(getR2());
+	}
+
+	Vector3f4 getUnitVector() const {
+		return *this / getR();
+	}
+
+	/** Rotation around the normalized axis by the angle (Rodrigues' formula) */
+	Vector3f4 getRotated(const Vector3f4 &axis, float angle) const {
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		return *this * c + axis.cross(*this) * s + axis * (axis.dot(*this) * (1 - c));
+	}
+};
+
+inline Vector3f4 operator *(float f, const Vector3f4 &v) {
+	return v * f;
+}
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_VECTOR3X4_H
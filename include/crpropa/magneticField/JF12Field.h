@@ -136,6 +136,9 @@ public:
 
 	// All set field components
 	Vector3d getField(const Vector3d& pos) const;
+
+	// False for non-finite positions, otherwise the field of getField
+	bool tryGetField(const Vector3d &pos, double z, Vector3d &field) const;
 };
 /** @} */
 
@@ -5,6 +5,9 @@
 #include "crpropa/Vector3.h"
 #include "crpropa/Referenced.h"
 
+#include <cmath>
+#include <vector>
+
 #ifdef CRPROPA_HAVE_MUPARSER
 #include "muParser.h"
 #endif
@@ -20,6 +23,11 @@ namespace crpropa {
  @brief Abstract base class for magnetic fields.
  */
 class MagneticField: public Referenced {
+protected:
+	static bool isFinite(const Vector3d &position) {
+		return std::isfinite(position.x) && std::isfinite(position.y)
+				&& std::isfinite(position.z);
+	}
 public:
 	virtual ~MagneticField() {
 	}
@@ -29,6 +37,30 @@ public:
 	virtual Vector3d getField(const Vector3d &position, double z) const {
 		return getField(position);
 	};
+	/**
+	 Field vector without throwing, used in the inner loops of the propagation.
+	 Returns false and sets the field to zero if the field is not defined at
+	 the position. The default implementation calls getField and catches
+	 (and logs) its exceptions; fields that cannot fail override it.
+	 @param position	position
+	 @param z			redshift
+	 @param field		field vector at the position
+	 */
+	virtual bool tryGetField(const Vector3d &position, double z,
+			Vector3d &field) const;
+	/**
+	 Field vectors at many positions, e.g. for the batch propagation.
+	 Calls tryGetField for each position unless overridden.
+	 @param positions	positions, contiguous as an (N, 3) array
+	 @param fields		resized to N and filled with the field vectors
+	 @param z			redshift
+	 */
+	virtual void getFieldBatch(const std::vector<Vector3d> &positions,
+			std::vector<Vector3d> &fields, double z = 0) const {
+		fields.resize(positions.size());
+		for (size_t i = 0; i < positions.size(); i++)
+			tryGetField(positions[i], z, fields[i]);
+	};
 };
 
 /**
@@ -83,6 +115,7 @@ class MagneticFieldList: public MagneticField {
 public:
 	void addField(ref_ptr<MagneticField> field);
 	Vector3d getField(const Vector3d &position) const;
+	bool tryGetField(const Vector3d &position, double z, Vector3d &field) const;
 };
 
 /**
@@ -27,6 +27,8 @@ public:
 	void setGrid(ref_ptr<Grid3f> grid);
 	ref_ptr<Grid3f> getGrid();
 	Vector3d getField(const Vector3d &position) const;
+	/** False for non-finite positions, otherwise the field of getField */
+	bool tryGetField(const Vector3d &position, double z, Vector3d &field) const;
 };
 
 /**
@@ -141,6 +141,8 @@ class PlaneWaveTurbulence : public TurbulentField {
 	   Theoretical runtime is O(Nm), where Nm is the number of wavemodes.
 	*/
 	Vector3d getField(const Vector3d &pos) const;
+	/** False for non-finite positions, otherwise the field of getField */
+	bool tryGetField(const Vector3d &pos, double z, Vector3d &field) const;
 };
 
 /** @} */
@@ -35,12 +35,58 @@
 #include <sstream>
 #include <iostream>
 #include <stdint.h>
+#include <list>
 
 
 namespace crpropa
 {
 
-/// Holds one matrix for the lens and information about the rigidity range
+class LensPart;
+
+/// Keeps the memory of the lens parts loaded from file within a budget by
+/// unloading the least recently used parts that are not in use (see
+/// LensPartMatrix). The budget is enforced whenever a part is loaded, also
+/// within parallel regions. All methods are called by the lens parts while
+/// holding the lock of the lens parts.
+class LensPartCache
+{
+	size_t _budget;
+	size_t _usage;
+	// loaded parts, most recently used first
+	std::list<LensPart*> _parts;
+
+public:
+	LensPartCache() : _budget(0), _usage(0)
+	{
+	}
+
+	/// Memory budget in bytes, 0 for unlimited
+	void setBudget(size_t bytes)
+	{
+		_budget = bytes;
+	}
+	size_t getBudget() const
+	{
+		return _budget;
+	}
+	/// Memory used by the loaded matrices in bytes
+	size_t getUsage() const
+	{
+		return _usage;
+	}
+
+	void use(LensPart *part);
+	void loaded(LensPart *part, size_t bytes);
+	void unloaded(LensPart *part, size_t bytes);
+	/// Unload least recently used parts, except keep and the parts in use,
+	/// to meet the budget
+	void shrink(const LensPart *keep);
+};
+
+/// Holds one matrix for the lens and information about the rigidity range.
+/// A matrix given by a file is loaded on the first access and can be
+/// unloaded again, e.g. by the LensPartCache of the lens. Normalizations
+/// are recorded and applied again when the matrix is reloaded.
 class LensPart
 {
 	string _filename;
@@ -50,26 +96,56 @@ class LensPart
 	double _maximumSumOfColumns;
 	bool _maximumSumOfColumns_calculated;
 
+	// lazy loading
+	bool _fromFile;
+	bool _loaded;
+	bool _columnsNormalized;
+	double _norm;
+	LensPartCache *_cache;
+	size_t _users; // number of LensPartMatrix using the matrix
+	void _load();
+	void _unload();
+	friend class LensPartCache;
+
 public:
-	LensPart()
+	LensPart() : _rigidityMin(0), _rigidityMax(0), _maximumSumOfColumns(0),
+			_maximumSumOfColumns_calculated(false), _fromFile(false),
+			_loaded(true), _columnsNormalized(false), _norm(1), _cache(NULL),
+			_users(0)
 	{
 	}
 	/// File containing the matrix to be used in the range rigidityMin,
 	/// rigidityMax in Joule
 	LensPart(const std::string &filename, double rigidityMin, double rigidityMax) :
-			_filename(filename), _rigidityMin(rigidityMin), _rigidityMax(rigidityMax), _maximumSumOfColumns_calculated(
-					false), _maximumSumOfColumns(0)
+			_filename(filename), _rigidityMin(rigidityMin), _rigidityMax(rigidityMax),
+			_maximumSumOfColumns(0), _maximumSumOfColumns_calculated(false),
+			_fromFile(true), _loaded(false), _columnsNormalized(false), _norm(1),
+			_cache(NULL), _users(0)
 	{
 	}
 
-	~LensPart()
+	~LensPart();
+
+	/// Loads the matrix from file, if not loaded yet
+	void loadMatrixFromFile();
+
+	/// Frees the memory of the matrix if it can be loaded again from file
+	/// and is not in use
+	void unloadMatrix();
+
+	/// Returns true if the matrix is in memory
+	bool isLoaded() const
 	{
+		return _loaded;
 	}
 
-	/// Loads the matrix from file
-	void loadMatrixFromFile()
+	/// Memory used by the matrix in bytes
+	size_t getMemoryUsage() const;
+
+	/// Sets the cache keeping track of the memory used by the lens parts
+	void setCache(LensPartCache *cache)
 	{
-		deserialize(_filename, M);
+		_cache = cache;
 	}
 
 	/// Returns the filename of the matrix
@@ -79,15 +155,7 @@ public:
 	}
 
 	/// Calculates the maximum of the sums of columns for the matrix
-	double getMaximumOfSumsOfColumns()
-	{
-		if (!_maximumSumOfColumns_calculated)
-		{ // lazy calculation of maximum
-			_maximumSumOfColumns = maximumOfSumsOfColumns(M);
-			_maximumSumOfColumns_calculated = true;
-		}
-		return _maximumSumOfColumns;
-	}
+	double getMaximumOfSumsOfColumns();
 
 	/// Returns the minimum of the rigidity range for the lenspart in eV
 	double getMinimumRigidity()
@@ -101,19 +169,46 @@ public:
 		return _rigidityMax / eV;
 	}
 
-	/// Returns the modelmatrix
-	ModelMatrixType& getMatrix()
-	{
-		return M;
-	}
+	/// Returns the modelmatrix, loads it from file if necessary.
+	/// With a memory budget, use LensPartMatrix to keep it loaded while
+	/// other threads load parts.
+	ModelMatrixType& getMatrix();
+
+	/// Loads the matrix if necessary and keeps it loaded until releaseMatrix
+	ModelMatrixType& acquireMatrix();
+	/// Allows to unload the matrix again after acquireMatrix
+	void releaseMatrix();
 
 	/// Sets the modelmatrix
-	void setMatrix(const ModelMatrixType& m)
-	{
-		M = m;
-	}
+	void setMatrix(const ModelMatrixType& m);
 
+	/// Normalizes all columns of the matrix
+	void normalizeColumns();
 
+	/// Divides the matrix by norm
+	void normalize(double norm);
+};
+
+/// Matrix of a lens part, kept loaded while in scope
+class LensPartMatrix
+{
+	LensPart *_part;
+	ModelMatrixType *_matrix;
+public:
+	LensPartMatrix(LensPart *part) : _part(part), _matrix(&part->acquireMatrix())
+	{
+	}
+	~LensPartMatrix()
+	{
+		_part->releaseMatrix();
+	}
+	ModelMatrixType& get()
+	{
+		return *_matrix;
+	}
+private:
+	LensPartMatrix(const LensPartMatrix &);
+	LensPartMatrix& operator=(const LensPartMatrix &);
 };
 
 /// Function to calculate the mean deflection [rad] of the matrix M, given a pixelization
@@ -159,6 +254,9 @@ class MagneticLens
 	// Checks Matrix, raises Errors if not ok - also generate
 	// _pixelization if called first time
 	void _checkMatrix(const ModelMatrixType &M);
+	void _checkMatrixSize(size_t rows, size_t cols);
+	// Memory budget of the lens parts loaded from file
+	LensPartCache _cache;
 	// minimum / maximum rigidity that is covered by the lens [Joule]
 	double _minimumRigidity;
 	double _maximumRigidity;
@@ -174,14 +272,14 @@ public:
 
 	/// Constructs lens with predefined healpix order
 	MagneticLens(uint8_t healpixorder) :
-			_pixelization(NULL), _minimumRigidity(DBL_MAX), _maximumRigidity(DBL_MIN)
+			_pixelization(NULL), _minimumRigidity(DBL_MAX), _maximumRigidity(DBL_MIN), _norm(1)
 	{
 		_pixelization = new Pixelization(healpixorder);
 	}
 
 	/// Construct lens and load lens from file
 	MagneticLens(const string &filename) :
-			_pixelization(NULL), _minimumRigidity(DBL_MAX), _maximumRigidity(DBL_MIN)
+			_pixelization(NULL), _minimumRigidity(DBL_MAX), _maximumRigidity(DBL_MIN), _norm(1)
 	{
 		loadLens(filename);
 	}
@@ -218,6 +316,11 @@ public:
 	/// correct size. Rigidity is given in Joule
 	void transformModelVector(double* model, double rigidity) const;
 
+	/// transforms nModels model arrays of the same rigidity [Joule] at once.
+	/// The buffer is used as scratch memory and can be reused between calls.
+	void transformModelVectors(double* const* models, size_t nModels,
+			double rigidity, std::vector<double> &buffer) const;
+
 	/// Loads M as part of a lens and use it in given rigidity range with
 	/// rigidities given in Joule
 	void setLensPart(const ModelMatrixType &M, double rigidityMin, double rigidityMax);
@@ -225,8 +328,16 @@ public:
 	/// Loads a lens from a given file, containing lines like
 	/// lensefile.MLDAT rigidityMin rigidityMax
 	/// rigidities are given in logarithmic units [log10(E / eV)]
+	/// The matrices are loaded on first use.
 	void loadLens(const string &filename);
 
+	/// Sets the maximum memory in bytes used by the matrices loaded from
+	/// file, 0 for unlimited. The least recently used matrices are unloaded.
+	void setMemoryBudget(size_t bytes);
+	size_t getMemoryBudget() const;
+	/// Memory in bytes used by the matrices loaded from file
+	size_t getMemoryUsage() const;
+
 	/// Normalizes the lens parts to the maximum of sums of columns of
 	/// every lenspart. By doing this, the lens won't distort the spectrum
 	void normalizeLens();
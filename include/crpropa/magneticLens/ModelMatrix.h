@@ -49,9 +49,22 @@ namespace crpropa
 	/// (Int, Int, Double) : (column, row, value) triples ...
 	void serialize(const string &filename, const ModelMatrixType &matrix);
 
-	/// Reads a matrix from file
+	/// Writes the ModelMatrix to disk in its compressed column storage:
+	/// "CRPLENS" magic, UInt16 (version), UInt16 (bytes per value),
+	/// UInt32 (size1), UInt32 (size2), UInt32 (reserved), UInt64 (number
+	/// of non zero elements), UInt64 column offsets (size2 + 1),
+	/// UInt32 row indices, padding to 8 bytes, and the values as float
+	/// (singlePrecision) or double.
+	void serializeCompressed(const string &filename, const ModelMatrixType &matrix,
+			bool singlePrecision = false);
+
+	/// Reads a matrix from file, written by serialize or serializeCompressed.
+	/// Compressed files are memory mapped and copied without sorting.
 	void deserialize(const string &filename, ModelMatrixType &matrix);
 
+	/// Reads only the size of a matrix from file
+	void deserializeSize(const string &filename, uint32_t &size1, uint32_t &size2);
+
 	/// Normalizes each column j of the matrix so that, \f$ \Vert m_j \Vert_1 = 1 \f$ 
 	void normalizeColumns(ModelMatrixType &matrix);
 
@@ -64,6 +77,13 @@ namespace crpropa
 
 	// matrix vector product with update: model = matrix * model
 	void prod_up(const ModelMatrixType& matrix, double* model);
+
+	/// Matrix vector products with update, models[i] = matrix * models[i],
+	/// done as sparse matrix x dense matrix products for up to 32 vectors
+	/// at once. The buffer is resized as needed and can be reused for the
+	/// next call to avoid allocations.
+	void prod_up(const ModelMatrixType& matrix, double* const* models,
+			size_t nModels, std::vector<double> &buffer);
 } // namespace parsec
 
 #endif // MODELMATRIX_HH
@@ -20,10 +20,24 @@ namespace crpropa {
 
  The maps are stored with discrete energies on a logarithmic scale. The
  default energy width is 0.02 with an energy bin from 10**17.99 - 10**18.01 eV.
+
+ The maps of all (particle id, energy bin) combinations are stored
+ contiguously in blocks of several maps and are addressed by a slot number,
+ so that the pointers returned by getMap stay valid when new maps are added.
+ Use addParticles to fill many particles at once in parallel.
  */
 class ParticleMapsContainer {
 private:
-	std::map<int, std::map <int, double*> > _data;
+	typedef std::pair<int, int> key_t;
+	typedef std::map<key_t, size_t> index_t;
+
+	// slot of the maps for (pid, energy bin), ordered by pid and energy
+	index_t _index;
+	std::vector<key_t> _keys;
+	// contiguous storage of mapsPerBlock maps each
+	std::vector<double*> _blocks;
+	static const size_t mapsPerBlock = 8;
+
 	Pixelization _pixelization;
 	double _deltaLogE;
 	double _bin0lowerEdge;
@@ -32,21 +46,31 @@ private:
 	int energy2Idx(double energy) const;
 	double idx2Energy(int idx) const;
 
+	// slot handling, returns -1 if no map exists
+	long _findSlot(int pid, int energyIdx) const;
+	size_t _findOrCreateSlot(int pid, int energyIdx);
+	double *_mapOfSlot(size_t slot) const;
+
 	// weights of the particles
 	double _sumOfWeights;
-	std::map<int, double > _weightsPID;
-	std::map<int, map<int, double> > _weights_pidEnergy;
+	std::vector<double> _weightsSlot;
+	std::vector<int> _pids;
+	std::vector<double> _weightsPID;
 
 	// lazy update of weights
 	bool _weightsUpToDate;
 	void _updateWeights();
 
+	// not copyable
+	ParticleMapsContainer(const ParticleMapsContainer &);
+	ParticleMapsContainer &operator=(const ParticleMapsContainer &);
+
 public:
 	/** Constructor.
 	 @param deltaLogE		width of logarithmic energy bin [in eV]
 	 @param bin0lowerEdge	logarithm of energy of the lower edge of first bin [in log(eV)]
 	 */
-	ParticleMapsContainer(double deltaLogE = 0.02, double bin0lowerEdge = 17.99) : _deltaLogE(deltaLogE), _bin0lowerEdge(bin0lowerEdge), _pixelization(6), _weightsUpToDate(false), _sumOfWeights(0) {
+	ParticleMapsContainer(double deltaLogE = 0.02, double bin0lowerEdge = 17.99) : _pixelization(6), _deltaLogE(deltaLogE), _bin0lowerEdge(bin0lowerEdge), _sumOfWeights(0), _weightsUpToDate(false) {
 	}
 	/** Destructor.
 	 */
@@ -78,6 +102,19 @@ public:
 	 @param weight				relative weight for the specific particle
 	*/
 	void addParticle(const int particleId, double energy, const Vector3d &v, double weight = 1);
+	/** Adds many particles to the map container.
+	 The maps are created serially, the pixels are calculated and filled in
+	 parallel if OpenMP is available.
+	 @param n					number of particles
+	 @param particleIds			ids of the particles following the PDG numbering scheme
+	 @param energies			energies of the particles [in Joules]
+	 @param galacticLongitudes	galactic longitudes [radians]
+	 @param galacticLatitudes	galactic latitudes [radians]
+	 @param weights				relative weights, all 1 if NULL
+	*/
+	void addParticles(size_t n, const int *particleIds, const double *energies,
+		const double *galacticLongitudes, const double *galacticLatitudes,
+		const double *weights = 0);
 
 	/** Get all particle ids in the map.
 	 @returns Vector of all ids.
@@ -132,11 +169,7 @@ public:
 	 @param energy				energy of interest [in eV]
 	 @returns Weight for the chosen particle and energy.
 	 */
-	double getWeight(int pid, double energy) {
-		if (!_weightsUpToDate)
-			_updateWeights();
-		return _weights_pidEnergy[pid][energy2Idx(energy)];
-	}
+	double getWeight(int pid, double energy);
 };
 /** @}*/
 
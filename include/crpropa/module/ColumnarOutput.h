@@ -0,0 +1,157 @@
+#ifndef CRPROPA_COLUMNAROUTPUT_H
+#define CRPROPA_COLUMNAROUTPUT_H
+
+#include "crpropa/module/Output.h"
+#include "crpropa/Referenced.h"
+
+#include <fstream>
+#include <stdint.h>
+
+namespace crpropa {
+/**
+ * \addtogroup Output
+ * @{
+ */
+
+/**
+ @class ColumnarOutput
+ @brief Streaming binary output, storing every column in separate chunks.
+
+ The candidates are buffered column-wise in memory. Whenever the buffers of
+ all columns together reach the chunk size (4 MB by default), the columns are
+ written to the file as one chunk. If CRPropa is compiled with zlib, every column
+ block is byte-shuffled and deflated; blocks that do not shrink are stored
+ uncompressed. Values are stored with full precision in their native type,
+ lengths and energies divided by the length and energy scale.
+
+ The columns are named as in HDF5Output; the enabled properties are stored
+ with the type of their default value.
+
+ File layout (native byte order):
+ ```
+ "CRPCOL" + version (uint16)
+ lengthScale, energyScale (double)
+ version string (uint32 size + chars)
+ number of columns (uint32)
+ per column: name (uint32 size + chars), Variant::Type (uint8)
+ chunks: number of rows (uint64)
+   per column: raw size, stored size (uint64), flags (uint8), data
+ ```
+ String columns are stored as uint32 size followed by the characters.
+ Use ColumnarOutputReader to read the file.
+ */
+class ColumnarOutput: public Output {
+public:
+	struct Column {
+		std::string name;
+		Variant::Type type;
+		std::vector<char> data;
+	};
+
+private:
+	std::string filename;
+	std::ofstream outfile;
+	mutable std::vector<Column> columns;
+	mutable size_t rowsInChunk;
+	mutable bool headerWritten;
+	size_t chunkSize;
+	int compressionLevel;
+
+	void setupColumns() const;
+	void writeHeader() const;
+	void writeChunk() const;
+
+public:
+	/** Constructor with the default OutputType (everything).
+	 @param filename	name of the output file
+	 */
+	ColumnarOutput(const std::string &filename);
+	/** Constructor
+	 @param filename	name of the output file
+	 @param outputType	type of output: Trajectory1D, Trajectory3D, Event1D, Event3D, Everything
+	 */
+	ColumnarOutput(const std::string &filename, OutputType outputType);
+	~ColumnarOutput();
+
+	/** Size of the buffers of all columns before a chunk is written.
+	 @param bytes	chunk size in bytes (default 4 MB)
+	 */
+	void setChunkSize(size_t bytes);
+	size_t getChunkSize() const;
+	/** zlib compression level of the column blocks.
+	 @param level	0 (no compression) to 9, default 1
+	 */
+	void setCompressionLevel(int level);
+	int getCompressionLevel() const;
+
+	void process(Candidate *candidate) const;
+	/** Write the buffered candidates to the file */
+	void flush() const;
+	void close();
+	std::string getDescription() const;
+};
+
+
+/**
+ @class ColumnarOutputReader
+ @brief Reader for files written by ColumnarOutput.
+
+ The file is memory mapped. If a column is stored uncompressed in a single
+ chunk, its data is accessed directly in the mapped file without copying;
+ otherwise the column is decompressed once on first access into a
+ contiguous buffer owned by the reader. In Python the numeric columns are
+ available as NumPy arrays that share this memory (getColumn_numpyArray).
+ */
+class ColumnarOutputReader: public Referenced {
+	struct ColumnInfo {
+		std::string name;
+		Variant::Type type;
+		std::vector<const char *> blocks;
+		std::vector<uint64_t> rawSizes, storedSizes;
+		std::vector<uint8_t> flags;
+		std::vector<char> buffer;
+		bool loaded;
+		const char *data;
+	};
+
+	std::string filename;
+	void *map;
+	size_t mapSize;
+	double lengthScale, energyScale;
+	std::string version;
+	size_t nRows;
+	std::vector<ColumnInfo> columns;
+
+	size_t findColumn(const std::string &name) const;
+	void loadColumn(ColumnInfo &col);
+
+public:
+	ColumnarOutputReader(const std::string &filename);
+	~ColumnarOutputReader();
+
+	size_t getNumberOfRows() const;
+	size_t getNumberOfColumns() const;
+	std::vector<std::string> getColumnNames() const;
+	bool hasColumn(const std::string &name) const;
+	Variant::Type getColumnType(const std::string &name) const;
+	/** Size of one value of a numeric column in bytes */
+	size_t getColumnTypeSize(const std::string &name) const;
+	double getLengthScale() const;
+	double getEnergyScale() const;
+	std::string getVersion() const;
+
+	/** Pointer to the contiguous data of a numeric column.
+	 The memory is valid as long as the reader exists.
+	 */
+	const void *getColumnData(const std::string &name);
+	/** Copy of a numeric column converted to double */
+	std::vector<double> getColumn(const std::string &name);
+	/** Copy of a string column, e.g. the tag */
+	std::vector<std::string> getStringColumn(const std::string &name);
+};
+
+/** @}*/
+
+} // namespace crpropa
+
+#endif // CRPROPA_COLUMNAROUTPUT_H
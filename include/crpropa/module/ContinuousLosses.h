@@ -0,0 +1,113 @@
+#ifndef CRPROPA_CONTINUOUSLOSSES_H
+#define CRPROPA_CONTINUOUSLOSSES_H
+
+#include "crpropa/Module.h"
+#include "crpropa/PhotonBackground.h"
+#include "crpropa/module/ElectronPairProduction.h"
+
+#include <vector>
+
+namespace crpropa {
+/**
+ * \addtogroup EnergyLosses
+ * @{
+ */
+
+/**
+ @class ContinuousLosses
+ @brief Combined continuous energy losses of nuclei, integrated over the full step.
+
+ This module replaces ElectronPairProduction (for all added photon fields)
+ and Redshift in 1D simulations. Instead of applying the loss rate at the
+ start of each step, the losses are integrated over the step:
+ - The redshift is updated with the exact relation between comoving distance
+   and redshift and the adiabatic energy loss E ~ (1 + z) is applied in two
+   halves around the electron pair production (operator splitting).
+ - The electron pair production loss dE/dx = -E / lossLength is integrated
+   analytically with a precomputed table of the integrated loss length
+   G(u) = int du / (u beta(u)), with u = (1 + z) Lorentz factor.
+   The energy after a step x follows from G(u') = G(u) - x.
+ Hence, the step size is not limited by the accuracy of the energy loss and
+ the module only limits the next step to a fraction (default 1) of the
+ energy loss length.
+
+ For photon fields with redshift dependent scaling, the table is computed on
+ redshift nodes in steps of 0.05 up to a maximum redshift (default 3) and
+ the result is interpolated between the nodes. Above the maximum redshift
+ the last node is used.
+
+ Secondary electrons are not produced; use ElectronPairProduction with
+ haveElectrons for this purpose.
+ */
+class ContinuousLosses: public Module {
+private:
+	std::vector<ref_ptr<ElectronPairProduction> > epp; ///< tabulated loss rates of the photon fields
+	std::vector<ref_ptr<PhotonField> > photonFields;
+	bool haveRedshift; ///< if true, update the redshift and apply the adiabatic energy loss
+	double limit; ///< fraction of energy loss length to limit the next step
+	double maxRedshift; ///< maximum redshift of the tables for redshift dependent photon fields
+
+	// loss rate beta(u) and integrated loss length G(u) per redshift node: [k * nU + j], u = 10^(lgMin + j * dlg)
+	static const double lgMin;
+	static const double lgMax;
+	static const size_t nU;
+	double dzNode; ///< redshift step of the nodes, 0 if only one node
+	std::vector<double> tabG; ///< integrated loss length for protons
+	std::vector<double> tabBeta; ///< loss rate for protons
+	std::vector<size_t> tabStart; ///< first tabulation point above the energy threshold per node
+
+	void initTable();
+
+	// integrate the loss at one redshift node over the scaled distance x
+	double integrateNode(size_t k, double lg, double x) const;
+
+public:
+	/** Constructor
+	 @param limit			step size limit as fraction of the energy loss length
+	 @param haveRedshift	if true, update the redshift and apply the adiabatic energy loss
+	 */
+	ContinuousLosses(double limit = 1, bool haveRedshift = true);
+
+	/** Add the electron pair production on a target photon field */
+	void addPhotonField(ref_ptr<PhotonField> photonField);
+	size_t getNumberOfPhotonFields() const;
+
+	void setHaveRedshift(bool haveRedshift);
+	bool getHaveRedshift() const;
+
+	/** Limit the propagation step to a fraction of the energy loss length
+	 @param limit fraction of the energy loss length
+	 */
+	void setLimit(double limit);
+	double getLimit() const;
+
+	/** Maximum redshift of the tables for redshift dependent photon fields */
+	void setMaximumRedshift(double z);
+	double getMaximumRedshift() const;
+
+	/**
+	 Lorentz factor after electron pair production over a distance
+	 at constant redshift.
+	 @param id		PDG particle ID
+	 @param lf		Lorentz factor
+	 @param distance	traveled distance in the local frame [m]
+	 @param z		redshift
+	 */
+	double integrate(int id, double lf, double distance, double z = 0) const;
+
+	/**
+	 Combined electron pair production energy loss length -E dx/dE in [m]
+	 @param	id		PDG particle ID
+	 @param lf		Lorentz factor
+	 @param z		redshift
+	 */
+	double lossLength(int id, double lf, double z = 0) const;
+
+	void process(Candidate *candidate) const;
+	std::string getDescription() const;
+};
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_CONTINUOUSLOSSES_H
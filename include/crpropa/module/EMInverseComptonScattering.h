@@ -24,7 +24,7 @@ namespace crpropa {
  For the maximum thinning of 1, only a few representative particles are added to the list of secondaries.
  Note that for thinning>0 the output must contain the column "weights", which should be included in the post-processing.
 */
-class EMInverseComptonScattering: public Module {
+class EMInverseComptonScattering: public StochasticInteraction {
 private:
 	ref_ptr<PhotonField> photonField;
 	bool havePhotons;
@@ -76,6 +76,8 @@ public:
 	void initCumulativeRate(std::string filename);
 
 	void process(Candidate *candidate) const;
+	double interactionRate(const Candidate *candidate) const;
+	void interact(Candidate *candidate) const;
 	void performInteraction(Candidate *candidate) const;
 };
 /** @}*/
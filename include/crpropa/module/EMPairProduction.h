@@ -26,7 +26,7 @@ namespace crpropa {
  For the maximum thinning of 1, only a few representative particles are added to the list of secondaries.
  Note that for thinning>0 the output must contain the column "weights", which should be included in the post-processing.
  */
-class EMPairProduction: public Module {
+class EMPairProduction: public StochasticInteraction {
 private:
 	ref_ptr<PhotonField> photonField; 	// target photon field
 	bool haveElectrons;					// add secondary electrons to simulation
@@ -79,6 +79,8 @@ public:
 
 	void performInteraction(Candidate *candidate) const;
 	void process(Candidate *candidate) const;
+	double interactionRate(const Candidate *candidate) const;
+	void interact(Candidate *candidate) const;
 };
 /** @}*/
 
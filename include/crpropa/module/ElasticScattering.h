@@ -12,7 +12,7 @@ namespace crpropa {
  @class ElasticScattering
  @brief Elastic scattering of background photons on cosmic-ray nuclei.
  */
-class ElasticScattering: public Module {
+class ElasticScattering: public StochasticInteraction {
 private:
 	ref_ptr<PhotonField> photonField;
 
@@ -36,6 +36,9 @@ public:
 	void initCDF(std::string filename);
 	void setPhotonField(ref_ptr<PhotonField> photonField);
 	void process(Candidate *candidate) const;
+	void performInteraction(Candidate *candidate) const;
+	double interactionRate(const Candidate *candidate) const;
+	void interact(Candidate *candidate) const;
 	
 	std::string getInteractionTag() const;
 	void setInteractionTag(std::string tag);
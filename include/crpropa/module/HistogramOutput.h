@@ -0,0 +1,182 @@
+#ifndef CRPROPA_HISTOGRAMOUTPUT_H
+#define CRPROPA_HISTOGRAMOUTPUT_H
+
+#include "crpropa/module/Output.h"
+#include "crpropa/PerThread.h"
+
+#ifdef CRPROPA_HAVE_GALACTIC_LENSES
+#include "crpropa/magneticLens/Pixelization.h"
+#endif
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace crpropa {
+/**
+ * \addtogroup Output
+ * @{
+ */
+
+/**
+ @class HistogramAxis
+ @brief Abstract base class for the axes of a HistogramOutput
+ */
+class HistogramAxis: public Referenced {
+protected:
+	std::string name;
+	std::vector<double> edges;
+public:
+	/** Bin of the candidate, -1 if outside of the axis */
+	virtual long getBin(const Candidate *candidate) const = 0;
+	size_t getNumberOfBins() const;
+	/** Lower edges of the bins and the upper edge of the last bin */
+	const std::vector<double> &getEdges() const;
+	std::string getName() const;
+	virtual std::string getDescription() const;
+};
+
+/**
+ @class HistogramQuantityAxis
+ @brief Linear or logarithmic binning of an output column or candidate property.
+
+ The quantity is given by the column name as in HDF5Output, e.g.
+ "E", "E0", "ID", "D", "z", "X", "Px", "W", by the mass number of the
+ current, source or created particle "A", "A0", "A1" or else by the name of
+ a candidate property. Candidates without the property are not counted.
+ Energies and lengths are given in SI units [J, m].
+ */
+class HistogramQuantityAxis: public HistogramAxis {
+private:
+	int quantity;
+	bool logarithmic;
+	double min, max;
+	double scale; ///< number of bins per unit of the (log) quantity
+
+	double getValue(const Candidate *candidate, bool &valid) const;
+public:
+	/** Constructor
+	 @param quantity	column name or property name
+	 @param min			lower edge of the first bin
+	 @param max			upper edge of the last bin
+	 @param nBins		number of bins
+	 @param log			logarithmic (true) or linear (false) bins
+	 */
+	HistogramQuantityAxis(const std::string &quantity, double min, double max,
+			size_t nBins, bool log = false);
+	long getBin(const Candidate *candidate) const;
+	std::string getDescription() const;
+};
+
+#ifdef CRPROPA_HAVE_GALACTIC_LENSES
+/**
+ @class HistogramHealpixAxis
+ @brief Healpix pixel of the arrival direction (see Pixelization).
+
+ The arrival direction is the reversed current direction, the pixels are
+ numbered as in ParticleMapsContainer.
+ */
+class HistogramHealpixAxis: public HistogramAxis {
+private:
+	Pixelization pixelization;
+public:
+	/** Constructor
+	 @param order	healpix order, 12 * 4^order pixels
+	 */
+	HistogramHealpixAxis(uint8_t order = 6);
+	long getBin(const Candidate *candidate) const;
+	std::string getDescription() const;
+};
+#endif
+
+/**
+ @class HistogramOutput
+ @brief Output aggregating the candidates in an N-dimensional histogram.
+
+ Instead of writing one row per candidate, the weights of the candidates
+ are summed in the bins of the configured axes, e.g. log energy x mass
+ number x arrival direction x trajectory length. The sums of the weights
+ and of the squared weights are stored.
+ Only filled bins are stored, so that fine binnings of many axes are
+ possible. Every thread fills its own histogram without locking; they are
+ merged on the first access to the results after the simulation (or with
+ merge). The histograms of several jobs with the same axes are combined by
+ loading their files (load adds to the current content).
+ */
+class HistogramOutput: public Output {
+private:
+	struct Bin {
+		double sumW, sumW2; ///< sum of weights and sum of squared weights
+	};
+	typedef std::unordered_map<size_t, Bin> BinMap;
+	struct ThreadHistogram {
+		BinMap bins;
+		double entries;
+		ThreadHistogram() : entries(0) {
+		}
+	};
+
+	std::vector<ref_ptr<HistogramAxis> > axes;
+	size_t nBins;
+	bool useWeights;
+	mutable BinMap bins;
+	mutable double nEntries;
+	mutable PerThread<ThreadHistogram> threadHistograms;
+
+	static void fill(BinMap &bins, size_t index, double w, double w2);
+
+public:
+	HistogramOutput();
+
+	/** Add an axis, the first axis varies slowest in the bin index.
+	 Axes can only be added before the first candidate is processed.
+	 */
+	void addAxis(HistogramAxis *axis);
+	/** Bin energy logarithmically [J] */
+	void addLogEnergyAxis(double min, double max, size_t nBins);
+	/** Bin the mass number of the current particle, 0 to maxA */
+	void addMassNumberAxis(int maxA = 56);
+	/** Bin the trajectory length linearly or logarithmically [m] */
+	void addTrajectoryLengthAxis(double min, double max, size_t nBins, bool log = false);
+#ifdef CRPROPA_HAVE_GALACTIC_LENSES
+	/** Bin the arrival direction in healpix pixels */
+	void addHealpixAxis(uint8_t order);
+#endif
+	size_t getNumberOfAxes() const;
+	HistogramAxis *getAxis(size_t i) const;
+	/** Number of bins of every axis */
+	std::vector<size_t> getShape() const;
+	size_t getNumberOfBins() const;
+	/** Use the candidate weight (default) or count every candidate with 1 */
+	void setUseWeights(bool use);
+
+	/** Flat bin index of the candidate, -1 if outside */
+	long getBinIndex(const Candidate *candidate) const;
+	void process(Candidate *candidate) const;
+
+	/** Add the per-thread histograms to the result */
+	void merge() const;
+	/** Sum of the weights per bin, flat in row-major order */
+	std::vector<double> getCounts() const;
+	/** Sum of the squared weights per bin, for the statistical uncertainty */
+	std::vector<double> getSquaredWeights() const;
+	/** Sum of the weights in the bin with the given flat index */
+	double getCount(size_t index) const;
+	/** Number of candidates counted in a bin */
+	double getNumberOfEntries() const;
+	/** Number of bins with at least one entry */
+	size_t getNumberOfFilledBins() const;
+	void clear();
+
+	/** Write the axes and sums to a binary file */
+	void save(const std::string &filename) const;
+	/** Add the sums of a file written by save with the same axes */
+	void load(const std::string &filename);
+
+	std::string getDescription() const;
+};
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_HISTOGRAMOUTPUT_H
@@ -0,0 +1,68 @@
+#ifndef CRPROPA_INTERACTIONSCHEDULER_H
+#define CRPROPA_INTERACTIONSCHEDULER_H
+
+#include "crpropa/Module.h"
+
+#include <string>
+#include <vector>
+
+namespace crpropa {
+/**
+ * \addtogroup EnergyLosses
+ * @{
+ */
+
+/**
+ @class InteractionScheduler
+ @brief Common sampling of the interactions of several stochastic interaction modules.
+
+ Instead of adding the interaction modules (PhotoPionProduction, PhotoDisintegration,
+ NuclearDecay, ElasticScattering and the electromagnetic interactions) to the
+ module list, they are added to the scheduler. For each candidate a single
+ optical depth to the next interaction is drawn from an exponential distribution
+ and reduced by the total interaction rate times the step in each step.
+ When it is used up, the interacting module is selected according to the
+ partial rates and a new optical depth is drawn. The rates are evaluated at the
+ start of each step, so that changes of the energy or redshift by other modules
+ enter the remaining optical depth.
+
+ The next step is limited to the distance to the next interaction point only,
+ instead of a fraction of the mean free path of each module. Between
+ interactions the step size is thus determined by the other modules,
+ e.g. the continuous energy losses.
+
+ The remaining optical depth is stored in a candidate slot (default name
+ "OpticalDepth", see Candidate::registerSlot). Secondaries start with a new
+ optical depth. Without interaction modules, process does nothing.
+ */
+class InteractionScheduler: public Module {
+private:
+	std::vector<ref_ptr<StochasticInteraction> > interactions;
+	size_t slot; ///< candidate slot of the remaining optical depth
+
+public:
+	InteractionScheduler(std::string slotName = "OpticalDepth");
+
+	/** Add an interaction module, it should not be added to the module list at the same time */
+	void add(StochasticInteraction *interaction);
+	size_t size() const;
+	ref_ptr<StochasticInteraction> operator[](size_t i) const;
+
+	void setSlotName(std::string slotName);
+	std::string getSlotName() const;
+
+	/** Remaining optical depth of the candidate, 0 if none was drawn yet */
+	double getOpticalDepth(const Candidate *candidate) const;
+	void setOpticalDepth(Candidate *candidate, double tau) const;
+
+	/** Total interaction rate of all modules per comoving distance [1/m] */
+	double interactionRate(const Candidate *candidate) const;
+
+	void process(Candidate *candidate) const;
+	std::string getDescription() const;
+};
+
+/** @}*/
+} // namespace crpropa
+
+#endif // CRPROPA_INTERACTIONSCHEDULER_H
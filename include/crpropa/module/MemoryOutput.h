@@ -0,0 +1,78 @@
+#ifndef CRPROPA_MEMORYOUTPUT_H
+#define CRPROPA_MEMORYOUTPUT_H
+
+#include "crpropa/module/Output.h"
+
+#include <string>
+#include <vector>
+
+namespace crpropa {
+/**
+ * \addtogroup Output
+ * @{
+ */
+
+/**
+ @class MemoryOutput
+ @brief Output keeping the columns in memory as contiguous arrays.
+
+ The enabled columns and properties are stored column-wise in their native
+ type, named as in HDF5Output, with lengths and energies divided by the
+ length and energy scale. In Python the numeric columns are available as
+ NumPy arrays (getColumn_numpyArray), copied as one block without creating
+ Python objects per candidate.
+ Use ParticleCollector::snapshot to convert collected candidates.
+ */
+class MemoryOutput: public Output {
+public:
+	struct Column {
+		std::string name;
+		Variant::Type type;
+		std::vector<char> data; ///< numeric values
+		std::vector<std::string> strings; ///< values of string columns
+	};
+
+private:
+	mutable std::vector<Column> columns;
+	mutable size_t nRows;
+	size_t nReserved;
+
+	void setupColumns() const;
+	size_t findColumn(const std::string &name) const;
+
+public:
+	/** Constructor with the default OutputType (everything) */
+	MemoryOutput();
+	/** Constructor
+	 @param outputType	type of output: Trajectory1D, Trajectory3D, Event1D, Event3D, Everything
+	 */
+	MemoryOutput(OutputType outputType);
+
+	void process(Candidate *candidate) const;
+	/** Reserve memory for the given number of rows */
+	void reserve(size_t n);
+	/** Remove all rows, the columns can be configured again */
+	void clear();
+
+	size_t getNumberOfRows() const;
+	size_t getNumberOfColumns() const;
+	std::vector<std::string> getColumnNames() const;
+	bool hasColumn(const std::string &name) const;
+	Variant::Type getColumnType(const std::string &name) const;
+	/** Pointer to the contiguous data of a numeric column.
+	 Valid until the next candidate is added or the output is cleared.
+	 */
+	const void *getColumnData(const std::string &name) const;
+	/** Copy of a numeric column converted to double */
+	std::vector<double> getColumn(const std::string &name) const;
+	/** Copy of a string column, e.g. the tag */
+	std::vector<std::string> getStringColumn(const std::string &name) const;
+
+	std::string getDescription() const;
+};
+
+/** @}*/
+
+} // namespace crpropa
+
+#endif // CRPROPA_MEMORYOUTPUT_H
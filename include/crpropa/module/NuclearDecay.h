@@ -21,7 +21,7 @@ namespace crpropa {
 
  For details on the preprocessing of the NuDat2 data refer to "CRPropa3-data/calc_decay.py".
  */
-class NuclearDecay: public Module {
+class NuclearDecay: public StochasticInteraction {
 private:
 	double limit;
 	bool haveElectrons;
@@ -66,6 +66,8 @@ public:
 	std::string getInteractionTag() const;
 
 	void process(Candidate *candidate) const;
+	double interactionRate(const Candidate *candidate) const;
+	void interact(Candidate *candidate) const;
 	void performInteraction(Candidate *candidate, int channel) const;
 	void gammaEmission(Candidate *candidate, int channel) const;
 	void betaDecay(Candidate *candidate, bool isBetaPlus) const;
@@ -100,6 +100,33 @@ public:
 };
 
 
+/**
+ @class ObserverSurfaces
+ @brief Detects particles crossing the boundaries of any of many closed surfaces
+
+ Equivalent to one ObserverSurface per surface, e.g. for a catalogue of
+ spheres around galaxies, but the surfaces are kept in a bounding volume
+ hierarchy (SurfaceIndex), so that the cost per step grows only
+ logarithmically with their number. The next step is limited to the
+ distance to the nearest surface. The surfaces need a bounding box, as
+ Sphere and ParaxialBox.
+ */
+class ObserverSurfaces: public ObserverFeature {
+private:
+	ref_ptr<SurfaceIndex> index;
+public:
+	ObserverSurfaces();
+	/** Add a closed surface, returns its index */
+	size_t add(Surface *surface);
+	/** Add a sphere, returns its index */
+	size_t addSphere(const Vector3d &center, double radius);
+	size_t size() const;
+	SurfaceIndex *getIndex() const;
+	DetectionState checkDetection(Candidate *candidate) const;
+	std::string getDescription() const;
+};
+
+
 /**
  @class ObserverTracking
  @brief Tracks particles inside a sphere
@@ -251,10 +278,20 @@ public:
  @class ObserverTimeEvolution
  @brief Observes the time evolution of the candidates (phase-space elements)
  This observer is very useful if the time evolution of the particle density is needed. It detects all candidates in lin-spaced, log-spaced, or user-defined time intervals and limits the nextStep of candidates to prevent overshooting of detection intervals.
+ The number of passed detection times is kept in the candidate slot "DetectionIndex" (see Candidate::registerSlot).
  */
 class ObserverTimeEvolution: public ObserverFeature {
 private:
 	std::vector<double> detList;
+	size_t indexSlot, beginSlot; ///< candidate slots of the detection index
+	bool batchDetection;
+	bool sorted;
+	// spacing of a single lin or log range, for the direct index computation
+	bool regular, regularLog;
+	double regularMin, regularStep;
+
+	void init();
+	size_t countTimes(double length, size_t index) const;
 public:
 	/** Default constructor
 	 */
@@ -278,6 +315,18 @@ public:
 	// max for observing particles
 	void addTimeRange(double min, double max, double numb, bool log = false);
 	const std::vector<double>& getTimes() const;
+	/** Detect a step crossing several detection times only once (default: false).
+	 By default one detection time is passed per step, so that such a
+	 candidate is detected again in the following steps. With batch
+	 detection all crossed times are passed at once and can be retrieved
+	 with getDetectedTimes, e.g. to emit one record per time.
+	 */
+	void setBatchDetection(bool batch);
+	bool getBatchDetection() const;
+	/** Number of detection times the candidate has passed */
+	size_t getDetectionIndex(const Candidate *candidate) const;
+	/** Detection times passed in the last detection of the candidate */
+	std::vector<double> getDetectedTimes(const Candidate *candidate) const;
 	DetectionState checkDetection(Candidate *candidate) const;
 	std::string getDescription() const;
 };
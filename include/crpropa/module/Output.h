@@ -69,6 +69,19 @@ protected:
 
 	void modify();
 
+	/** Name and type of a column of the binary outputs (MemoryOutput, ColumnarOutput) */
+	struct ColumnSpec {
+		std::string name;
+		Variant::Type type;
+	};
+	/** Enabled columns and properties, named as in HDF5Output, in the order of packRow */
+	std::vector<ColumnSpec> getColumnSpecs() const;
+	/** Append the values of the enabled columns of a candidate to a row in their
+	 native type, lengths and energies divided by the scales. Strings are
+	 stored as uint32 size followed by the characters.
+	 */
+	void packRow(Candidate *candidate, std::vector<char> &row) const;
+
 public:
 	enum OutputColumn {
 		TrajectoryLengthColumn,
@@ -162,6 +175,9 @@ public:
 	 */
 	size_t size() const;
 
+	/** Size of a value of the given type in packRow, 0 for strings */
+	static size_t packedSize(Variant::Type type);
+
 	void process(Candidate *) const;
 };
 
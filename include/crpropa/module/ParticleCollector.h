@@ -5,6 +5,7 @@
 
 #include "crpropa/Module.h"
 #include "crpropa/ModuleList.h"
+#include "crpropa/module/MemoryOutput.h"
 
 namespace crpropa {
 /**
@@ -35,9 +36,40 @@ public:
         void process(Candidate *candidate) const;
 	void process(ref_ptr<Candidate> c) const;
 	void reprocess(Module *action) const;
+	/** Process all candidates with the given module using OpenMP threads.
+	 The action has to be thread-safe, like all modules in a ModuleList.
+	 */
+	void reprocessParallel(Module *action) const;
+	/**
+	 Columnar snapshot of the collected candidates.
+	 The candidates are appended in order to the output, whose enabled
+	 columns and properties select what is exported, e.g. for NumPy access.
+	 @param output	in-memory output receiving the columns
+	 */
+	void snapshot(MemoryOutput *output) const;
 	void dump(const std::string &filename) const;
 	void load(const std::string &filename);
 
+	/**
+	 Dump all candidates in binary form (see Candidate::serialize).
+	 In contrast to dump, the full precision, all properties and serial
+	 numbers are preserved.
+	 @param filename	name of the output file
+	 @param recursive	also store the secondaries of the candidates
+	 */
+	void dumpBinary(const std::string &filename, bool recursive = false) const;
+	/** Append all candidates of a file written by dumpBinary */
+	void loadBinary(const std::string &filename);
+	/**
+	 Stream the candidates of a file written by dumpBinary to a module.
+	 The candidates are read in chunks, which are processed in parallel.
+	 At most chunkSize candidates are kept in memory at the same time.
+	 @param filename	name of the input file
+	 @param action		module to process the candidates with, e.g. a ModuleList
+	 @param chunkSize	number of candidates read per chunk
+	 */
+	static void reprocessBinary(const std::string &filename, Module *action, std::size_t chunkSize = 100000);
+
         std::size_t size() const;
 	ref_ptr<Candidate> operator[](const std::size_t i) const;
         void clearContainer();
@@ -5,7 +5,6 @@
 #include "crpropa/PhotonBackground.h"
 
 #include <vector>
-#include <map>
 
 namespace crpropa {
 /**
@@ -17,26 +16,31 @@ namespace crpropa {
  @class PhotoDisintegration
  @brief Photodisintegration of nuclei by background photons.
  */
-class PhotoDisintegration: public Module {
+class PhotoDisintegration: public StochasticInteraction {
 private:
 	ref_ptr<PhotonField> photonField;
 	double limit; // fraction of mean free path for limiting the next step
 	bool havePhotons;
 	std::string interactionTag = "PD";
 
-	struct Branch {
-		int channel; // number of emitted (n, p, H2, H3, He3, He4)
-		std::vector<double> branchingRatio; // branching ratio as function of nucleus Lorentz factor
-	};
+	std::vector<std::vector<double> > pdRate; // pdRate[Z * 31 + N] = total interaction rate
 
-	struct PhotonEmission {
-		double energy; // energy of emitted photon [J]
-		std::vector<double> emissionProbability; // emission probability as function of nucleus Lorentz factor
-	};
+	// branching ratios, packed for all nuclei
+	// the channels of nucleus idx = Z * 31 + N are pdBranchOffset[idx] ... pdBranchOffset[idx + 1] - 1
+	std::vector<size_t> pdBranchOffset;
+	std::vector<int> pdChannel; // number of emitted (n, p, H2, H3, He3, He4)
+	std::vector<double> pdBranchCdf; // cumulative branching ratios, [pdBranchOffset[idx] * nlg + lorentzBin * nChannels + channel]
 
-	std::vector<std::vector<double> > pdRate; // pdRate[Z * 31 + N] = total interaction rate
-	std::vector<std::vector<Branch> > pdBranch; // pdTable[Z * 31 + N] = branching ratios
-	mutable std::map<int, std::vector<PhotonEmission> > pdPhoton; // map of emitted photon energies and photon emission probabilities
+	// photon emission, packed for all nuclei and grouped by daughter nucleus
+	// the groups of nucleus idx are pdPhotonOffset[idx] ... pdPhotonOffset[idx + 1] - 1, sorted by daughter
+	std::vector<size_t> pdPhotonOffset;
+	std::vector<int> pdPhotonDaughter; // daughter Z * 31 + N of each group
+	std::vector<size_t> pdPhotonBegin; // emissions of group g are pdPhotonBegin[g] ... pdPhotonBegin[g + 1] - 1
+	std::vector<double> pdPhotonEnergy; // energy of emitted photon [J]
+	std::vector<double> pdPhotonProbability; // emission probability, [pdPhotonBegin[g] * nlg + lorentzBin * nEmissions + emission]
+
+	// select a channel with the cumulative branching ratios at the tabulation point l
+	int selectChannel(size_t idx, size_t l, double r) const;
 
 	static const double lgmin; // minimum log10(Lorentz-factor)
 	static const double lgmax; // maximum log10(Lorentz-factor)
@@ -72,6 +76,8 @@ public:
 	void initPhotonEmission(std::string filename);
 
 	void process(Candidate *candidate) const;
+	double interactionRate(const Candidate *candidate) const;
+	void interact(Candidate *candidate) const;
 	void performInteraction(Candidate *candidate, int channel) const;
 
 	/**
@@ -22,7 +22,7 @@ struct SophiaEventOutput {
  @class PhotoPionProduction
  @brief Photo-pion interactions of nuclei with background photons.
  */
-class PhotoPionProduction: public Module {
+class PhotoPionProduction: public StochasticInteraction {
 
 protected:
 	ref_ptr<PhotonField> photonField;
@@ -48,6 +48,9 @@ protected:
 	// - output: probability to encounter photon of energy eps
 	double probEps(double eps, bool onProton, double Ein, double z) const;
 
+	// probEps for a given comoving photon density [1/m^3] at eps
+	double probEpsFromDensity(double eps, double photonDensity, bool onProton, double Ein) const;
+
 	/** called by: sampleEps
 	@param onProton	particle type: proton or neutron
 	@param Ein		energy of incoming nucleon
@@ -92,6 +95,32 @@ protected:
 
 	bool sampleLog = true;
 	double correctionFactor = 1.6; // increeses the maximum of the propability function
+
+	// envelope of the photon energy distribution, used by sampleEps
+	struct SampleTable: public Referenced {
+		std::string fieldName;
+		double correctionFactor;
+		double logEMin, dLogE; // log10(nucleon energy / eV)
+		size_t nE;
+		double logEpsMin, dLogEps; // log10(photon energy / eV)
+		size_t nEps;
+		std::vector<double> redshifts; // bin edges, only 0 for fields without redshift dependence
+		std::vector<double> envelope; // [neutron][redshift][energy][photon energy]
+		std::vector<double> cdf; // cumulative envelope of each distribution
+		size_t nRedshiftBins() const;
+		size_t offset(bool onProton, size_t iz, size_t iE) const;
+		void updateCdf();
+	};
+	ref_ptr<SampleTable> sampleTable;
+	double sampleTableMaxRedshift = 3.;
+
+	// build the table for the current photon field
+	void buildSampleTable();
+
+	// rejection sampling from the tabulated envelope
+	// - input: Ein [GeV], photon energy range [eV]
+	// - output: photon energy [eV], 0 if the table does not cover Ein or z
+	double sampleEpsFromTable(bool onProton, double Ein, double z, double epsMin, double epsMax) const;
 	
 
 public:
@@ -160,6 +189,8 @@ public:
 	 */
 	double nucleiModification(int A, int X) const;
 	void process(Candidate *candidate) const;
+	double interactionRate(const Candidate *candidate) const;
+	void interact(Candidate *candidate) const;
 	void performInteraction(Candidate *candidate, bool onProton) const;
 
 	/**
@@ -209,6 +240,25 @@ public:
 	// A correction factor can be set to increase pEpsMax by that factor
 	void setCorrectionFactor(double factor);
 
+	/** Precompute an envelope of the photon energy distribution for sampleEps.
+	 For protons and neutrons, nucleon energies of 10^15 - 10^23 eV (20 bins
+	 per decade) and, for redshift dependent photon fields, redshifts up to
+	 maxRedshift (bins of 0.2), the photon energy distribution is tabulated
+	 in 20 bins per decade, with the maximum of each bin increased by the
+	 correction factor. sampleEps then draws a bin from the table and needs
+	 only a few evaluations of the interaction probability. Outside the
+	 table the photon is sampled directly.
+	 The table is shared by all threads and can be saved and loaded.
+	 @param b			use the table
+	 @param maxRedshift	maximum redshift for redshift dependent photon fields
+	 */
+	void setSampleTable(bool b, double maxRedshift = 3.);
+	bool getSampleTable() const;
+	/** Save the table of setSampleTable to a text file */
+	void saveSampleTable(const std::string &filename) const;
+	/** Load and use a table saved with saveSampleTable for the same photon field */
+	void loadSampleTable(const std::string &filename);
+
 	/** get functions for the parameters of the class PhotoPionProduction, similar to the set functions */
 	ref_ptr<PhotonField> getPhotonField() const;
 	bool getHavePhotons() const;
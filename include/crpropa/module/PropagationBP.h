@@ -2,6 +2,7 @@
 #define CRPROPA_PROPAGATIONBP_H
 
 #include "crpropa/Module.h"
+#include "crpropa/ParticleBatch.h"
 #include "crpropa/Units.h"
 #include "crpropa/magneticField/MagneticField.h"
 #include "kiss/logger.h"
@@ -21,7 +22,10 @@ namespace crpropa {
  It can be used with a fixed step size or an adaptive version which supports the step size control.
  The step size control tries to keep the relative error close to, but smaller than the designated tolerance.
  Additionally a minimum and maximum size for the steps can be set.
- For neutral particles a rectilinear propagation is applied and a next step of the maximum step size proposed.
+ For neutral particles a rectilinear propagation is applied and a next step of the maximum step size proposed.\n
+ Many particles can be propagated at once with propagate(ParticleBatch&, ...), e.g. for back-tracking through the Galactic field.
+ This batch mode uses the fixed step of each particle, looks up the field for many particles with MagneticField::getFieldBatch
+ and runs the Boris push over contiguous arrays.
  */
 class PropagationBP: public Module {
 
@@ -77,6 +81,15 @@ public:
 	 * @param candidate	 The Candidate is a passive object, that holds the information about the state of the cosmic ray and the simulation itself. */
 	void process(Candidate *candidate) const;
 
+	/** Propagates all active particles of the batch over the given trajectory length with the fixed step of each particle.
+	 * The last step is shortened to the remaining length. Particles leaving the escape sphere of the batch are deactivated.
+	 * The batch is split into chunks that are processed in parallel.
+	 * @param batch	 particles to propagate
+	 * @param length	trajectory length to propagate each particle
+	 * @param z		 redshift for the magnetic field
+	 */
+	void propagate(ParticleBatch &batch, double length, double z = 0) const;
+
 	/** Calculates the new position and direction of the particle based on the solution of the Lorentz force
 	 * @param pos	current position of the candidate
 	 * @param dir	current direction of the candidate
@@ -58,12 +58,23 @@ public:
 /**
   @class EmissionMapFiller
   @brief Fill EmissionMap with source particle state
+
+  By default all threads fill the EmissionMap in a critical section. In the
+  concurrent mode every thread fills its own maps with the same binning,
+  without locking (EmissionMap::fillMapConcurrent). They are added to the
+  EmissionMap on its next access after the simulation.
 */
 class EmissionMapFiller: public Module {
 	ref_ptr<EmissionMap> emissionMap;
+	bool concurrent;
 public:
 	EmissionMapFiller(EmissionMap *emissionMap);
 	void setEmissionMap(EmissionMap *emissionMap);
+	/** Fill per-thread maps instead of locking the EmissionMap */
+	void setConcurrent(bool concurrent);
+	bool isConcurrent() const;
+	/** Add the per-thread maps to the EmissionMap, see EmissionMap::mergeThreadMaps */
+	void mergeThreadMaps();
 	void process(Candidate* candidate) const;
 	std::string getDescription() const;
 };
@@ -1,7 +1,16 @@
 #ifndef KISS_LOG_H
 #define KISS_LOG_H
 
+#include <atomic>
 #include <iostream>
+#include <sstream>
+#include <stdint.h>
+
+// Log levels above KISS_LOG_MAX_LEVEL are removed at compile time,
+// e.g. -DKISS_LOG_MAX_LEVEL=2 strips KISS_LOG_DEBUG.
+#ifndef KISS_LOG_MAX_LEVEL
+#define KISS_LOG_MAX_LEVEL 3
+#endif
 
 namespace kiss {
 
@@ -9,11 +18,45 @@ enum eLogLevel {
 	LOG_LEVEL_ERROR, LOG_LEVEL_WARNING, LOG_LEVEL_INFO, LOG_LEVEL_DEBUG
 };
 
+/**
+ Call site of a rate limited message, see KISS_LOG_WARNING_LIMITED.
+ The first `limit` occurrences are logged, afterwards only the occurrences
+ limit * 2^k, together with the number of suppressed messages.
+ */
+class LogSite {
+	const char *file;
+	int line;
+	uint64_t limit;
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> logged;
+public:
+	LogSite(const char *file, int line, uint64_t limit);
+	/** Count an occurrence, returns its number if it is to be logged, else 0 */
+	uint64_t accept();
+	uint64_t getCount() const;
+	uint64_t getLogged() const;
+	uint64_t getLimit() const;
+	const char *getFile() const;
+	int getLine() const;
+};
+
+/**
+ Log message, written as a whole when the Logger is destroyed.
+ The message is composed in the buffer of the Logger without locking.
+ Complete messages are written directly (under a lock) or, in the
+ asynchronous mode, by a background thread.
+ */
 class Logger {
 	static std::ostream *stream;
 	static eLogLevel level;
+	std::ostringstream buffer;
+	uint64_t occurrence, limit;
+
+	void writeHeader(eLogLevel level);
 public:
 	Logger(eLogLevel level);
+	/** Message of a rate limited call site */
+	Logger(eLogLevel level, uint64_t occurrence, uint64_t limit);
 	~Logger();
 	static std::ostream &getLogStream();
 	static void setLogStream(std::ostream *s);
@@ -24,32 +67,47 @@ public:
 
 	static void loadEnvLogLevel();
 
+	/** Write the messages in a background thread */
+	static void setAsync(bool async);
+	static bool isAsync();
+	/** Wait until all messages are written and flush the stream */
+	static void flush();
+	/** Log the number of suppressed messages of the rate limited call sites */
+	static void reportSuppressed();
+
 	operator std::ostream &() {
-		return getLogStream();
+		return buffer;
 	}
 
 	template<typename T> inline Logger& operator<<(T& data) {
-		#pragma omp critical (KISS_LOGGER)
-		{
-		getLogStream() << data;
-		}
+		buffer << data;
 		return *this;
 	}
 
 	inline Logger& operator<<(std::ostream& (*func)(std::ostream&)) {
-		#pragma omp critical (KISS_LOGGER)
-		{
-		getLogStream() << func;
-		}
+		buffer << func;
 		return *this;
 	}
 };
 
 } // namespace kiss
 
-#define KISS_LOG_ERROR if (kiss::Logger::getLogLevel() < kiss::LOG_LEVEL_ERROR) {} else kiss::Logger(kiss::LOG_LEVEL_ERROR)
-#define KISS_LOG_WARNING if (kiss::Logger::getLogLevel() < kiss::LOG_LEVEL_WARNING) {} else kiss::Logger(kiss::LOG_LEVEL_WARNING)
-#define KISS_LOG_INFO if (kiss::Logger::getLogLevel() < kiss::LOG_LEVEL_INFO) {} else kiss::Logger(kiss::LOG_LEVEL_INFO)
-#define KISS_LOG_DEBUG if (kiss::Logger::getLogLevel() < kiss::LOG_LEVEL_DEBUG) {} else kiss::Logger(kiss::LOG_LEVEL_DEBUG)
+#define KISS_LOG_ENABLED(l) (((l) <= KISS_LOG_MAX_LEVEL) && (kiss::Logger::getLogLevel() >= (l)))
+
+#define KISS_LOG_ERROR if (!KISS_LOG_ENABLED(kiss::LOG_LEVEL_ERROR)) {} else kiss::Logger(kiss::LOG_LEVEL_ERROR)
+#define KISS_LOG_WARNING if (!KISS_LOG_ENABLED(kiss::LOG_LEVEL_WARNING)) {} else kiss::Logger(kiss::LOG_LEVEL_WARNING)
+#define KISS_LOG_INFO if (!KISS_LOG_ENABLED(kiss::LOG_LEVEL_INFO)) {} else kiss::Logger(kiss::LOG_LEVEL_INFO)
+#define KISS_LOG_DEBUG if (!KISS_LOG_ENABLED(kiss::LOG_LEVEL_DEBUG)) {} else kiss::Logger(kiss::LOG_LEVEL_DEBUG)
+
+// rate limited messages for hot paths, limit has to be a constant
+#define KISS_LOG_SITE(limit) ([]() -> kiss::LogSite & { static kiss::LogSite site(__FILE__, __LINE__, limit); return site; }())
+#define KISS_LOG_LIMITED(l, limit) \
+	for (uint64_t kiss_log_n_ = KISS_LOG_ENABLED(l) ? KISS_LOG_SITE(limit).accept() : 0; kiss_log_n_ > 0; kiss_log_n_ = 0) \
+		kiss::Logger(l, kiss_log_n_, limit)
+
+#define KISS_LOG_ERROR_LIMITED(limit) KISS_LOG_LIMITED(kiss::LOG_LEVEL_ERROR, limit)
+#define KISS_LOG_WARNING_LIMITED(limit) KISS_LOG_LIMITED(kiss::LOG_LEVEL_WARNING, limit)
+#define KISS_LOG_INFO_LIMITED(limit) KISS_LOG_LIMITED(kiss::LOG_LEVEL_INFO, limit)
+#define KISS_LOG_DEBUG_LIMITED(limit) KISS_LOG_LIMITED(kiss::LOG_LEVEL_DEBUG, limit)
 
 #endif /* KISSLOG_H */
@@ -1,7 +1,14 @@
 #include "kiss/logger.h"
 
 #include <stdlib.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace kiss {
 
@@ -17,21 +24,188 @@ public:
 };
 static EnvLogger _env_log_;
 
-Logger::Logger(eLogLevel level) {
+// Writes complete messages to the log stream, either directly or in the
+// background thread of the asynchronous mode.
+class LogWriter {
+	std::mutex streamMutex; // serializes the writes to the stream
+	std::mutex queueMutex;
+	std::condition_variable queueChanged;
+	std::deque<std::string> queue;
+	std::thread thread;
+	std::atomic<bool> running;
+	bool stopping;
+	size_t pending; // messages taken from the queue but not yet written
+
+	void run() {
+		std::unique_lock<std::mutex> lock(queueMutex);
+		while (true) {
+			queueChanged.wait(lock, [this]{ return stopping || !queue.empty(); });
+			if (queue.empty())
+				break;
+			std::deque<std::string> messages;
+			messages.swap(queue);
+			pending = messages.size();
+			lock.unlock();
+			{
+				std::lock_guard<std::mutex> streamLock(streamMutex);
+				std::ostream &out = Logger::getLogStream();
+				for (size_t i = 0; i < messages.size(); i++)
+					out << messages[i];
+				out.flush();
+			}
+			lock.lock();
+			pending = 0;
+			queueChanged.notify_all();
+		}
+	}
+
+public:
+	LogWriter() : running(false), stopping(false), pending(0) {
+	}
+
+	void write(const std::string &message) {
+		if (running) {
+			std::lock_guard<std::mutex> lock(queueMutex);
+			if (running) {
+				queue.push_back(message);
+				queueChanged.notify_one();
+				return;
+			}
+		}
+		std::lock_guard<std::mutex> lock(streamMutex);
+		Logger::getLogStream() << message << std::flush;
+	}
+
+	void start() {
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if (running)
+			return;
+		stopping = false;
+		running = true;
+		thread = std::thread(&LogWriter::run, this);
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			if (!running)
+				return;
+			running = false;
+			stopping = true;
+			queueChanged.notify_all();
+		}
+		thread.join();
+	}
+
+	bool isRunning() const {
+		return running;
+	}
+
+	void flush() {
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueChanged.wait(lock, [this]{ return queue.empty() && pending == 0; });
+		}
+		std::lock_guard<std::mutex> lock(streamMutex);
+		Logger::getLogStream().flush();
+	}
+};
+
+// never destroyed, so that messages can be logged during static destruction
+static LogWriter &logWriter() {
+	static LogWriter *writer = new LogWriter;
+	return *writer;
+}
+
+// joins the background thread at exit
+class LogWriterShutdown {
+public:
+	~LogWriterShutdown() {
+		logWriter().stop();
+	}
+};
+static LogWriterShutdown _log_writer_shutdown_;
+
+// Rate limited call sites, never destroyed as they are function statics
+static std::mutex &logSitesMutex() {
+	static std::mutex *m = new std::mutex;
+	return *m;
+}
+
+static std::vector<LogSite *> &logSites() {
+	static std::vector<LogSite *> *sites = new std::vector<LogSite *>;
+	return *sites;
+}
+
+LogSite::LogSite(const char *file, int line, uint64_t limit) :
+		file(file), line(line), limit(limit > 0 ? limit : 1), count(0), logged(0) {
+	std::lock_guard<std::mutex> lock(logSitesMutex());
+	logSites().push_back(this);
+}
+
+uint64_t LogSite::accept() {
+	uint64_t n = ++count;
+	if (n > limit) {
+		// log the occurrences limit * 2^k
+		uint64_t q = n / limit;
+		if ((n % limit != 0) || (q & (q - 1)) != 0)
+			return 0;
+	}
+	++logged;
+	return n;
+}
+
+uint64_t LogSite::getCount() const {
+	return count;
+}
+
+uint64_t LogSite::getLogged() const {
+	return logged;
+}
+
+uint64_t LogSite::getLimit() const {
+	return limit;
+}
+
+const char *LogSite::getFile() const {
+	return file;
+}
+
+int LogSite::getLine() const {
+	return line;
+}
+
+Logger::Logger(eLogLevel level) : occurrence(0), limit(0) {
+	writeHeader(level);
+}
+
+Logger::Logger(eLogLevel level, uint64_t occurrence, uint64_t limit) :
+		occurrence(occurrence), limit(limit) {
+	writeHeader(level);
+}
+
+void Logger::writeHeader(eLogLevel level) {
 	time_t rawtime;
-	struct tm * timeinfo;
-	char buffer[80];
+	struct tm timeinfo;
+	char timestamp[80];
 
 	time(&rawtime);
-	timeinfo = localtime(&rawtime);
+	localtime_r(&rawtime, &timeinfo);
 
-	strftime(buffer, 80, "%Y-%m-%d %H:%M:%S ", timeinfo);
-	*stream << buffer;
-	*stream << "[" << sLoggerLevel[level] << "] ";
+	strftime(timestamp, 80, "%Y-%m-%d %H:%M:%S ", &timeinfo);
+	buffer << timestamp;
+	buffer << "[" << sLoggerLevel[level] << "] ";
 }
 
 Logger::~Logger() {
-	*stream << std::endl;
+	if (occurrence > limit) {
+		// occurrence = limit * 2^k, the previous one logged was occurrence / 2
+		uint64_t suppressed = occurrence - occurrence / 2 - 1;
+		buffer << " [occurrence " << occurrence << ", " << suppressed
+				<< " similar messages suppressed]";
+	}
+	buffer << "\n";
+	logWriter().write(buffer.str());
 }
 
 std::ostream &Logger::getLogStream() {
@@ -53,8 +227,38 @@ eLogLevel Logger::getLogLevel() {
 	return (level);
 }
 
+void Logger::setAsync(bool async) {
+	if (async)
+		logWriter().start();
+	else
+		logWriter().stop();
+}
+
+bool Logger::isAsync() {
+	return logWriter().isRunning();
+}
 
+void Logger::flush() {
+	logWriter().flush();
+}
 
+void Logger::reportSuppressed() {
+	std::vector<LogSite *> sites;
+	{
+		std::lock_guard<std::mutex> lock(logSitesMutex());
+		sites = logSites();
+	}
+	for (size_t i = 0; i < sites.size(); i++) {
+		uint64_t count = sites[i]->getCount();
+		uint64_t suppressed = count - sites[i]->getLogged();
+		const char *file = sites[i]->getFile();
+		int line = sites[i]->getLine();
+		if (suppressed > 0) {
+			KISS_LOG_WARNING << "kiss::Logger: " << suppressed << " of " << count
+					<< " messages suppressed at " << file << ":" << line;
+		}
+	}
+}
 
 void Logger::loadEnvLogLevel() {
 	if (::getenv("KISS_LOG_LEVEL")) {
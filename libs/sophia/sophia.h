@@ -10,6 +10,11 @@ void sophiaevent_(int& nature,                   // IN:  channel: 0 -> p, 1 -> n
 									int outPartID[2000],           // OUT: list of output particle IDs (see list below)
 									int& nParticles                // OUT: number of output particles
 		);
+
+// Random number in (0, 1) used by SOPHIA, to be provided by the caller.
+// If SOPHIA is compiled with OpenMP, its COMMON blocks are thread private
+// and sophiaevent_ can be called from several threads at once.
+double crprndm_(int& idummy);
 }
 
 /*
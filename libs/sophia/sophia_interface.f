@@ -42,31 +42,39 @@ c** authors: A.Muecke    **
 c**          R.Engel     **
 c**************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
-      SAVE
 
        COMMON /S_RUN/ SQS, S, Q2MIN, XMIN, ZMIN, kb, kt, a1, a2, Nproc
+!$OMP THREADPRIVATE(/S_RUN/)
        COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
        COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
        COMMON /S_CHP/ S_LIFE(49), ICHP(49), ISTR(49), IBAR(49)
+!$OMP THREADPRIVATE(/S_CHP/)
        COMMON /S_CSYDEC/ CBR(102), IDB(49), KDEC(612), LBARP(49)
+!$OMP THREADPRIVATE(/S_CSYDEC/)
 
       CHARACTER NAMPRES*6
       COMMON /RES_PROP/ AMRES(9), SIG0(9),WIDTH(9),
      +                    NAMPRES(0:9)
+!$OMP THREADPRIVATE(/RES_PROP/)
 
       CHARACTER NAMPRESp*6
       COMMON /RES_PROPp/ AMRESp(9), BGAMMAp(9),WIDTHp(9),
      +                    RATIOJp(9),NAMPRESp(0:9)
+!$OMP THREADPRIVATE(/RES_PROPp/)
 
       CHARACTER NAMPRESn*6
       COMMON /RES_PROPn/ AMRESn(9), BGAMMAn(9),WIDTHn(9),
      +                    RATIOJn(9),NAMPRESn(0:9)
+!$OMP THREADPRIVATE(/RES_PROPn/)
 
        DOUBLE PRECISION P_nuc(4),P_gam(4),P_sum(4),PC(4),GamBet(4)
 
        DATA pi /3.141593D0/
        DATA IRESMAX /9/
        DATA Icount / 0 /
+!$OMP THREADPRIVATE(Icount)
 
 C  incoming nucleon
        pm = AM(L0)
@@ -246,12 +254,13 @@ C*****************************
       IMPLICIT DOUBLE PRECISION (A-M,O-Z)
       IMPLICIT INTEGER (N)
 
-      SAVE
 
       CHARACTER NAMPRES*6
       COMMON /RES_PROP/ AMRES(9), SIG0(9),WIDTH(9), 
      +                    NAMPRES(0:9)
+!$OMP THREADPRIVATE(/RES_PROP/)
       COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
 
       DIMENSION sig_res(9)
 
@@ -454,7 +463,6 @@ C***********************************************************************
        IMPLICIT DOUBLE PRECISION (A-M,O-Z)
        IMPLICIT INTEGER (N)
 
-       SAVE
 
 c***************************************************************************
 c calculates Breit-Wigner cross section of a resonance with width Gamma [GeV],
@@ -477,7 +485,6 @@ c***************************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
 
        if (xth.gt.x) then
         Pl = 0.
@@ -497,7 +504,6 @@ c***************************************************************************
       IMPLICIT DOUBLE PRECISION (A-M,O-Z)
       IMPLICIT INTEGER (N)
 
-       SAVE
 
        wth = w+th
        if (x.le.th) then
@@ -522,7 +528,6 @@ c***************************************************************************
 
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
-      SAVE
 
        DOUBLE PRECISION RNDM
        external RNDM
@@ -594,8 +599,9 @@ c ... --> fragmentation mode/multipion production
       IMPLICIT INTEGER (I-N)
 
       COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
       COMMON /RES_FLAG/ FRES(49),XLIMRES(49)
-      SAVE
+!$OMP THREADPRIVATE(/RES_FLAG/)
       DIMENSION Pres(2000,5),Lres(2000)
 
 c***********************************************************
@@ -699,7 +705,6 @@ c theta is scattering angle in CM frame:
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
 
 c*****************************************************************************
 c*** decides which resonance with ID=IRES in list takes place at eps_prime ***
@@ -750,7 +755,6 @@ c*** sum of all resonances:
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
 
 c**********************************************************************
 c*** decide which decay with ID=IPROC of resonance IRES takes place ***
@@ -763,9 +767,11 @@ c**********************
        COMMON /S_RESp/ CBRRES1p(18),CBRRES2p(36),CBRRES3p(26),
      +  RESLIMp(36),ELIMITSp(9),KDECRES1p(90),KDECRES2p(180),
      +  KDECRES3p(130),IDBRES1p(9),IDBRES2p(9),IDBRES3p(9)
+!$OMP THREADPRIVATE(/S_RESp/)
        COMMON /S_RESn/ CBRRES1n(18),CBRRES2n(36),CBRRES3n(22),
      +  RESLIMn(36),ELIMITSn(9),KDECRES1n(90),KDECRES2n(180),
      +  KDECRES3n(110),IDBRES1n(9),IDBRES2n(9),IDBRES3n(9)
+!$OMP THREADPRIVATE(/S_RESn/)
        DIMENSION prob_sum(0:9)
 
 c      x = eps_prime
@@ -952,15 +958,17 @@ c... determine the energy range of the resonance:
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
 
        COMMON /S_RESp/ CBRRES1p(18),CBRRES2p(36),CBRRES3p(26),
      +  RESLIMp(36),ELIMITSp(9),KDECRES1p(90),KDECRES2p(180),
      +  KDECRES3p(130),IDBRES1p(9),IDBRES2p(9),IDBRES3p(9) 
+!$OMP THREADPRIVATE(/S_RESp/)
        COMMON /S_RESn/ CBRRES1n(18),CBRRES2n(36),CBRRES3n(22),
      +  RESLIMn(36),ELIMITSn(9),KDECRES1n(90),KDECRES2n(180),
      +  KDECRES3n(110),IDBRES1n(9),IDBRES2n(9),IDBRES3n(9) 
+!$OMP THREADPRIVATE(/S_RESn/)
        COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
 
 c********************************************************
 c  RESONANCE AMD with code number IRES  INTO  M1 + M2
@@ -1045,7 +1053,6 @@ c****************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
        singleback = 92.7D0*Pl(x,.152D0,.25D0,2.D0)
 
        END
@@ -1058,7 +1065,6 @@ c*****************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
        twoback = 37.7D0*Pl(x,.4D0,.6D0,2.D0)
 
        END
@@ -1069,7 +1075,6 @@ c*****************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
 
 c*******************************************************************
 c This routine samples the cos of the scattering angle for a given *
@@ -1085,6 +1090,7 @@ c** author: A.Muecke **
 c**********************
 
        COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
 
 c ... use rejection method for sampling:
        LA = LLIST(1)
@@ -1114,7 +1120,6 @@ c ... distribution is isotropic for other than one-pion decays:
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-       SAVE
 
 c********************************************************************
 c probability distribution for scattering angle of given resonance **
@@ -1237,26 +1242,36 @@ c***************************
       IMPLICIT INTEGER (I-N)
       SAVE
        COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
        COMMON /S_CSYDEC/ CBR(102), IDB(49), KDEC(612), LBARP(49)
+!$OMP THREADPRIVATE(/S_CSYDEC/)
       COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
       COMMON /S_CHP/  S_LIFE(49), ICHP(49), ISTR(49), IBAR(49)
+!$OMP THREADPRIVATE(/S_CHP/)
       COMMON /S_CNAM/ NAMP (0:49)
+!$OMP THREADPRIVATE(/S_CNAM/)
 
       CHARACTER NAMPRESp*6
       COMMON /RES_PROPp/ AMRESp(9), BGAMMAp(9),WIDTHp(9),  
      +                    RATIOJp(9),NAMPRESp(0:9)
+!$OMP THREADPRIVATE(/RES_PROPp/)
 
       CHARACTER NAMPRESn*6
       COMMON /RES_PROPn/ AMRESn(9), BGAMMAn(9),WIDTHn(9),  
      +                    RATIOJn(9),NAMPRESn(0:9)
+!$OMP THREADPRIVATE(/RES_PROPn/)
 
        COMMON /S_RESp/ CBRRES1p(18),CBRRES2p(36),CBRRES3p(26),
      +  RESLIMp(36),ELIMITSp(9),KDECRES1p(90),KDECRES2p(180),
      +  KDECRES3p(130),IDBRES1p(9),IDBRES2p(9),IDBRES3p(9)
+!$OMP THREADPRIVATE(/S_RESp/)
        COMMON /S_RESn/ CBRRES1n(18),CBRRES2n(36),CBRRES3n(22),
      +  RESLIMn(36),ELIMITSn(9),KDECRES1n(90),KDECRES2n(180),
      +  KDECRES3n(110),IDBRES1n(9),IDBRES2n(9),IDBRES3n(9)
+!$OMP THREADPRIVATE(/S_RESn/)
       COMMON /RES_FLAG/ FRES(49),XLIMRES(49)
+!$OMP THREADPRIVATE(/RES_FLAG/)
       CHARACTER NAMP*6
 
       DATA Ideb / 0 /
@@ -1463,12 +1478,19 @@ C................................................
       IMPLICIT INTEGER (I-N)
       SAVE
       COMMON /S_CZDIS/ FA, FB0
+!$OMP THREADPRIVATE(/S_CZDIS/)
       COMMON /S_CZDISs/ FAs1, fAs2
+!$OMP THREADPRIVATE(/S_CZDISs/)
       COMMON /S_CZLEAD/ CLEAD, FLEAD
+!$OMP THREADPRIVATE(/S_CZLEAD/)
       COMMON /S_CPSPL/ CCHIK(3,6:14)
+!$OMP THREADPRIVATE(/S_CPSPL/)
       COMMON /S_CQDIS/ PPT0 (33),ptflag
+!$OMP THREADPRIVATE(/S_CQDIS/)
       COMMON /S_CDIF0/ FFD, FBD, FDD
+!$OMP THREADPRIVATE(/S_CDIF0/)
       COMMON /S_CFLAFR/ PAR(8)
+!$OMP THREADPRIVATE(/S_CFLAFR/)
 C...Longitudinal Fragmentation function
       DATA FA /0.5/, FB0 /0.8/
 C...Longitudinal Fragmentation function for leading baryons
@@ -1520,11 +1542,15 @@ C**********************************************************************
       IMPLICIT INTEGER (I-N)
 
       COMMON /S_RUN/ SQS, S, Q2MIN, XMIN, ZMIN, kb, kt, a1, a2, Nproc
+!$OMP THREADPRIVATE(/S_RUN/)
       COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
       COMMON /S_CHP/ S_LIFE(49), ICHP(49), ISTR(49), IBAR(49)
+!$OMP THREADPRIVATE(/S_CHP/)
       COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
       COMMON /S_CFLAFR/ PAR(8)
-      SAVE
+!$OMP THREADPRIVATE(/S_CFLAFR/)
 
       DIMENSION P_dec(10,5), P_in(5)
       DIMENSION xs1(2), xs2(2), xmi(2), xma(2)
@@ -1533,6 +1559,7 @@ C**********************************************************************
       DOUBLE PRECISION PA1(4), PA2(4), P1(4), P2(4)
 
       DATA Ic / 0 /
+!$OMP THREADPRIVATE(Ic)
 
 C  second particle is always photon
       IP2 = 1
@@ -2285,13 +2312,18 @@ C***********************************************************************
       IMPLICIT INTEGER (I-N)
 
       COMMON /S_RUN/ SQS, S, Q2MIN, XMIN, ZMIN, kb, kt, a1, a2, Nproc
+!$OMP THREADPRIVATE(/S_RUN/)
       COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
       COMMON /S_CSYDEC/ CBR(102), IDB(49), KDEC(612), LBARP(49)
+!$OMP THREADPRIVATE(/S_CSYDEC/)
       COMMON /S_CHP/ S_LIFE(49), ICHP(49), ISTR(49), IBAR(49)
+!$OMP THREADPRIVATE(/S_CHP/)
       COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
       COMMON /S_CNAM/ NAMP (0:49)
+!$OMP THREADPRIVATE(/S_CNAM/)
       CHARACTER*6 NAMP
-      SAVE
 
       px = 0.D0
       py = 0.D0
@@ -2358,7 +2390,6 @@ C**********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
 
-      SAVE
 
       if(ip.eq.1) then
         if(rndm(0).gt.0.2D0) then
@@ -2431,9 +2462,11 @@ C***********************************************************************
       IMPLICIT INTEGER (I-N)
 
       COMMON /S_CSYDEC/ CBR(102), IDB(49), KDEC(612), LBARP(49)
+!$OMP THREADPRIVATE(/S_CSYDEC/)
       COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
       COMMON /S_PLIST1/ LLIST1(2000)
-      SAVE
+!$OMP THREADPRIVATE(/S_PLIST1/)
 
       DIMENSION P0(5), LL(10), PD(10,5)
 
@@ -2485,8 +2518,9 @@ C***********************************************************************
       IMPLICIT INTEGER (I-N)
 
        COMMON /S_CSYDEC/ CBR(102), IDB(49), KDEC(612), LBARP(49)
+!$OMP THREADPRIVATE(/S_CSYDEC/)
       COMMON /S_MASS1/ AM(49), AM2(49)
-      SAVE
+!$OMP THREADPRIVATE(/S_MASS1/)
 
       DIMENSION P0(5), LL(10), P(10,5)
       DIMENSION PV(10,5), RORD(10), UE(3),BE(3), FACN(3:10)
@@ -2650,7 +2684,6 @@ C     (taken from PHOJET v1.12, R.E. 08/98)
 C
 C*********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
-      SAVE
 
       EP=PCX*BGX+PCY*BGY+PCZ*BGZ
       PE=EP/(GA+1.D0)+EC
@@ -2673,7 +2706,6 @@ C     (taken from PHOJET v1.12, R.E. 08/98)
 C
 C**********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
-      SAVE
 
       X= CDE*CFE*XO-SFE*YO+SDE*CFE*ZO
       Y= CDE*SFE*XO+CFE*YO+SDE*SFE*ZO
@@ -2692,7 +2724,6 @@ C
 C***********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
-      SAVE
 
       DIMENSION XS1(2),XS2(2)
       DIMENSION XMIN(2),XMAX(2)
@@ -2763,7 +2794,6 @@ C
 C********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
-      SAVE
 
       Y = PO_RNDGAM(1.D0,GAM)
       Z = PO_RNDGAM(1.D0,ETA)
@@ -2783,7 +2813,6 @@ C
 C********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
-      SAVE
 
       NCOU=0
       N = ETA
@@ -2825,11 +2854,14 @@ C***********************************************************************
       IMPLICIT INTEGER (I-N)
 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT3/MDCY(500,3),MDME(2000,2),BRAT(2000),KFDP(2000,5)
-      SAVE
+!$OMP THREADPRIVATE(/LUDAT3/)
 
       DATA init / 0 /
+!$OMP THREADPRIVATE(init)
 
 
       if(init.eq.0) then
@@ -2905,9 +2937,11 @@ C***********************************************************************
       IMPLICIT INTEGER (I-N)
 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT3/MDCY(500,3),MDME(2000,2),BRAT(2000),KFDP(2000,5)
-      SAVE
+!$OMP THREADPRIVATE(/LUDAT3/)
 
       if(IFL.eq.1) then
         Il = 2
@@ -2959,9 +2993,11 @@ C***********************************************************************
       IMPLICIT INTEGER (I-N)
 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT3/MDCY(500,3),MDME(2000,2),BRAT(2000),KFDP(2000,5)
-      SAVE
+!$OMP THREADPRIVATE(/LUDAT3/)
 
       PX = PLU(I,1)
       PY = PLU(I,2)
@@ -2987,7 +3023,6 @@ C
 C                                         (R.E. 09/97)
 C
 C************************************************************************
-      SAVE
 
       DIMENSION ITABLE(49)
       DATA ITABLE /
@@ -3043,7 +3078,6 @@ C     (taken from PHOJET 1.12, R.E. 08/98)
 C
 C********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
-      SAVE
 
       PARAMETER ( DEPS = 1.D-5 )
 
@@ -3103,7 +3137,6 @@ C     (taken from PHOJET 1.12, R.E. 08/98)
 C
 C**********************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
-      SAVE
 
       YZ=Y-Z
       XLAM=X*X-2.D0*X*(Y+Z)+YZ*YZ
@@ -3120,14 +3153,17 @@ c*******************************************************************
 c initialization routine for setting parameters of resonances
 c*******************************************************************
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
-      SAVE
       COMMON /RES_PROP/ AMRES(9),SIG0(9),WIDTH(9), 
      +                    NAMPRES(0:9)
+!$OMP THREADPRIVATE(/RES_PROP/)
       COMMON /RES_PROPp/ AMRESp(9), BGAMMAp(9),WIDTHp(9),  
      +                    RATIOJp(9),NAMPRESp(0:9)
+!$OMP THREADPRIVATE(/RES_PROPp/)
       COMMON /RES_PROPn/ AMRESn(9), BGAMMAn(9),WIDTHn(9),  
      +                    RATIOJn(9),NAMPRESn(0:9)
+!$OMP THREADPRIVATE(/RES_PROPn/)
       COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
       CHARACTER NAMPRESp*6, NAMPRESn*6
       CHARACTER NAMPRES*6
 
@@ -3224,8 +3260,11 @@ CDECK  ID>, LUJOIN
 C...Purpose: to connect a sequence of partons with colour flow indices, 
 C...as required for subsequent shower evolution (or other operations). 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/ 
       DIMENSION IJOIN(*) 
  
@@ -3278,9 +3317,13 @@ CDECK  ID>, LUEXEC
  
 C...Purpose: to administrate the fragmentation and decay chain. 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       COMMON/LUDAT3/MDCY(500,3),MDME(2000,2),BRAT(2000),KFDP(2000,5) 
+!$OMP THREADPRIVATE(/LUDAT3/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/,/LUDAT3/ 
       DIMENSION PS(2,6) 
  
@@ -3401,9 +3444,13 @@ C...Purpose: to rearrange partons along strings, to allow small systems
 C...to collapse into one or two particles and to check flavours. 
 C     IMPLICIT DOUBLE PRECISION(D) 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       COMMON/LUDAT3/MDCY(500,3),MDME(2000,2),BRAT(2000),KFDP(2000,5) 
+!$OMP THREADPRIVATE(/LUDAT3/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/,/LUDAT3/ 
       DIMENSION DPS(5),DPC(5),UE(3) 
  
@@ -3749,8 +3796,11 @@ C...Purpose: to handle the fragmentation of an arbitrary colour singlet
 C...jet system according to the Lund string fragmentation model. 
 C     IMPLICIT DOUBLE PRECISION(D) 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/ 
       DIMENSION DPS(5),KFL(3),PMQ(3),PX(3),PY(3),GAM(3),IE(2),PR(2), 
      &IN(9),DHM(4),DHG(4),DP(5,5),IRANK(2),MJU(4),IJU(3),PJU(5,5), 
@@ -4867,8 +4917,11 @@ C...Purpose: to handle the fragmentation of a jet system (or a single
 C...jet) according to independent fragmentation models. 
 C     IMPLICIT DOUBLE PRECISION(D) 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/ 
       DIMENSION DPS(5),PSI(4),NFI(3),NFL(3),IFET(3),KFLF(3), 
      &KFLO(2),PXO(2),PYO(2),WO(2) 
@@ -5330,9 +5383,13 @@ CDECK  ID>, LUDECY
  
 C...Purpose: to handle the decay of unstable particles. 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       COMMON/LUDAT3/MDCY(500,3),MDME(2000,2),BRAT(2000),KFDP(2000,5) 
+!$OMP THREADPRIVATE(/LUDAT3/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/,/LUDAT3/ 
       DIMENSION VDCY(4),KFLO(4),KFL1(4),PV(10,5),RORD(10),UE(3),BE(3), 
      &WTCOR(10),PTAU(4),PCMTAU(4) 
@@ -6213,7 +6270,9 @@ CDECK  ID>, LUKFDI
  
 C...Purpose: to generate a new flavour pair and combine off a hadron. 
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUDAT1/,/LUDAT2/ 
  
 C...Default flavour values. Input consistency checks. 
@@ -6548,6 +6607,7 @@ CDECK  ID>, LUPTDI
  
 C...Purpose: to generate transverse momentum according to a Gaussian. 
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       SAVE /LUDAT1/ 
  
 C...Generate p_T and azimuthal angle, gives p_x and p_y. 
@@ -6571,7 +6631,9 @@ CDECK  ID>, LUZDIS
  
 C...Purpose: to generate the longitudinal splitting variable z. 
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUDAT1/,/LUDAT2/ 
  
 C...Check if heavy flavour fragmentation. 
@@ -6694,8 +6756,11 @@ CDECK  ID>, LUSHOW
 C...Purpose: to generate timelike parton showers from given partons. 
 C     IMPLICIT DOUBLE PRECISION(D) 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/ 
       DIMENSION PMTH(5,50),PS(5),PMA(4),PMSD(4),IEP(4),IPA(4), 
      &KFLA(4),KFLD(4),KFL(4),ITRY(4),ISI(4),ISL(4),DP(4),DPT(5,4), 
@@ -7787,7 +7852,9 @@ C...Bose-Einstein effects according to a simple phenomenological
 C...parametrization. 
 C     IMPLICIT DOUBLE PRECISION(D) 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       SAVE /LUJETS/,/LUDAT1/ 
       DIMENSION DPS(4),KFBE(9),NBE(0:9),BEI(100) 
       DATA KFBE/211,-211,111,321,-321,130,310,221,331/ 
@@ -7950,7 +8017,9 @@ CDECK  ID>, ULMASS
  
 C...Purpose: to give the mass of a particle/parton. 
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUDAT1/,/LUDAT2/ 
  
 C...Reset variables. Compressed code. 
@@ -8042,6 +8111,7 @@ CDECK  ID>, LUCHGE
  
 C...Purpose: to give three times the charge for a particle/parton. 
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUDAT2/ 
  
 C...Initial values. Simple case of direct readout. 
@@ -8078,6 +8148,7 @@ CDECK  ID>, LUCOMP
 C...Purpose: to compress the standard KF codes for use in mass and decay 
 C...arrays; also to check whether a given code actually is defined. 
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUDAT2/ 
       DIMENSION KFTAB(25),KCTAB(25) 
       DATA KFTAB/211,111,221,311,321,130,310,213,113,223, 
@@ -8195,7 +8266,9 @@ CDECK  ID>, LUERRM
  
 C...Purpose: to inform user of errors in program execution. 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       SAVE /LUJETS/,/LUDAT1/ 
       CHARACTER CHMESS*(*) 
  
@@ -8247,6 +8320,7 @@ CDECK  ID>, ULANGL
  
 C...Purpose: to reconstruct an angle from given x and y coordinates. 
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       SAVE /LUDAT1/ 
  
       ULANGL=0. 
@@ -8274,71 +8348,12 @@ CDECK  ID>, RLU
  
 C...Purpose: to generate random numbers uniformly distributed between 
 C...0 and 1, excluding the endpoints. 
-      COMMON/LUDATR/MRLU(6),RRLU(100) 
-      SAVE /LUDATR/ 
-      EQUIVALENCE (MRLU1,MRLU(1)),(MRLU2,MRLU(2)),(MRLU3,MRLU(3)), 
-     &(MRLU4,MRLU(4)),(MRLU5,MRLU(5)),(MRLU6,MRLU(6)), 
-     &(RRLU98,RRLU(98)),(RRLU99,RRLU(99)),(RRLU00,RRLU(100)) 
- 
-C...Initialize generation from given seed. 
-      IF(MRLU2.EQ.0) THEN 
-        IJ=MOD(MRLU1/30082,31329) 
-        KL=MOD(MRLU1,30082) 
-        I=MOD(IJ/177,177)+2 
-        J=MOD(IJ,177)+2 
-        K=MOD(KL/169,178)+1 
-        L=MOD(KL,169) 
-        DO 110 II=1,97 
-        S=0. 
-        T=0.5 
-        DO 100 JJ=1,24 
-        M=MOD(MOD(I*J,179)*K,179) 
-        I=J 
-        J=K 
-        K=M 
-        L=MOD(53*L+1,169) 
-        IF(MOD(L*M,64).GE.32) S=S+T 
-        T=0.5*T 
-  100   CONTINUE 
-        RRLU(II)=S 
-  110   CONTINUE 
-        TWOM24=1. 
-        DO 120 I24=1,24 
-        TWOM24=0.5*TWOM24 
-  120   CONTINUE 
-        RRLU98=362436.*TWOM24 
-        RRLU99=7654321.*TWOM24 
-        RRLU00=16777213.*TWOM24 
-        MRLU2=1 
-        MRLU3=0 
-        MRLU4=97 
-        MRLU5=33 
-      ENDIF 
- 
-C...Generate next random number. 
-  130 RUNI=RRLU(MRLU4)-RRLU(MRLU5) 
-      IF(RUNI.LT.0.) RUNI=RUNI+1. 
-      RRLU(MRLU4)=RUNI 
-      MRLU4=MRLU4-1 
-      IF(MRLU4.EQ.0) MRLU4=97 
-      MRLU5=MRLU5-1 
-      IF(MRLU5.EQ.0) MRLU5=97 
-      RRLU98=RRLU98-RRLU99 
-      IF(RRLU98.LT.0.) RRLU98=RRLU98+RRLU00 
-      RUNI=RUNI-RRLU98 
-      IF(RUNI.LT.0.) RUNI=RUNI+1. 
-      IF(RUNI.LE.0.OR.RUNI.GE.1.) GOTO 130 
- 
-C...Update counters. Random number to output. 
-      MRLU3=MRLU3+1 
-      IF(MRLU3.EQ.1000000000) THEN 
-        MRLU2=MRLU2+1 
-        MRLU3=0 
-      ENDIF 
-      RLU=RUNI 
- 
+C...The numbers are drawn from the thread local random generator of CRPropa.
+      EXTERNAL CRPRNDM
+      DOUBLE PRECISION CRPRNDM
+      RLU=CRPRNDM(IDUMMY)
       RETURN 
-      END 
+      END
  
 C********************************************************************* 
  
@@ -8349,7 +8364,9 @@ CDECK  ID>, LUROBO
 C...Purpose: to perform rotations and boosts. 
 C     IMPLICIT DOUBLE PRECISION(D) 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       SAVE /LUJETS/,/LUDAT1/ 
       DIMENSION ROT(3,3),PR(3),VR(3),DP(4),DV(4) 
  
@@ -8458,8 +8475,11 @@ CDECK  ID>, LUEDIT
 C...Purpose: to perform global manipulations on the event record, 
 C...in particular to exclude unstable or undetectable partons/particles. 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/ 
       DIMENSION NS(2),PTS(2),PLS(2) 
  
@@ -8734,8 +8754,11 @@ CDECK  ID>, KLU
  
 C...Purpose: to provide various integer-valued event related data. 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/ 
  
 C...Default value. For I=0 number of entries, number of stable entries 
@@ -8866,8 +8889,11 @@ CDECK  ID>, PLU
  
 C...Purpose: to provide various real-valued event related data. 
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       SAVE /LUJETS/,/LUDAT1/,/LUDAT2/ 
       DIMENSION PSUM(4) 
  
@@ -8942,11 +8968,16 @@ CDECK  ID>, LUDATA
 C...Purpose: to give default values to parameters and particle and 
 C...decay data. 
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       COMMON/LUDAT2/KCHG(500,3),PMAS(500,4),PARF(2000),VCKM(4,4) 
+!$OMP THREADPRIVATE(/LUDAT2/)
       COMMON/LUDAT3/MDCY(500,3),MDME(2000,2),BRAT(2000),KFDP(2000,5) 
+!$OMP THREADPRIVATE(/LUDAT3/)
       COMMON/LUDAT4/CHAF(500) 
+!$OMP THREADPRIVATE(/LUDAT4/)
       CHARACTER CHAF*8 
       COMMON/LUDATR/MRLU(6),RRLU(100) 
+!$OMP THREADPRIVATE(/LUDATR/)
       SAVE /LUDAT1/,/LUDAT2/,/LUDAT3/,/LUDAT4/,/LUDATR/ 
  
 C...LUDAT1, containing status codes and most parameters. 
@@ -9407,7 +9438,9 @@ C...give the flavour codes K(I,2) and the five-momenta P(I,1), P(I,2),
 C...P(I,3), P(I,4) and P(I,5). The rest will be stored automatically. 
  
       COMMON/LUJETS/K(4000,5),P(4000,5),V(4000,5),N 
+!$OMP THREADPRIVATE(/LUJETS/)
       COMMON/LUDAT1/MSTU(200),PARU(200),MSTJ(200),PARJ(200) 
+!$OMP THREADPRIVATE(/LUDAT1/)
       SAVE /LUJETS/,/LUDAT1/ 
  
 C...Stop program if this routine is ever called. 
@@ -9428,72 +9461,11 @@ C...Format for error printout.
       DOUBLE PRECISION FUNCTION RNDM(IDUMMY)
        IMPLICIT DOUBLE PRECISION (A-H,O-Z)
        IMPLICIT INTEGER (I-N)
-C...Generator  from the LUND montecarlo
-C...Purpose: to generate random numbers uniformly distributed between
-C...0 and 1, excluding the endpoints.
-      COMMON/LUDATR/MRLU(6),RRLU(100)
-      EQUIVALENCE (MRLU1,MRLU(1)),(MRLU2,MRLU(2)),(MRLU3,MRLU(3)),
-     &(MRLU4,MRLU(4)),(MRLU5,MRLU(5)),(MRLU6,MRLU(6)),
-     &(RRLU98,RRLU(98)),(RRLU99,RRLU(99)),(RRLU00,RRLU(100))
-      SAVE
- 
-C...Initialize generation from given seed.
-      IF(MRLU2.EQ.0) THEN
-        IF (MRLU1 .EQ. 0)  MRLU1 = 19780503    ! initial seed
-        IJ=MOD(MRLU1/30082,31329)
-        KL=MOD(MRLU1,30082)
-        I=MOD(IJ/177,177)+2
-        J=MOD(IJ,177)+2
-        K=MOD(KL/169,178)+1
-        L=MOD(KL,169)
-        DO 110 II=1,97
-        S=0.
-        T=0.5
-        DO 100 JJ=1,24
-        M=MOD(MOD(I*J,179)*K,179)
-        I=J
-        J=K
-        K=M
-        L=MOD(53*L+1,169)
-        IF(MOD(L*M,64).GE.32) S=S+T
-        T=0.5*T
-  100   CONTINUE
-        RRLU(II)=S
-  110   CONTINUE
-        TWOM24=1.
-        DO 120 I24=1,24
-        TWOM24=0.5*TWOM24
-  120   CONTINUE
-        RRLU98=362436.*TWOM24
-        RRLU99=7654321.*TWOM24
-        RRLU00=16777213.*TWOM24
-        MRLU2=1
-        MRLU3=0
-        MRLU4=97
-        MRLU5=33
-      ENDIF
- 
-C...Generate next random number.
-  130 RUNI=RRLU(MRLU4)-RRLU(MRLU5)
-      IF(RUNI.LT.0.) RUNI=RUNI+1.
-      RRLU(MRLU4)=RUNI
-      MRLU4=MRLU4-1
-      IF(MRLU4.EQ.0) MRLU4=97
-      MRLU5=MRLU5-1
-      IF(MRLU5.EQ.0) MRLU5=97
-      RRLU98=RRLU98-RRLU99
-      IF(RRLU98.LT.0.) RRLU98=RRLU98+RRLU00
-      RUNI=RUNI-RRLU98
-      IF(RUNI.LT.0.) RUNI=RUNI+1.
-      IF(RUNI.LE.0.OR.RUNI.GE.1.) GOTO 130
- 
-C...Update counters. Random number to output.
-      MRLU3=MRLU3+1
-      IF(MRLU3.EQ.1000000000) THEN
-        MRLU2=MRLU2+1
-        MRLU3=0
-      ENDIF
-      RNDM=RUNI
+C...Random numbers uniformly distributed between 0 and 1, excluding the
+C...endpoints, drawn from the thread local random generator of CRPropa.
+      EXTERNAL CRPRNDM
+      DOUBLE PRECISION CRPRNDM
+      RNDM=CRPRNDM(IDUMMY)
       RETURN
       END
 c*****************************************************************************
@@ -9534,11 +9506,12 @@ c** author: A.Muecke **
 c**********************
        IMPLICIT DOUBLE PRECISION (A-H,O-Z)
        IMPLICIT INTEGER (I-N)
-       SAVE
 
        common/input/ tbb,E0,alpha1,alpha2,
      &           epsm1,epsm2,epsb,L0
+!$OMP THREADPRIVATE(/input/)
        COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
 
       external functs,gauss,rndm
       double precision functs,gauss,rndm
@@ -9622,10 +9595,10 @@ c**********************
        IMPLICIT DOUBLE PRECISION (A-H,O-Z)
        IMPLICIT INTEGER (I-N)
 
-        SAVE
 
        common/input/ tbb,E0,alpha1,alpha2,
      &           epsm1,epsm2,epsb,L0
+!$OMP THREADPRIVATE(/input/)
 
         external crossection
         double precision crossection
@@ -9679,26 +9652,33 @@ c**********************************
 
       IMPLICIT DOUBLE PRECISION (A-H,O-Z)
       IMPLICIT INTEGER (I-N)
-      SAVE
       
       COMMON/input/ tbb,E0,alpha1,alpha2,
      &     epsm1,epsm2,epsb,L0
+!$OMP THREADPRIVATE(/input/)
       COMMON /S_PLIST/ P(2000,5), LLIST(2000), NP, Ideb
+!$OMP THREADPRIVATE(/S_PLIST/)
       COMMON /S_MASS1/ AM(49), AM2(49)
+!$OMP THREADPRIVATE(/S_MASS1/)
       COMMON /S_CHP/  S_LIFE(49), ICHP(49), ISTR(49), IBAR(49)
+!$OMP THREADPRIVATE(/S_CHP/)
       COMMON /S_CSYDEC/ CBR(102), IDB(49), KDEC(612), LBARP(49)
+!$OMP THREADPRIVATE(/S_CSYDEC/)
       
       CHARACTER*6 NAMPRES
       COMMON /RES_PROP/ AMRES(9), SIG0(9),WIDTH(9), 
      +                    NAMPRES(0:9)
+!$OMP THREADPRIVATE(/RES_PROP/)
 
       CHARACTER*6 NAMPRESp
       COMMON /RES_PROPp/ AMRESp(9), BGAMMAp(9),WIDTHp(9),  
      +                    RATIOJp(9),NAMPRESp(0:9)
+!$OMP THREADPRIVATE(/RES_PROPp/)
 
       CHARACTER*6 NAMPRESn
       COMMON /RES_PROPn/ AMRESn(9), BGAMMAn(9),WIDTHn(9),  
      +                    RATIOJn(9),NAMPRESn(0:9)
+!$OMP THREADPRIVATE(/RES_PROPn/)
 
       external sample_s
 
@@ -43,7 +43,10 @@ using namespace crpropa;   // for usage of namespace in header files, necessary
 %ignore operator crpropa::SourceFeature*;
 %ignore operator crpropa::Candidate*;
 %ignore operator crpropa::Module*;
+%ignore operator crpropa::StochasticInteraction*;
 %ignore operator crpropa::ModuleList*;
+%ignore operator crpropa::ModuleList1D*;
+%ignore crpropa::ModuleList1D::Particle1D;
 %ignore operator crpropa::Observer*;
 %ignore operator crpropa::ObserverFeature*;
 %ignore operator crpropa::MagneticField*;
@@ -176,9 +179,67 @@ using namespace crpropa;   // for usage of namespace in header files, necessary
 %template(RandomSeed) std::vector<uint32_t>;
 %template(RandomSeedThreads) std::vector< std::vector<uint32_t> >;
 %include "crpropa/Random.h"
+%include "crpropa/SharedMemory.h"
 %include "crpropa/ParticleState.h"
 %include "crpropa/ParticleID.h"
 %include "crpropa/ParticleMass.h"
+
+%template(ParticleBatchRefPtr) crpropa::ref_ptr<crpropa::ParticleBatch>;
+%include "crpropa/ParticleBatch.h"
+
+#ifdef WITHNUMPY
+%{
+static void ParticleBatch_release(PyObject *capsule) {
+  crpropa::ParticleBatch *batch = (crpropa::ParticleBatch *) PyCapsule_GetPointer(capsule, NULL);
+  batch->removeView();
+  batch->removeReference();
+}
+
+template<typename T>
+static PyObject *ParticleBatch_view(crpropa::ParticleBatch *batch, std::vector<T> &column, int typenum) {
+  npy_intp dims[1] = {(npy_intp) column.size()};
+  if (dims[0] == 0)
+    return PyArray_SimpleNew(1, dims, typenum);
+
+  // writable view on the column, the batch is kept alive and
+  // cannot change its size as long as the array exists
+  PyObject *array = PyArray_New(&PyArray_Type, 1, dims, typenum, NULL,
+      (void *) &column[0], 0, NPY_ARRAY_CARRAY, NULL);
+  batch->addReference();
+  batch->addView();
+  PyObject *base = PyCapsule_New((void *) batch, NULL, ParticleBatch_release);
+  PyArray_SetBaseObject((PyArrayObject *) array, base);
+  return array;
+}
+%}
+
+%extend crpropa::ParticleBatch {
+  PyObject *getColumn_numpyArray(const std::string &name)
+  {
+      if (name == "id") return ParticleBatch_view($self, $self->id, NPY_INT);
+      if (name == "energy") return ParticleBatch_view($self, $self->energy, NPY_DOUBLE);
+      if (name == "charge") return ParticleBatch_view($self, $self->charge, NPY_DOUBLE);
+      if (name == "x") return ParticleBatch_view($self, $self->x, NPY_DOUBLE);
+      if (name == "y") return ParticleBatch_view($self, $self->y, NPY_DOUBLE);
+      if (name == "z") return ParticleBatch_view($self, $self->z, NPY_DOUBLE);
+      if (name == "ux") return ParticleBatch_view($self, $self->ux, NPY_DOUBLE);
+      if (name == "uy") return ParticleBatch_view($self, $self->uy, NPY_DOUBLE);
+      if (name == "uz") return ParticleBatch_view($self, $self->uz, NPY_DOUBLE);
+      if (name == "step") return ParticleBatch_view($self, $self->step, NPY_DOUBLE);
+      if (name == "trajectoryLength") return ParticleBatch_view($self, $self->trajectoryLength, NPY_DOUBLE);
+      if (name == "active") return ParticleBatch_view($self, $self->active, NPY_BOOL);
+      throw std::runtime_error("ParticleBatch: unknown column " + name);
+  }
+};
+#else
+%extend crpropa::ParticleBatch {
+  PyObject *getColumn_numpyArray(const std::string &name)
+  {
+      std::cerr << "ERROR: CRPropa was compiled without NumPy support!" << std::endl;
+      Py_RETURN_NONE;
+  }
+};
+#endif
 %include "crpropa/Version.h"
 
 %import "crpropa/Variant.h"
@@ -377,6 +438,13 @@ using namespace crpropa;   // for usage of namespace in header files, necessary
 %thread; /* reenable threading */
 
 
+%ignore crpropa::PopulationControl::Rule;
+%ignore crpropa::PopulationControl::getRules;
+%template(PopulationControlRefPtr) crpropa::ref_ptr<crpropa::PopulationControl>;
+%include "crpropa/PopulationControl.h"
+
+%ignore crpropa::Candidate::serialize;
+%ignore crpropa::Candidate::deserialize;
 %template(CandidateVector) std::vector< crpropa::ref_ptr<crpropa::Candidate> >;
 %template(CandidateRefPtr) crpropa::ref_ptr<crpropa::Candidate>;
 %include "crpropa/Candidate.h"
@@ -388,12 +456,33 @@ using namespace crpropa;   // for usage of namespace in header files, necessary
 %template(ModuleRefPtr) crpropa::ref_ptr<crpropa::Module>;
 %template(stdModuleList) std::list< crpropa::ref_ptr<crpropa::Module> >;
 %feature("director") crpropa::Module;
+%feature("director") crpropa::StochasticInteraction;
+%feature("director") crpropa::BatchModule;
+%ignore crpropa::BatchModule::processCandidates;
 %feature("director") crpropa::AbstractCondition;
 %include "crpropa/Module.h"
+%template(StochasticInteractionRefPtr) crpropa::ref_ptr<crpropa::StochasticInteraction>;
+%template(BatchModuleRefPtr) crpropa::ref_ptr<crpropa::BatchModule>;
 
 %implicitconv crpropa::ref_ptr<crpropa::MagneticField>;
 %template(MagneticFieldRefPtr) crpropa::ref_ptr<crpropa::MagneticField>;
 %feature("director") crpropa::MagneticField;
+#ifdef WITHNUMPY
+/* getFieldBatch in Python: positions and fields as (N, 3) arrays viewing the
+   C++ vectors (Vector3d is three contiguous doubles), fields has size N */
+%typemap(directorin) const std::vector<crpropa::Vector3d> &positions
+{
+    npy_intp dims[2] = {(npy_intp) $1.size(), 3};
+    $input = PyArray_New(&PyArray_Type, 2, dims, NPY_DOUBLE, NULL,
+        $1.empty() ? NULL : (void *) &$1[0].x, 0, NPY_ARRAY_CARRAY_RO, NULL);
+}
+%typemap(directorin) std::vector<crpropa::Vector3d> &fields
+{
+    npy_intp dims[2] = {(npy_intp) $1.size(), 3};
+    $input = PyArray_New(&PyArray_Type, 2, dims, NPY_DOUBLE, NULL,
+        $1.empty() ? NULL : (void *) &$1[0].x, 0, NPY_ARRAY_CARRAY, NULL);
+}
+#endif
 %include "crpropa/magneticField/MagneticField.h"
 
 %implicitconv crpropa::ref_ptr<crpropa::PhotonField>;
@@ -411,9 +500,117 @@ using namespace crpropa;   // for usage of namespace in header files, necessary
 %feature("director") crpropa::Density;
 %include "crpropa/massDistribution/Density.h"
 
+%ignore crpropa::sharedGrid3f;
+%ignore crpropa::sharedGrid1f;
+%ignore crpropa::Grid::getData;
+%ignore crpropa::Grid::setExternalStorage;
 %include "crpropa/Grid.h"
 %include "crpropa/GridTools.h"
 
+#ifdef WITHNUMPY
+%{
+// keeps a NumPy array alive as long as a grid uses its memory
+class Grid_NumpyOwner: public crpropa::Referenced {
+  PyObject *array;
+public:
+  Grid_NumpyOwner(PyObject *array) : array(array) {
+    Py_INCREF(array);
+  }
+  ~Grid_NumpyOwner() {
+    PyGILState_STATE state = PyGILState_Ensure();
+    Py_DECREF(array);
+    PyGILState_Release(state);
+  }
+};
+
+template<typename T>
+static void Grid_setExternalStorage(crpropa::Grid<T> *grid, PyObject *input, size_t components) {
+  size_t n = grid->getNx() * grid->getNy() * grid->getNz() * components;
+  if (!PyArray_Check(input))
+    throw std::runtime_error("Grid: expected a NumPy array");
+  PyArrayObject *arr = (PyArrayObject *) input;
+  if ((PyArray_TYPE(arr) != NPY_FLOAT32) || !PyArray_IS_C_CONTIGUOUS(arr)
+      || !PyArray_ISALIGNED(arr) || !PyArray_ISWRITEABLE(arr))
+    throw std::runtime_error("Grid: expected a writeable, C-contiguous float32 array");
+  if ((size_t) PyArray_SIZE(arr) != n)
+    throw std::runtime_error("Grid: array and grid size do not match");
+  grid->setExternalStorage((T *) PyArray_DATA(arr), new Grid_NumpyOwner(input));
+}
+
+static void Grid_release(PyObject *capsule) {
+  crpropa::Referenced *grid = (crpropa::Referenced *) PyCapsule_GetPointer(capsule, NULL);
+  grid->removeReference();
+}
+
+template<typename T>
+static PyObject *Grid_view(crpropa::Grid<T> *grid, size_t components) {
+  npy_intp dims[4] = {(npy_intp) grid->getNx(), (npy_intp) grid->getNy(),
+      (npy_intp) grid->getNz(), (npy_intp) components};
+  int nd = (components > 1) ? 4 : 3;
+  // view on the grid values, the grid is kept alive by the array;
+  // read-only memory (e.g. shared memory) gives a read-only view
+  int flags = grid->isReadOnly() ? NPY_ARRAY_CARRAY_RO : NPY_ARRAY_CARRAY;
+  PyObject *array = PyArray_New(&PyArray_Type, nd, dims, NPY_FLOAT32, NULL,
+      (void *) grid->getData(), 0, flags, NULL);
+  crpropa::Referenced *owner = grid;
+  owner->addReference();
+  PyObject *base = PyCapsule_New((void *) owner, NULL, Grid_release);
+  PyArray_SetBaseObject((PyArrayObject *) array, base);
+  return array;
+}
+%}
+
+%extend crpropa::Grid<crpropa::Vector3<float> > {
+  void setExternalStorage_numpyArray(PyObject *array)
+  {
+      Grid_setExternalStorage($self, array, 3);
+  }
+
+  PyObject *getData_numpyArray()
+  {
+      return Grid_view($self, 3);
+  }
+};
+
+%extend crpropa::Grid<float> {
+  void setExternalStorage_numpyArray(PyObject *array)
+  {
+      Grid_setExternalStorage($self, array, 1);
+  }
+
+  PyObject *getData_numpyArray()
+  {
+      return Grid_view($self, 1);
+  }
+};
+#else
+%extend crpropa::Grid<crpropa::Vector3<float> > {
+  void setExternalStorage_numpyArray(PyObject *array)
+  {
+      std::cerr << "ERROR: CRPropa was compiled without NumPy support!" << std::endl;
+  }
+
+  PyObject *getData_numpyArray()
+  {
+      std::cerr << "ERROR: CRPropa was compiled without NumPy support!" << std::endl;
+      Py_RETURN_NONE;
+  }
+};
+
+%extend crpropa::Grid<float> {
+  void setExternalStorage_numpyArray(PyObject *array)
+  {
+      std::cerr << "ERROR: CRPropa was compiled without NumPy support!" << std::endl;
+  }
+
+  PyObject *getData_numpyArray()
+  {
+      std::cerr << "ERROR: CRPropa was compiled without NumPy support!" << std::endl;
+      Py_RETURN_NONE;
+  }
+};
+#endif
+
 %template(Array3d) std::array<double, 3>;
 %template(Array3f) std::array<float, 3>;
 
@@ -547,12 +744,107 @@ using namespace crpropa;   // for usage of namespace in header files, necessary
 %include "crpropa/module/TextOutput.h"
 
 %include "crpropa/module/HDF5Output.h"
+
+%template(StringVector) std::vector<std::string>;
+%ignore crpropa::ColumnarOutputReader::getColumnData;
+%include "crpropa/module/ColumnarOutput.h"
+
+#ifdef WITHNUMPY
+%{
+// NumPy type of a numeric column
+static int Variant_numpyType(crpropa::Variant::Type type) {
+  switch (type) {
+    case crpropa::Variant::TYPE_BOOL: return NPY_BOOL;
+    case crpropa::Variant::TYPE_CHAR: return NPY_BYTE;
+    case crpropa::Variant::TYPE_UCHAR: return NPY_UBYTE;
+    case crpropa::Variant::TYPE_INT16: return NPY_INT16;
+    case crpropa::Variant::TYPE_UINT16: return NPY_UINT16;
+    case crpropa::Variant::TYPE_INT32: return NPY_INT32;
+    case crpropa::Variant::TYPE_UINT32: return NPY_UINT32;
+    case crpropa::Variant::TYPE_INT64: return NPY_INT64;
+    case crpropa::Variant::TYPE_UINT64: return NPY_UINT64;
+    case crpropa::Variant::TYPE_FLOAT: return NPY_FLOAT32;
+    default: return NPY_FLOAT64;
+  }
+}
+
+static void ColumnarOutputReader_release(PyObject *capsule) {
+  crpropa::ColumnarOutputReader *reader = (crpropa::ColumnarOutputReader *) PyCapsule_GetPointer(capsule, NULL);
+  reader->removeReference();
+}
+%}
+
+%extend crpropa::ColumnarOutputReader {
+  PyObject *getColumn_numpyArray(const std::string &name)
+  {
+      const void *data = $self->getColumnData(name);
+      int typenum = Variant_numpyType($self->getColumnType(name));
+
+      npy_intp dims[1] = {(npy_intp) $self->getNumberOfRows()};
+      if (dims[0] == 0)
+        return PyArray_SimpleNew(1, dims, typenum);
+
+      // read-only view on the reader memory, the reader is kept alive by the array
+      PyObject *array = PyArray_New(&PyArray_Type, 1, dims, typenum, NULL,
+          (void *) data, 0, NPY_ARRAY_CARRAY_RO, NULL);
+      $self->addReference();
+      PyObject *base = PyCapsule_New((void *) $self, NULL, ColumnarOutputReader_release);
+      PyArray_SetBaseObject((PyArrayObject *) array, base);
+      return array;
+  }
+};
+#else
+%extend crpropa::ColumnarOutputReader {
+  PyObject *getColumn_numpyArray(const std::string &name)
+  {
+      std::cerr << "ERROR: CRPropa was compiled without NumPy support!" << std::endl;
+      Py_RETURN_NONE;
+  }
+};
+#endif
+
+%ignore crpropa::MemoryOutput::Column;
+%ignore crpropa::MemoryOutput::getColumnData;
+%include "crpropa/module/MemoryOutput.h"
+
+#ifdef WITHNUMPY
+%extend crpropa::MemoryOutput {
+  PyObject *getColumn_numpyArray(const std::string &name)
+  {
+      const void *data = $self->getColumnData(name);
+      int typenum = Variant_numpyType($self->getColumnType(name));
+
+      npy_intp dims[1] = {(npy_intp) $self->getNumberOfRows()};
+      PyObject *array = PyArray_SimpleNew(1, dims, typenum);
+      if (array == NULL || dims[0] == 0)
+        return array;
+
+      // copy, the column memory moves when candidates are added
+      memcpy(PyArray_DATA((PyArrayObject *) array), data,
+          dims[0] * PyArray_ITEMSIZE((PyArrayObject *) array));
+      return array;
+  }
+};
+#else
+%extend crpropa::MemoryOutput {
+  PyObject *getColumn_numpyArray(const std::string &name)
+  {
+      std::cerr << "ERROR: CRPropa was compiled without NumPy support!" << std::endl;
+      Py_RETURN_NONE;
+  }
+};
+#endif
+
+%template(HistogramAxisRefPtr) crpropa::ref_ptr<crpropa::HistogramAxis>;
+%feature("director") crpropa::HistogramAxis;
+%include "crpropa/module/HistogramOutput.h"
 %include "crpropa/module/OutputShell.h"
 %include "crpropa/module/EMCascade.h"
 %include "crpropa/module/PhotonEleCa.h"
 %include "crpropa/module/PhotonOutput1D.h"
 %include "crpropa/module/NuclearDecay.h"
 %include "crpropa/module/ElectronPairProduction.h"
+%include "crpropa/module/ContinuousLosses.h"
 %include "crpropa/module/PhotoPionProduction.h"
 %include "crpropa/module/PhotoDisintegration.h"
 %include "crpropa/module/ElasticScattering.h"
@@ -564,6 +856,7 @@ using namespace crpropa;   // for usage of namespace in header files, necessary
 %include "crpropa/module/EMInverseComptonScattering.h"
 %include "crpropa/module/SynchrotronRadiation.h"
 %include "crpropa/module/AdiabaticCooling.h"
+%include "crpropa/module/InteractionScheduler.h"
 
 %template(IntSet) std::set<int>;
 %include "crpropa/module/Tools.h"
@@ -15,6 +15,7 @@
 #include "crpropa/magneticLens/ParticleMapsContainer.h"
 %}
 
+%ignore crpropa::prod_up(const ModelMatrixType&, double* const*, size_t, std::vector<double> &);
 %include "crpropa/magneticLens/ModelMatrix.h"
 %apply double &INOUT {double &longitude, double &latitude};
 %typemap(in,numinputs=0) double& longitude (double temp) "$1 = &temp;"
@@ -34,6 +35,10 @@
 
 %apply double &INOUT {double &phi, double &theta};
 %ignore MagneticLens::transformModelVector(double *,double) const;
+%ignore MagneticLens::transformModelVectors;
+%ignore crpropa::LensPartCache;
+%ignore LensPart::setCache;
+%ignore crpropa::LensPartMatrix;
 %include "crpropa/magneticLens/MagneticLens.h"
 %template(LenspartVector) std::vector< crpropa::LensPart *>;
 
@@ -78,6 +83,7 @@
 %ignore ParticleMapsContainer::getParticleIds;
 %ignore ParticleMapsContainer::getEnergies;
 %ignore ParticleMapsContainer::getRandomParticles;
+%ignore ParticleMapsContainer::addParticles(size_t, const int *, const double *, const double *, const double *, const double *);
 %include "crpropa/magneticLens/ParticleMapsContainer.h"
 
 #ifdef WITHNUMPY
@@ -152,24 +158,25 @@
     npy_intp *D = PyArray_DIMS(particleIds_arr);
     int arraySize = D[0];
 
+    std::vector<int> ids(arraySize);
     for(size_t i = 0; i < arraySize; i++)
     {
       if (intSize == 32)
       {
-        $self->addParticle(((int32_t*) particleIds_dp)[i], energies_dp[i],
-            galacticLongitudes_dp[i], galacticLatitudes_dp[i], weights_dp[i]);
+        ids[i] = ((int32_t*) particleIds_dp)[i];
       }
       else if (intSize == 64)
       {
-        $self->addParticle(((int64_t*) particleIds_dp)[i], energies_dp[i],
-            galacticLongitudes_dp[i], galacticLatitudes_dp[i], weights_dp[i]);
+        ids[i] = ((int64_t*) particleIds_dp)[i];
       }
       else
       {
         throw std::runtime_error("ParticleMapsContainer::addParticles - unknown int size");
       }
-
     }
+    if (arraySize > 0)
+      $self->addParticles(arraySize, &ids[0], energies_dp,
+          galacticLongitudes_dp, galacticLatitudes_dp, weights_dp);
     Py_RETURN_TRUE;
   }
 
@@ -1,13 +1,17 @@
 #include "crpropa/Candidate.h"
+#include "crpropa/BinaryIO.h"
 #include "crpropa/ParticleID.h"
 #include "crpropa/Units.h"
 
+#include <algorithm>
+#include <istream>
+#include <ostream>
 #include <stdexcept>
 
 namespace crpropa {
 
 Candidate::Candidate(int id, double E, Vector3d pos, Vector3d dir, double z, double weight, std::string tagOrigin) :
-  redshift(z), trajectoryLength(0), weight(weight), currentStep(0), nextStep(0), active(true), parent(0), tagOrigin(tagOrigin) {
+  redshift(z), trajectoryLength(0), weight(weight), currentStep(0), nextStep(0), active(true), parent(0), tagOrigin(tagOrigin), sourceSerialNumber(0), createdSerialNumber(0) {
 	ParticleState state(id, E, pos, dir);
 	source = state;
 	created = state;
@@ -27,7 +31,7 @@ Candidate::Candidate(int id, double E, Vector3d pos, Vector3d dir, double z, dou
 }
 
 Candidate::Candidate(const ParticleState &state) :
-		source(state), created(state), current(state), previous(state), redshift(0), trajectoryLength(0), currentStep(0), nextStep(0), active(true), parent(0), tagOrigin ("PRIM") {
+		source(state), created(state), current(state), previous(state), redshift(0), trajectoryLength(0), currentStep(0), nextStep(0), active(true), parent(0), tagOrigin ("PRIM"), sourceSerialNumber(0), createdSerialNumber(0) {
 
 #if defined(OPENMP_3_1)
 		#pragma omp atomic capture
@@ -132,42 +136,103 @@ bool Candidate::hasProperty(const std::string &name) const {
 	return true;
 }
 
+namespace {
+std::vector<std::string> &slotNames() {
+	static std::vector<std::string> names;
+	return names;
+}
+}
+
+size_t Candidate::registerSlot(const std::string &name) {
+	size_t slot;
+#pragma omp critical(CandidateSlots)
+	{
+		std::vector<std::string> &names = slotNames();
+		slot = std::find(names.begin(), names.end(), name) - names.begin();
+		if (slot == names.size())
+			names.push_back(name);
+	}
+	return slot;
+}
+
+std::string Candidate::getSlotName(size_t slot) {
+	std::string name;
+#pragma omp critical(CandidateSlots)
+	{
+		if (slot < slotNames().size())
+			name = slotNames()[slot];
+	}
+	if (name.empty())
+		throw std::runtime_error("Candidate: unknown slot");
+	return name;
+}
+
+void Candidate::setSlot(size_t slot, uint64_t value) {
+	if (slot >= slots.size())
+		slots.resize(slot + 1, 0);
+	slots[slot] = value;
+}
+
 void Candidate::addSecondary(Candidate *c) {
 	secondaries.push_back(c);
 }
 
 void Candidate::addSecondary(int id, double energy, double w, std::string tagOrigin) {
-	ref_ptr<Candidate> secondary = new Candidate;
-	secondary->setRedshift(redshift);
-	secondary->setTrajectoryLength(trajectoryLength);
-	secondary->setWeight(weight * w);
-	secondary->source = source;
-	secondary->previous = previous;
-	secondary->created = previous;
-	secondary->current = current;
-	secondary->current.setId(id);
-	secondary->current.setEnergy(energy);
-	secondary->parent = this;
-	secondary->setTagOrigin (tagOrigin);
-	secondaries.push_back(secondary);
+	double secondaryWeight = weight * w;
+	size_t n = 1;
+	if (populationControl.valid())
+		n = populationControl->sample(id, energy, secondaryWeight);
+
+	for (size_t i = 0; i < n; i++) {
+		ref_ptr<Candidate> secondary = new Candidate;
+		secondary->setRedshift(redshift);
+		secondary->setTrajectoryLength(trajectoryLength);
+		secondary->setWeight(secondaryWeight);
+		secondary->source = source;
+		secondary->previous = previous;
+		secondary->created = previous;
+		secondary->current = current;
+		secondary->current.setId(id);
+		secondary->current.setEnergy(energy);
+		secondary->parent = this;
+		secondary->setTagOrigin (tagOrigin);
+		secondary->populationControl = populationControl;
+		secondaries.push_back(secondary);
+	}
 }
 
 void Candidate::addSecondary(int id, double energy, Vector3d position, double w, std::string tagOrigin) {
-	ref_ptr<Candidate> secondary = new Candidate;
-	secondary->setRedshift(redshift);
-	secondary->setTrajectoryLength(trajectoryLength - (current.getPosition() - position).getR() );
-	secondary->setWeight(weight * w);
-	secondary->source = source;
-	secondary->previous = previous;
-	secondary->created = previous;
-	secondary->current = current;
-	secondary->current.setId(id);
-	secondary->current.setEnergy(energy);
-	secondary->current.setPosition(position);
-	secondary->created.setPosition(position);
-	secondary->parent = this;
-	secondary->setTagOrigin (tagOrigin);
-	secondaries.push_back(secondary);
+	double secondaryWeight = weight * w;
+	size_t n = 1;
+	if (populationControl.valid())
+		n = populationControl->sample(id, energy, secondaryWeight);
+
+	for (size_t i = 0; i < n; i++) {
+		ref_ptr<Candidate> secondary = new Candidate;
+		secondary->setRedshift(redshift);
+		secondary->setTrajectoryLength(trajectoryLength - (current.getPosition() - position).getR() );
+		secondary->setWeight(secondaryWeight);
+		secondary->source = source;
+		secondary->previous = previous;
+		secondary->created = previous;
+		secondary->current = current;
+		secondary->current.setId(id);
+		secondary->current.setEnergy(energy);
+		secondary->current.setPosition(position);
+		secondary->created.setPosition(position);
+		secondary->parent = this;
+		secondary->setTagOrigin (tagOrigin);
+		secondary->populationControl = populationControl;
+		secondaries.push_back(secondary);
+	}
+}
+
+void Candidate::setPopulationControl(ref_ptr<PopulationControl> control) {
+	populationControl = control;
+}
+
+ref_ptr<PopulationControl> Candidate::getPopulationControl() const {
+	return populationControl;
 }
 
 void Candidate::clearSecondaries() {
@@ -190,12 +255,23 @@ ref_ptr<Candidate> Candidate::clone(bool recursive) const {
 	cloned->previous = previous;
 
 	cloned->properties = properties;
+	cloned->slots = slots;
 	cloned->active = active;
 	cloned->redshift = redshift;
 	cloned->weight = weight;
 	cloned->trajectoryLength = trajectoryLength;
 	cloned->currentStep = currentStep;
 	cloned->nextStep = nextStep;
+	cloned->tagOrigin = tagOrigin;
+	cloned->populationControl = populationControl;
+	// the clone has no parent, keep the serial numbers of the ancestors
+	if (parent) {
+		cloned->sourceSerialNumber = parent->getSourceSerialNumber();
+		cloned->createdSerialNumber = parent->getSerialNumber();
+	} else {
+		cloned->sourceSerialNumber = sourceSerialNumber;
+		cloned->createdSerialNumber = createdSerialNumber;
+	}
 	if (recursive) {
 		cloned->secondaries.reserve(secondaries.size());
 		for (size_t i = 0; i < secondaries.size(); i++) {
@@ -218,6 +294,8 @@ void Candidate::setSerialNumber(const uint64_t snr) {
 uint64_t Candidate::getSourceSerialNumber() const {
 	if (parent)
 		return parent->getSourceSerialNumber();
+	else if (sourceSerialNumber)
+		return sourceSerialNumber;
 	else
 		return serialNumber;
 }
@@ -225,10 +303,20 @@ uint64_t Candidate::getSourceSerialNumber() const {
 uint64_t Candidate::getCreatedSerialNumber() const {
 	if (parent)
 		return parent->getSerialNumber();
+	else if (createdSerialNumber)
+		return createdSerialNumber;
 	else
 		return serialNumber;
 }
 
+void Candidate::detachParent() {
+	if (not parent)
+		return;
+	sourceSerialNumber = parent->getSourceSerialNumber();
+	createdSerialNumber = parent->getSerialNumber();
+	parent = 0;
+}
+
 void Candidate::setNextSerialNumber(uint64_t snr) {
 	nextSerialNumber = snr;
 }
@@ -246,4 +334,157 @@ void Candidate::restart() {
 	current = source;
 }
 
+using namespace binary;
+
+static void writeState(std::ostream &out, const ParticleState &state) {
+	write<int32_t>(out, state.getId());
+	write<double>(out, state.getEnergy());
+	write<double>(out, state.getPosition().x);
+	write<double>(out, state.getPosition().y);
+	write<double>(out, state.getPosition().z);
+	write<double>(out, state.getDirection().x);
+	write<double>(out, state.getDirection().y);
+	write<double>(out, state.getDirection().z);
+}
+
+static void readState(std::istream &in, ParticleState &state) {
+	state.setId(read<int32_t>(in));
+	state.setEnergy(read<double>(in));
+	Vector3d v;
+	v.x = read<double>(in);
+	v.y = read<double>(in);
+	v.z = read<double>(in);
+	state.setPosition(v);
+	v.x = read<double>(in);
+	v.y = read<double>(in);
+	v.z = read<double>(in);
+	state.setDirection(v);
+}
+
+static void writeVariant(std::ostream &out, const Variant &value) {
+	write<uint8_t>(out, value.getType());
+	if (value.getType() == Variant::TYPE_STRING) {
+		writeString(out, value.toString());
+	} else {
+		char buffer[sizeof(double)];
+		size_t n = Variant(value).copyToBuffer(buffer);
+		out.write(buffer, n);
+	}
+}
+
+static Variant readVariant(std::istream &in) {
+	Variant::Type type = Variant::Type(read<uint8_t>(in));
+	switch (type) {
+	case Variant::TYPE_NONE:
+		return Variant();
+	case Variant::TYPE_BOOL:
+		return Variant::fromBool(read<bool>(in));
+	case Variant::TYPE_CHAR:
+		return Variant::fromChar(read<char>(in));
+	case Variant::TYPE_UCHAR:
+		return Variant::fromUChar(read<unsigned char>(in));
+	case Variant::TYPE_INT16:
+		return Variant::fromInt16(read<int16_t>(in));
+	case Variant::TYPE_UINT16:
+		return Variant::fromUInt16(read<uint16_t>(in));
+	case Variant::TYPE_INT32:
+		return Variant::fromInt32(read<int32_t>(in));
+	case Variant::TYPE_UINT32:
+		return Variant::fromUInt32(read<uint32_t>(in));
+	case Variant::TYPE_INT64:
+		return Variant::fromInt64(read<int64_t>(in));
+	case Variant::TYPE_UINT64:
+		return Variant::fromUInt64(read<uint64_t>(in));
+	case Variant::TYPE_FLOAT:
+		return Variant::fromFloat(read<float>(in));
+	case Variant::TYPE_DOUBLE:
+		return Variant::fromDouble(read<double>(in));
+	case Variant::TYPE_STRING:
+		return Variant(readString(in));
+	default:
+		throw std::runtime_error("Candidate::deserialize: unknown property type");
+	}
+}
+
+void Candidate::serialize(std::ostream &out, bool recursive) const {
+	write<uint64_t>(out, serialNumber);
+	write<uint64_t>(out, getSourceSerialNumber());
+	write<uint64_t>(out, getCreatedSerialNumber());
+	writeState(out, source);
+	writeState(out, created);
+	writeState(out, current);
+	writeState(out, previous);
+	write<double>(out, weight);
+	write<double>(out, redshift);
+	write<double>(out, trajectoryLength);
+	write<double>(out, currentStep);
+	write<double>(out, nextStep);
+	write<uint8_t>(out, active);
+	writeString(out, tagOrigin);
+
+	write<uint32_t>(out, properties.size());
+	for (PropertyMap::const_iterator i = properties.begin(); i != properties.end(); ++i) {
+		writeString(out, i->first);
+		writeVariant(out, i->second);
+	}
+
+	uint32_t nSlots = 0;
+	for (size_t i = 0; i < slots.size(); i++)
+		nSlots += (slots[i] != 0);
+	write<uint32_t>(out, nSlots);
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i] == 0)
+			continue;
+		writeString(out, getSlotName(i));
+		write<uint64_t>(out, slots[i]);
+	}
+
+	uint32_t nSecondaries = recursive ? secondaries.size() : 0;
+	write<uint32_t>(out, nSecondaries);
+	for (size_t i = 0; i < nSecondaries; i++)
+		secondaries[i]->serialize(out, recursive);
+}
+
+ref_ptr<Candidate> Candidate::deserialize(std::istream &in, uint16_t version) {
+	if (version != serializationVersion)
+		throw std::runtime_error("Candidate::deserialize: unsupported format version");
+
+	ref_ptr<Candidate> c = new Candidate;
+	c->serialNumber = read<uint64_t>(in);
+	c->sourceSerialNumber = read<uint64_t>(in);
+	c->createdSerialNumber = read<uint64_t>(in);
+	readState(in, c->source);
+	readState(in, c->created);
+	readState(in, c->current);
+	readState(in, c->previous);
+	c->weight = read<double>(in);
+	c->redshift = read<double>(in);
+	c->trajectoryLength = read<double>(in);
+	c->currentStep = read<double>(in);
+	c->nextStep = read<double>(in);
+	c->active = read<uint8_t>(in);
+	c->tagOrigin = readString(in);
+
+	uint32_t nProperties = read<uint32_t>(in);
+	for (size_t i = 0; i < nProperties; i++) {
+		std::string name = readString(in);
+		c->properties[name] = readVariant(in);
+	}
+
+	uint32_t nSlots = read<uint32_t>(in);
+	for (size_t i = 0; i < nSlots; i++) {
+		std::string name = readString(in);
+		c->setSlot(registerSlot(name), read<uint64_t>(in));
+	}
+
+	uint32_t nSecondaries = read<uint32_t>(in);
+	c->secondaries.reserve(nSecondaries);
+	for (size_t i = 0; i < nSecondaries; i++) {
+		ref_ptr<Candidate> s = deserialize(in, version);
+		s->parent = c;
+		c->secondaries.push_back(s);
+	}
+	return c;
+}
+
 } // namespace crpropa
@@ -48,6 +48,8 @@ const std::vector<double>& CylindricalProjectionMap::getPdf() const {
 }
 
 std::vector<double>& CylindricalProjectionMap::getPdf() {
+	// the pdf may be modified by the caller
+	dirty = true;
 	return pdf;
 }
 
@@ -121,15 +123,18 @@ void CylindricalProjectionMap::updateCdf() const {
 EmissionMap::EmissionMap() : minEnergy(0.0001 * EeV), maxEnergy(10000 * EeV),
 	nEnergy(8*2), nPhi(360), nTheta(180) {
 	logStep = log10(maxEnergy / minEnergy) / nEnergy;
+	threadMaps = new ThreadMaps();
 }
 
 EmissionMap::EmissionMap(size_t nPhi, size_t nTheta, size_t nEnergy) : minEnergy(0.0001 * EeV), maxEnergy(10000 * EeV),
 	nEnergy(nEnergy), nPhi(nPhi), nTheta(nTheta) {
 	logStep = log10(maxEnergy / minEnergy) / nEnergy;
+	threadMaps = new ThreadMaps();
 }
 
 EmissionMap::EmissionMap(size_t nPhi, size_t nTheta, size_t nEnergy, double minEnergy, double maxEnergy) : minEnergy(minEnergy), maxEnergy(maxEnergy), nEnergy(nEnergy), nPhi(nPhi), nTheta(nTheta) {
 	logStep = log10(maxEnergy / minEnergy) / nEnergy;
+	threadMaps = new ThreadMaps();
 }
 
 double EmissionMap::energyFromBin(size_t bin) const {
@@ -141,22 +146,51 @@ size_t EmissionMap::binFromEnergy(double energy) const {
 }
 
 void EmissionMap::fillMap(int pid, double energy, const Vector3d& direction, double weight) {
-	getMap(pid, energy)->fillBin(direction, weight);
+	getMapForKey(key_t(pid, binFromEnergy(energy)))->fillBin(direction, weight);
 }
 
 void EmissionMap::fillMap(const ParticleState& state, double weight) {
 	fillMap(state.getId(), state.getEnergy(), state.getDirection(), weight);
 }
 
+void EmissionMap::fillMapConcurrent(const ParticleState& state, double weight) {
+	ref_ptr<EmissionMap> &map = threadMaps->maps.local();
+	if (!map) {
+		map = createEmpty();
+		threadMaps->filled = true;
+	}
+	map->fillMap(state, weight);
+}
+
+void EmissionMap::mergeThreadMaps() const {
+	if (!threadMaps->filled)
+		return;
+	std::lock_guard<std::mutex> lock(threadMaps->mutex);
+	if (!threadMaps->filled)
+		return;
+	// the thread maps are part of the content of this map
+	EmissionMap *self = const_cast<EmissionMap *>(this);
+	PerThread<ref_ptr<EmissionMap> > &m = threadMaps->maps;
+	for (size_t i = 0; i < m.size(); i++) {
+		if (m[i].valid())
+			self->merge(m[i]);
+		m[i] = NULL;
+	}
+	threadMaps->filled = false;
+}
+
 EmissionMap::map_t &EmissionMap::getMaps() {
+	mergeThreadMaps();
 	return maps;
 }
 
 const EmissionMap::map_t &EmissionMap::getMaps() const {
+	mergeThreadMaps();
 	return maps;
 }
 
 bool EmissionMap::drawDirection(int pid, double energy, Vector3d& direction) const {
+	mergeThreadMaps();
 	key_t key(pid, binFromEnergy(energy));
 	map_t::const_iterator i = maps.find(key);
 
@@ -173,6 +207,7 @@ bool EmissionMap::drawDirection(const ParticleState& state, Vector3d& direction)
 }
 
 bool EmissionMap::checkDirection(int pid, double energy, const Vector3d& direction) const {
+	mergeThreadMaps();
 	key_t key(pid, binFromEnergy(energy));
 	map_t::const_iterator i = maps.find(key);
 
@@ -188,6 +223,7 @@ bool EmissionMap::checkDirection(const ParticleState& state) const {
 }
 
 bool EmissionMap::hasMap(int pid, double energy) {
+	mergeThreadMaps();
     key_t key(pid, binFromEnergy(energy));
     map_t::iterator i = maps.find(key);
     if (i == maps.end() || !i->second.valid())
@@ -197,7 +233,11 @@ bool EmissionMap::hasMap(int pid, double energy) {
 }
 
 ref_ptr<CylindricalProjectionMap> EmissionMap::getMap(int pid, double energy) {
-	key_t key(pid, binFromEnergy(energy));
+	mergeThreadMaps();
+	return getMapForKey(key_t(pid, binFromEnergy(energy)));
+}
+
+ref_ptr<CylindricalProjectionMap> EmissionMap::getMapForKey(const key_t &key) {
 	map_t::iterator i = maps.find(key);
 	if (i == maps.end() || !i->second.valid()) {
 		ref_ptr<CylindricalProjectionMap> cpm = new CylindricalProjectionMap(nPhi, nTheta);
@@ -209,6 +249,7 @@ ref_ptr<CylindricalProjectionMap> EmissionMap::getMap(int pid, double energy) {
 }
 
 void EmissionMap::save(const std::string &filename) {
+	mergeThreadMaps();
 	std::ofstream out(filename.c_str());
 	out.imbue(std::locale("C"));
 
@@ -234,7 +275,7 @@ void EmissionMap::merge(const EmissionMap *other) {
 			continue;
 
 		std::vector<double> &otherpdf = i->second->getPdf();
-		ref_ptr<CylindricalProjectionMap> cpm = getMap(i->first.first, i->first.second);
+		ref_ptr<CylindricalProjectionMap> cpm = getMapForKey(i->first);
 
 		if (otherpdf.size() != cpm->getPdf().size()) {
 			throw std::runtime_error("PDF size mismatch!");
@@ -253,7 +294,26 @@ void EmissionMap::merge(const std::string &filename) {
 	merge(&em);
 }
 
+EmissionMap *EmissionMap::createEmpty() const {
+	return new EmissionMap(nPhi, nTheta, nEnergy, minEnergy, maxEnergy);
+}
+
+void EmissionMap::updateCdf() const {
+	mergeThreadMaps();
+	std::vector<const CylindricalProjectionMap *> cpms;
+	cpms.reserve(maps.size());
+	for (map_t::const_iterator i = maps.begin(); i != maps.end(); i++) {
+		if (i->second.valid())
+			cpms.push_back(i->second.get());
+	}
+
+#pragma omp parallel for schedule(dynamic, 1)
+	for (long i = 0; i < (long)cpms.size(); i++)
+		cpms[i]->updateCdf();
+}
+
 void EmissionMap::load(const std::string &filename) {
+	mergeThreadMaps();
 	std::ifstream in(filename.c_str());
 	in.imbue(std::locale("C"));
 
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <limits>
 #include <cmath>
+#include <stdexcept>
 #include "kiss/logger.h"
 #include "crpropa/Geometry.h"
 
@@ -48,6 +50,12 @@ Vector3d Sphere::normal(const Vector3d& point) const {
 	return d.getUnitVector();
 }
 
+bool Sphere::getBoundingBox(Vector3d &lower, Vector3d &upper) const {
+	lower = center - Vector3d(radius);
+	upper = center + Vector3d(radius);
+	return true;
+}
+
 std::string Sphere::getDescription() const {
 	std::stringstream ss;
 	ss << "Sphere: " << std::endl
@@ -112,6 +120,12 @@ Vector3d ParaxialBox::normal(const Vector3d& point) const {
 	return n;
 }
 
+bool ParaxialBox::getBoundingBox(Vector3d &lower, Vector3d &upper) const {
+	lower = corner;
+	upper = corner + size;
+	return true;
+}
+
 std::string ParaxialBox::getDescription() const {
 	std::stringstream ss;
 	ss << "ParaxialBox: " << std::endl
@@ -121,4 +135,206 @@ std::string ParaxialBox::getDescription() const {
 };
 
 
+// SurfaceIndex ------------------------------------------------------------
+namespace {
+
+const size_t leafSize = 4;
+
+inline bool boxContains(const Vector3d &lower, const Vector3d &upper,
+		const Vector3d &point) {
+	return (point.x >= lower.x) and (point.x <= upper.x)
+		and (point.y >= lower.y) and (point.y <= upper.y)
+		and (point.z >= lower.z) and (point.z <= upper.z);
+}
+
+inline double boxDistance2(const Vector3d &lower, const Vector3d &upper,
+		const Vector3d &point) {
+	double dx = std::max(0., std::max(lower.x - point.x, point.x - upper.x));
+	double dy = std::max(0., std::max(lower.y - point.y, point.y - upper.y));
+	double dz = std::max(0., std::max(lower.z - point.z, point.z - upper.z));
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// orders surfaces by the center of their bounding box along one axis
+struct CenterLess {
+	const std::vector<Vector3d> &lowers, &uppers;
+	int axis;
+	CenterLess(const std::vector<Vector3d> &lowers,
+			const std::vector<Vector3d> &uppers, int axis) :
+			lowers(lowers), uppers(uppers), axis(axis) {
+	}
+	bool operator()(size_t a, size_t b) const {
+		return (lowers[a].data[axis] + uppers[a].data[axis])
+			< (lowers[b].data[axis] + uppers[b].data[axis]);
+	}
+};
+
+} // namespace
+
+SurfaceIndex::SurfaceIndex() : built(true) {
+}
+
+size_t SurfaceIndex::add(Surface *surface) {
+	Vector3d lower, upper;
+	if (not surface->getBoundingBox(lower, upper))
+		throw std::runtime_error("SurfaceIndex: surface has no bounding box");
+	surfaces.push_back(surface);
+	lowers.push_back(lower);
+	uppers.push_back(upper);
+	built.store(false, std::memory_order_relaxed);
+	return surfaces.size() - 1;
+}
+
+size_t SurfaceIndex::size() const {
+	return surfaces.size();
+}
+
+Surface *SurfaceIndex::get(size_t i) const {
+	return surfaces.at(i);
+}
+
+void SurfaceIndex::build() {
+	nodes.clear();
+	order.resize(surfaces.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	if (order.size() > 0) {
+		nodes.reserve(2 * order.size() / leafSize + 1);
+		buildNode(0, order.size());
+	}
+	// publishes the nodes to threads checking built with acquire order
+	built.store(true, std::memory_order_release);
+}
+
+int SurfaceIndex::buildNode(size_t begin, size_t end) {
+	int index = nodes.size();
+	nodes.push_back(Node());
+
+	Vector3d lower = lowers[order[begin]];
+	Vector3d upper = uppers[order[begin]];
+	for (size_t i = begin + 1; i < end; i++) {
+		lower.setXYZ(std::min(lower.x, lowers[order[i]].x),
+			std::min(lower.y, lowers[order[i]].y),
+			std::min(lower.z, lowers[order[i]].z));
+		upper.setXYZ(std::max(upper.x, uppers[order[i]].x),
+			std::max(upper.y, uppers[order[i]].y),
+			std::max(upper.z, uppers[order[i]].z));
+	}
+
+	int left = -1, right = -1;
+	if (end - begin > leafSize) {
+		// split at the median along the longest axis
+		Vector3d extent = upper - lower;
+		int axis = 0;
+		if (extent.y > extent.data[axis])
+			axis = 1;
+		if (extent.z > extent.data[axis])
+			axis = 2;
+		size_t middle = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + middle,
+				order.begin() + end, CenterLess(lowers, uppers, axis));
+		left = buildNode(begin, middle);
+		right = buildNode(middle, end);
+	}
+
+	// nodes may have been reallocated by the recursion
+	Node &node = nodes[index];
+	node.lower = lower;
+	node.upper = upper;
+	node.begin = begin;
+	node.end = end;
+	node.left = left;
+	node.right = right;
+	return index;
+}
+
+void SurfaceIndex::buildIfNeeded() const {
+	if (built.load(std::memory_order_acquire))
+		return;
+	#pragma omp critical(SurfaceIndexBuild)
+	{
+		if (not built.load(std::memory_order_acquire))
+			const_cast<SurfaceIndex *>(this)->build();
+	}
+}
+
+int SurfaceIndex::findCrossing(const Vector3d &previous,
+		const Vector3d &current) const {
+	buildIfNeeded();
+	if (nodes.empty())
+		return -1;
+
+	// a crossed surface encloses one of the two positions
+	std::vector<int> stack;
+	stack.push_back(0);
+	while (not stack.empty()) {
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+		if (not (boxContains(node.lower, node.upper, previous)
+				or boxContains(node.lower, node.upper, current)))
+			continue;
+		if (node.left >= 0) {
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+			continue;
+		}
+		for (size_t i = node.begin; i < node.end; i++) {
+			size_t j = order[i];
+			if (not (boxContains(lowers[j], uppers[j], previous)
+					or boxContains(lowers[j], uppers[j], current)))
+				continue;
+			double currentDistance = surfaces[j]->distance(current);
+			double previousDistance = surfaces[j]->distance(previous);
+			if ((currentDistance * previousDistance <= 0) and (previousDistance != 0))
+				return j;
+		}
+	}
+	return -1;
+}
+
+double SurfaceIndex::distance(const Vector3d &point) const {
+	buildIfNeeded();
+	double best = std::numeric_limits<double>::infinity();
+	if (nodes.empty())
+		return best;
+
+	// branch and bound, the distance to a bounding box is a lower limit
+	// for the distance to the surfaces outside of which the point lies
+	std::vector<std::pair<double, int> > stack;
+	stack.push_back(std::make_pair(0., 0));
+	while (not stack.empty()) {
+		std::pair<double, int> entry = stack.back();
+		stack.pop_back();
+		if (entry.first >= best * best)
+			continue;
+		const Node &node = nodes[entry.second];
+		if (node.left >= 0) {
+			double dl = boxDistance2(nodes[node.left].lower, nodes[node.left].upper, point);
+			double dr = boxDistance2(nodes[node.right].lower, nodes[node.right].upper, point);
+			// visit the closer child first
+			if (dl < dr) {
+				stack.push_back(std::make_pair(dr, node.right));
+				stack.push_back(std::make_pair(dl, node.left));
+			} else {
+				stack.push_back(std::make_pair(dl, node.left));
+				stack.push_back(std::make_pair(dr, node.right));
+			}
+			continue;
+		}
+		for (size_t i = node.begin; i < node.end; i++) {
+			size_t j = order[i];
+			if (boxDistance2(lowers[j], uppers[j], point) >= best * best)
+				continue;
+			best = std::min(best, std::fabs(surfaces[j]->distance(point)));
+		}
+	}
+	return best;
+}
+
+std::string SurfaceIndex::getDescription() const {
+	std::stringstream ss;
+	ss << "SurfaceIndex: " << surfaces.size() << " surfaces" << std::endl;
+	return ss.str();
+}
+
 } // namespace
@@ -1,12 +1,139 @@
 #include "crpropa/GridTools.h"
 #include "crpropa/magneticField/MagneticField.h"
+#include "crpropa/SharedMemory.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace crpropa {
 
+namespace {
+
+static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f has to be packed for the binary grid files");
+
+// memory mapping of a grid file, owned by the grid using it
+class MappedGridFile: public Referenced {
+	void *map;
+	size_t size;
+public:
+	MappedGridFile(const std::string &filename, size_t expectedSize) : map(NULL), size(0) {
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("loadGridMapped: " + filename + " not found");
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t) st.st_size != expectedSize) {
+			close(fd);
+			throw std::runtime_error("loadGridMapped: file and grid size do not match");
+		}
+		size = expectedSize;
+		// private writable mapping: pages are shared with the page cache
+		// until modified and changes never reach the file
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		std::string error(strerror(errno));
+		close(fd);
+		if (map == MAP_FAILED) {
+			map = NULL;
+			throw std::runtime_error("loadGridMapped: cannot map " + filename + ": " + error);
+		}
+	}
+
+	~MappedGridFile() {
+		if (map)
+			munmap(map, size);
+	}
+
+	void *getData() const {
+		return map;
+	}
+};
+
+template<typename T>
+void loadGridMapped(ref_ptr<Grid<T> > grid, const std::string &filename, double c) {
+	size_t n = grid->getNx() * grid->getNy() * grid->getNz();
+	if (n == 0)
+		throw std::runtime_error("loadGridMapped: empty grid");
+	ref_ptr<MappedGridFile> file = new MappedGridFile(filename, n * sizeof(T));
+	grid->setExternalStorage(static_cast<T *>(file->getData()), file.get());
+	grid->setValueScale(c);
+}
+
+template<typename T>
+ref_ptr<Grid<T> > sharedGrid(const std::string &name, const GridProperties &p,
+		std::function<void(ref_ptr<Grid<T> >)> fill, double timeout,
+		const std::string &key) {
+	size_t size = p.Nx * p.Ny * p.Nz * sizeof(T);
+	ref_ptr<SharedMemorySegment> segment = SharedMemorySegment::attach(name, size,
+			[&](void *data, size_t) {
+				ref_ptr<Grid<T> > grid = new Grid<T>(p, static_cast<T *>(data));
+				fill(grid);
+			}, timeout, key);
+	T *values = static_cast<T *>(const_cast<void *>(segment->getData()));
+	return new Grid<T>(p, values, segment.get(), true);
+}
+
+template<typename T>
+ref_ptr<Grid<T> > shareGrid(ref_ptr<Grid<T> > grid, const std::string &name,
+		const std::string &key) {
+	GridProperties p(grid->getOrigin(), grid->getNx(), grid->getNy(), grid->getNz(),
+			grid->getSpacing());
+	p.setReflective(grid->isReflective());
+	p.setInterpolationType(grid->getInterpolationType());
+	size_t n = p.Nx * p.Ny * p.Nz;
+	ref_ptr<Grid<T> > shared = sharedGrid<T>(name, p,
+			[&](ref_ptr<Grid<T> > target) {
+				std::copy(grid->getData(), grid->getData() + n, target->getData());
+			}, 600, key);
+	shared->setClipVolume(grid->getClipVolume());
+	shared->setValueScale(grid->getValueScale());
+	return shared;
+}
+
+} // namespace
+
+void loadGridMapped(ref_ptr<Grid3f> grid, std::string filename, double c) {
+	loadGridMapped<Vector3f>(grid, filename, c);
+}
+
+void loadGridMapped(ref_ptr<Grid1f> grid, std::string filename, double c) {
+	loadGridMapped<float>(grid, filename, c);
+}
+
+ref_ptr<Grid3f> sharedGrid3f(const std::string &name, const GridProperties &p,
+		std::function<void(ref_ptr<Grid3f>)> fill, double timeout,
+		const std::string &key) {
+	return sharedGrid<Vector3f>(name, p, fill, timeout, key);
+}
+
+ref_ptr<Grid1f> sharedGrid1f(const std::string &name, const GridProperties &p,
+		std::function<void(ref_ptr<Grid1f>)> fill, double timeout,
+		const std::string &key) {
+	return sharedGrid<float>(name, p, fill, timeout, key);
+}
+
+ref_ptr<Grid3f> shareGrid(ref_ptr<Grid3f> grid, const std::string &name,
+		const std::string &key) {
+	return shareGrid<Vector3f>(grid, name, key);
+}
+
+ref_ptr<Grid1f> shareGrid(ref_ptr<Grid1f> grid, const std::string &name,
+		const std::string &key) {
+	return shareGrid<float>(grid, name, key);
+}
+
 void scaleGrid(ref_ptr<Grid1f> grid, double a) {
+	// external values may be read-only (shared memory) or a file mapping
+	if (grid->hasExternalStorage()) {
+		grid->setValueScale(grid->getValueScale() * a);
+		return;
+	}
 	for (int ix = 0; ix < grid->getNx(); ix++)
 		for (int iy = 0; iy < grid->getNy(); iy++)
 			for (int iz = 0; iz < grid->getNz(); iz++)
@@ -14,6 +141,11 @@ void scaleGrid(ref_ptr<Grid1f> grid, double a) {
 }
 
 void scaleGrid(ref_ptr<Grid3f> grid, double a) {
+	// external values may be read-only (shared memory) or a file mapping
+	if (grid->hasExternalStorage()) {
+		grid->setValueScale(grid->getValueScale() * a);
+		return;
+	}
 	for (int ix = 0; ix < grid->getNx(); ix++)
 		for (int iy = 0; iy < grid->getNy(); iy++)
 			for (int iz = 0; iz < grid->getNz(); iz++)
@@ -28,8 +160,8 @@ Vector3f meanFieldVector(ref_ptr<Grid3f> grid) {
 	for (int ix = 0; ix < Nx; ix++)
 		for (int iy = 0; iy < Ny; iy++)
 			for (int iz = 0; iz < Nz; iz++)
-				mean += grid->get(ix, iy, iz);
-	return mean / Nx / Ny / Nz;
+				mean += grid->getValue(ix, iy, iz);
+	return mean * grid->getValueScale() / Nx / Ny / Nz;
 }
 
 double meanFieldStrength(ref_ptr<Grid3f> grid) {
@@ -40,8 +172,8 @@ double meanFieldStrength(ref_ptr<Grid3f> grid) {
 	for (int ix = 0; ix < Nx; ix++)
 		for (int iy = 0; iy < Ny; iy++)
 			for (int iz = 0; iz < Nz; iz++)
-				mean += grid->get(ix, iy, iz).getR();
-	return mean / Nx / Ny / Nz;
+				mean += grid->getValue(ix, iy, iz).getR();
+	return mean * std::fabs(grid->getValueScale()) / Nx / Ny / Nz;
 }
 
 double meanFieldStrength(ref_ptr<Grid1f> grid) {
@@ -52,8 +184,8 @@ double meanFieldStrength(ref_ptr<Grid1f> grid) {
 	for (int ix = 0; ix < Nx; ix++)
 		for (int iy = 0; iy < Ny; iy++)
 			for (int iz = 0; iz < Nz; iz++)
-				mean += grid->get(ix, iy, iz);
-	return mean / Nx / Ny / Nz;
+				mean += grid->getValue(ix, iy, iz);
+	return mean * grid->getValueScale() / Nx / Ny / Nz;
 }
 
 double rmsFieldStrength(ref_ptr<Grid3f> grid) {
@@ -64,8 +196,8 @@ double rmsFieldStrength(ref_ptr<Grid3f> grid) {
 	for (int ix = 0; ix < Nx; ix++)
 		for (int iy = 0; iy < Ny; iy++)
 			for (int iz = 0; iz < Nz; iz++)
-				sumV2 += grid->get(ix, iy, iz).getR2();
-	return std::sqrt(sumV2 / Nx / Ny / Nz);
+				sumV2 += grid->getValue(ix, iy, iz).getR2();
+	return std::sqrt(sumV2 / Nx / Ny / Nz) * std::fabs(grid->getValueScale());
 }
 
 double rmsFieldStrength(ref_ptr<Grid1f> grid) {
@@ -76,8 +208,8 @@ double rmsFieldStrength(ref_ptr<Grid1f> grid) {
 	for (int ix = 0; ix < Nx; ix++)
 		for (int iy = 0; iy < Ny; iy++)
 			for (int iz = 0; iz < Nz; iz++)
-				sumV2 += pow(grid->get(ix, iy, iz), 2);
-	return std::sqrt(sumV2 / Nx / Ny / Nz);
+				sumV2 += pow(grid->getValue(ix, iy, iz), 2);
+	return std::sqrt(sumV2 / Nx / Ny / Nz) * std::fabs(grid->getValueScale());
 }
 
 std::array<float, 3> rmsFieldStrengthPerAxis(ref_ptr<Grid3f> grid) {
@@ -90,14 +222,15 @@ std::array<float, 3> rmsFieldStrengthPerAxis(ref_ptr<Grid3f> grid) {
     for (int ix = 0; ix < Nx; ix++)
         for (int iy = 0; iy < Ny; iy++)
             for (int iz = 0; iz < Nz; iz++) {
-                sumV2_x += pow(grid->get(ix, iy, iz).x, 2);
-                sumV2_y += pow(grid->get(ix, iy, iz).y, 2);
-                sumV2_z += pow(grid->get(ix, iy, iz).z, 2);
+                sumV2_x += pow(grid->getValue(ix, iy, iz).x, 2);
+                sumV2_y += pow(grid->getValue(ix, iy, iz).y, 2);
+                sumV2_z += pow(grid->getValue(ix, iy, iz).z, 2);
             }
+    float scale = std::fabs(grid->getValueScale());
     return {
-        std::sqrt(sumV2_x / Nx / Ny / Nz),
-        std::sqrt(sumV2_y / Nx / Ny / Nz),
-        std::sqrt(sumV2_z / Nx / Ny / Nz)
+        std::sqrt(sumV2_x / Nx / Ny / Nz) * scale,
+        std::sqrt(sumV2_y / Nx / Ny / Nz) * scale,
+        std::sqrt(sumV2_z / Nx / Ny / Nz) * scale
     };
 }
 
@@ -148,20 +281,19 @@ void loadGrid(ref_ptr<Grid3f> grid, std::string filename, double c) {
 	size_t ny = grid->getNy();
 	size_t nz = grid->getNz();
 
+	grid->checkWritable();
 	if (length != (3 * nx * ny * nz))
 		throw std::runtime_error("loadGrid: file and grid size do not match");
 
-	for (int ix = 0; ix < grid->getNx(); ix++) {
-		for (int iy = 0; iy < grid->getNy(); iy++) {
-			for (int iz = 0; iz < grid->getNz(); iz++) {
-				Vector3f &b = grid->get(ix, iy, iz);
-				fin.read((char*) &(b.x), sizeof(float));
-				fin.read((char*) &(b.y), sizeof(float));
-				fin.read((char*) &(b.z), sizeof(float));
-				b *= c;
-			}
-		}
-	}
+	// the file has the memory layout of the grid, read it as one block
+	size_t n = nx * ny * nz;
+	Vector3f *values = grid->getData();
+	fin.read((char*) values, n * sizeof(Vector3f));
+	if (!fin)
+		throw std::runtime_error("loadGrid: error reading " + filename);
+	if (c != 1)
+		for (size_t i = 0; i < n; i++)
+			values[i] *= c;
 	fin.close();
 }
 
@@ -182,18 +314,19 @@ void loadGrid(ref_ptr<Grid1f> grid, std::string filename, double c) {
 	size_t ny = grid->getNy();
 	size_t nz = grid->getNz();
 
+	grid->checkWritable();
 	if (length != (nx * ny * nz))
 		throw std::runtime_error("loadGrid: file and grid size do not match");
 
-	for (int ix = 0; ix < nx; ix++) {
-		for (int iy = 0; iy < ny; iy++) {
-			for (int iz = 0; iz < nz; iz++) {
-				float &b = grid->get(ix, iy, iz);
-				fin.read((char*) &b, sizeof(float));
-				b *= c;
-			}
-		}
-	}
+	// the file has the memory layout of the grid, read it as one block
+	size_t n = nx * ny * nz;
+	float *values = grid->getData();
+	fin.read((char*) values, n * sizeof(float));
+	if (!fin)
+		throw std::runtime_error("loadGrid: error reading " + filename);
+	if (c != 1)
+		for (size_t i = 0; i < n; i++)
+			values[i] *= c;
 	fin.close();
 }
 
@@ -204,10 +337,11 @@ void dumpGrid(ref_ptr<Grid3f> grid, std::string filename, double c) {
 		ss << "dump Grid3f: " << filename << " not found";
 		throw std::runtime_error(ss.str());
 	}
+	c *= grid->getValueScale();
 	for (int ix = 0; ix < grid->getNx(); ix++) {
 		for (int iy = 0; iy < grid->getNy(); iy++) {
 			for (int iz = 0; iz < grid->getNz(); iz++) {
-				Vector3f b = grid->get(ix, iy, iz) * c;
+				Vector3f b = grid->getValue(ix, iy, iz) * c;
 				fout.write((char*) &(b.x), sizeof(float));
 				fout.write((char*) &(b.y), sizeof(float));
 				fout.write((char*) &(b.z), sizeof(float));
@@ -224,10 +358,11 @@ void dumpGrid(ref_ptr<Grid1f> grid, std::string filename, double c) {
 		ss << "dump Grid1f: " << filename << " not found";
 		throw std::runtime_error(ss.str());
 	}
+	c *= grid->getValueScale();
 	for (int ix = 0; ix < grid->getNx(); ix++) {
 		for (int iy = 0; iy < grid->getNy(); iy++) {
 			for (int iz = 0; iz < grid->getNz(); iz++) {
-				float b = grid->get(ix, iy, iz) * c;
+				float b = grid->getValue(ix, iy, iz) * c;
 				fout.write((char*) &b, sizeof(float));
 			}
 		}
@@ -292,10 +427,11 @@ void dumpGridToTxt(ref_ptr<Grid3f> grid, std::string filename, double c) {
 		ss << "dump Grid3f: " << filename << " not found";
 		throw std::runtime_error(ss.str());
 	}
+	c *= grid->getValueScale();
 	for (int ix = 0; ix < grid->getNx(); ix++) {
 		for (int iy = 0; iy < grid->getNy(); iy++) {
 			for (int iz = 0; iz < grid->getNz(); iz++) {
-				Vector3f b = grid->get(ix, iy, iz) * c;
+				Vector3f b = grid->getValue(ix, iy, iz) * c;
 				fout << b << "\n";
 			}
 		}
@@ -310,10 +446,11 @@ void dumpGridToTxt(ref_ptr<Grid1f> grid, std::string filename, double c) {
 		ss << "dump Grid1f: " << filename << " not found";
 		throw std::runtime_error(ss.str());
 	}
+	c *= grid->getValueScale();
 	for (int ix = 0; ix < grid->getNx(); ix++) {
 		for (int iy = 0; iy < grid->getNy(); iy++) {
 			for (int iz = 0; iz < grid->getNz(); iz++) {
-				float b = grid->get(ix, iy, iz) * c;
+				float b = grid->getValue(ix, iy, iz) * c;
 				fout << b << "\n";
 			}
 		}
@@ -344,7 +481,7 @@ std::vector<std::pair<int, float>> gridPowerSpectrum(ref_ptr<Grid3f> grid) {
     for (size_t iy = 0; iy < n; iy++) {
       for (size_t iz = 0; iz < n; iz++) {
         i = ix * n * n + iy * n + iz;
-        Vector3<float> &b = grid->get(ix, iy, iz);
+        Vector3<float> b = grid->getValue(ix, iy, iz) * grid->getValueScale();
         Bx[i][0] = b.x / rms;
         By[i][0] = b.y / rms;
         Bz[i][0] = b.z / rms;
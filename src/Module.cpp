@@ -77,4 +77,34 @@ void AbstractCondition::setAcceptFlag(std::string key, std::string value) {
 	acceptFlagValue = value;
 }
 
+void BatchModule::processCandidates(const std::vector<Candidate*> &candidates) const {
+	// on the heap, views on the arrays (e.g. in Python) may keep it alive
+	ref_ptr<ParticleBatch> p = new ParticleBatch();
+	ParticleBatch &batch = *p;
+	batch.resize(candidates.size());
+	for (size_t i = 0; i < candidates.size(); i++) {
+		batch.set(i, candidates[i]->current);
+		batch.step[i] = candidates[i]->getCurrentStep();
+		batch.trajectoryLength[i] = candidates[i]->getTrajectoryLength();
+		batch.active[i] = candidates[i]->isActive();
+	}
+
+	processBatch(batch);
+
+	for (size_t i = 0; i < candidates.size(); i++) {
+		ParticleState &current = candidates[i]->current;
+		if (batch.id[i] != current.getId())
+			current.setId(batch.id[i]);
+		current.setEnergy(batch.energy[i]);
+		current.setPosition(Vector3d(batch.x[i], batch.y[i], batch.z[i]));
+		current.setDirection(Vector3d(batch.ux[i], batch.uy[i], batch.uz[i]));
+		if (not batch.active[i])
+			candidates[i]->setActive(false);
+	}
+}
+
+void BatchModule::process(Candidate *candidate) const {
+	processCandidates(std::vector<Candidate*>(1, candidate));
+}
+
 } // namespace crpropa
@@ -0,0 +1,156 @@
+#include "crpropa/ParticleBatch.h"
+#include "crpropa/Units.h"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace crpropa {
+
+ParticleBatch::ParticleBatch() : escapeRadius(0), views(0) {
+}
+
+void ParticleBatch::checkResizable() const {
+	if (views > 0)
+		throw std::runtime_error("ParticleBatch: cannot change the size while views on the arrays exist");
+}
+
+size_t ParticleBatch::add(const ParticleState &state, double s) {
+	if (s <= 0)
+		throw std::runtime_error("ParticleBatch: step must be positive");
+	checkResizable();
+	id.push_back(state.getId());
+	energy.push_back(state.getEnergy());
+	charge.push_back(state.getCharge());
+	Vector3d pos = state.getPosition();
+	Vector3d dir = state.getDirection();
+	x.push_back(pos.x);
+	y.push_back(pos.y);
+	z.push_back(pos.z);
+	ux.push_back(dir.x);
+	uy.push_back(dir.y);
+	uz.push_back(dir.z);
+	step.push_back(s);
+	trajectoryLength.push_back(0);
+	active.push_back(1);
+	return id.size() - 1;
+}
+
+ParticleState ParticleBatch::get(size_t i) const {
+	ParticleState state(id.at(i), energy[i], Vector3d(x[i], y[i], z[i]),
+			Vector3d(ux[i], uy[i], uz[i]));
+	return state;
+}
+
+void ParticleBatch::set(size_t i, const ParticleState &state) {
+	id.at(i) = state.getId();
+	energy[i] = state.getEnergy();
+	charge[i] = state.getCharge();
+	Vector3d pos = state.getPosition();
+	Vector3d dir = state.getDirection();
+	x[i] = pos.x;
+	y[i] = pos.y;
+	z[i] = pos.z;
+	ux[i] = dir.x;
+	uy[i] = dir.y;
+	uz[i] = dir.z;
+}
+
+size_t ParticleBatch::size() const {
+	return id.size();
+}
+
+size_t ParticleBatch::countActive() const {
+	size_t n = 0;
+	for (size_t i = 0; i < active.size(); i++)
+		n += active[i];
+	return n;
+}
+
+void ParticleBatch::reserve(size_t n) {
+	checkResizable();
+	id.reserve(n);
+	energy.reserve(n);
+	charge.reserve(n);
+	x.reserve(n);
+	y.reserve(n);
+	z.reserve(n);
+	ux.reserve(n);
+	uy.reserve(n);
+	uz.reserve(n);
+	step.reserve(n);
+	trajectoryLength.reserve(n);
+	active.reserve(n);
+}
+
+void ParticleBatch::resize(size_t n) {
+	checkResizable();
+	id.resize(n, 0);
+	energy.resize(n, 0);
+	charge.resize(n, 0);
+	x.resize(n, 0);
+	y.resize(n, 0);
+	z.resize(n, 0);
+	ux.resize(n, 0);
+	uy.resize(n, 0);
+	uz.resize(n, 0);
+	step.resize(n, 0);
+	trajectoryLength.resize(n, 0);
+	active.resize(n, 0);
+}
+
+void ParticleBatch::clear() {
+	checkResizable();
+	id.clear();
+	energy.clear();
+	charge.clear();
+	x.clear();
+	y.clear();
+	z.clear();
+	ux.clear();
+	uy.clear();
+	uz.clear();
+	step.clear();
+	trajectoryLength.clear();
+	active.clear();
+}
+
+void ParticleBatch::setRigidityScaledSteps(double s, double rigidity) {
+	if ((s <= 0) or (rigidity <= 0))
+		throw std::runtime_error("ParticleBatch: step and rigidity must be positive");
+	for (size_t i = 0; i < size(); i++) {
+		// neutral particles keep their step
+		if (charge[i] == 0)
+			continue;
+		// charge in [C], i.e. the rigidity E / |q| in [V]
+		step[i] = s * energy[i] / std::fabs(charge[i]) / rigidity;
+	}
+}
+
+void ParticleBatch::setEscapeSphere(const Vector3d &center, double radius) {
+	escapeCenter = center;
+	escapeRadius = radius;
+}
+
+Vector3d ParticleBatch::getEscapeCenter() const {
+	return escapeCenter;
+}
+
+double ParticleBatch::getEscapeRadius() const {
+	return escapeRadius;
+}
+
+void ParticleBatch::addView() {
+	views++;
+}
+
+void ParticleBatch::removeView() {
+	if (views == 0)
+		throw std::runtime_error("ParticleBatch: no view to remove");
+	views--;
+}
+
+size_t ParticleBatch::getViewCount() const {
+	return views;
+}
+
+} // namespace crpropa
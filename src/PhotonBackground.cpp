@@ -4,6 +4,7 @@
 
 #include "kiss/logger.h"
 
+#include <algorithm>
 #include <fstream>
 #include <stdexcept>
 #include <limits>
@@ -21,6 +22,7 @@ TabularPhotonField::TabularPhotonField(std::string fieldName, bool isRedshiftDep
 		readRedshift(getDataPath("") + "Scaling/" + this->fieldName + "_redshift.txt");
 
 	checkInputData();
+	initLookup();
 
 	if (this->isRedshiftDependent)
 		initRedshiftScaling();
@@ -30,19 +32,121 @@ TabularPhotonField::TabularPhotonField(std::string fieldName, bool isRedshiftDep
 double TabularPhotonField::getPhotonDensity(double Ephoton, double z) const {	
 	if ((this->isRedshiftDependent)) {
 		// fix behaviour for future redshift. See issue #414
-		// with redshift < 0 the photon density is set to 0 in interpolate2d. 
+		// with redshift < 0 the photon density would be 0.
 		// Therefore it is assumed that the photon density does not change from values at z = 0. This is only valid for small changes in redshift.
 		double zMin = this->redshifts[0];
 		if(z < zMin){
 			if(z < -1) {
-				KISS_LOG_WARNING << "Photon Field " << fieldName << " uses FutureRedshift with z < -1. The photon density is set to n(Ephoton, z=0). \n";
+				KISS_LOG_WARNING_LIMITED(10) << "Photon Field " << fieldName << " uses FutureRedshift with z < -1. The photon density is set to n(Ephoton, z=0).";
 			}
-			return getPhotonDensity(Ephoton, zMin);
-		} else {
-			return interpolate2d(Ephoton, z, this->photonEnergies, this->redshifts, this->photonDensity);
+			z = zMin;
 		}
+		if ((z > this->redshifts.back()) || (Ephoton < this->photonEnergies.front()) || (Ephoton > this->photonEnergies.back()))
+			return 0;
+		size_t j = findRedshiftBin(z);
+		double wz = (z - this->redshifts[j]) / (this->redshifts[j + 1] - this->redshifts[j]);
+		return interpolateDensity(Ephoton, j, wz);
 	} else {
-		return interpolate(Ephoton, this->photonEnergies, this->photonDensity);
+		// constant continuation outside of the tabulated energies
+		if (Ephoton <= this->photonEnergies.front())
+			return this->photonDensity.front();
+		if (Ephoton >= this->photonEnergies.back())
+			return this->photonDensity.back();
+		size_t i = findEnergyBin(Ephoton);
+		const double *e = &this->photonEnergies[i];
+		const double *n = &this->photonDensity[i];
+		return n[0] + (Ephoton - e[0]) * (n[1] - n[0]) / (e[1] - e[0]);
+	}
+}
+
+void TabularPhotonField::getPhotonDensities(const std::vector<double> &ePhotons,
+		std::vector<double> &densities, double z) const {
+	densities.resize(ePhotons.size());
+	if (!this->isRedshiftDependent || (z < this->redshifts[0])) {
+		for (size_t i = 0; i < ePhotons.size(); i++)
+			densities[i] = getPhotonDensity(ePhotons[i], z);
+		return;
+	}
+	if (z > this->redshifts.back()) {
+		std::fill(densities.begin(), densities.end(), 0.);
+		return;
+	}
+
+	// the redshift interval is the same for all energies
+	size_t j = findRedshiftBin(z);
+	double wz = (z - this->redshifts[j]) / (this->redshifts[j + 1] - this->redshifts[j]);
+	double eMin = this->photonEnergies.front();
+	double eMax = this->photonEnergies.back();
+	for (size_t i = 0; i < ePhotons.size(); i++) {
+		double e = ePhotons[i];
+		densities[i] = ((e < eMin) || (e > eMax)) ? 0. : interpolateDensity(e, j, wz);
+	}
+}
+
+size_t TabularPhotonField::findEnergyBin(double ePhoton) const {
+	long c = std::log(ePhoton) * energyLookupScale - energyLookupMin * energyLookupScale;
+	c = std::min(std::max(c, 0L), long(this->energyLookup.size()) - 1);
+	size_t i = this->energyLookup[c];
+	// correct for rounding at the cell edges
+	const size_t last = this->photonEnergies.size() - 2;
+	while ((i > 0) && (this->photonEnergies[i] > ePhoton))
+		i--;
+	while ((i < last) && (this->photonEnergies[i + 1] <= ePhoton))
+		i++;
+	return i;
+}
+
+size_t TabularPhotonField::findRedshiftBin(double z) const {
+	long c = z * redshiftLookupScale;
+	c = std::min(std::max(c, 0L), long(this->redshiftLookup.size()) - 1);
+	size_t j = this->redshiftLookup[c];
+	const size_t last = this->redshifts.size() - 2;
+	while ((j > 0) && (this->redshifts[j] > z))
+		j--;
+	while ((j < last) && (this->redshifts[j + 1] <= z))
+		j++;
+	return j;
+}
+
+double TabularPhotonField::interpolateDensity(double ePhoton, size_t j, double wz) const {
+	const size_t nZ = this->redshifts.size();
+	size_t i = findEnergyBin(ePhoton);
+	double wE = (ePhoton - this->photonEnergies[i]) / (this->photonEnergies[i + 1] - this->photonEnergies[i]);
+	// densities at the energies i and i + 1, linear in redshift
+	const double *n = &this->photonDensity[i * nZ + j];
+	double n0 = n[0] * (1 - wz) + n[1] * wz;
+	double n1 = n[nZ] * (1 - wz) + n[nZ + 1] * wz;
+	return n0 * (1 - wE) + n1 * wE;
+}
+
+void TabularPhotonField::initLookup() {
+	// a few lookup cells per tabulated interval, so that the interval of an
+	// energy (redshift) is found after a few comparisons
+	const size_t nE = this->photonEnergies.size();
+	size_t nCells = 4 * nE;
+	energyLookupMin = std::log(this->photonEnergies.front());
+	energyLookupScale = nCells / (std::log(this->photonEnergies.back()) - energyLookupMin);
+	energyLookup.resize(nCells + 1);
+	size_t i = 0;
+	for (size_t c = 0; c <= nCells; c++) {
+		double e = std::exp(energyLookupMin + c / energyLookupScale);
+		while ((i + 2 < nE) && (this->photonEnergies[i + 1] <= e))
+			i++;
+		energyLookup[c] = i;
+	}
+
+	if (!this->isRedshiftDependent)
+		return;
+	const size_t nZ = this->redshifts.size();
+	nCells = 4 * nZ;
+	redshiftLookupScale = nCells / this->redshifts.back();
+	redshiftLookup.resize(nCells + 1);
+	size_t j = 0;
+	for (size_t c = 0; c <= nCells; c++) {
+		double z = c / redshiftLookupScale;
+		while ((j + 2 < nZ) && (this->redshifts[j + 1] <= z))
+			j++;
+		redshiftLookup[c] = j;
 	}
 }
 
@@ -108,20 +212,20 @@ void TabularPhotonField::readRedshift(std::string filePath) {
 }
 
 void TabularPhotonField::initRedshiftScaling() {
-	double n0 = 0.;
-	for (int i = 0; i < this->redshifts.size(); ++i) {
-		double z = this->redshifts[i];
-		double n = 0.;
-		for (int j = 0; j < this->photonEnergies.size()-1; ++j) {
-			double e_j = this->photonEnergies[j];
-			double e_j1 = this->photonEnergies[j+1];
-			double deltaLogE = std::log10(e_j1) - std::log10(e_j);
-			if (z == 0.)
-				n0 += (getPhotonDensity(e_j, 0) + getPhotonDensity(e_j1, 0)) / 2. * deltaLogE;
-			n += (getPhotonDensity(e_j, z) + getPhotonDensity(e_j1, z)) / 2. * deltaLogE;
-		}
-		this->redshiftScalings.push_back(n / n0);
+	// integrate the spectrum in log(E) at each tabulated redshift, directly
+	// on the table nodes; the first redshift is z = 0
+	const size_t nZ = this->redshifts.size();
+	std::vector<double> n(nZ, 0.);
+	for (size_t j = 0; j + 1 < this->photonEnergies.size(); ++j) {
+		double deltaLogE = std::log10(this->photonEnergies[j+1]) - std::log10(this->photonEnergies[j]);
+		const double *n_j = &this->photonDensity[j * nZ];
+		const double *n_j1 = &this->photonDensity[(j + 1) * nZ];
+		for (size_t i = 0; i < nZ; ++i)
+			n[i] += (n_j[i] + n_j1[i]) / 2. * deltaLogE;
 	}
+	this->redshiftScalings.resize(nZ);
+	for (size_t i = 0; i < nZ; ++i)
+		this->redshiftScalings[i] = n[i] / n[0];
 }
 
 void TabularPhotonField::checkInputData() const {
@@ -133,8 +237,11 @@ void TabularPhotonField::checkInputData() const {
 			throw std::runtime_error("TabularPhotonField::checkInputData: length of photon energy input is unequal to length of photon density input");
 	}
 
+	if (this->photonEnergies.size() < 2)
+		throw std::runtime_error("TabularPhotonField::checkInputData: at least two photon energies are needed");
+
+	double ePrevious = 0.;
 	for (int i = 0; i < this->photonEnergies.size(); ++i) {
-		double ePrevious = 0.;
 		double e = this->photonEnergies[i];
 		if (e <= 0.)
 			throw std::runtime_error("TabularPhotonField::checkInputData: a value in the photon energy input is not positive");
@@ -149,11 +256,13 @@ void TabularPhotonField::checkInputData() const {
 	}
 
 	if (this->isRedshiftDependent) {
+		if (this->redshifts.size() < 2)
+			throw std::runtime_error("TabularPhotonField::checkInputData: at least two redshifts are needed");
 		if (this->redshifts[0] != 0.)
 			throw std::runtime_error("TabularPhotonField::checkInputData: redshift input must start with zero");
 
+		double zPrevious = -1.;
 		for (int i = 0; i < this->redshifts.size(); ++i) {
-			double zPrevious = -1.;
 			double z = this->redshifts[i];
 			if (z < 0.)
 				throw std::runtime_error("TabularPhotonField::checkInputData: a value in the redshift input is negative");
@@ -174,10 +283,21 @@ BlackbodyPhotonField::BlackbodyPhotonField(std::string fieldName, double blackbo
 	this->fieldName = fieldName;
 	this->blackbodyTemperature = blackbodyTemperature;
 	this->quantile = 0.0001; // tested to be sufficient, only used for extreme values of primary energy or temperature
+	this->densityFactor = 8 * M_PI / pow_integer<3>(h_planck * c_light);
+	this->inverseThermalEnergy = 1. / (k_boltzmann * blackbodyTemperature);
 }
 
 double BlackbodyPhotonField::getPhotonDensity(double Ephoton, double z) const {
-	return 8 * M_PI * pow_integer<3>(Ephoton / (h_planck * c_light)) / std::expm1(Ephoton / (k_boltzmann * this->blackbodyTemperature));
+	return densityFactor * pow_integer<3>(Ephoton) / std::expm1(Ephoton * inverseThermalEnergy);
+}
+
+void BlackbodyPhotonField::getPhotonDensities(const std::vector<double> &ePhotons,
+		std::vector<double> &densities, double z) const {
+	densities.resize(ePhotons.size());
+	const double *e = ePhotons.data();
+	double *n = densities.data();
+	for (size_t i = 0; i < ePhotons.size(); i++)
+		n[i] = densityFactor * pow_integer<3>(e[i]) / std::expm1(e[i] * inverseThermalEnergy);
 }
 
 double BlackbodyPhotonField::getMinimumPhotonEnergy(double z) const {
@@ -0,0 +1,130 @@
+#include "crpropa/PopulationControl.h"
+#include "crpropa/Random.h"
+#include "crpropa/Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace crpropa {
+
+PopulationControl::Rule::Rule(int id) : id(id), eThin(0), alpha(1), eMin(0),
+		survivalProbability(1), eSplit(std::numeric_limits<double>::max()), nSplit(1) {
+}
+
+PopulationControl::PopulationControl() : maxWeight(0) {
+}
+
+PopulationControl::Rule &PopulationControl::rule(int id) {
+	for (size_t i = 0; i < rules.size(); i++)
+		if (rules[i].id == id)
+			return rules[i];
+	rules.push_back(Rule(id));
+	return rules.back();
+}
+
+void PopulationControl::setThinning(int id, double eThin, double alpha) {
+	if (alpha < 0)
+		throw std::runtime_error("PopulationControl: thinning exponent must be positive");
+	Rule &r = rule(id);
+	r.eThin = eThin;
+	r.alpha = alpha;
+}
+
+void PopulationControl::setRussianRoulette(int id, double eMin, double survivalProbability) {
+	if ((survivalProbability <= 0) or (survivalProbability > 1))
+		throw std::runtime_error("PopulationControl: survival probability must be in (0, 1]");
+	Rule &r = rule(id);
+	r.eMin = eMin;
+	r.survivalProbability = survivalProbability;
+}
+
+void PopulationControl::setSplitting(int id, double eSplit, size_t n) {
+	if (n < 1)
+		throw std::runtime_error("PopulationControl: number of copies must be at least 1");
+	Rule &r = rule(id);
+	r.eSplit = eSplit;
+	r.nSplit = n;
+}
+
+void PopulationControl::setMaximumWeight(double w) {
+	maxWeight = w;
+}
+
+double PopulationControl::getMaximumWeight() const {
+	return maxWeight;
+}
+
+void PopulationControl::clear() {
+	rules.clear();
+}
+
+const std::vector<PopulationControl::Rule> &PopulationControl::getRules() const {
+	return rules;
+}
+
+size_t PopulationControl::sample(int id, double energy, double &weight) const {
+	// rule of the species, otherwise the rule for all species
+	const Rule *r = NULL;
+	for (size_t i = 0; i < rules.size(); i++) {
+		if (rules[i].id == id) {
+			r = &rules[i];
+			break;
+		}
+		if (rules[i].id == 0)
+			r = &rules[i];
+	}
+
+	// survival probability
+	double p = 1;
+	if (r != NULL) {
+		if (energy < r->eThin)
+			p = pow(energy / r->eThin, r->alpha);
+		if (energy < r->eMin)
+			p *= r->survivalProbability;
+	}
+	if (maxWeight > 0)
+		p = std::max(p, weight / maxWeight);
+
+	if (p < 1) {
+		if (Random::instance().rand() >= p)
+			return 0;
+		weight /= p;
+	}
+
+	// splitting
+	size_t n = 1;
+	if ((r != NULL) and (energy > r->eSplit) and (r->nSplit > 1))
+		n = r->nSplit;
+	weight /= n;
+
+	// heavier secondaries are split further into copies within the maximum weight
+	if ((maxWeight > 0) and (weight > maxWeight)) {
+		size_t m = std::ceil(weight / maxWeight);
+		n *= m;
+		weight /= m;
+	}
+	return n;
+}
+
+std::string PopulationControl::getDescription() const {
+	std::stringstream ss;
+	ss << "PopulationControl";
+	if (maxWeight > 0)
+		ss << ", maximum weight " << maxWeight;
+	for (size_t i = 0; i < rules.size(); i++) {
+		const Rule &r = rules[i];
+		ss << "\n  id " << r.id << ":";
+		if (r.eThin > 0)
+			ss << " thinning below " << r.eThin / eV << " eV (alpha = " << r.alpha << ")";
+		if (r.eMin > 0)
+			ss << " roulette below " << r.eMin / eV << " eV (p = " << r.survivalProbability << ")";
+		if (r.nSplit > 1)
+			ss << " splitting above " << r.eSplit / eV << " eV (n = " << r.nSplit << ")";
+	}
+	return ss.str();
+}
+
+} // namespace crpropa
@@ -0,0 +1,237 @@
+#include "crpropa/SharedMemory.h"
+
+#include "kiss/logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace crpropa {
+
+namespace {
+
+const char segmentMagic[8] = "CRPSHM1";
+
+enum SegmentState {
+	SEGMENT_INIT = 0, SEGMENT_READY = 1, SEGMENT_FAILED = 2
+};
+
+// header in front of the data, 64 bytes to keep the data aligned
+struct SegmentHeader {
+	char magic[8];
+	std::atomic<uint32_t> state;
+	uint32_t reserved;
+	uint64_t size;
+	uint64_t key; // hash of the content key
+	char padding[32];
+};
+
+static_assert(sizeof(SegmentHeader) == 64, "SegmentHeader has to be 64 bytes");
+
+SegmentHeader *header(void *map) {
+	return static_cast<SegmentHeader *>(map);
+}
+
+// FNV-1a, identical in all processes (unlike std::hash)
+uint64_t keyHash(const std::string &key) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < key.size(); i++) {
+		hash ^= (unsigned char) key[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+std::string errnoString() {
+	return std::string(strerror(errno));
+}
+
+} // namespace
+
+SharedMemorySegment::SharedMemorySegment(const std::string &name) :
+		name(name), map(NULL), mapSize(0), size(0), creator(false) {
+}
+
+SharedMemorySegment::~SharedMemorySegment() {
+	if (map)
+		munmap(map, mapSize);
+}
+
+std::string SharedMemorySegment::systemName(const std::string &name) {
+	if (name.empty() || name.find('/') != std::string::npos)
+		throw std::runtime_error("SharedMemorySegment: invalid name '" + name + "'");
+	return "/crpropa." + name;
+}
+
+void SharedMemorySegment::mapFile(int fd, bool writable) {
+	int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void *m = mmap(NULL, mapSize, prot, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED)
+		throw std::runtime_error("SharedMemorySegment: cannot map '" + name + "': " + errnoString());
+	map = m;
+}
+
+ref_ptr<SharedMemorySegment> SharedMemorySegment::attach(const std::string &name,
+		size_t size, Initializer init, double timeout, const std::string &key) {
+	std::string sname = systemName(name);
+	uint64_t hash = keyHash(key);
+	ref_ptr<SharedMemorySegment> segment = new SharedMemorySegment(name);
+	segment->size = size;
+	segment->mapSize = sizeof(SegmentHeader) + size;
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+			+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>(timeout));
+
+	while (true) {
+		// try to create the segment, exactly one process succeeds
+		int fd = shm_open(sname.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd >= 0) {
+			segment->creator = true;
+			if (ftruncate(fd, segment->mapSize) != 0) {
+				std::string error = errnoString();
+				close(fd);
+				shm_unlink(sname.c_str());
+				throw std::runtime_error("SharedMemorySegment: cannot allocate '" + name + "': " + error);
+			}
+			try {
+				segment->mapFile(fd, true);
+			} catch (...) {
+				close(fd);
+				shm_unlink(sname.c_str());
+				throw;
+			}
+			close(fd);
+
+			SegmentHeader *h = header(segment->map);
+			memcpy(h->magic, segmentMagic, sizeof(segmentMagic));
+			h->size = size;
+			h->key = hash;
+			try {
+				init(static_cast<char *>(segment->map) + sizeof(SegmentHeader), size);
+			} catch (...) {
+				h->state.store(SEGMENT_FAILED, std::memory_order_release);
+				shm_unlink(sname.c_str());
+				throw;
+			}
+			h->state.store(SEGMENT_READY, std::memory_order_release);
+			// protect the content against accidental modification
+			mprotect(segment->map, segment->mapSize, PROT_READ);
+			KISS_LOG_INFO << "SharedMemorySegment: created '" << name << "' (" << size << " bytes)";
+			return segment;
+		}
+		if (errno != EEXIST)
+			throw std::runtime_error("SharedMemorySegment: cannot create '" + name + "': " + errnoString());
+
+		// another process created the segment, wait until it is filled
+		fd = shm_open(sname.c_str(), O_RDONLY, 0);
+		if (fd < 0) {
+			if (errno == ENOENT)
+				continue; // removed in the meantime (e.g. failed), try to create it
+			throw std::runtime_error("SharedMemorySegment: cannot open '" + name + "': " + errnoString());
+		}
+		bool ready = false;
+		while (!ready) {
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				std::string error = errnoString();
+				close(fd);
+				throw std::runtime_error("SharedMemorySegment: cannot stat '" + name + "': " + error);
+			}
+			if (st.st_size > 0) {
+				if ((size_t) st.st_size != segment->mapSize) {
+					close(fd);
+					throw std::runtime_error("SharedMemorySegment: '" + name + "' exists with a different size");
+				}
+				if (!segment->map) {
+					try {
+						segment->mapFile(fd, false);
+					} catch (...) {
+						close(fd);
+						throw;
+					}
+				}
+				uint32_t state = header(segment->map)->state.load(std::memory_order_acquire);
+				if (state == SEGMENT_FAILED) {
+					close(fd);
+					throw std::runtime_error("SharedMemorySegment: creation of '" + name + "' failed in another process");
+				}
+				ready = (state == SEGMENT_READY);
+			}
+			if (!ready) {
+				if (std::chrono::steady_clock::now() > deadline) {
+					close(fd);
+					throw std::runtime_error("SharedMemorySegment: timeout waiting for '" + name
+							+ "', remove it if the creating process was aborted");
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+		close(fd);
+		if (memcmp(header(segment->map)->magic, segmentMagic, sizeof(segmentMagic)) != 0
+				|| header(segment->map)->size != size)
+			throw std::runtime_error("SharedMemorySegment: '" + name + "' is not a valid segment");
+		if (header(segment->map)->key != hash)
+			throw std::runtime_error("SharedMemorySegment: '" + name
+					+ "' exists with a different content key, remove it if it is outdated");
+		return segment;
+	}
+}
+
+ref_ptr<SharedMemorySegment> SharedMemorySegment::find(const std::string &name) {
+	std::string sname = systemName(name);
+	int fd = shm_open(sname.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SegmentHeader)) {
+		close(fd);
+		return NULL;
+	}
+	ref_ptr<SharedMemorySegment> segment = new SharedMemorySegment(name);
+	segment->mapSize = st.st_size;
+	try {
+		segment->mapFile(fd, false);
+	} catch (...) {
+		close(fd);
+		throw;
+	}
+	close(fd);
+	SegmentHeader *h = header(segment->map);
+	if (h->state.load(std::memory_order_acquire) != SEGMENT_READY
+			|| memcmp(h->magic, segmentMagic, sizeof(segmentMagic)) != 0
+			|| h->size + sizeof(SegmentHeader) != segment->mapSize)
+		return NULL;
+	segment->size = h->size;
+	return segment;
+}
+
+bool SharedMemorySegment::remove(const std::string &name) {
+	return shm_unlink(systemName(name).c_str()) == 0;
+}
+
+const void *SharedMemorySegment::getData() const {
+	return static_cast<const char *>(map) + sizeof(SegmentHeader);
+}
+
+size_t SharedMemorySegment::getSize() const {
+	return size;
+}
+
+std::string SharedMemorySegment::getName() const {
+	return name;
+}
+
+bool SharedMemorySegment::isCreator() const {
+	return creator;
+}
+
+} // namespace crpropa
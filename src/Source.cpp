@@ -1118,6 +1118,20 @@ void SourceTag::setTag(std::string tag) {
 
 // ----------------------------------------------------------------------------
 
+SourcePopulationControl::SourcePopulationControl(ref_ptr<PopulationControl> control) : control(control) {
+	setDescription();
+}
+
+void SourcePopulationControl::prepareCandidate(Candidate &candidate) const {
+	candidate.setPopulationControl(control);
+}
+
+void SourcePopulationControl::setDescription() {
+	description = "SourcePopulationControl: " + control->getDescription();
+}
+
+// ----------------------------------------------------------------------------
+
 SourceMassDistribution::SourceMassDistribution(ref_ptr<Density> density, double max, double x, double y, double z) : 
 	density(density), maxDensity(max), xMin(-x), xMax(x), yMin(-y), yMax(y), zMin(-z), zMax(z) {}
 
@@ -340,6 +340,14 @@ Vector3d JF12Field::getTurbulentField(const Vector3d& pos) const {
 	return (turbulentGrid->interpolate(pos) * getTurbulentStrength(pos));
 }
 
+bool JF12Field::tryGetField(const Vector3d& pos, double z, Vector3d &field) const {
+	if (!isFinite(pos)) {
+		field = Vector3d(0.);
+		return false;
+	}
+	return MagneticField::tryGetField(pos, z, field);
+}
+
 Vector3d JF12Field::getField(const Vector3d& pos) const {
 	Vector3d b(0.);
 	if (useTurbulentField)
@@ -1,7 +1,23 @@
 #include "crpropa/magneticField/MagneticField.h"
 
+#include "kiss/logger.h"
+
 namespace crpropa {
 
+bool MagneticField::tryGetField(const Vector3d &position, double z,
+		Vector3d &field) const {
+	try {
+		field = getField(position, z);
+		return true;
+	} catch (std::exception &e) {
+		std::string what = e.what();
+		KISS_LOG_ERROR_LIMITED(100) << "MagneticField: Exception in getField.\n"
+				<< what;
+	}
+	field = Vector3d(0.);
+	return false;
+}
+
 PeriodicMagneticField::PeriodicMagneticField(ref_ptr<MagneticField> field,
 		const Vector3d &extends) :
 		field(field), extends(extends), origin(0, 0, 0), reflective(false) {
@@ -68,6 +84,18 @@ Vector3d MagneticFieldList::getField(const Vector3d &position) const {
 	return b;
 }
 
+bool MagneticFieldList::tryGetField(const Vector3d &position, double z,
+		Vector3d &field) const {
+	field = Vector3d(0.);
+	bool valid = true;
+	Vector3d b;
+	for (size_t i = 0; i < fields.size(); i++) {
+		valid &= fields[i]->tryGetField(position, z, b);
+		field += b;
+	}
+	return valid;
+}
+
 MagneticFieldEvolution::MagneticFieldEvolution(ref_ptr<MagneticField> field,
 	double m) :
 	field(field), m(m) {
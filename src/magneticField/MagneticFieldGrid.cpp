@@ -18,6 +18,17 @@ Vector3d MagneticFieldGrid::getField(const Vector3d &pos) const {
 	return grid->interpolate(pos);
 }
 
+bool MagneticFieldGrid::tryGetField(const Vector3d &pos, double z,
+		Vector3d &field) const {
+	// the grid rejects interpolation types it does not support
+	if (!isFinite(pos)) {
+		field = Vector3d(0.);
+		return false;
+	}
+	// through getField, which subclasses may override
+	return MagneticField::tryGetField(pos, z, field);
+}
+
 ModulatedMagneticFieldGrid::ModulatedMagneticFieldGrid(ref_ptr<Grid3f> grid,
 		ref_ptr<Grid1f> modGrid) {
 	grid->setReflective(false);
@@ -227,6 +227,15 @@ PlaneWaveTurbulence::PlaneWaveTurbulence(const TurbulenceSpectrum &spectrum,
 #endif // ENABLE_FAST_WAVES
 }
 
+bool PlaneWaveTurbulence::tryGetField(const Vector3d &pos, double z,
+		Vector3d &field) const {
+	if (!isFinite(pos)) {
+		field = Vector3d(0.);
+		return false;
+	}
+	return MagneticField::tryGetField(pos, z, field);
+}
+
 Vector3d PlaneWaveTurbulence::getField(const Vector3d &pos) const {
 
 #ifndef ENABLE_FAST_WAVES
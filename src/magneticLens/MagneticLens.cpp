@@ -31,6 +31,201 @@
 namespace crpropa 
 {
 
+void LensPartCache::use(LensPart *part)
+{
+	if (!_parts.empty() && _parts.front() == part)
+		return;
+	_parts.remove(part);
+	_parts.push_front(part);
+}
+
+void LensPartCache::loaded(LensPart *part, size_t bytes)
+{
+	_parts.push_front(part);
+	_usage += bytes;
+}
+
+void LensPartCache::unloaded(LensPart *part, size_t bytes)
+{
+	_parts.remove(part);
+	_usage -= std::min(bytes, _usage);
+}
+
+void LensPartCache::shrink(const LensPart *keep)
+{
+	if (_budget == 0)
+		return;
+	std::list<LensPart*>::reverse_iterator i = _parts.rbegin();
+	while (_usage > _budget && i != _parts.rend())
+	{
+		LensPart *part = *i;
+		++i;
+		if (part != keep && part->_users == 0)
+			part->_unload();
+	}
+}
+
+LensPart::~LensPart()
+{
+	if (_cache && _fromFile && _loaded)
+	{
+#pragma omp critical(crpropa_lenspart)
+		_cache->unloaded(this, getMemoryUsage());
+	}
+}
+
+void LensPart::_load()
+{
+	deserialize(_filename, M);
+	if (_columnsNormalized)
+		crpropa::normalizeColumns(M);
+	if (_norm != 1)
+		normalizeMatrix(M, _norm);
+	_loaded = true;
+
+	if (_cache)
+	{
+		_cache->loaded(this, getMemoryUsage());
+		_cache->shrink(this);
+	}
+}
+
+void LensPart::_unload()
+{
+	if (!_fromFile || !_loaded)
+		return;
+	if (_cache)
+		_cache->unloaded(this, getMemoryUsage());
+	ModelMatrixType empty;
+	M.swap(empty);
+	_loaded = false;
+}
+
+void LensPart::loadMatrixFromFile()
+{
+	getMatrix();
+}
+
+void LensPart::unloadMatrix()
+{
+#pragma omp critical(crpropa_lenspart)
+	{
+		if (_users == 0)
+			_unload();
+	}
+}
+
+size_t LensPart::getMemoryUsage() const
+{
+	if (!_loaded)
+		return 0;
+	return M.nonZeros() * (sizeof(ModelMatrixType::Scalar) + sizeof(ModelMatrixType::StorageIndex))
+			+ (M.cols() + 1) * sizeof(ModelMatrixType::StorageIndex);
+}
+
+double LensPart::getMaximumOfSumsOfColumns()
+{
+	if (!_maximumSumOfColumns_calculated)
+	{ // lazy calculation of maximum
+		LensPartMatrix matrix(this);
+		_maximumSumOfColumns = maximumOfSumsOfColumns(matrix.get());
+		_maximumSumOfColumns_calculated = true;
+	}
+	return _maximumSumOfColumns;
+}
+
+ModelMatrixType& LensPart::getMatrix()
+{
+	// exceptions must not leave the critical section
+	std::string error;
+#pragma omp critical(crpropa_lenspart)
+	{
+		try
+		{
+			if (!_loaded)
+				_load();
+			else if (_cache && _fromFile)
+				_cache->use(this);
+		}
+		catch (std::exception &e)
+		{
+			error = e.what();
+		}
+	}
+	if (!error.empty())
+		throw std::runtime_error(error);
+	return M;
+}
+
+ModelMatrixType& LensPart::acquireMatrix()
+{
+	std::string error;
+#pragma omp critical(crpropa_lenspart)
+	{
+		try
+		{
+			if (!_loaded)
+				_load();
+			else if (_cache && _fromFile)
+				_cache->use(this);
+			_users++;
+		}
+		catch (std::exception &e)
+		{
+			error = e.what();
+		}
+	}
+	if (!error.empty())
+		throw std::runtime_error(error);
+	return M;
+}
+
+void LensPart::releaseMatrix()
+{
+#pragma omp critical(crpropa_lenspart)
+	{
+		if (_users > 0)
+			_users--;
+		if (_users == 0 && _cache)
+			_cache->shrink(NULL);
+	}
+}
+
+void LensPart::setMatrix(const ModelMatrixType& m)
+{
+#pragma omp critical(crpropa_lenspart)
+	{
+		_unload();
+		_fromFile = false;
+		_loaded = true;
+		M = m;
+		_maximumSumOfColumns_calculated = false;
+	}
+}
+
+void LensPart::normalizeColumns()
+{
+#pragma omp critical(crpropa_lenspart)
+	{
+		if (_loaded)
+			crpropa::normalizeColumns(M);
+		_columnsNormalized = true;
+		_norm = 1;
+		_maximumSumOfColumns_calculated = false;
+	}
+}
+
+void LensPart::normalize(double norm)
+{
+#pragma omp critical(crpropa_lenspart)
+	{
+		if (_loaded)
+			normalizeMatrix(M, norm);
+		_norm *= norm;
+		_maximumSumOfColumns /= norm;
+	}
+}
+
 void MagneticLens::loadLens(const string &filename)
 {
 	ifstream infile(filename.c_str());
@@ -85,7 +280,11 @@ bool MagneticLens::transformCosmicRay(double rigidity, double& phi,
 		return false;
 	}
 
-	ModelVectorType v = lenspart->getMatrix().col(c);
+	ModelVectorType v;
+	{
+		LensPartMatrix matrix(lenspart);
+		v = matrix.get().col(c);
+	}
 
 	uint32_t r;
 
@@ -128,33 +327,41 @@ void MagneticLens::loadLensPart(const string &filename, double rigidityMin,
 {
 	updateRigidityBounds(rigidityMin, rigidityMax);
 
-	LensPart *p = new LensPart(filename, rigidityMin, rigidityMax);
-	p->loadMatrixFromFile();
-	_checkMatrix(p->getMatrix());
+	// only the size is checked, the matrix is loaded on first use
+	uint32_t rows, cols;
+	deserializeSize(filename, rows, cols);
+	_checkMatrixSize(rows, cols);
 
+	LensPart *p = new LensPart(filename, rigidityMin, rigidityMax);
+	p->setCache(&_cache);
 	_lensParts.push_back(p);
 }
 
 void MagneticLens::_checkMatrix(const ModelMatrixType &M)
 {
-	if (M.rows() != M.cols())
+	_checkMatrixSize(M.rows(), M.cols());
+}
+
+void MagneticLens::_checkMatrixSize(size_t rows, size_t cols)
+{
+	if (rows != cols)
 	{
 		throw std::runtime_error("Not a square Matrix!");
 	}
 
 	if (_pixelization)
 	{
-		if (_pixelization->nPix() != M.cols())
+		if (_pixelization->nPix() != cols)
 		{
 			std::cerr << "*** ERROR ***" << endl;
 			std::cerr << "  Pixelization: " << _pixelization->nPix() << endl;
-			std::cerr << "  Matrix Size : " << M.cols() << endl;
+			std::cerr << "  Matrix Size : " << cols << endl;
 			throw std::runtime_error("Matrix doesn't fit into Lense");
 		}
 	}
 	else
 	{
-		uint32_t morder = Pixelization::pix2Order(M.cols());
+		uint32_t morder = Pixelization::pix2Order(cols);
 		if (morder == 0)
 		{
 			throw std::runtime_error(
@@ -208,6 +415,25 @@ LensPart* MagneticLens::getLensPart(double rigidity) const
 	return NULL;
 }
 
+void MagneticLens::setMemoryBudget(size_t bytes)
+{
+#pragma omp critical(crpropa_lenspart)
+	{
+		_cache.setBudget(bytes);
+		_cache.shrink(NULL);
+	}
+}
+
+size_t MagneticLens::getMemoryBudget() const
+{
+	return _cache.getBudget();
+}
+
+size_t MagneticLens::getMemoryUsage() const
+{
+	return _cache.getUsage();
+}
+
 bool MagneticLens::rigidityCovered(double rigidity) const
 {
 	if (getLensPart(rigidity))
@@ -222,7 +448,7 @@ void MagneticLens::normalizeMatrixColumns()
 	for (LensPartIter iter = _lensParts.begin(); iter != _lensParts.end();
 			++iter)
 	{
-		normalizeColumns((*iter)->getMatrix());
+		(*iter)->normalizeColumns();
 	}
 }
 
@@ -242,7 +468,7 @@ void MagneticLens::normalizeLens()
 	for (LensPartIter iter = _lensParts.begin(); iter != _lensParts.end();
 			++iter)
 	{
-		normalizeMatrix((*iter)->getMatrix(), norm);
+		(*iter)->normalize(norm);
 	}
   _norm = norm;
 }
@@ -253,7 +479,7 @@ void MagneticLens::normalizeLensparts()
 			++iter)
 	{
 		double norm = (*iter)->getMaximumOfSumsOfColumns();
-		normalizeMatrix((*iter)->getMatrix(), norm);
+		(*iter)->normalize(norm);
 	}
 }
 
@@ -267,8 +493,24 @@ void MagneticLens::transformModelVector(double* model, double rigidity) const
 		return;
 	}
 
-	prod_up(lenspart->getMatrix(), model);
+	LensPartMatrix matrix(lenspart);
+	prod_up(matrix.get(), model);
+
+}
+
+void MagneticLens::transformModelVectors(double* const* models, size_t nModels,
+		double rigidity, std::vector<double> &buffer) const
+{
+	LensPart* lenspart = getLensPart(rigidity);
+
+	if (!lenspart)
+	{
+		std::cerr << "Warning. Trying to transform vector with rigidity " << rigidity / eV << "eV which is not covered by this lens!.\n" << std::endl;
+		return;
+	}
 
+	LensPartMatrix matrix(lenspart);
+	prod_up(matrix.get(), models, nModels, buffer);
 }
 
 
@@ -22,11 +22,166 @@
 
 #include "crpropa/magneticLens/ModelMatrix.h"
 #include <ctime>
+#include <cstring>
+#include <algorithm>
+#include <limits>
 
 #include <Eigen/Core>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace crpropa 
 {
 
+static const char compressedMagic[8] = {'C', 'R', 'P', 'L', 'E', 'N', 'S', 0};
+static const uint16_t compressedVersion = 1;
+/// Maximum number of vectors multiplied at once in prod_up
+static const size_t prodBatchSize = 32;
+
+struct CompressedHeader
+{
+	char magic[8];
+	uint16_t version;
+	uint16_t valueSize;
+	uint32_t size1;
+	uint32_t size2;
+	uint32_t reserved;
+	uint64_t nnz;
+};
+
+static bool isCompressed(const string &filename)
+{
+	ifstream infile(filename.c_str(), ios::binary);
+	char magic[8];
+	infile.read(magic, sizeof(magic));
+	return infile && (memcmp(magic, compressedMagic, sizeof(magic)) == 0);
+}
+
+void serializeCompressed(const string &filename, const ModelMatrixType &m,
+		bool singlePrecision)
+{
+	ofstream outfile(filename.c_str(), ios::binary);
+	if (!outfile)
+	{
+		throw runtime_error("Can't write file: " + filename);
+	}
+
+	ModelMatrixType matrix(m);
+	matrix.makeCompressed();
+
+	CompressedHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, compressedMagic, sizeof(compressedMagic));
+	header.version = compressedVersion;
+	header.valueSize = singlePrecision ? sizeof(float) : sizeof(double);
+	header.size1 = matrix.rows();
+	header.size2 = matrix.cols();
+	header.nnz = matrix.nonZeros();
+	outfile.write((char*) &header, sizeof(header));
+
+	for (size_t i = 0; i <= (size_t) matrix.cols(); i++)
+	{
+		uint64_t offset = matrix.outerIndexPtr()[i];
+		outfile.write((char*) &offset, sizeof(uint64_t));
+	}
+	for (size_t i = 0; i < header.nnz; i++)
+	{
+		uint32_t row = matrix.innerIndexPtr()[i];
+		outfile.write((char*) &row, sizeof(uint32_t));
+	}
+	if (header.nnz % 2)
+	{
+		uint32_t padding = 0;
+		outfile.write((char*) &padding, sizeof(uint32_t));
+	}
+	for (size_t i = 0; i < header.nnz; i++)
+	{
+		if (singlePrecision)
+		{
+			float val = matrix.valuePtr()[i];
+			outfile.write((char*) &val, sizeof(float));
+		}
+		else
+		{
+			outfile.write((char*) &matrix.valuePtr()[i], sizeof(double));
+		}
+	}
+
+	if (outfile.fail())
+	{
+		throw runtime_error("Error writing file: " + filename);
+	}
+	outfile.close();
+}
+
+
+static void deserializeCompressed(const string &filename, ModelMatrixType& matrix)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw runtime_error("Can't read file: " + filename);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CompressedHeader))
+	{
+		::close(fd);
+		throw runtime_error("Invalid lens file: " + filename);
+	}
+	size_t mapSize = st.st_size;
+	void *map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+		throw runtime_error("Can't map file: " + filename);
+	}
+
+	const char *data = static_cast<const char*>(map);
+	CompressedHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	size_t offsetsSize = (header.size2 + 1) * sizeof(uint64_t);
+	size_t rowsSize = (header.nnz + header.nnz % 2) * sizeof(uint32_t);
+	size_t valuesSize = header.nnz * header.valueSize;
+	if (header.version != compressedVersion
+			|| (header.valueSize != sizeof(float) && header.valueSize != sizeof(double))
+			|| header.nnz > (uint64_t) std::numeric_limits<ModelMatrixType::StorageIndex>::max()
+			|| mapSize < sizeof(header) + offsetsSize + rowsSize + valuesSize)
+	{
+		munmap(map, mapSize);
+		throw runtime_error("Invalid lens file: " + filename);
+	}
+	madvise(map, mapSize, MADV_SEQUENTIAL);
+
+	const uint64_t *offsets = (const uint64_t*) (data + sizeof(header));
+	const uint32_t *rows = (const uint32_t*) (data + sizeof(header) + offsetsSize);
+	const char *values = data + sizeof(header) + offsetsSize + rowsSize;
+
+	matrix.resize(header.size1, header.size2);
+	matrix.makeCompressed();
+	matrix.resizeNonZeros(header.nnz);
+	for (size_t i = 0; i <= header.size2; i++)
+		matrix.outerIndexPtr()[i] = offsets[i];
+	for (size_t i = 0; i < header.nnz; i++)
+		matrix.innerIndexPtr()[i] = rows[i];
+	if (header.valueSize == sizeof(double))
+	{
+		memcpy(matrix.valuePtr(), values, valuesSize);
+	}
+	else
+	{
+		const float *v = (const float*) values;
+		for (size_t i = 0; i < header.nnz; i++)
+			matrix.valuePtr()[i] = v[i];
+	}
+
+	munmap(map, mapSize);
+}
+
+
 void serialize(const string &filename, const ModelMatrixType& matrix)
 {
 	ofstream outfile(filename.c_str(), ios::binary);
@@ -72,6 +227,12 @@ void serialize(const string &filename, const ModelMatrixType& matrix)
 
 void deserialize(const string &filename, ModelMatrixType& matrix)
 {
+	if (isCompressed(filename))
+	{
+		deserializeCompressed(filename, matrix);
+		return;
+	}
+
 	ifstream infile(filename.c_str(), ios::binary);
 	if (!infile)
 	{
@@ -102,6 +263,35 @@ void deserialize(const string &filename, ModelMatrixType& matrix)
 }
 
 
+void deserializeSize(const string &filename, uint32_t &size1, uint32_t &size2)
+{
+	ifstream infile(filename.c_str(), ios::binary);
+	if (!infile)
+	{
+		throw runtime_error("Can't read file: " + filename);
+	}
+
+	if (isCompressed(filename))
+	{
+		CompressedHeader header;
+		infile.read((char*) &header, sizeof(header));
+		size1 = header.size1;
+		size2 = header.size2;
+	}
+	else
+	{
+		uint32_t nnz;
+		infile.read((char*) &nnz, sizeof(uint32_t));
+		infile.read((char*) &size1, sizeof(uint32_t));
+		infile.read((char*) &size2, sizeof(uint32_t));
+	}
+	if (!infile)
+	{
+		throw runtime_error("Invalid lens file: " + filename);
+	}
+}
+
+
 double norm_1(const ModelVectorType &v)
 {
 	return v.cwiseAbs().sum();
@@ -137,24 +327,39 @@ double maximumOfSumsOfColumns(const ModelMatrixType &matrix)
 
 	void prod_up(const ModelMatrixType& matrix, double* model)
 {
+	// reused by the following calls of the thread
+	static thread_local std::vector<double> buffer;
+	prod_up(matrix, &model, 1, buffer);
+}
 
-	// copy storage of model, as matrix vector product cannot be done
-	// in place
-	
-	const size_t mSize = matrix.cols();
-	double *origVectorStorage = new double[mSize];
-	memcpy(origVectorStorage, model, mSize * sizeof(double));
 
+void prod_up(const ModelMatrixType& matrix, double* const* models,
+		size_t nModels, std::vector<double> &buffer)
+{
+	typedef Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic> > DenseMap;
 
+	// the product cannot be done in place, so the vectors are copied into
+	// the columns of a dense matrix followed by the result matrix
+	const size_t mSize = matrix.cols();
+	const size_t nBatch = std::min(nModels, prodBatchSize);
+	if (buffer.size() < 2 * mSize * nBatch)
+		buffer.resize(2 * mSize * nBatch);
 
-	Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 1> > origVectorAdaptor(origVectorStorage, mSize);
-	Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 1> > modelVectorAdaptor(model, mSize);
+	for (size_t first = 0; first < nModels; first += nBatch)
+	{
+		const size_t n = std::min(nBatch, nModels - first);
+		for (size_t i = 0; i < n; i++)
+			memcpy(&buffer[i * mSize], models[first + i], mSize * sizeof(double));
 
-	// perform the optimized product
-	modelVectorAdaptor = matrix * origVectorAdaptor;
+		DenseMap origAdaptor(&buffer[0], mSize, n);
+		DenseMap resultAdaptor(&buffer[mSize * nBatch], mSize, n);
 
-	// clean up
-	delete[] origVectorStorage;
+		// perform the optimized product
+		resultAdaptor.noalias() = matrix * origAdaptor;
+
+		for (size_t i = 0; i < n; i++)
+			memcpy(models[first + i], &buffer[mSize * (nBatch + i)], mSize * sizeof(double));
+	}
 }
 
 
@@ -5,17 +5,13 @@
 
 #include <iostream>
 #include <fstream>
+#include <limits>
 
 namespace crpropa  {
 
 ParticleMapsContainer::~ParticleMapsContainer() {
-	for(std::map<int, std::map<int, double*> >::iterator pid_iter = _data.begin(); 
-			pid_iter != _data.end(); ++pid_iter) {
-		for(std::map<int, double*>::iterator energy_iter = pid_iter->second.begin();
-			energy_iter != pid_iter->second.end(); ++energy_iter) {
-			delete[] (energy_iter->second);
-		}
-	}
+	for (size_t i = 0; i < _blocks.size(); i++)
+		delete[] _blocks[i];
 }
 
 int ParticleMapsContainer::energy2Idx(double energy) const {
@@ -27,37 +23,59 @@ double ParticleMapsContainer::idx2Energy(int idx) const {
 	return pow(10, idx * _deltaLogE + _bin0lowerEdge + _deltaLogE / 2) * eV;
 }
 
+
+long ParticleMapsContainer::_findSlot(int pid, int energyIdx) const {
+	index_t::const_iterator i = _index.find(key_t(pid, energyIdx));
+	if (i == _index.end())
+		return -1;
+	return i->second;
+}
+
+
+size_t ParticleMapsContainer::_findOrCreateSlot(int pid, int energyIdx) {
+	key_t key(pid, energyIdx);
+	index_t::const_iterator i = _index.find(key);
+	if (i != _index.end())
+		return i->second;
+
+	size_t slot = _keys.size();
+	if (slot % mapsPerBlock == 0) {
+		size_t n = mapsPerBlock * _pixelization.nPix();
+		double *block = new double[n];
+		std::fill(block, block + n, 0.);
+		_blocks.push_back(block);
+	}
+	_keys.push_back(key);
+	_index[key] = slot;
+	return slot;
+}
+
+
+double *ParticleMapsContainer::_mapOfSlot(size_t slot) const {
+	return _blocks[slot / mapsPerBlock] + (slot % mapsPerBlock) * _pixelization.nPix();
+}
+
 		
 double* ParticleMapsContainer::getMap(const int particleId, double energy) {
 	_weightsUpToDate = false;
-	if (_data.find(particleId) == _data.end()) {
+	if (_index.lower_bound(key_t(particleId, std::numeric_limits<int>::min())) == _index.upper_bound(key_t(particleId, std::numeric_limits<int>::max()))) {
 		std::cerr << "No map for ParticleID " << particleId << std::endl;
 		return NULL;
 	}
-	int energyIdx	= energy2Idx(energy);
-	if (_data[particleId].find(energyIdx) == _data[particleId].end()) {
+	long slot = _findSlot(particleId, energy2Idx(energy));
+	if (slot < 0) {
 		std::cerr << "No map for ParticleID and energy" << energy / eV << " eV" << std::endl;
 		return NULL;
 	}
-	return _data[particleId][energy2Idx(energy)];
+	return _mapOfSlot(slot);
 }
 			
 			
 void ParticleMapsContainer::addParticle(const int particleId, double energy, double galacticLongitude, double galacticLatitude, double weight) {
 	_weightsUpToDate = false;
-	if (_data.find(particleId) == _data.end()) {
-		map<int, double*> M;
-		_data[particleId] = M;
-	}
-
-	int energyIdx	= energy2Idx(energy);
-	if (_data[particleId].find(energyIdx) == _data[particleId].end()) {
-		_data[particleId][energyIdx] = new double[_pixelization.getNumberOfPixels()];
-		std::fill(_data[particleId][energyIdx], _data[particleId][energyIdx] + _pixelization.getNumberOfPixels(), 0);
-	}
-
+	size_t slot = _findOrCreateSlot(particleId, energy2Idx(energy));
 	uint32_t pixel = _pixelization.direction2Pix(galacticLongitude, galacticLatitude);
-	_data[particleId][energyIdx][pixel] += weight;
+	_mapOfSlot(slot)[pixel] += weight;
 }
 
 
@@ -68,11 +86,32 @@ void ParticleMapsContainer::addParticle(const int particleId, double energy, con
 }
 
 
+void ParticleMapsContainer::addParticles(size_t n, const int *particleIds, const double *energies,
+		const double *galacticLongitudes, const double *galacticLatitudes,
+		const double *weights) {
+	_weightsUpToDate = false;
+
+	// creating the maps modifies the index and is done serially
+	std::vector<size_t> slots(n);
+	for (size_t i = 0; i < n; i++)
+		slots[i] = _findOrCreateSlot(particleIds[i], energy2Idx(energies[i]));
+
+#pragma omp parallel for schedule(static)
+	for (long i = 0; i < (long)n; i++) {
+		uint32_t pixel = _pixelization.direction2Pix(galacticLongitudes[i], galacticLatitudes[i]);
+		double *map = _mapOfSlot(slots[i]);
+		double weight = weights ? weights[i] : 1.;
+#pragma omp atomic
+		map[pixel] += weight;
+	}
+}
+
+
 std::vector<int> ParticleMapsContainer::getParticleIds() {
 	std::vector<int> ids;
-	for(std::map<int, std::map<int, double*> >::iterator pid_iter = _data.begin(); 
-			pid_iter != _data.end(); ++pid_iter) {
-		ids.push_back(pid_iter->first);
+	for (index_t::const_iterator i = _index.begin(); i != _index.end(); ++i) {
+		if (ids.empty() || ids.back() != i->first.first)
+			ids.push_back(i->first.first);
 	}
 	return ids;
 }
@@ -80,12 +119,9 @@ std::vector<int> ParticleMapsContainer::getParticleIds() {
 
 std::vector<double> ParticleMapsContainer::getEnergies(int pid) {
 	std::vector<double> energies;
-	if (_data.find(pid) != _data.end()) {
-		for(std::map<int, double*>::iterator iter = _data[pid].begin(); 
-			iter != _data[pid].end(); ++iter) {
-			energies.push_back( idx2Energy(iter->first) / eV );
-		}
-	}
+	index_t::const_iterator i = _index.lower_bound(key_t(pid, std::numeric_limits<int>::min()));
+	for (; i != _index.end() && i->first.first == pid; ++i)
+		energies.push_back(idx2Energy(i->first.second) / eV);
 	return energies;
 }
 
@@ -94,20 +130,46 @@ void ParticleMapsContainer::applyLens(MagneticLens &lens) {
 	// if lens is normalized, this should not be necessary.
 	_weightsUpToDate = false;
 
-	for(std::map<int, std::map<int, double*> >::iterator pid_iter = _data.begin(); 
-			pid_iter != _data.end(); ++pid_iter) {
-		for(std::map<int, double*>::iterator energy_iter = pid_iter->second.begin();
-			energy_iter != pid_iter->second.end(); ++energy_iter) {
-			// transform only nuclei
-			double energy = idx2Energy(energy_iter->first);
-			int chargeNumber = HepPID::Z(pid_iter->first);
-			if (chargeNumber != 0 && lens.rigidityCovered(energy / chargeNumber)) {
-				lens.transformModelVector(energy_iter->second, energy / chargeNumber);
-			} else { // still normalize the vectors 
-				for(size_t j=0; j< _pixelization.getNumberOfPixels() ; j++) {
-					energy_iter->second[j] /= lens.getNorm();
-				}
-			}
+	// group the maps by lens part, these are transformed together
+	std::map<LensPart*, std::vector<double*> > groups;
+	std::vector<double*> others;
+	for (index_t::const_iterator i = _index.begin(); i != _index.end(); ++i) {
+		double *map = _mapOfSlot(i->second);
+		// transform only nuclei
+		double energy = idx2Energy(i->first.second);
+		int chargeNumber = HepPID::Z(i->first.first);
+		if (chargeNumber != 0 && lens.rigidityCovered(energy / chargeNumber)) {
+			groups[lens.getLensPart(energy / chargeNumber)].push_back(map);
+		} else {
+			others.push_back(map);
+		}
+	}
+
+	std::vector<LensPart*> parts;
+	std::vector<std::vector<double*> > partMaps;
+	for (std::map<LensPart*, std::vector<double*> >::const_iterator i = groups.begin(); i != groups.end(); ++i) {
+		parts.push_back(i->first);
+		partMaps.push_back(i->second);
+	}
+
+	const double norm = lens.getNorm();
+	const size_t nPix = _pixelization.nPix();
+#pragma omp parallel
+	{
+		// scratch memory of this thread, reused for all lens parts
+		std::vector<double> buffer;
+
+#pragma omp for schedule(dynamic, 1) nowait
+		for (long i = 0; i < (long)parts.size(); i++) {
+			LensPartMatrix matrix(parts[i]);
+			prod_up(matrix.get(), &partMaps[i][0], partMaps[i].size(), buffer);
+		}
+
+		// still normalize the other vectors
+#pragma omp for schedule(static)
+		for (long i = 0; i < (long)others.size(); i++) {
+			for (size_t j = 0; j < nPix; j++)
+				others[i][j] /= norm;
 		}
 	}
 }
@@ -117,20 +179,29 @@ void ParticleMapsContainer::_updateWeights() {
 	if (_weightsUpToDate)
 		return;
 
-	for(std::map<int, std::map<int, double*> >::iterator pid_iter = _data.begin(); 
-			pid_iter != _data.end(); ++pid_iter) {
-		_weightsPID[pid_iter->first] = 0;
-
-		for(std::map<int, double*>::iterator energy_iter = pid_iter->second.begin();
-			energy_iter != pid_iter->second.end(); ++energy_iter)  {
+	// the sums of the maps are independent
+	size_t nSlots = _keys.size();
+	size_t nPix = _pixelization.nPix();
+	_weightsSlot.assign(nSlots, 0.);
+#pragma omp parallel for schedule(static)
+	for (long s = 0; s < (long)nSlots; s++) {
+		const double *map = _mapOfSlot(s);
+		double sum = 0;
+		for (size_t j = 0; j < nPix; j++)
+			sum += map[j];
+		_weightsSlot[s] = sum;
+	}
 
-			_weights_pidEnergy[pid_iter->first][energy_iter->first] = 0;
-			for(size_t j = 0; j< _pixelization.getNumberOfPixels() ; j++) {
-				_weights_pidEnergy[pid_iter->first][energy_iter->first] +=energy_iter->second[j];
-				_weightsPID[pid_iter->first]+=energy_iter->second[j];
-			}
-			_sumOfWeights+=_weights_pidEnergy[pid_iter->first][energy_iter->first];
+	_pids.clear();
+	_weightsPID.clear();
+	_sumOfWeights = 0;
+	for (index_t::const_iterator i = _index.begin(); i != _index.end(); ++i) {
+		if (_pids.empty() || _pids.back() != i->first.first) {
+			_pids.push_back(i->first.first);
+			_weightsPID.push_back(0.);
 		}
+		_weightsPID.back() += _weightsSlot[i->second];
+		_sumOfWeights += _weightsSlot[i->second];
 	}
 	_weightsUpToDate = true;
 }
@@ -146,22 +217,28 @@ void ParticleMapsContainer::getRandomParticles(size_t N, vector<int> &particleId
 	galacticLongitudes.resize(N);
 	galacticLatitudes.resize(N);
 
+	if (_pids.empty())
+		return;
+
 	for(size_t i=0; i< N; i++) {
 		//get particle
 		double r = Random::instance().rand() * _sumOfWeights;
-		std::map<int, double>::iterator iter = _weightsPID.begin();
-		while ((r-= iter->second) > 0) {
-			++iter; 
+		size_t p = 0;
+		while ((r -= _weightsPID[p]) > 0 && p + 1 < _pids.size()) {
+			++p;
 		}
-		particleId[i] = iter->first;
+		particleId[i] = _pids[p];
 	
 		//get energy
-		r = Random::instance().rand() * iter->second;
-		iter = _weights_pidEnergy[particleId[i]].begin();
-		while ((r-= iter->second) > 0) {
-		 ++iter; 
+		r = Random::instance().rand() * _weightsPID[p];
+		index_t::const_iterator iter = _index.lower_bound(key_t(_pids[p], std::numeric_limits<int>::min()));
+		index_t::const_iterator last = iter;
+		for (; iter != _index.end() && iter->first.first == _pids[p]; ++iter) {
+			last = iter;
+			if ((r -= _weightsSlot[iter->second]) <= 0)
+				break;
 		}
-		energy[i] = idx2Energy(iter->first) / eV;
+		energy[i] = idx2Energy(last->first.second) / eV;
 
 		placeOnMap(particleId[i], energy[i] * eV, galacticLongitudes[i], galacticLatitudes[i]);
 	}
@@ -171,18 +248,16 @@ void ParticleMapsContainer::getRandomParticles(size_t N, vector<int> &particleId
 bool ParticleMapsContainer::placeOnMap(int pid, double energy, double &galacticLongitude, double &galacticLatitude) {
 	_updateWeights();
 
-	if (_data.find(pid) == _data.end()) {
-		return false;
-	}
-	int energyIdx	= energy2Idx(energy);
-	if (_data[pid].find(energyIdx) == _data[pid].end()) {
+	long slot = _findSlot(pid, energy2Idx(energy));
+	if (slot < 0) {
 		return false;
 	}
 
-	double r = Random::instance().rand() * _weights_pidEnergy[pid][energyIdx];
+	const double *map = _mapOfSlot(slot);
+	double r = Random::instance().rand() * _weightsSlot[slot];
 
-	for(size_t j = 0; j< _pixelization.getNumberOfPixels(); j++) {
-		r -= _data[pid][energyIdx][j];
+	for(size_t j = 0; j< _pixelization.nPix(); j++) {
+		r -= map[j];
 		if (r <= 0) {
 			_pixelization.getRandomDirectionInPixel(j, galacticLongitude, galacticLatitude);
 			return true;
@@ -196,4 +271,13 @@ void ParticleMapsContainer::forceWeightUpdate() {
 	_weightsUpToDate = false;
 }
 
+
+double ParticleMapsContainer::getWeight(int pid, double energy) {
+	_updateWeights();
+	long slot = _findSlot(pid, energy2Idx(energy));
+	if (slot < 0)
+		return 0;
+	return _weightsSlot[slot];
+}
+
 } // namespace crpropa
@@ -0,0 +1,506 @@
+#include "crpropa/module/ColumnarOutput.h"
+#include "crpropa/BinaryIO.h"
+#include "crpropa/Units.h"
+#include "crpropa/Version.h"
+
+#include "kiss/logger.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef CRPROPA_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace crpropa {
+
+static const char columnarMagic[6] = {'C', 'R', 'P', 'C', 'O', 'L'};
+static const uint16_t columnarVersion = 1;
+static const uint8_t blockDeflated = 1;
+static const uint8_t blockShuffled = 2;
+static const size_t blockAlignment = 8;
+
+using binary::put;
+using binary::putString;
+
+// group the n-th bytes of all values together, which makes floating point
+// columns much better compressible
+static void shuffle(const char *in, char *out, size_t size, size_t width) {
+	size_t n = size / width;
+	for (size_t i = 0; i < n; i++)
+		for (size_t b = 0; b < width; b++)
+			out[b * n + i] = in[i * width + b];
+}
+
+static void unshuffle(const char *in, char *out, size_t size, size_t width) {
+	size_t n = size / width;
+	for (size_t i = 0; i < n; i++)
+		for (size_t b = 0; b < width; b++)
+			out[i * width + b] = in[b * n + i];
+}
+
+ColumnarOutput::ColumnarOutput(const std::string &filename) :
+		Output(), filename(filename), rowsInChunk(0), headerWritten(false),
+		chunkSize(4 * 1024 * 1024), compressionLevel(1) {
+	outfile.open(filename.c_str(), std::ios::binary);
+	if (!outfile.is_open())
+		throw std::runtime_error(std::string("Cannot create file: ") + filename);
+}
+
+ColumnarOutput::ColumnarOutput(const std::string &filename, OutputType outputType) :
+		Output(outputType), filename(filename), rowsInChunk(0), headerWritten(false),
+		chunkSize(4 * 1024 * 1024), compressionLevel(1) {
+	outfile.open(filename.c_str(), std::ios::binary);
+	if (!outfile.is_open())
+		throw std::runtime_error(std::string("Cannot create file: ") + filename);
+}
+
+ColumnarOutput::~ColumnarOutput() {
+	close();
+}
+
+void ColumnarOutput::setChunkSize(size_t bytes) {
+	modify();
+	if (bytes == 0)
+		throw std::runtime_error("ColumnarOutput: chunk size must be positive");
+	chunkSize = bytes;
+}
+
+size_t ColumnarOutput::getChunkSize() const {
+	return chunkSize;
+}
+
+void ColumnarOutput::setCompressionLevel(int level) {
+	modify();
+	if ((level < 0) || (level > 9))
+		throw std::runtime_error("ColumnarOutput: compression level must be in [0, 9]");
+#ifndef CRPROPA_HAVE_ZLIB
+	if (level > 0)
+		KISS_LOG_WARNING << "ColumnarOutput: CRPropa was built without zlib, columns are stored uncompressed.";
+#endif
+	compressionLevel = level;
+}
+
+int ColumnarOutput::getCompressionLevel() const {
+	return compressionLevel;
+}
+
+void ColumnarOutput::setupColumns() const {
+	std::vector<ColumnSpec> specs = getColumnSpecs();
+	columns.clear();
+	columns.resize(specs.size());
+	for (size_t i = 0; i < specs.size(); i++) {
+		columns[i].name = specs[i].name;
+		columns[i].type = specs[i].type;
+		// the chunk size bounds the buffer of all columns together
+		columns[i].data.reserve(chunkSize / specs.size());
+	}
+}
+
+void ColumnarOutput::writeHeader() const {
+	std::vector<char> header;
+	header.insert(header.end(), columnarMagic, columnarMagic + sizeof(columnarMagic));
+	put<uint16_t>(header, columnarVersion);
+	put<double>(header, lengthScale);
+	put<double>(header, energyScale);
+	putString(header, g_GIT_DESC);
+	put<uint32_t>(header, columns.size());
+	for (size_t i = 0; i < columns.size(); i++) {
+		putString(header, columns[i].name);
+		put<uint8_t>(header, columns[i].type);
+	}
+	std::ofstream &out = const_cast<std::ofstream &>(outfile);
+	out.write(&header[0], header.size());
+	headerWritten = true;
+}
+
+void ColumnarOutput::writeChunk() const {
+	std::ofstream &out = const_cast<std::ofstream &>(outfile);
+	uint64_t nRows = rowsInChunk;
+	out.write(reinterpret_cast<const char *>(&nRows), sizeof(nRows));
+
+	std::vector<char> shuffled, compressed;
+	for (size_t i = 0; i < columns.size(); i++) {
+		std::vector<char> &raw = columns[i].data;
+		const char *block = raw.empty() ? NULL : &raw[0];
+		uint64_t rawSize = raw.size();
+		uint64_t storedSize = rawSize;
+		uint8_t flags = 0;
+
+#ifdef CRPROPA_HAVE_ZLIB
+		if ((compressionLevel > 0) && (rawSize > 0)) {
+			const char *input = &raw[0];
+			size_t width = packedSize(columns[i].type);
+			uint8_t inputFlags = blockDeflated;
+			if (width > 1) {
+				shuffled.resize(rawSize);
+				shuffle(&raw[0], &shuffled[0], rawSize, width);
+				input = &shuffled[0];
+				inputFlags |= blockShuffled;
+			}
+			uLongf destSize = compressBound(rawSize);
+			compressed.resize(destSize);
+			int status = compress2(reinterpret_cast<Bytef *>(&compressed[0]), &destSize,
+					reinterpret_cast<const Bytef *>(input), rawSize, compressionLevel);
+			if ((status == Z_OK) && (destSize < rawSize)) {
+				block = &compressed[0];
+				storedSize = destSize;
+				flags = inputFlags;
+			}
+		}
+#endif
+
+		out.write(reinterpret_cast<const char *>(&rawSize), sizeof(rawSize));
+		out.write(reinterpret_cast<const char *>(&storedSize), sizeof(storedSize));
+		out.write(reinterpret_cast<const char *>(&flags), sizeof(flags));
+		// align the block to allow direct access of mapped data
+		static const char padding[blockAlignment] = {0};
+		size_t pos = out.tellp();
+		if (pos % blockAlignment)
+			out.write(padding, blockAlignment - pos % blockAlignment);
+		if (storedSize > 0)
+			out.write(block, storedSize);
+		raw.clear();
+	}
+	rowsInChunk = 0;
+
+	if (!out.good())
+		throw std::runtime_error("ColumnarOutput: error writing to file " + filename);
+}
+
+void ColumnarOutput::process(Candidate *c) const {
+	if (fields.none() && properties.empty())
+		return;
+
+	// serialize the row in column order, scatter to the columns later
+	std::vector<char> row;
+	row.reserve(256);
+	packRow(c, row);
+
+#pragma omp critical(ColumnarOutput)
+	{
+		if (!headerWritten) {
+			setupColumns();
+			writeHeader();
+		}
+		Output::process(c);
+
+		size_t pos = 0;
+		size_t buffered = 0;
+		for (size_t i = 0; i < columns.size(); i++) {
+			size_t n = packedSize(columns[i].type);
+			if (n == 0)
+				n = sizeof(uint32_t) + *reinterpret_cast<const uint32_t *>(&row[pos]);
+			std::vector<char> &data = columns[i].data;
+			data.insert(data.end(), row.begin() + pos, row.begin() + pos + n);
+			pos += n;
+			buffered += data.size();
+		}
+		rowsInChunk++;
+		if (buffered >= chunkSize)
+			writeChunk();
+	}
+}
+
+void ColumnarOutput::flush() const {
+#pragma omp critical(ColumnarOutput)
+	{
+		if (!headerWritten) {
+			setupColumns();
+			writeHeader();
+		}
+		if (rowsInChunk > 0)
+			writeChunk();
+		const_cast<std::ofstream &>(outfile).flush();
+	}
+}
+
+void ColumnarOutput::close() {
+	if (!outfile.is_open())
+		return;
+	flush();
+	outfile.close();
+}
+
+std::string ColumnarOutput::getDescription() const {
+	return "ColumnarOutput: " + filename;
+}
+
+
+// ColumnarOutputReader -------------------------------------------------------
+namespace {
+class MapCursor {
+	const char *pos, *end;
+public:
+	MapCursor(const char *begin, const char *end) : pos(begin), end(end) {
+	}
+	void check(size_t n) const {
+		if (n > size_t(end - pos))
+			throw std::runtime_error("ColumnarOutputReader: unexpected end of file");
+	}
+	template<typename T>
+	T get() {
+		check(sizeof(T));
+		T value;
+		std::memcpy(&value, pos, sizeof(T));
+		pos += sizeof(T);
+		return value;
+	}
+	std::string getString() {
+		uint32_t n = get<uint32_t>();
+		check(n);
+		std::string s(pos, n);
+		pos += n;
+		return s;
+	}
+	const char *skip(size_t n) {
+		check(n);
+		const char *p = pos;
+		pos += n;
+		return p;
+	}
+	void align(const char *begin, size_t alignment) {
+		size_t offset = (pos - begin) % alignment;
+		if (offset)
+			skip(alignment - offset);
+	}
+	bool atEnd() const {
+		return pos >= end;
+	}
+};
+}
+
+ColumnarOutputReader::ColumnarOutputReader(const std::string &filename) :
+		filename(filename), map(NULL), mapSize(0), nRows(0) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("ColumnarOutputReader: could not open file " + filename);
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		::close(fd);
+		throw std::runtime_error("ColumnarOutputReader: empty or unreadable file " + filename);
+	}
+	mapSize = st.st_size;
+	map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		throw std::runtime_error("ColumnarOutputReader: could not map file " + filename);
+	}
+
+	const char *begin = static_cast<const char *>(map);
+	MapCursor cursor(begin, begin + mapSize);
+	try {
+		if (std::memcmp(cursor.skip(sizeof(columnarMagic)), columnarMagic, sizeof(columnarMagic)) != 0)
+			throw std::runtime_error("ColumnarOutputReader: not a columnar output file " + filename);
+		uint16_t version = cursor.get<uint16_t>();
+		if (version != columnarVersion)
+			throw std::runtime_error("ColumnarOutputReader: unsupported file version in " + filename);
+		lengthScale = cursor.get<double>();
+		energyScale = cursor.get<double>();
+		this->version = cursor.getString();
+		uint32_t nColumns = cursor.get<uint32_t>();
+		columns.resize(nColumns);
+		for (size_t i = 0; i < nColumns; i++) {
+			columns[i].name = cursor.getString();
+			columns[i].type = Variant::Type(cursor.get<uint8_t>());
+			columns[i].loaded = false;
+			columns[i].data = NULL;
+			Output::packedSize(columns[i].type);
+		}
+
+		while (!cursor.atEnd()) {
+			nRows += cursor.get<uint64_t>();
+			for (size_t i = 0; i < nColumns; i++) {
+				ColumnInfo &col = columns[i];
+				col.rawSizes.push_back(cursor.get<uint64_t>());
+				col.storedSizes.push_back(cursor.get<uint64_t>());
+				col.flags.push_back(cursor.get<uint8_t>());
+				cursor.align(begin, blockAlignment);
+				col.blocks.push_back(cursor.skip(col.storedSizes.back()));
+			}
+		}
+	} catch (...) {
+		munmap(map, mapSize);
+		map = NULL;
+		throw;
+	}
+}
+
+ColumnarOutputReader::~ColumnarOutputReader() {
+	if (map)
+		munmap(map, mapSize);
+}
+
+size_t ColumnarOutputReader::findColumn(const std::string &name) const {
+	for (size_t i = 0; i < columns.size(); i++)
+		if (columns[i].name == name)
+			return i;
+	throw std::runtime_error("ColumnarOutputReader: no column " + name + " in " + filename);
+}
+
+void ColumnarOutputReader::loadColumn(ColumnInfo &col) {
+	if (col.loaded)
+		return;
+
+	// single uncompressed block: use the mapped memory directly
+	if ((col.blocks.size() == 1) && (col.flags[0] == 0)) {
+		col.data = col.blocks[0];
+		col.loaded = true;
+		return;
+	}
+
+	size_t total = 0;
+	for (size_t b = 0; b < col.blocks.size(); b++)
+		total += col.rawSizes[b];
+	col.buffer.resize(total);
+
+	size_t width = Output::packedSize(col.type);
+	std::vector<char> tmp;
+	size_t pos = 0;
+	for (size_t b = 0; b < col.blocks.size(); b++) {
+		size_t rawSize = col.rawSizes[b];
+		if (col.flags[b] & blockDeflated) {
+#ifdef CRPROPA_HAVE_ZLIB
+			char *target = &col.buffer[pos];
+			if (col.flags[b] & blockShuffled) {
+				tmp.resize(rawSize);
+				target = &tmp[0];
+			}
+			uLongf destSize = rawSize;
+			int status = uncompress(reinterpret_cast<Bytef *>(target), &destSize,
+					reinterpret_cast<const Bytef *>(col.blocks[b]), col.storedSizes[b]);
+			if ((status != Z_OK) || (destSize != rawSize))
+				throw std::runtime_error("ColumnarOutputReader: corrupt column " + col.name + " in " + filename);
+			if (col.flags[b] & blockShuffled)
+				unshuffle(&tmp[0], &col.buffer[pos], rawSize, width);
+#else
+			throw std::runtime_error("CRPropa was built without Zlib compression!");
+#endif
+		} else if (rawSize > 0) {
+			std::memcpy(&col.buffer[pos], col.blocks[b], rawSize);
+		}
+		pos += rawSize;
+	}
+	col.data = col.buffer.empty() ? NULL : &col.buffer[0];
+	col.loaded = true;
+}
+
+size_t ColumnarOutputReader::getNumberOfRows() const {
+	return nRows;
+}
+
+size_t ColumnarOutputReader::getNumberOfColumns() const {
+	return columns.size();
+}
+
+std::vector<std::string> ColumnarOutputReader::getColumnNames() const {
+	std::vector<std::string> names;
+	for (size_t i = 0; i < columns.size(); i++)
+		names.push_back(columns[i].name);
+	return names;
+}
+
+bool ColumnarOutputReader::hasColumn(const std::string &name) const {
+	for (size_t i = 0; i < columns.size(); i++)
+		if (columns[i].name == name)
+			return true;
+	return false;
+}
+
+Variant::Type ColumnarOutputReader::getColumnType(const std::string &name) const {
+	return columns[findColumn(name)].type;
+}
+
+size_t ColumnarOutputReader::getColumnTypeSize(const std::string &name) const {
+	return Output::packedSize(getColumnType(name));
+}
+
+double ColumnarOutputReader::getLengthScale() const {
+	return lengthScale;
+}
+
+double ColumnarOutputReader::getEnergyScale() const {
+	return energyScale;
+}
+
+std::string ColumnarOutputReader::getVersion() const {
+	return version;
+}
+
+const void *ColumnarOutputReader::getColumnData(const std::string &name) {
+	ColumnInfo &col = columns[findColumn(name)];
+	if (col.type == Variant::TYPE_STRING)
+		throw std::runtime_error("ColumnarOutputReader: column " + name + " is not numeric");
+	loadColumn(col);
+	return col.data;
+}
+
+template<typename T>
+static void convertColumn(const void *data, size_t n, std::vector<double> &result) {
+	const T *values = static_cast<const T *>(data);
+	for (size_t i = 0; i < n; i++)
+		result[i] = values[i];
+}
+
+std::vector<double> ColumnarOutputReader::getColumn(const std::string &name) {
+	const void *data = getColumnData(name);
+	std::vector<double> result(nRows);
+	switch (getColumnType(name)) {
+	case Variant::TYPE_BOOL:
+	case Variant::TYPE_UCHAR:
+		convertColumn<unsigned char>(data, nRows, result);
+		break;
+	case Variant::TYPE_CHAR:
+		convertColumn<char>(data, nRows, result);
+		break;
+	case Variant::TYPE_INT16:
+		convertColumn<int16_t>(data, nRows, result);
+		break;
+	case Variant::TYPE_UINT16:
+		convertColumn<uint16_t>(data, nRows, result);
+		break;
+	case Variant::TYPE_INT32:
+		convertColumn<int32_t>(data, nRows, result);
+		break;
+	case Variant::TYPE_UINT32:
+		convertColumn<uint32_t>(data, nRows, result);
+		break;
+	case Variant::TYPE_INT64:
+		convertColumn<int64_t>(data, nRows, result);
+		break;
+	case Variant::TYPE_UINT64:
+		convertColumn<uint64_t>(data, nRows, result);
+		break;
+	case Variant::TYPE_FLOAT:
+		convertColumn<float>(data, nRows, result);
+		break;
+	default:
+		convertColumn<double>(data, nRows, result);
+	}
+	return result;
+}
+
+std::vector<std::string> ColumnarOutputReader::getStringColumn(const std::string &name) {
+	ColumnInfo &col = columns[findColumn(name)];
+	if (col.type != Variant::TYPE_STRING)
+		throw std::runtime_error("ColumnarOutputReader: column " + name + " is not a string column");
+	loadColumn(col);
+
+	std::vector<std::string> result;
+	result.reserve(nRows);
+	size_t size = 0;
+	for (size_t b = 0; b < col.rawSizes.size(); b++)
+		size += col.rawSizes[b];
+	MapCursor cursor(col.data, col.data + size);
+	for (size_t i = 0; i < nRows; i++)
+		result.push_back(cursor.getString());
+	return result;
+}
+
+} // namespace crpropa
@@ -0,0 +1,230 @@
+#include "crpropa/module/ContinuousLosses.h"
+#include "crpropa/Units.h"
+#include "crpropa/Cosmology.h"
+#include "crpropa/ParticleID.h"
+#include "crpropa/ParticleMass.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace crpropa {
+
+const double ContinuousLosses::lgMin = 6;  // minimum log10((1 + z) * Lorentz factor)
+const double ContinuousLosses::lgMax = 16; // maximum log10((1 + z) * Lorentz factor)
+const size_t ContinuousLosses::nU = 4001;  // number of tabulation points
+
+// integral of du / (u beta) over a fraction t of an interval of width h in ln(u),
+// with beta changing linearly in ln(u) from b0 to b1 over the interval
+static double integrateInterval(double b0, double b1, double h, double t) {
+	double db = (b1 - b0) * t;
+	if (std::fabs(db) < 1e-8 * b0)
+		return h * t / b0;
+	return h * t * std::log1p(db / b0) / db;
+}
+
+// inverse of integrateInterval: fraction of the interval for the integral g
+static double invertInterval(double b0, double b1, double h, double g) {
+	double db = b1 - b0;
+	if (std::fabs(db) < 1e-8 * b0)
+		return g * b0 / h;
+	return std::expm1(g * db / h) * b0 / db;
+}
+
+ContinuousLosses::ContinuousLosses(double limit, bool haveRedshift) :
+		haveRedshift(haveRedshift), limit(limit), maxRedshift(3), dzNode(0) {
+}
+
+void ContinuousLosses::addPhotonField(ref_ptr<PhotonField> photonField) {
+	epp.push_back(new ElectronPairProduction(photonField));
+	photonFields.push_back(photonField);
+	initTable();
+}
+
+size_t ContinuousLosses::getNumberOfPhotonFields() const {
+	return photonFields.size();
+}
+
+void ContinuousLosses::setHaveRedshift(bool haveRedshift) {
+	this->haveRedshift = haveRedshift;
+}
+
+bool ContinuousLosses::getHaveRedshift() const {
+	return haveRedshift;
+}
+
+void ContinuousLosses::setLimit(double limit) {
+	this->limit = limit;
+}
+
+double ContinuousLosses::getLimit() const {
+	return limit;
+}
+
+void ContinuousLosses::setMaximumRedshift(double z) {
+	maxRedshift = z;
+	if (photonFields.size() > 0)
+		initTable();
+}
+
+double ContinuousLosses::getMaximumRedshift() const {
+	return maxRedshift;
+}
+
+void ContinuousLosses::initTable() {
+	const double dlg = (lgMax - lgMin) / (nU - 1);
+	const int proton = nucleusId(1, 1);
+
+	// proton loss rates at z = 0 of each photon field
+	std::vector<std::vector<double> > beta(epp.size(), std::vector<double>(nU));
+	bool redshiftDependent = false;
+	for (size_t i = 0; i < epp.size(); i++) {
+		for (size_t j = 0; j < nU; j++) {
+			double l = epp[i]->lossLength(proton, pow(10, lgMin + j * dlg), 0);
+			beta[i][j] = (l < std::numeric_limits<double>::max()) ? 1. / l : 0.;
+		}
+		redshiftDependent |= photonFields[i]->hasRedshiftDependence();
+	}
+
+	dzNode = redshiftDependent ? 0.05 : 0;
+	size_t nNodes = redshiftDependent ? size_t(std::ceil(maxRedshift / dzNode)) + 1 : 1;
+	tabG.assign(nNodes * nU, 0.);
+	tabBeta.assign(nNodes * nU, 0.);
+	tabStart.assign(nNodes, nU);
+
+	for (size_t k = 0; k < nNodes; k++) {
+		double z = k * dzNode;
+		std::vector<double> b(nU, 0.);
+		for (size_t i = 0; i < epp.size(); i++) {
+			double s = photonFields[i]->getRedshiftScaling(z);
+			for (size_t j = 0; j < nU; j++)
+				b[j] += s * beta[i][j];
+		}
+
+		// the loss rate is positive from the energy threshold on
+		size_t start = nU;
+		while ((start > 0) and (b[start - 1] > 0))
+			start--;
+		tabStart[k] = start;
+
+		// G(u) = int du / (u beta(u)), exact for beta linear in ln(u) between the tabulation points
+		double *G = &tabG[k * nU];
+		for (size_t j = start + 1; j < nU; j++)
+			G[j] = G[j - 1] + integrateInterval(b[j - 1], b[j], dlg * M_LN10, 1);
+		std::copy(b.begin(), b.end(), tabBeta.begin() + k * nU);
+	}
+}
+
+double ContinuousLosses::integrateNode(size_t k, double lg, double x) const {
+	const double dlg = (lgMax - lgMin) / (nU - 1);
+	const double h = dlg * M_LN10;
+	const double *G = &tabG[k * nU];
+	const double *b = &tabBeta[k * nU];
+	size_t start = tabStart[k];
+	if (start + 1 >= nU)
+		return lg;
+
+	// above the table the loss at the upper end is applied
+	double lgc = std::min(lg, lgMax);
+	double pos = (lgc - lgMin) / dlg;
+	if (pos <= start)
+		return lg; // below energy threshold
+
+	size_t j = std::min(size_t(pos), nU - 2);
+	double g = G[j] + integrateInterval(b[j], b[j + 1], h, pos - j);
+
+	// invert G(u') = G(u) - x
+	double gNew = g - x;
+	if (gNew <= 0)
+		return lgMin + start * dlg + (lg - lgc);
+	j = std::upper_bound(G + start, G + nU, gNew) - G - 1;
+	j = std::min(j, nU - 2);
+	double t = invertInterval(b[j], b[j + 1], h, gNew - G[j]);
+	double lgNew = lgMin + (j + std::min(std::max(t, 0.), 1.)) * dlg;
+	return lgNew + (lg - lgc);
+}
+
+double ContinuousLosses::integrate(int id, double lf, double distance, double z) const {
+	double Z = chargeNumber(id);
+	if ((Z == 0) or (tabG.size() == 0))
+		return lf;
+
+	// scaling for nuclei and cosmological evolution, cf. ElectronPairProduction::lossLength
+	double A = nuclearMass(id) / nuclearMass(nucleusId(1, 1));
+	double x = distance * Z * Z / A * pow_integer<3>(1 + z);
+	double lg = log10(lf * (1 + z));
+
+	double lgNew;
+	if (dzNode == 0) {
+		lgNew = integrateNode(0, lg, x);
+	} else {
+		// interpolate between the redshift nodes
+		size_t nNodes = tabStart.size();
+		double pos = std::min(std::max(z, 0.) / dzNode, double(nNodes - 1));
+		size_t k = std::min(size_t(pos), nNodes - 1);
+		double f = pos - k;
+		lgNew = integrateNode(k, lg, x);
+		if ((f > 0) and (k + 1 < nNodes))
+			lgNew = (1 - f) * lgNew + f * integrateNode(k + 1, lg, x);
+	}
+	return lf * pow(10, lgNew - lg);
+}
+
+double ContinuousLosses::lossLength(int id, double lf, double z) const {
+	double rate = 0;
+	for (size_t i = 0; i < epp.size(); i++) {
+		double l = epp[i]->lossLength(id, lf, z);
+		if (l < std::numeric_limits<double>::max())
+			rate += 1. / l;
+	}
+	if (rate == 0)
+		return std::numeric_limits<double>::max();
+	return 1. / rate;
+}
+
+void ContinuousLosses::process(Candidate *c) const {
+	double step = c->getCurrentStep();
+	double z = c->getRedshift();
+
+	// redshift at the middle and the end of the step
+	double zMid = z;
+	double zNew = z;
+	if (haveRedshift and (z > std::numeric_limits<double>::min())) {
+		double d = redshift2ComovingDistance(z);
+		zMid = (d > step / 2) ? comovingDistance2Redshift(d - step / 2) : 0;
+		zNew = (d > step) ? comovingDistance2Redshift(d - step) : 0;
+		c->setRedshift(zNew);
+	}
+
+	// adiabatic energy loss in the first half of the step: E ~ (1 + z)
+	c->current.setEnergy(c->current.getEnergy() * (1 + zMid) / (1 + z));
+
+	// electron pair production over the full step
+	int id = c->current.getId();
+	if (not isNucleus(id)) {
+		c->current.setEnergy(c->current.getEnergy() * (1 + zNew) / (1 + zMid));
+		return;
+	}
+	double lf = c->current.getLorentzFactor();
+	c->current.setLorentzFactor(integrate(id, lf, step / (1 + zMid), zMid));
+
+	// adiabatic energy loss in the second half of the step
+	c->current.setEnergy(c->current.getEnergy() * (1 + zNew) / (1 + zMid));
+
+	double losslen = lossLength(id, c->current.getLorentzFactor(), zNew);
+	if (losslen < std::numeric_limits<double>::max())
+		c->limitNextStep(limit * losslen);
+}
+
+std::string ContinuousLosses::getDescription() const {
+	std::stringstream s;
+	s << "ContinuousLosses: electron pair production on";
+	for (size_t i = 0; i < photonFields.size(); i++)
+		s << " " << photonFields[i]->getFieldName();
+	if (haveRedshift)
+		s << ", redshift";
+	return s.str();
+}
+
+} // namespace crpropa
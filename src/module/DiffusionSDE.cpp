@@ -176,7 +176,7 @@ void DiffusionSDE::process(Candidate *candidate) const {
 	bool NaN = std::isnan(PO.getR());
 	if (NaN == true){
 		  candidate->setActive(false);
-		  KISS_LOG_WARNING
+		  KISS_LOG_WARNING_LIMITED(100)
 			<< "\nCandidate with 'nan'-position occured: \n"
 		 	<< "position = " << PO << "\n"
 		  	<< "PosIn = " << PosIn << "\n"
@@ -350,16 +350,10 @@ ref_ptr<MagneticField> DiffusionSDE::getMagneticField() const {
 
 Vector3d DiffusionSDE::getMagneticFieldAtPosition(Vector3d pos, double z) const {
 	Vector3d B(0, 0, 0);
-	try {
-		// check if field is valid and use the field vector at the
-		// position pos with the redshift z
-		if (magneticField.valid())
-			B = magneticField->getField(pos, z);
-	}
-	catch (std::exception &e) {
-		KISS_LOG_ERROR 	<< "DiffusionSDE: Exception in DiffusionSDE::getMagneticFieldAtPosition.\n"
-				<< e.what();
-	}	
+	// check if field is valid and use the field vector at the
+	// position pos with the redshift z, B = 0 where it is not defined
+	if (magneticField.valid())
+		magneticField->tryGetField(pos, z, B);
 	return B;
 }
 
@@ -376,7 +370,7 @@ Vector3d DiffusionSDE::getAdvectionFieldAtPosition(Vector3d pos) const {
 			AdvField = advectionField->getField(pos);
 	}
 	catch (std::exception &e) {
-		KISS_LOG_ERROR 	<< "DiffusionSDE: Exception in DiffusionSDE::getAdvectionFieldAtPosition.\n"
+		KISS_LOG_ERROR_LIMITED(100) << "DiffusionSDE: Exception in DiffusionSDE::getAdvectionFieldAtPosition.\n"
 				<< e.what();
 	}
 	return AdvField;
@@ -258,4 +258,22 @@ std::string EMPairProduction::getInteractionTag() const {
 	return interactionTag;
 }
 
+double EMPairProduction::interactionRate(const Candidate *candidate) const {
+	if (candidate->current.getId() != 22)
+		return 0;
+
+	// scale the particle energy instead of background photons
+	double z = candidate->getRedshift();
+	double E = candidate->current.getEnergy() * (1 + z);
+	if ((E < tabEnergy.front()) or (E > tabEnergy.back()))
+		return 0;
+
+	double rate = interpolate(E, tabEnergy, tabRate);
+	return rate * pow_integer<2>(1 + z) * photonField->getRedshiftScaling(z);
+}
+
+void EMPairProduction::interact(Candidate *candidate) const {
+	performInteraction(candidate);
+}
+
 } // namespace crpropa
@@ -107,24 +107,53 @@ void ElasticScattering::process(Candidate *candidate) const {
 		if (step < randDist)
 			return;
 
-		// draw random background photon energy from CDF
-		size_t i = floor((lg - lgmin) / (lgmax - lgmin) * (nlg - 1)); // index of closest gamma tabulation point
-		size_t j = random.randBin(tabCDF[i]) - 1; // index of next lower tabulated eps value
-		double binWidth = (epsmax - epsmin) / (neps - 1); // logarithmic bin width
-		double eps = pow(10, epsmin + (j + random.rand()) * binWidth);
-
-		// boost to lab frame
-		double cosTheta = 2 * random.rand() - 1;
-		double E = eps * candidate->current.getLorentzFactor() * (1. - cosTheta);
-
-		Vector3d pos = random.randomInterpolatedPosition(candidate->previous.getPosition(), candidate->current.getPosition());
-		candidate->addSecondary(22, E, pos, 1., interactionTag);
+		performInteraction(candidate);
 
 		// repeat with remaining step
 		step -= randDist;
 	}
 }
 
+void ElasticScattering::performInteraction(Candidate *candidate) const {
+	Random &random = Random::instance();
+	double lg = log10(candidate->current.getLorentzFactor() * (1 + candidate->getRedshift()));
+
+	// draw random background photon energy from CDF
+	size_t i = floor((lg - lgmin) / (lgmax - lgmin) * (nlg - 1)); // index of closest gamma tabulation point
+	size_t j = random.randBin(tabCDF[i]) - 1; // index of next lower tabulated eps value
+	double binWidth = (epsmax - epsmin) / (neps - 1); // logarithmic bin width
+	double eps = pow(10, epsmin + (j + random.rand()) * binWidth);
+
+	// boost to lab frame
+	double cosTheta = 2 * random.rand() - 1;
+	double E = eps * candidate->current.getLorentzFactor() * (1. - cosTheta);
+
+	Vector3d pos = random.randomInterpolatedPosition(candidate->previous.getPosition(), candidate->current.getPosition());
+	candidate->addSecondary(22, E, pos, 1., interactionTag);
+}
+
+double ElasticScattering::interactionRate(const Candidate *candidate) const {
+	int id = candidate->current.getId();
+	if (not isNucleus(id))
+		return 0;
+
+	double z = candidate->getRedshift();
+	double lg = log10(candidate->current.getLorentzFactor() * (1 + z));
+	if ((lg < lgmin) or (lg > lgmax))
+		return 0;
+
+	int A = massNumber(id);
+	int Z = chargeNumber(id);
+	int N = A - Z;
+	double rate = interpolateEquidistant(lg, lgmin, lgmax, tabRate);
+	rate *= Z * N / double(A);  // TRK scaling
+	return rate * pow_integer<2>(1 + z) * photonField->getRedshiftScaling(z);  // cosmological scaling
+}
+
+void ElasticScattering::interact(Candidate *candidate) const {
+	performInteraction(candidate);
+}
+
 void ElasticScattering::setInteractionTag(std::string tag) {
 	this -> interactionTag = tag;
 }
@@ -0,0 +1,421 @@
+#include "crpropa/module/HistogramOutput.h"
+#include "crpropa/BinaryIO.h"
+#include "crpropa/ParticleID.h"
+#include "crpropa/Units.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace crpropa {
+
+// HistogramAxis ---------------------------------------------------------------
+size_t HistogramAxis::getNumberOfBins() const {
+	return edges.empty() ? 0 : edges.size() - 1;
+}
+
+const std::vector<double> &HistogramAxis::getEdges() const {
+	return edges;
+}
+
+std::string HistogramAxis::getName() const {
+	return name;
+}
+
+std::string HistogramAxis::getDescription() const {
+	std::stringstream ss;
+	ss << name << ": " << getNumberOfBins() << " bins";
+	return ss.str();
+}
+
+// HistogramQuantityAxis -------------------------------------------------------
+namespace {
+
+enum Quantity {
+	PropertyQuantity,
+	TrajectoryLength, Redshift, Weight,
+	Id, Energy, X, Y, Z, Px, Py, Pz, MassNumber,
+	Id0, Energy0, X0, Y0, Z0, P0x, P0y, P0z, MassNumber0,
+	Id1, Energy1, X1, Y1, Z1, P1x, P1y, P1z, MassNumber1
+};
+
+// names of the particle state quantities, for the current, source and created state
+const char *stateNames[] = {"ID", "E", "X", "Y", "Z", "Px", "Py", "Pz", "A"};
+const char *stateNames0[] = {"ID0", "E0", "X0", "Y0", "Z0", "P0x", "P0y", "P0z", "A0"};
+const char *stateNames1[] = {"ID1", "E1", "X1", "Y1", "Z1", "P1x", "P1y", "P1z", "A1"};
+const int nStateNames = 9;
+
+int findQuantity(const std::string &name) {
+	if (name == "D")
+		return TrajectoryLength;
+	if (name == "z")
+		return Redshift;
+	if (name == "W")
+		return Weight;
+	for (int i = 0; i < nStateNames; i++) {
+		if (name == stateNames[i])
+			return Id + i;
+		if (name == stateNames0[i])
+			return Id0 + i;
+		if (name == stateNames1[i])
+			return Id1 + i;
+	}
+	return PropertyQuantity;
+}
+
+double stateValue(const ParticleState &state, int i) {
+	switch (i) {
+	case 0: return state.getId();
+	case 1: return state.getEnergy();
+	case 2: return state.getPosition().x;
+	case 3: return state.getPosition().y;
+	case 4: return state.getPosition().z;
+	case 5: return state.getDirection().x;
+	case 6: return state.getDirection().y;
+	case 7: return state.getDirection().z;
+	default: return isNucleus(state.getId()) ? massNumber(state.getId()) : 0;
+	}
+}
+
+} // namespace
+
+HistogramQuantityAxis::HistogramQuantityAxis(const std::string &quantity,
+		double min, double max, size_t nBins, bool log) :
+		quantity(findQuantity(quantity)), logarithmic(log), min(min), max(max) {
+	if (nBins == 0)
+		throw std::runtime_error("HistogramQuantityAxis: number of bins must be positive");
+	if (not (max > min))
+		throw std::runtime_error("HistogramQuantityAxis: max must be larger than min");
+	if (log and (min <= 0))
+		throw std::runtime_error("HistogramQuantityAxis: min must be positive for logarithmic bins");
+	name = quantity;
+	edges.resize(nBins + 1);
+	for (size_t i = 0; i <= nBins; i++) {
+		if (log)
+			edges[i] = min * std::pow(max / min, double(i) / nBins);
+		else
+			edges[i] = min + (max - min) * i / nBins;
+	}
+	edges[nBins] = max;
+	scale = nBins / (log ? std::log(max / min) : (max - min));
+}
+
+double HistogramQuantityAxis::getValue(const Candidate *c, bool &valid) const {
+	valid = true;
+	switch (quantity) {
+	case TrajectoryLength:
+		return c->getTrajectoryLength();
+	case Redshift:
+		return c->getRedshift();
+	case Weight:
+		return c->getWeight();
+	case PropertyQuantity: {
+		Candidate::PropertyMap::const_iterator i = c->properties.find(name);
+		if (i == c->properties.end()) {
+			valid = false;
+			return 0;
+		}
+		return i->second.toDouble();
+	}
+	default:
+		if (quantity >= Id1)
+			return stateValue(c->created, quantity - Id1);
+		if (quantity >= Id0)
+			return stateValue(c->source, quantity - Id0);
+		return stateValue(c->current, quantity - Id);
+	}
+}
+
+long HistogramQuantityAxis::getBin(const Candidate *candidate) const {
+	bool valid;
+	double value = getValue(candidate, valid);
+	if (not valid or not (value >= min) or not (value < max))
+		return -1;
+	double x = logarithmic ? std::log(value / min) : value - min;
+	long bin = x * scale;
+	// rounding at the edges
+	long n = edges.size() - 1;
+	if (bin >= n)
+		bin = n - 1;
+	if ((bin > 0) and (value < edges[bin]))
+		bin--;
+	else if ((bin + 1 < n) and (value >= edges[bin + 1]))
+		bin++;
+	return bin;
+}
+
+std::string HistogramQuantityAxis::getDescription() const {
+	std::stringstream ss;
+	ss << name << ": " << getNumberOfBins() << (logarithmic ? " log" : " linear")
+			<< " bins from " << min << " to " << max;
+	return ss.str();
+}
+
+#ifdef CRPROPA_HAVE_GALACTIC_LENSES
+// HistogramHealpixAxis --------------------------------------------------------
+HistogramHealpixAxis::HistogramHealpixAxis(uint8_t order) : pixelization(order) {
+	name = "pixel";
+	edges.resize(pixelization.nPix() + 1);
+	for (size_t i = 0; i < edges.size(); i++)
+		edges[i] = i;
+}
+
+long HistogramHealpixAxis::getBin(const Candidate *candidate) const {
+	const Vector3d p = candidate->current.getDirection();
+	double longitude = atan2(-p.y, -p.x);
+	double latitude = M_PI / 2 - acos(-p.z / p.getR());
+	return pixelization.direction2Pix(longitude, latitude);
+}
+
+std::string HistogramHealpixAxis::getDescription() const {
+	std::stringstream ss;
+	ss << name << ": healpix order " << int(pixelization.getOrder()) << ", "
+			<< getNumberOfBins() << " pixels";
+	return ss.str();
+}
+#endif
+
+// HistogramOutput -------------------------------------------------------------
+HistogramOutput::HistogramOutput() : Output(), nBins(1), useWeights(true), nEntries(0) {
+}
+
+void HistogramOutput::addAxis(HistogramAxis *axis) {
+	bool filled = (count > 0) or (nEntries > 0);
+	for (size_t i = 0; i < threadHistograms.size(); i++)
+		filled = filled or (threadHistograms[i].entries > 0);
+	if (filled)
+		throw std::runtime_error("HistogramOutput: cannot add axes after candidates have been processed");
+	if (axis->getNumberOfBins() == 0)
+		throw std::runtime_error("HistogramOutput: axis without bins");
+	axes.push_back(axis);
+	nBins *= axis->getNumberOfBins();
+}
+
+void HistogramOutput::addLogEnergyAxis(double min, double max, size_t n) {
+	addAxis(new HistogramQuantityAxis("E", min, max, n, true));
+}
+
+void HistogramOutput::addMassNumberAxis(int maxA) {
+	addAxis(new HistogramQuantityAxis("A", -0.5, maxA + 0.5, maxA + 1));
+}
+
+void HistogramOutput::addTrajectoryLengthAxis(double min, double max, size_t n, bool log) {
+	addAxis(new HistogramQuantityAxis("D", min, max, n, log));
+}
+
+#ifdef CRPROPA_HAVE_GALACTIC_LENSES
+void HistogramOutput::addHealpixAxis(uint8_t order) {
+	addAxis(new HistogramHealpixAxis(order));
+}
+#endif
+
+size_t HistogramOutput::getNumberOfAxes() const {
+	return axes.size();
+}
+
+HistogramAxis *HistogramOutput::getAxis(size_t i) const {
+	return axes.at(i);
+}
+
+std::vector<size_t> HistogramOutput::getShape() const {
+	std::vector<size_t> shape(axes.size());
+	for (size_t i = 0; i < axes.size(); i++)
+		shape[i] = axes[i]->getNumberOfBins();
+	return shape;
+}
+
+size_t HistogramOutput::getNumberOfBins() const {
+	return nBins;
+}
+
+void HistogramOutput::setUseWeights(bool use) {
+	useWeights = use;
+}
+
+long HistogramOutput::getBinIndex(const Candidate *candidate) const {
+	long index = 0;
+	for (size_t i = 0; i < axes.size(); i++) {
+		long bin = axes[i]->getBin(candidate);
+		if (bin < 0)
+			return -1;
+		index = index * axes[i]->getNumberOfBins() + bin;
+	}
+	return index;
+}
+
+void HistogramOutput::fill(BinMap &bins, size_t index, double w, double w2) {
+	BinMap::iterator i = bins.find(index);
+	if (i == bins.end()) {
+		Bin bin = {w, w2};
+		bins.insert(std::make_pair(index, bin));
+	} else {
+		i->second.sumW += w;
+		i->second.sumW2 += w2;
+	}
+}
+
+void HistogramOutput::process(Candidate *candidate) const {
+	long index = getBinIndex(candidate);
+	if (index < 0)
+		return;
+	double w = useWeights ? candidate->getWeight() : 1;
+
+	ThreadHistogram &histogram = threadHistograms.local();
+	fill(histogram.bins, index, w, w * w);
+	histogram.entries += 1;
+}
+
+void HistogramOutput::merge() const {
+	for (size_t i = 0; i < threadHistograms.size(); i++) {
+		ThreadHistogram &h = threadHistograms[i];
+		for (BinMap::const_iterator j = h.bins.begin(); j != h.bins.end(); ++j)
+			fill(bins, j->first, j->second.sumW, j->second.sumW2);
+		BinMap().swap(h.bins);
+		nEntries += h.entries;
+		count += h.entries;
+		h.entries = 0;
+	}
+}
+
+std::vector<double> HistogramOutput::getCounts() const {
+	merge();
+	std::vector<double> counts(nBins, 0);
+	for (BinMap::const_iterator i = bins.begin(); i != bins.end(); ++i)
+		counts[i->first] = i->second.sumW;
+	return counts;
+}
+
+std::vector<double> HistogramOutput::getSquaredWeights() const {
+	merge();
+	std::vector<double> squares(nBins, 0);
+	for (BinMap::const_iterator i = bins.begin(); i != bins.end(); ++i)
+		squares[i->first] = i->second.sumW2;
+	return squares;
+}
+
+double HistogramOutput::getCount(size_t index) const {
+	if (index >= nBins)
+		throw std::runtime_error("HistogramOutput: bin index out of range");
+	merge();
+	BinMap::const_iterator i = bins.find(index);
+	return (i == bins.end()) ? 0 : i->second.sumW;
+}
+
+double HistogramOutput::getNumberOfEntries() const {
+	merge();
+	return nEntries;
+}
+
+size_t HistogramOutput::getNumberOfFilledBins() const {
+	merge();
+	return bins.size();
+}
+
+void HistogramOutput::clear() {
+	BinMap().swap(bins);
+	for (size_t i = 0; i < threadHistograms.size(); i++) {
+		BinMap().swap(threadHistograms[i].bins);
+		threadHistograms[i].entries = 0;
+	}
+	nEntries = 0;
+	count = 0;
+}
+
+// binary format: magic, version, axes (name, edges), number of entries,
+// filled bins (index, sum of weights, sum of squared weights) sorted by index
+static const char histogramMagic[8] = {'C', 'R', 'P', 'H', 'I', 'S', 'T', '\0'};
+static const uint16_t histogramVersion = 1;
+
+using namespace binary;
+
+void HistogramOutput::save(const std::string &filename) const {
+	merge();
+	std::ofstream out(filename.c_str(), std::ios::binary);
+	if (!out.is_open())
+		throw std::runtime_error(std::string("Cannot create file: ") + filename);
+
+	out.write(histogramMagic, sizeof(histogramMagic));
+	write<uint16_t>(out, histogramVersion);
+	write<uint32_t>(out, axes.size());
+	for (size_t i = 0; i < axes.size(); i++) {
+		writeString(out, axes[i]->getName());
+		const std::vector<double> &edges = axes[i]->getEdges();
+		write<uint64_t>(out, edges.size());
+		out.write(reinterpret_cast<const char *>(&edges[0]), edges.size() * sizeof(double));
+	}
+	write<double>(out, nEntries);
+
+	std::vector<size_t> indices;
+	indices.reserve(bins.size());
+	for (BinMap::const_iterator i = bins.begin(); i != bins.end(); ++i)
+		indices.push_back(i->first);
+	std::sort(indices.begin(), indices.end());
+	write<uint64_t>(out, indices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		const Bin &bin = bins[indices[i]];
+		write<uint64_t>(out, indices[i]);
+		write<double>(out, bin.sumW);
+		write<double>(out, bin.sumW2);
+	}
+
+	if (!out.good())
+		throw std::runtime_error("HistogramOutput: error writing to file " + filename);
+}
+
+void HistogramOutput::load(const std::string &filename) {
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	if (!in.good())
+		throw std::runtime_error("HistogramOutput: could not open file " + filename);
+
+	char magic[8];
+	in.read(magic, sizeof(magic));
+	if (!in || std::memcmp(magic, histogramMagic, sizeof(magic)) != 0)
+		throw std::runtime_error("HistogramOutput: not a histogram file " + filename);
+	if (read<uint16_t>(in) != histogramVersion)
+		throw std::runtime_error("HistogramOutput: unsupported format version in " + filename);
+
+	// the binning has to match exactly
+	if (read<uint32_t>(in) != axes.size())
+		throw std::runtime_error("HistogramOutput: different axes in " + filename);
+	for (size_t i = 0; i < axes.size(); i++) {
+		std::string name = readString(in);
+		uint64_t nEdges = read<uint64_t>(in);
+		if (!in || (name != axes[i]->getName()) || (nEdges != axes[i]->getEdges().size()))
+			throw std::runtime_error("HistogramOutput: different axes in " + filename);
+		std::vector<double> edges(nEdges);
+		in.read(reinterpret_cast<char *>(&edges[0]), edges.size() * sizeof(double));
+		if (!in || (edges != axes[i]->getEdges()))
+			throw std::runtime_error("HistogramOutput: different axes in " + filename);
+	}
+
+	double entries = read<double>(in);
+	uint64_t nFilled = read<uint64_t>(in);
+	BinMap loaded;
+	for (uint64_t i = 0; i < nFilled; i++) {
+		uint64_t index = read<uint64_t>(in);
+		double w = read<double>(in);
+		double w2 = read<double>(in);
+		if (!in || (index >= nBins))
+			throw std::runtime_error("HistogramOutput: error reading file " + filename);
+		fill(loaded, index, w, w2);
+	}
+
+	merge();
+	for (BinMap::const_iterator i = loaded.begin(); i != loaded.end(); ++i)
+		fill(bins, i->first, i->second.sumW, i->second.sumW2);
+	nEntries += entries;
+	count += entries;
+}
+
+std::string HistogramOutput::getDescription() const {
+	std::stringstream ss;
+	ss << "HistogramOutput: " << nBins << " bins";
+	for (size_t i = 0; i < axes.size(); i++)
+		ss << "\n  " << axes[i]->getDescription();
+	return ss.str();
+}
+
+} // namespace crpropa
@@ -0,0 +1,108 @@
+#include "crpropa/module/InteractionScheduler.h"
+#include "crpropa/Random.h"
+
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+namespace crpropa {
+
+InteractionScheduler::InteractionScheduler(std::string slotName) {
+	setSlotName(slotName);
+}
+
+void InteractionScheduler::add(StochasticInteraction *interaction) {
+	interactions.push_back(interaction);
+}
+
+size_t InteractionScheduler::size() const {
+	return interactions.size();
+}
+
+ref_ptr<StochasticInteraction> InteractionScheduler::operator[](size_t i) const {
+	return interactions.at(i);
+}
+
+void InteractionScheduler::setSlotName(std::string slotName) {
+	slot = Candidate::registerSlot(slotName);
+}
+
+std::string InteractionScheduler::getSlotName() const {
+	return Candidate::getSlotName(slot);
+}
+
+double InteractionScheduler::getOpticalDepth(const Candidate *candidate) const {
+	// the slot holds the bits of the double, 0 for unset
+	uint64_t bits = candidate->getSlot(slot);
+	double tau;
+	std::memcpy(&tau, &bits, sizeof(tau));
+	return tau;
+}
+
+void InteractionScheduler::setOpticalDepth(Candidate *candidate, double tau) const {
+	uint64_t bits;
+	std::memcpy(&bits, &tau, sizeof(bits));
+	candidate->setSlot(slot, bits);
+}
+
+double InteractionScheduler::interactionRate(const Candidate *candidate) const {
+	double rate = 0;
+	for (size_t i = 0; i < interactions.size(); i++)
+		rate += interactions[i]->interactionRate(candidate);
+	return rate;
+}
+
+void InteractionScheduler::process(Candidate *candidate) const {
+	if (interactions.empty())
+		return;
+
+	Random &random = Random::instance();
+	double step = candidate->getCurrentStep();
+
+	// remaining optical depth to the next interaction, always > 0 once drawn
+	double tau = getOpticalDepth(candidate);
+	if (tau <= 0)
+		tau = -log(random.rand());
+
+	std::vector<double> rates(interactions.size());
+	while (candidate->isActive()) {
+		double totalRate = 0;
+		for (size_t i = 0; i < interactions.size(); i++) {
+			rates[i] = interactions[i]->interactionRate(candidate);
+			totalRate += rates[i];
+		}
+		if (totalRate <= 0)
+			break;
+
+		// no interaction in the remaining step: limit the next step to the interaction point
+		if (tau > totalRate * step) {
+			tau -= totalRate * step;
+			candidate->limitNextStep(tau / totalRate);
+			break;
+		}
+
+		// interact and continue with the remaining step
+		step -= tau / totalRate;
+		double r = random.rand() * totalRate;
+		size_t i = 0;
+		for (; i + 1 < interactions.size(); i++) {
+			r -= rates[i];
+			if (r < 0)
+				break;
+		}
+		interactions[i]->interact(candidate);
+		tau = -log(random.rand());
+	}
+
+	setOpticalDepth(candidate, tau);
+}
+
+std::string InteractionScheduler::getDescription() const {
+	std::stringstream ss;
+	ss << "InteractionScheduler:";
+	for (size_t i = 0; i < interactions.size(); i++)
+		ss << "\n    " << interactions[i]->getDescription();
+	return ss.str();
+}
+
+} // namespace crpropa
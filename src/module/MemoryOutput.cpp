@@ -0,0 +1,165 @@
+#include "crpropa/module/MemoryOutput.h"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace crpropa {
+
+template<typename T>
+static double valueAt(const std::vector<char> &data, size_t i) {
+	T value;
+	std::memcpy(&value, &data[i * sizeof(T)], sizeof(T));
+	return value;
+}
+
+MemoryOutput::MemoryOutput() : Output(), nRows(0), nReserved(0) {
+}
+
+MemoryOutput::MemoryOutput(OutputType outputType) : Output(outputType), nRows(0), nReserved(0) {
+}
+
+void MemoryOutput::setupColumns() const {
+	std::vector<ColumnSpec> specs = getColumnSpecs();
+	columns.clear();
+	columns.resize(specs.size());
+	for (size_t i = 0; i < specs.size(); i++) {
+		Column &col = columns[i];
+		col.name = specs[i].name;
+		col.type = specs[i].type;
+		size_t n = packedSize(col.type);
+		if (n > 0)
+			col.data.reserve(n * nReserved);
+		else
+			col.strings.reserve(nReserved);
+	}
+}
+
+void MemoryOutput::process(Candidate *c) const {
+	if (fields.none() && properties.empty())
+		return;
+
+	// serialize the row in column order, scatter to the columns later
+	std::vector<char> row;
+	row.reserve(256);
+	packRow(c, row);
+
+#pragma omp critical(MemoryOutput)
+	{
+		if (nRows == 0)
+			setupColumns();
+		Output::process(c);
+
+		std::vector<char>::const_iterator pos = row.begin();
+		for (size_t i = 0; i < columns.size(); i++) {
+			Column &col = columns[i];
+			size_t n = packedSize(col.type);
+			if (n > 0) {
+				col.data.insert(col.data.end(), pos, pos + n);
+			} else {
+				uint32_t size;
+				std::memcpy(&size, &*pos, sizeof(size));
+				pos += sizeof(size);
+				col.strings.push_back(std::string(pos, pos + size));
+				n = size;
+			}
+			pos += n;
+		}
+		nRows++;
+	}
+}
+
+void MemoryOutput::reserve(size_t n) {
+	nReserved = n;
+	for (size_t i = 0; i < columns.size(); i++) {
+		size_t size = packedSize(columns[i].type);
+		if (size > 0)
+			columns[i].data.reserve(size * n);
+		else
+			columns[i].strings.reserve(n);
+	}
+}
+
+void MemoryOutput::clear() {
+	columns.clear();
+	nRows = 0;
+	count = 0;
+}
+
+size_t MemoryOutput::getNumberOfRows() const {
+	return nRows;
+}
+
+size_t MemoryOutput::getNumberOfColumns() const {
+	return columns.size();
+}
+
+std::vector<std::string> MemoryOutput::getColumnNames() const {
+	std::vector<std::string> names;
+	for (size_t i = 0; i < columns.size(); i++)
+		names.push_back(columns[i].name);
+	return names;
+}
+
+size_t MemoryOutput::findColumn(const std::string &name) const {
+	for (size_t i = 0; i < columns.size(); i++)
+		if (columns[i].name == name)
+			return i;
+	throw std::runtime_error("MemoryOutput: unknown column " + name);
+}
+
+bool MemoryOutput::hasColumn(const std::string &name) const {
+	for (size_t i = 0; i < columns.size(); i++)
+		if (columns[i].name == name)
+			return true;
+	return false;
+}
+
+Variant::Type MemoryOutput::getColumnType(const std::string &name) const {
+	return columns[findColumn(name)].type;
+}
+
+const void *MemoryOutput::getColumnData(const std::string &name) const {
+	const Column &col = columns[findColumn(name)];
+	if (col.type == Variant::TYPE_STRING)
+		throw std::runtime_error("MemoryOutput: " + name + " is a string column");
+	return col.data.empty() ? NULL : &col.data[0];
+}
+
+std::vector<double> MemoryOutput::getColumn(const std::string &name) const {
+	const Column &col = columns[findColumn(name)];
+	std::vector<double> values(nRows);
+	for (size_t i = 0; i < nRows; i++) {
+		switch (col.type) {
+		case Variant::TYPE_BOOL: values[i] = valueAt<uint8_t>(col.data, i); break;
+		case Variant::TYPE_CHAR: values[i] = valueAt<char>(col.data, i); break;
+		case Variant::TYPE_UCHAR: values[i] = valueAt<unsigned char>(col.data, i); break;
+		case Variant::TYPE_INT16: values[i] = valueAt<int16_t>(col.data, i); break;
+		case Variant::TYPE_UINT16: values[i] = valueAt<uint16_t>(col.data, i); break;
+		case Variant::TYPE_INT32: values[i] = valueAt<int32_t>(col.data, i); break;
+		case Variant::TYPE_UINT32: values[i] = valueAt<uint32_t>(col.data, i); break;
+		case Variant::TYPE_INT64: values[i] = valueAt<int64_t>(col.data, i); break;
+		case Variant::TYPE_UINT64: values[i] = valueAt<uint64_t>(col.data, i); break;
+		case Variant::TYPE_FLOAT: values[i] = valueAt<float>(col.data, i); break;
+		case Variant::TYPE_DOUBLE: values[i] = valueAt<double>(col.data, i); break;
+		default:
+			throw std::runtime_error("MemoryOutput: " + name + " is a string column");
+		}
+	}
+	return values;
+}
+
+std::vector<std::string> MemoryOutput::getStringColumn(const std::string &name) const {
+	const Column &col = columns[findColumn(name)];
+	if (col.type != Variant::TYPE_STRING)
+		throw std::runtime_error("MemoryOutput: " + name + " is not a string column");
+	return col.strings;
+}
+
+std::string MemoryOutput::getDescription() const {
+	std::stringstream ss;
+	ss << "MemoryOutput: " << nRows << " rows, " << columns.size() << " columns";
+	return ss.str();
+}
+
+} // namespace crpropa
@@ -316,4 +316,44 @@ std::string NuclearDecay::getInteractionTag() const {
 	return interactionTag;
 }
 
+double NuclearDecay::interactionRate(const Candidate *candidate) const {
+	int id = candidate->current.getId();
+	if (not (isNucleus(id)))
+		return 0;
+
+	int A = massNumber(id);
+	int Z = chargeNumber(id);
+	int N = A - Z;
+	const std::vector<DecayMode> &decays = decayTable[Z * 31 + N];
+
+	double totalRate = 0;
+	for (size_t i = 0; i < decays.size(); i++)
+		totalRate += decays[i].rate;
+	// relativistic time dilation and rate per comoving distance
+	return totalRate / candidate->current.getLorentzFactor() / (1 + candidate->getRedshift());
+}
+
+void NuclearDecay::interact(Candidate *candidate) const {
+	int id = candidate->current.getId();
+	int A = massNumber(id);
+	int Z = chargeNumber(id);
+	int N = A - Z;
+	const std::vector<DecayMode> &decays = decayTable[Z * 31 + N];
+	if (decays.size() == 0)
+		return;
+
+	// select the decay mode according to the partial rates
+	double totalRate = 0;
+	for (size_t i = 0; i < decays.size(); i++)
+		totalRate += decays[i].rate;
+	double r = Random::instance().rand() * totalRate;
+	size_t i = 0;
+	for (; i + 1 < decays.size(); i++) {
+		r -= decays[i].rate;
+		if (r < 0)
+			break;
+	}
+	performInteraction(candidate, decays[i].channel);
+}
+
 } // namespace crpropa
@@ -5,6 +5,7 @@
 
 #include "kiss/logger.h"
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 
@@ -260,67 +261,94 @@ std::string ObserverParticleIdVeto::getDescription() const {
 
 
 // ObserverTimeEvolution --------------------------------------------------------
-ObserverTimeEvolution::ObserverTimeEvolution() {}
+ObserverTimeEvolution::ObserverTimeEvolution() {
+	init();
+}
 
 ObserverTimeEvolution::ObserverTimeEvolution(double min, double dist, double numb) {
+	init();
 	double max = min + numb * dist;
 	bool log = false;
 	addTimeRange(min, max, numb, log);
 }
 
 ObserverTimeEvolution::ObserverTimeEvolution(double min, double max, double numb, bool log) {
+	init();
 	addTimeRange(min, max, numb, log);
 }
 
+void ObserverTimeEvolution::init() {
+	indexSlot = Candidate::registerSlot("DetectionIndex");
+	beginSlot = Candidate::registerSlot("DetectionIndexBegin");
+	batchDetection = false;
+	sorted = true;
+	regular = false;
+	regularLog = false;
+	regularMin = 0;
+	regularStep = 0;
+}
 
 DetectionState ObserverTimeEvolution::checkDetection(Candidate *c) const {
+	// Load the number of passed detection times
+	size_t index = c->getSlot(indexSlot);
 
-	if (detList.size()) {
-		double length = c->getTrajectoryLength();
-		size_t index;
-		const std::string DI = "DetectionIndex";
-		std::string value;
-
-		// Load the last detection index
-		if (c->hasProperty(DI)) {
-			index = c->getProperty(DI).asUInt64();
-		}
-		else {
-			index = 0;
-		}
-
-		// Break if the particle has been detected once for all detList entries.
-		if (index > detList.size()) {
-			return NOTHING;
-		}
+	// Break if the particle has been detected once for all detList entries.
+	if (index >= detList.size())
+		return NOTHING;
 
-		// Calculate the distance to next detection
-		double distance = length - detList[index];
+	// Limit next step to the next detection
+	double length = c->getTrajectoryLength();
+	if (length < detList[index]) {
+		c->limitNextStep(detList[index] - length);
+		return NOTHING;
+	}
 
-		// Limit next step and detect candidate.
-		// Increase the index by one in case of detection
-		if (distance < 0.) {
-			c->limitNextStep(-distance);
-			return NOTHING;
-		}
-		else {
+	// Pass one or all crossed detection times
+	size_t next = batchDetection ? countTimes(length, index) : index + 1;
+	if ((next < detList.size()) and (detList[next] > length))
+		c->limitNextStep(detList[next] - length);
+	c->setSlot(beginSlot, index);
+	c->setSlot(indexSlot, next);
+	return DETECTED;
+}
 
-			if (index < detList.size()-1) {
-				c->limitNextStep(detList[index+1]-length);
-			}
-			c->setProperty(DI, Variant::fromUInt64(index+1));
+size_t ObserverTimeEvolution::countTimes(double length, size_t index) const {
+	size_t n = detList.size();
+	size_t count = index + 1;
+	if (not sorted) {
+		while ((count < n) and (detList[count] <= length))
+			count++;
+		return count;
+	}
 
-			return DETECTED;
-		}
+	if (regular) {
+		// direct estimate, corrected for rounding below
+		double i = regularLog ? std::log(length / regularMin) / regularStep
+				: (length - regularMin) / regularStep;
+		if (i + 1 >= n)
+			count = n;
+		else if (i + 1 > count)
+			count = i + 1;
+		while ((count < n) and (detList[count] <= length))
+			count++;
+		while ((count > index + 1) and (detList[count - 1] > length))
+			count--;
+		return count;
 	}
-	return NOTHING;
+
+	return std::upper_bound(detList.begin() + count, detList.end(), length)
+			- detList.begin();
 }
 
 void ObserverTimeEvolution::addTime(const double& t) {
+	if ((detList.size() > 0) and (t < detList.back()))
+		sorted = false;
 	detList.push_back(t);
+	regular = false;
 }
 
 void ObserverTimeEvolution::addTimeRange(double min, double max, double numb, bool log) {
+	bool first = detList.empty();
 	for (size_t i = 0; i < numb; i++) {
 		if (log == true) {
 			addTime(min * pow(max / min, i / (numb - 1.0)));
@@ -328,6 +356,32 @@ void ObserverTimeEvolution::addTimeRange(double min, double max, double numb, bo
 			addTime(min + i * (max - min) / numb);
 		}
 	}
+
+	// a single range allows to compute the index directly
+	regular = first and (numb > 1) and (max > min) and ((min > 0) or (not log));
+	regularLog = log;
+	regularMin = min;
+	regularStep = log ? std::log(max / min) / (numb - 1.0) : (max - min) / numb;
+}
+
+void ObserverTimeEvolution::setBatchDetection(bool batch) {
+	batchDetection = batch;
+}
+
+bool ObserverTimeEvolution::getBatchDetection() const {
+	return batchDetection;
+}
+
+size_t ObserverTimeEvolution::getDetectionIndex(const Candidate *candidate) const {
+	return candidate->getSlot(indexSlot);
+}
+
+std::vector<double> ObserverTimeEvolution::getDetectedTimes(const Candidate *candidate) const {
+	size_t begin = candidate->getSlot(beginSlot);
+	size_t end = std::min<size_t>(candidate->getSlot(indexSlot), detList.size());
+	if (begin >= end)
+		return std::vector<double>();
+	return std::vector<double>(detList.begin() + begin, detList.begin() + end);
 }
 
 const std::vector<double>& ObserverTimeEvolution::getTimes() const {
@@ -365,4 +419,40 @@ std::string ObserverSurface::getDescription() const {
 	return ss.str();
 }
 
+// ObserverSurfaces -----------------------------------------------------------
+ObserverSurfaces::ObserverSurfaces() : index(new SurfaceIndex()) {
+}
+
+size_t ObserverSurfaces::add(Surface *surface) {
+	return index->add(surface);
+}
+
+size_t ObserverSurfaces::addSphere(const Vector3d &center, double radius) {
+	return index->add(new Sphere(center, radius));
+}
+
+size_t ObserverSurfaces::size() const {
+	return index->size();
+}
+
+SurfaceIndex *ObserverSurfaces::getIndex() const {
+	return index;
+}
+
+DetectionState ObserverSurfaces::checkDetection(Candidate *candidate) const {
+	candidate->limitNextStep(index->distance(candidate->current.getPosition()));
+
+	if (index->findCrossing(candidate->previous.getPosition(),
+			candidate->current.getPosition()) < 0)
+		return NOTHING;
+	else
+		return DETECTED;
+}
+
+std::string ObserverSurfaces::getDescription() const {
+	std::stringstream ss;
+	ss << "ObserverSurfaces: " << index->size() << " surfaces";
+	return ss.str();
+}
+
 } // namespace crpropa
@@ -1,4 +1,5 @@
 #include "crpropa/module/Output.h"
+#include "crpropa/BinaryIO.h"
 #include "crpropa/Units.h"
 
 #include <stdexcept>
@@ -133,4 +134,237 @@ void Output::enableProperty(const std::string &property, const Variant &defaultV
 	properties.push_back(prop);
 };
 
+size_t Output::packedSize(Variant::Type type) {
+	switch (type) {
+	case Variant::TYPE_BOOL:
+	case Variant::TYPE_CHAR:
+	case Variant::TYPE_UCHAR:
+		return 1;
+	case Variant::TYPE_INT16:
+	case Variant::TYPE_UINT16:
+		return 2;
+	case Variant::TYPE_INT32:
+	case Variant::TYPE_UINT32:
+	case Variant::TYPE_FLOAT:
+		return 4;
+	case Variant::TYPE_INT64:
+	case Variant::TYPE_UINT64:
+	case Variant::TYPE_DOUBLE:
+		return 8;
+	case Variant::TYPE_STRING:
+		return 0;
+	default:
+		throw std::runtime_error("Output: unsupported column type");
+	}
+}
+
+std::vector<Output::ColumnSpec> Output::getColumnSpecs() const {
+	std::vector<ColumnSpec> columns;
+	struct Add {
+		std::vector<ColumnSpec> &columns;
+		void operator()(const std::string &name, Variant::Type type) {
+			packedSize(type); // check that the type is supported
+			ColumnSpec col;
+			col.name = name;
+			col.type = type;
+			columns.push_back(col);
+		}
+	} add = {columns};
+
+	if (fields.test(TrajectoryLengthColumn))
+		add("D", Variant::TYPE_DOUBLE);
+	if (fields.test(RedshiftColumn))
+		add("z", Variant::TYPE_DOUBLE);
+	if (fields.test(SerialNumberColumn))
+		add("SN", Variant::TYPE_UINT64);
+	if (fields.test(CurrentIdColumn))
+		add("ID", Variant::TYPE_INT32);
+	if (fields.test(CurrentEnergyColumn))
+		add("E", Variant::TYPE_DOUBLE);
+	if (fields.test(CurrentPositionColumn)) {
+		add("X", Variant::TYPE_DOUBLE);
+		if (not oneDimensional) {
+			add("Y", Variant::TYPE_DOUBLE);
+			add("Z", Variant::TYPE_DOUBLE);
+		}
+	}
+	if (fields.test(CurrentDirectionColumn) && not oneDimensional) {
+		add("Px", Variant::TYPE_DOUBLE);
+		add("Py", Variant::TYPE_DOUBLE);
+		add("Pz", Variant::TYPE_DOUBLE);
+	}
+	if (fields.test(SerialNumberColumn))
+		add("SN0", Variant::TYPE_UINT64);
+	if (fields.test(SourceIdColumn))
+		add("ID0", Variant::TYPE_INT32);
+	if (fields.test(SourceEnergyColumn))
+		add("E0", Variant::TYPE_DOUBLE);
+	if (fields.test(SourcePositionColumn)) {
+		add("X0", Variant::TYPE_DOUBLE);
+		if (not oneDimensional) {
+			add("Y0", Variant::TYPE_DOUBLE);
+			add("Z0", Variant::TYPE_DOUBLE);
+		}
+	}
+	if (fields.test(SourceDirectionColumn) && not oneDimensional) {
+		add("P0x", Variant::TYPE_DOUBLE);
+		add("P0y", Variant::TYPE_DOUBLE);
+		add("P0z", Variant::TYPE_DOUBLE);
+	}
+	if (fields.test(SerialNumberColumn))
+		add("SN1", Variant::TYPE_UINT64);
+	if (fields.test(CreatedIdColumn))
+		add("ID1", Variant::TYPE_INT32);
+	if (fields.test(CreatedEnergyColumn))
+		add("E1", Variant::TYPE_DOUBLE);
+	if (fields.test(CreatedPositionColumn)) {
+		add("X1", Variant::TYPE_DOUBLE);
+		if (not oneDimensional) {
+			add("Y1", Variant::TYPE_DOUBLE);
+			add("Z1", Variant::TYPE_DOUBLE);
+		}
+	}
+	if (fields.test(CreatedDirectionColumn) && not oneDimensional) {
+		add("P1x", Variant::TYPE_DOUBLE);
+		add("P1y", Variant::TYPE_DOUBLE);
+		add("P1z", Variant::TYPE_DOUBLE);
+	}
+	if (fields.test(WeightColumn))
+		add("W", Variant::TYPE_DOUBLE);
+	if (fields.test(CandidateTagColumn))
+		add("tag", Variant::TYPE_STRING);
+	for (size_t i = 0; i < properties.size(); i++)
+		add(properties[i].name, properties[i].defaultValue.getType());
+	return columns;
+}
+
+using binary::put;
+using binary::putString;
+
+// append a variant converted to the type of the column
+static void putVariant(std::vector<char> &row, Variant::Type type, const Variant &v) {
+	switch (type) {
+	case Variant::TYPE_BOOL:
+		put<uint8_t>(row, v.toBool());
+		break;
+	case Variant::TYPE_CHAR:
+		put<char>(row, v.toChar());
+		break;
+	case Variant::TYPE_UCHAR:
+		put<unsigned char>(row, v.toUChar());
+		break;
+	case Variant::TYPE_INT16:
+		put<int16_t>(row, v.toInt16());
+		break;
+	case Variant::TYPE_UINT16:
+		put<uint16_t>(row, v.toUInt16());
+		break;
+	case Variant::TYPE_INT32:
+		put<int32_t>(row, v.toInt32());
+		break;
+	case Variant::TYPE_UINT32:
+		put<uint32_t>(row, v.toUInt32());
+		break;
+	case Variant::TYPE_INT64:
+		put<int64_t>(row, v.toInt64());
+		break;
+	case Variant::TYPE_UINT64:
+		put<uint64_t>(row, v.toUInt64());
+		break;
+	case Variant::TYPE_FLOAT:
+		put<float>(row, v.toFloat());
+		break;
+	case Variant::TYPE_DOUBLE:
+		put<double>(row, v.toDouble());
+		break;
+	case Variant::TYPE_STRING:
+		putString(row, v.toString());
+		break;
+	default:
+		throw std::runtime_error("Output: unsupported property type");
+	}
+}
+
+void Output::packRow(Candidate *c, std::vector<char> &row) const {
+	if (fields.test(TrajectoryLengthColumn))
+		put<double>(row, c->getTrajectoryLength() / lengthScale);
+	if (fields.test(RedshiftColumn))
+		put<double>(row, c->getRedshift());
+	if (fields.test(SerialNumberColumn))
+		put<uint64_t>(row, c->getSerialNumber());
+	if (fields.test(CurrentIdColumn))
+		put<int32_t>(row, c->current.getId());
+	if (fields.test(CurrentEnergyColumn))
+		put<double>(row, c->current.getEnergy() / energyScale);
+	if (fields.test(CurrentPositionColumn)) {
+		const Vector3d pos = c->current.getPosition() / lengthScale;
+		put<double>(row, pos.x);
+		if (not oneDimensional) {
+			put<double>(row, pos.y);
+			put<double>(row, pos.z);
+		}
+	}
+	if (fields.test(CurrentDirectionColumn) && not oneDimensional) {
+		const Vector3d dir = c->current.getDirection();
+		put<double>(row, dir.x);
+		put<double>(row, dir.y);
+		put<double>(row, dir.z);
+	}
+
+	if (fields.test(SerialNumberColumn))
+		put<uint64_t>(row, c->getSourceSerialNumber());
+	if (fields.test(SourceIdColumn))
+		put<int32_t>(row, c->source.getId());
+	if (fields.test(SourceEnergyColumn))
+		put<double>(row, c->source.getEnergy() / energyScale);
+	if (fields.test(SourcePositionColumn)) {
+		const Vector3d pos = c->source.getPosition() / lengthScale;
+		put<double>(row, pos.x);
+		if (not oneDimensional) {
+			put<double>(row, pos.y);
+			put<double>(row, pos.z);
+		}
+	}
+	if (fields.test(SourceDirectionColumn) && not oneDimensional) {
+		const Vector3d dir = c->source.getDirection();
+		put<double>(row, dir.x);
+		put<double>(row, dir.y);
+		put<double>(row, dir.z);
+	}
+
+	if (fields.test(SerialNumberColumn))
+		put<uint64_t>(row, c->getCreatedSerialNumber());
+	if (fields.test(CreatedIdColumn))
+		put<int32_t>(row, c->created.getId());
+	if (fields.test(CreatedEnergyColumn))
+		put<double>(row, c->created.getEnergy() / energyScale);
+	if (fields.test(CreatedPositionColumn)) {
+		const Vector3d pos = c->created.getPosition() / lengthScale;
+		put<double>(row, pos.x);
+		if (not oneDimensional) {
+			put<double>(row, pos.y);
+			put<double>(row, pos.z);
+		}
+	}
+	if (fields.test(CreatedDirectionColumn) && not oneDimensional) {
+		const Vector3d dir = c->created.getDirection();
+		put<double>(row, dir.x);
+		put<double>(row, dir.y);
+		put<double>(row, dir.z);
+	}
+
+	if (fields.test(WeightColumn))
+		put<double>(row, c->getWeight());
+	if (fields.test(CandidateTagColumn))
+		putString(row, c->getTagOrigin());
+
+	for (size_t i = 0; i < properties.size(); i++) {
+		const Property &p = properties[i];
+		if (c->hasProperty(p.name))
+			putVariant(row, p.defaultValue.getType(), c->getProperty(p.name));
+		else
+			putVariant(row, p.defaultValue.getType(), p.defaultValue);
+	}
+}
+
 } // namespace crpropa
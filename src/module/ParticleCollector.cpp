@@ -2,6 +2,11 @@
 #include "crpropa/module/TextOutput.h"
 #include "crpropa/Units.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
 namespace crpropa {
 
 ParticleCollector::ParticleCollector() : nBuffer(10e6), clone(false), recursive(false)  {
@@ -43,6 +48,88 @@ void ParticleCollector::reprocess(Module *action) const {
 	}
 }
 
+void ParticleCollector::snapshot(MemoryOutput *output) const {
+	output->reserve(output->getNumberOfRows() + container.size());
+	for (size_t i = 0; i < container.size(); i++)
+		output->process(container[i]);
+}
+
+void ParticleCollector::reprocessParallel(Module *action) const {
+	size_t n = container.size();
+#pragma omp parallel for schedule(dynamic, 1000)
+	for (size_t i = 0; i < n; i++) {
+		if (clone)
+			action->process(container[i]->clone(false));
+		else
+			action->process(container[i]);
+	}
+}
+
+static const char binaryMagic[8] = {'C', 'R', 'P', 'C', 'A', 'N', 'D', '\0'};
+
+static uint16_t readBinaryHeader(std::istream &in, const std::string &filename, uint64_t &count) {
+	char magic[sizeof(binaryMagic)];
+	uint16_t version;
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char *>(&version), sizeof(version));
+	in.read(reinterpret_cast<char *>(&count), sizeof(count));
+	if (!in || std::memcmp(magic, binaryMagic, sizeof(magic)) != 0)
+		throw std::runtime_error("ParticleCollector: not a binary candidate file " + filename);
+	return version;
+}
+
+void ParticleCollector::dumpBinary(const std::string &filename, bool recursive) const {
+	std::ofstream out(filename.c_str(), std::ios::binary);
+	if (!out.is_open())
+		throw std::runtime_error(std::string("Cannot create file: ") + filename);
+
+	uint16_t version = Candidate::serializationVersion;
+	uint64_t count = container.size();
+	out.write(binaryMagic, sizeof(binaryMagic));
+	out.write(reinterpret_cast<const char *>(&version), sizeof(version));
+	out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+	for (const_iterator itr = container.begin(); itr != container.end(); ++itr)
+		(*itr)->serialize(out, recursive);
+
+	if (!out.good())
+		throw std::runtime_error("ParticleCollector: error writing to file " + filename);
+}
+
+void ParticleCollector::loadBinary(const std::string &filename) {
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	if (!in.good())
+		throw std::runtime_error("crpropa::ParticleCollector: could not open file " + filename);
+
+	uint64_t count;
+	uint16_t version = readBinaryHeader(in, filename, count);
+	container.reserve(container.size() + count);
+	for (uint64_t i = 0; i < count; i++)
+		container.push_back(Candidate::deserialize(in, version));
+}
+
+void ParticleCollector::reprocessBinary(const std::string &filename, Module *action, std::size_t chunkSize) {
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	if (!in.good())
+		throw std::runtime_error("crpropa::ParticleCollector: could not open file " + filename);
+	if (chunkSize == 0)
+		throw std::runtime_error("ParticleCollector: chunk size must be positive");
+
+	uint64_t count;
+	uint16_t version = readBinaryHeader(in, filename, count);
+	tContainer chunk;
+	chunk.reserve(std::min<uint64_t>(count, chunkSize));
+	for (uint64_t offset = 0; offset < count; offset += chunk.size()) {
+		chunk.clear();
+		for (uint64_t i = offset; (i < count) && (chunk.size() < chunkSize); i++)
+			chunk.push_back(Candidate::deserialize(in, version));
+
+		size_t n = chunk.size();
+#pragma omp parallel for schedule(dynamic, 100)
+		for (size_t i = 0; i < n; i++)
+			action->process(chunk[i]);
+	}
+}
+
 void ParticleCollector::dump(const std::string &filename) const {
 	TextOutput output(filename.c_str(), Output::Everything);
 	reprocess(&output);
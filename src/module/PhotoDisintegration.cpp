@@ -5,8 +5,10 @@
 #include "crpropa/Random.h"
 #include "kiss/logger.h"
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <map>
 #include <sstream>
 #include <fstream>
 #include <stdexcept>
@@ -73,9 +75,9 @@ void PhotoDisintegration::initBranching(std::string filename) {
 	if (not infile.good())
 		throw std::runtime_error("PhotoDisintegration: could not open file " + filename);
 
-	// clear previously loaded interaction rates
-	pdBranch.clear();
-	pdBranch.resize(27 * 31);
+	// read the channels and branching ratios per nucleus
+	std::vector<std::vector<int> > channels(27 * 31);
+	std::vector<std::vector<double> > ratios(27 * 31);
 
 	std::string line;
 	while (std::getline(infile, line)) {
@@ -88,19 +90,36 @@ void PhotoDisintegration::initBranching(std::string filename) {
 		lineStream >> Z;
 		lineStream >> N;
 
-		Branch branch;
-		lineStream >> branch.channel;
+		int channel;
+		lineStream >> channel;
+		channels[Z * 31 + N].push_back(channel);
 
 		double r;
 		for (size_t i = 0; i < nlg; i++) {
 			lineStream >> r;
-			branch.branchingRatio.push_back(r);
+			ratios[Z * 31 + N].push_back(r);
 		}
-
-		pdBranch[Z * 31 + N].push_back(branch);
 	}
 
 	infile.close();
+
+	// pack the cumulative branching ratios as [Lorentz factor][channel]
+	pdBranchOffset.assign(27 * 31 + 1, 0);
+	pdChannel.clear();
+	pdBranchCdf.clear();
+	for (size_t idx = 0; idx < 27 * 31; idx++) {
+		size_t n = channels[idx].size();
+		pdBranchOffset[idx] = pdChannel.size();
+		pdChannel.insert(pdChannel.end(), channels[idx].begin(), channels[idx].end());
+		for (size_t l = 0; l < nlg; l++) {
+			double cdf = 0;
+			for (size_t i = 0; i < n; i++) {
+				cdf += ratios[idx][i * nlg + l];
+				pdBranchCdf.push_back(cdf);
+			}
+		}
+	}
+	pdBranchOffset[27 * 31] = pdChannel.size();
 }
 
 void PhotoDisintegration::initPhotonEmission(std::string filename) {
@@ -108,8 +127,9 @@ void PhotoDisintegration::initPhotonEmission(std::string filename) {
 	if (not infile.good())
 		throw std::runtime_error("PhotoDisintegration: could not open file " + filename);
 
-	// clear previously loaded emission probabilities
-	pdPhoton.clear();
+	// read the emissions per nucleus and daughter nucleus
+	std::map<std::pair<int, int>, std::vector<double> > energies;
+	std::map<std::pair<int, int>, std::vector<double> > probabilities;
 
 	std::string line;
 	while (std::getline(infile, line)) {
@@ -124,25 +144,52 @@ void PhotoDisintegration::initPhotonEmission(std::string filename) {
 		lineStream >> Zd;
 		lineStream >> Nd;
 
-		PhotonEmission em;
-		lineStream >> em.energy;
-		em.energy *= eV;
+		std::pair<int, int> key(Z * 31 + N, Zd * 31 + Nd);
+		double energy;
+		lineStream >> energy;
+		energies[key].push_back(energy * eV);
 
 		double r;
 		for (size_t i = 0; i < nlg; i++) {
 			lineStream >> r;
-			em.emissionProbability.push_back(r);
+			probabilities[key].push_back(r);
 		}
-
-		int key = Z * 1000000 + N * 10000 + Zd * 100 + Nd;
-		if (pdPhoton.find(key) == pdPhoton.end()) {
-			std::vector<PhotonEmission> emissions;
-			pdPhoton[key] = emissions;
-		}
-		pdPhoton[key].push_back(em);
 	}
 
 	infile.close();
+
+	// pack the emission probabilities as [Lorentz factor][emission] per daughter nucleus
+	pdPhotonOffset.assign(27 * 31 + 1, 0);
+	pdPhotonDaughter.clear();
+	pdPhotonBegin.clear();
+	pdPhotonEnergy.clear();
+	pdPhotonProbability.clear();
+	std::map<std::pair<int, int>, std::vector<double> >::const_iterator it;
+	size_t idx = 0;
+	for (it = energies.begin(); it != energies.end(); ++it) {
+		while (idx <= size_t(it->first.first))
+			pdPhotonOffset[idx++] = pdPhotonDaughter.size();
+		pdPhotonDaughter.push_back(it->first.second);
+		pdPhotonBegin.push_back(pdPhotonEnergy.size());
+
+		const std::vector<double> &p = probabilities[it->first];
+		size_t n = it->second.size();
+		pdPhotonEnergy.insert(pdPhotonEnergy.end(), it->second.begin(), it->second.end());
+		for (size_t l = 0; l < nlg; l++)
+			for (size_t i = 0; i < n; i++)
+				pdPhotonProbability.push_back(p[i * nlg + l]);
+	}
+	while (idx <= 27 * 31)
+		pdPhotonOffset[idx++] = pdPhotonDaughter.size();
+	pdPhotonBegin.push_back(pdPhotonEnergy.size());
+}
+
+int PhotoDisintegration::selectChannel(size_t idx, size_t l, double r) const {
+	// first channel with a cumulative branching ratio >= r
+	size_t n = pdBranchOffset[idx + 1] - pdBranchOffset[idx];
+	const double *cdf = &pdBranchCdf[pdBranchOffset[idx] * nlg + l * n];
+	size_t i = std::lower_bound(cdf, cdf + n, r) - cdf;
+	return pdChannel[pdBranchOffset[idx] + std::min(i, n - 1)];
 }
 
 void PhotoDisintegration::process(Candidate *candidate) const {
@@ -184,15 +231,11 @@ void PhotoDisintegration::process(Candidate *candidate) const {
 		}
 
 		// select channel and interact
-		const std::vector<Branch> &branches = pdBranch[idx];
+		if (pdBranchOffset[idx + 1] == pdBranchOffset[idx])
+			return;
 		double cmp = random.rand();
 		int l = round((lg - lgmin) / (lgmax - lgmin) * (nlg - 1)); // index of closest tabulation point
-		size_t i = 0;
-		while ((i < branches.size()) and (cmp > 0)) {
-			cmp -= branches[i].branchingRatio[l];
-			i++;
-		}
-		performInteraction(candidate, branches[i-1].channel);
+		performInteraction(candidate, selectChannel(idx, l, cmp));
 
 		// repeat with remaining step
 		step -= randDist;
@@ -256,16 +299,28 @@ void PhotoDisintegration::performInteraction(Candidate *candidate, int channel)
 	double lf = candidate->current.getLorentzFactor();
 
 	int l = round((lg - lgmin) / (lgmax - lgmin) * (nlg - 1));  // index of closest tabulation point
-	int key = Z*1e6 + (A-Z)*1e4 + (Z+dZ)*1e2 + (A+dA) - (Z+dZ);
+	size_t idx = Z * 31 + A - Z;
+	int daughter = (Z + dZ) * 31 + (A + dA) - (Z + dZ);
+
+	// find the emissions for this daughter nucleus
+	const int *first = pdPhotonDaughter.data() + pdPhotonOffset[idx];
+	const int *last = pdPhotonDaughter.data() + pdPhotonOffset[idx + 1];
+	const int *group = std::lower_bound(first, last, daughter);
+	if ((group == last) or (*group != daughter))
+		return;
+	size_t g = group - pdPhotonDaughter.data();
+	size_t begin = pdPhotonBegin[g];
+	size_t n = pdPhotonBegin[g + 1] - begin;
+	const double *probability = &pdPhotonProbability[begin * nlg + l * n];
 
-	for (int i = 0; i < pdPhoton[key].size(); i++) {
+	for (size_t i = 0; i < n; i++) {
 		// check for random emission
-		if (random.rand() > pdPhoton[key][i].emissionProbability[l])
+		if (random.rand() > probability[i])
 			continue;
 
 		// boost to lab frame
 		double cosTheta = 2 * random.rand() - 1;
-		double E = pdPhoton[key][i].energy * lf * (1 - cosTheta);
+		double E = pdPhotonEnergy[begin + i] * lf * (1 - cosTheta);
 		candidate->addSecondary(22, E, pos, 1., interactionTag);
 	}
 }
@@ -300,9 +355,11 @@ double PhotoDisintegration::lossLength(int id, double gamma, double z) {
 
 	// average number of nucleons lost for all disintegration channels
 	double avg_dA = 0;
-	const std::vector<Branch> &branches = pdBranch[idx];
-	for (size_t i = 0; i < branches.size(); i++) {
-		int channel = branches[i].channel;
+	size_t n = pdBranchOffset[idx + 1] - pdBranchOffset[idx];
+	const double *cdf = &pdBranchCdf[pdBranchOffset[idx] * nlg];
+	std::vector<double> branchingRatio(nlg);
+	for (size_t i = 0; i < n; i++) {
+		int channel = pdChannel[pdBranchOffset[idx] + i];
 		int dA = 0;
 		dA += 1 * digit(channel, 100000);
 		dA += 1 * digit(channel, 10000);
@@ -311,7 +368,9 @@ double PhotoDisintegration::lossLength(int id, double gamma, double z) {
 		dA += 3 * digit(channel, 10);
 		dA += 4 * digit(channel, 1);
 
-		double br = interpolateEquidistant(lg, lgmin, lgmax, branches[i].branchingRatio);
+		for (size_t l = 0; l < nlg; l++)
+			branchingRatio[l] = cdf[l * n + i] - ((i > 0) ? cdf[l * n + i - 1] : 0);
+		double br = interpolateEquidistant(lg, lgmin, lgmax, branchingRatio);
 		avg_dA += br * dA;
 	}
 
@@ -327,4 +386,38 @@ std::string PhotoDisintegration::getInteractionTag() const {
 	return interactionTag;
 }
 
+double PhotoDisintegration::interactionRate(const Candidate *candidate) const {
+	int id = candidate->current.getId();
+	if (not isNucleus(id))
+		return 0;
+
+	int A = massNumber(id);
+	int Z = chargeNumber(id);
+	int N = A - Z;
+	size_t idx = Z * 31 + N;
+	if ((Z > 26) or (N > 30))
+		return 0;
+	if ((pdRate[idx].size() == 0) or (pdBranchOffset[idx + 1] == pdBranchOffset[idx]))
+		return 0;
+
+	double z = candidate->getRedshift();
+	double lg = log10(candidate->current.getLorentzFactor() * (1 + z));
+	if ((lg <= lgmin) or (lg >= lgmax))
+		return 0;
+
+	double rate = interpolateEquidistant(lg, lgmin, lgmax, pdRate[idx]);
+	return rate * pow_integer<2>(1 + z) * photonField->getRedshiftScaling(z); // rate per comoving distance
+}
+
+void PhotoDisintegration::interact(Candidate *candidate) const {
+	int id = candidate->current.getId();
+	int A = massNumber(id);
+	int Z = chargeNumber(id);
+	size_t idx = Z * 31 + A - Z;
+	double z = candidate->getRedshift();
+	double lg = log10(candidate->current.getLorentzFactor() * (1 + z));
+	int l = round((lg - lgmin) / (lgmax - lgmin) * (nlg - 1)); // index of closest tabulation point
+	performInteraction(candidate, selectChannel(idx, l, Random::instance().rand()));
+}
+
 } // namespace crpropa
@@ -7,12 +7,18 @@
 #include "kiss/logger.h"
 #include "sophia.h"
 
+#include <algorithm>
 #include <limits>
 #include <cmath>
 #include <sstream>
 #include <fstream>
 #include <stdexcept>
 
+// SOPHIA draws its random numbers from the thread local generator
+extern "C" double crprndm_(int &idummy) {
+	return crpropa::Random::instance().randDblExc();
+}
+
 namespace crpropa {
 
 PhotoPionProduction::PhotoPionProduction(ref_ptr<PhotonField> field, bool photons, bool neutrinos, bool electrons, bool antiNucleons, double l, bool redshift) {
@@ -39,6 +45,8 @@ void PhotoPionProduction::setPhotonField(ref_ptr<PhotonField> field) {
 	}
 	
 	setDescription("PhotoPionProduction: " + fname);
+	if (sampleTable)
+		buildSampleTable();
 	if (haveRedshiftDependence){
 		initRate(getDataPath("PhotoPionProduction/rate_" + fname.replace(0, 3, "IRBz") + ".txt"));
 	}
@@ -231,10 +239,14 @@ void PhotoPionProduction::performInteraction(Candidate *candidate, bool onProton
 	int outPartID[2000];
 	int nParticles;
 
+#ifdef CRPROPA_HAVE_REENTRANT_SOPHIA
+	sophiaevent_(nature, Ein, eps, outputEnergy, outPartID, nParticles);
+#else
 #pragma omp critical
 	{
 		sophiaevent_(nature, Ein, eps, outputEnergy, outPartID, nParticles);
 	}
+#endif
 
 	Random &random = Random::instance();
 	Vector3d pos = random.randomInterpolatedPosition(candidate->previous.getPosition(), candidate->current.getPosition());
@@ -418,6 +430,13 @@ double PhotoPionProduction::sampleEps(bool onProton, double E, double z) const {
 	double Ein = E / GeV;
 	double epsMin = std::max(photonField -> getMinimumPhotonEnergy(z) / eV, epsMinInteraction(onProton, Ein));
 	double epsMax = photonField -> getMaximumPhotonEnergy(z) / eV;
+
+	if (sampleTable) {
+		double eps = sampleEpsFromTable(onProton, Ein, z, epsMin, epsMax);
+		if (eps > 0)
+			return eps * eV;
+	}
+
 	double pEpsMax = probEpsMax(onProton, Ein, z, epsMin, epsMax);
 
 	Random &random = Random::instance();
@@ -430,6 +449,130 @@ double PhotoPionProduction::sampleEps(bool onProton, double E, double z) const {
 	throw std::runtime_error("error: no photon found in sampleEps, please make sure that photon field provides photons for the interaction by adapting the energy range of the tabulated photon field.");
 }
 
+size_t PhotoPionProduction::SampleTable::nRedshiftBins() const {
+	return std::max(redshifts.size(), size_t(2)) - 1;
+}
+
+size_t PhotoPionProduction::SampleTable::offset(bool onProton, size_t iz, size_t iE) const {
+	return ((size_t(!onProton) * nRedshiftBins() + iz) * nE + iE) * nEps;
+}
+
+void PhotoPionProduction::SampleTable::updateCdf() {
+	cdf.resize(envelope.size());
+	for (size_t i = 0; i < envelope.size(); i += nEps) {
+		double sum = 0;
+		for (size_t j = 0; j < nEps; j++) {
+			sum += envelope[i + j];
+			cdf[i + j] = sum;
+		}
+	}
+}
+
+void PhotoPionProduction::buildSampleTable() {
+	ref_ptr<SampleTable> t = new SampleTable();
+	t->fieldName = photonField->getFieldName();
+	t->correctionFactor = correctionFactor;
+	t->logEMin = 15;
+	t->dLogE = 0.05;
+	t->nE = 160;
+
+	t->redshifts.push_back(0);
+	if (photonField->hasRedshiftDependence()) {
+		size_t n = std::max(1., std::ceil(sampleTableMaxRedshift / 0.2));
+		for (size_t i = 1; i <= n; i++)
+			t->redshifts.push_back(sampleTableMaxRedshift * i / n);
+	}
+
+	// photon energy range of the field at all redshifts
+	double epsLow = std::numeric_limits<double>::max(), epsHigh = 0;
+	for (size_t i = 0; i < t->redshifts.size(); i++) {
+		epsLow = std::min(epsLow, photonField->getMinimumPhotonEnergy(t->redshifts[i]) / eV);
+		epsHigh = std::max(epsHigh, photonField->getMaximumPhotonEnergy(t->redshifts[i]) / eV);
+	}
+	t->dLogEps = 0.05;
+	t->logEpsMin = std::floor(std::log10(epsLow) / t->dLogEps) * t->dLogEps;
+	t->nEps = std::max(1., std::ceil((std::log10(epsHigh) - t->logEpsMin) / t->dLogEps));
+
+	// distribution in log(eps) at the bin edges and photon bin centers
+	const size_t nZEdges = t->redshifts.size();
+	const size_t nEEdges = t->nE + 1;
+	const size_t nNodes = 2 * t->nEps + 1;
+	std::vector<double> epsNodes(nNodes), ePhotons(nNodes);
+	for (size_t i = 0; i < nNodes; i++) {
+		epsNodes[i] = pow(10, t->logEpsMin + i * t->dLogEps / 2);
+		ePhotons[i] = epsNodes[i] * eV;
+	}
+	// photon densities at the nodes, per redshift
+	std::vector<std::vector<double> > densities(nZEdges);
+	for (size_t i = 0; i < nZEdges; i++)
+		photonField->getPhotonDensities(ePhotons, densities[i], t->redshifts[i]);
+
+	std::vector<double> nodes(2 * nZEdges * nEEdges * nNodes);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (long k = 0; k < long(2 * nZEdges * nEEdges); k++) {
+		bool onProton = (k / (nZEdges * nEEdges)) == 0;
+		const std::vector<double> &density = densities[(k / nEEdges) % nZEdges];
+		double Ein = pow(10, t->logEMin + (k % nEEdges) * t->dLogE) * eV / GeV;
+		for (size_t i = 0; i < nNodes; i++) {
+			double eps = epsNodes[i];
+			nodes[k * nNodes + i] = probEpsFromDensity(eps, density[i], onProton, Ein) * eps;
+		}
+	}
+
+	// envelope: maximum at the edges of each bin, increased by the correction factor
+	const size_t nZBins = t->nRedshiftBins();
+	t->envelope.resize(2 * nZBins * t->nE * t->nEps);
+	for (size_t p = 0; p < 2; p++) {
+		for (size_t iz = 0; iz < nZBins; iz++) {
+			for (size_t iE = 0; iE < t->nE; iE++) {
+				double *envelope = &t->envelope[t->offset(p == 0, iz, iE)];
+				for (size_t j = 0; j < t->nEps; j++) {
+					double m = 0;
+					for (size_t dz = 0; dz < std::min(nZEdges, size_t(2)); dz++)
+						for (size_t dE = 0; dE < 2; dE++)
+							for (size_t i = 2 * j; i <= 2 * j + 2; i++)
+								m = std::max(m, nodes[((p * nZEdges + iz + dz) * nEEdges + iE + dE) * nNodes + i]);
+					envelope[j] = m * correctionFactor;
+				}
+			}
+		}
+	}
+	t->updateCdf();
+	sampleTable = t;
+}
+
+double PhotoPionProduction::sampleEpsFromTable(bool onProton, double Ein, double z, double epsMin, double epsMax) const {
+	const SampleTable &t = *sampleTable;
+	double logE = std::log10(Ein * GeV / eV);
+	if ((logE < t.logEMin) || (logE >= t.logEMin + t.nE * t.dLogE))
+		return 0;
+	size_t iE = (logE - t.logEMin) / t.dLogE;
+	size_t iz = 0;
+	if (t.redshifts.size() > 1) {
+		if ((z < t.redshifts.front()) || (z >= t.redshifts.back()))
+			return 0;
+		iz = std::upper_bound(t.redshifts.begin(), t.redshifts.end(), z) - t.redshifts.begin() - 1;
+	}
+
+	const double *envelope = &t.envelope[t.offset(onProton, iz, iE)];
+	const double *cdf = &t.cdf[t.offset(onProton, iz, iE)];
+	const double total = cdf[t.nEps - 1];
+	if (total <= 0)
+		return 0;
+
+	Random &random = Random::instance();
+	for (int i = 0; i < 1000000; i++) {
+		size_t j = std::upper_bound(cdf, cdf + t.nEps, random.rand() * total) - cdf;
+		j = std::min(j, t.nEps - 1);
+		double eps = pow(10, t.logEpsMin + (j + random.rand()) * t.dLogEps);
+		if ((eps < epsMin) || (eps > epsMax))
+			continue;
+		if (random.rand() * envelope[j] < probEps(eps, onProton, Ein, z) * eps)
+			return eps;
+	}
+	return 0;
+}
+
 double PhotoPionProduction::epsMinInteraction(bool onProton, double Ein) const {
 	// labframe energy of least energetic photon where PPP can occur
 	// this kind-of ties samplingEps to the PPP and SOPHIA
@@ -451,6 +594,8 @@ double PhotoPionProduction::probEpsMax(bool onProton, double Ein, double z, doub
 	} else
 		step = (epsMax - epsMin) / nrSteps;
 
+	// tested photon energies, the last one is the first >= epsMax
+	std::vector<double> eps, ePhotons, densities;
 	double epsDummy = 0.;
 	int i = 0;
 	while (epsDummy < epsMax) {
@@ -458,17 +603,22 @@ double PhotoPionProduction::probEpsMax(bool onProton, double Ein, double z, doub
 			epsDummy = epsMin * pow(10, step * i);
 		else
 			epsDummy = epsMin + step * i;
-		double p = probEps(epsDummy, onProton, Ein, z);
+		eps.push_back(epsDummy);
+		ePhotons.push_back(epsDummy * eV);
+		i++;
+	}
+	photonField->getPhotonDensities(ePhotons, densities, z);
+	for (size_t j = 0; j < eps.size(); j++) {
+		double p = probEpsFromDensity(eps[j], densities[j], onProton, Ein);
 		if(p > pEpsMaxTested)
 			pEpsMaxTested = p;
-		i++;
 	}
 	// the following factor corrects for only trying to find the maximum on nrIteration photon energies
 	// the factor should be determined in convergence tests
 	double pEpsMax = pEpsMaxTested * correctionFactor;
 
 	if(pEpsMax == 0) {
-		KISS_LOG_WARNING << "pEpsMax is 0 in the following configuration: \n"
+		KISS_LOG_WARNING_LIMITED(10) << "pEpsMax is 0 in the following configuration: \n"
 			<< "\t" << "onProton: " << onProton << "\n"
 			<< "\t" << "Ein: " << Ein << " [GeV] \n"
 			<< "\t" << "epsRange [eV] " << epsMin << "\t" << epsMax << "\n"
@@ -482,7 +632,11 @@ double PhotoPionProduction::probEpsMax(bool onProton, double Ein, double z, doub
 double PhotoPionProduction::probEps(double eps, bool onProton, double Ein, double z) const {
 	// probEps returns "probability to encounter a photon of energy eps", given a primary nucleon
 	// note, probEps does not return a normalized probability [0,...,1]
-	double photonDensity = photonField->getPhotonDensity(eps * eV, z) * ccm / eps;
+	return probEpsFromDensity(eps, photonField->getPhotonDensity(eps * eV, z), onProton, Ein);
+}
+
+double PhotoPionProduction::probEpsFromDensity(double eps, double density, bool onProton, double Ein) const {
+	double photonDensity = density * ccm / eps;
 	if (photonDensity != 0.) {
 		const double p = momentum(onProton, Ein);
 		const double sMax = mass(onProton) * mass(onProton) + 2. * eps * (Ein + p) / 1.e9;
@@ -633,6 +787,70 @@ void PhotoPionProduction::setSampleLog(bool b) {
 
 void PhotoPionProduction::setCorrectionFactor(double factor) {
 	correctionFactor = factor;
+	if (sampleTable)
+		buildSampleTable();
+}
+
+void PhotoPionProduction::setSampleTable(bool b, double maxRedshift) {
+	sampleTableMaxRedshift = maxRedshift;
+	sampleTable = 0;
+	if (b)
+		buildSampleTable();
+}
+
+bool PhotoPionProduction::getSampleTable() const {
+	return sampleTable.valid();
+}
+
+void PhotoPionProduction::saveSampleTable(const std::string &filename) const {
+	if (!sampleTable)
+		throw std::runtime_error("PhotoPionProduction: no sample table to save");
+	const SampleTable &t = *sampleTable;
+
+	std::ofstream out(filename.c_str());
+	if (!out.good())
+		throw std::runtime_error("PhotoPionProduction: could not open file " + filename);
+	out.imbue(std::locale("C"));
+	out.precision(17);
+	out << "# PhotoPionProduction sample table\n";
+	out << "# fieldName correctionFactor logEMin dLogE nE logEpsMin dLogEps nEps nRedshifts redshifts...\n";
+	out << "# envelope for neutron = 0, 1, redshift bins, energy bins: one line per photon energy distribution\n";
+	out << t.fieldName << " " << t.correctionFactor << " " << t.logEMin << " " << t.dLogE << " " << t.nE << " "
+		<< t.logEpsMin << " " << t.dLogEps << " " << t.nEps << " " << t.redshifts.size();
+	for (size_t i = 0; i < t.redshifts.size(); i++)
+		out << " " << t.redshifts[i];
+	out << "\n";
+	for (size_t i = 0; i < t.envelope.size(); i++)
+		out << t.envelope[i] << (((i + 1) % t.nEps == 0) ? "\n" : " ");
+}
+
+void PhotoPionProduction::loadSampleTable(const std::string &filename) {
+	std::ifstream in(filename.c_str());
+	if (!in.good())
+		throw std::runtime_error("PhotoPionProduction: could not open file " + filename);
+	in.imbue(std::locale("C"));
+	while (in.peek() == '#')
+		in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+	ref_ptr<SampleTable> t = new SampleTable();
+	size_t nRedshifts = 0;
+	in >> t->fieldName >> t->correctionFactor >> t->logEMin >> t->dLogE >> t->nE
+		>> t->logEpsMin >> t->dLogEps >> t->nEps >> nRedshifts;
+	if (!in || (nRedshifts == 0) || (t->nE == 0) || (t->nEps == 0))
+		throw std::runtime_error("PhotoPionProduction: invalid sample table " + filename);
+	if (t->fieldName != photonField->getFieldName())
+		throw std::runtime_error("PhotoPionProduction: sample table " + filename + " is for photon field " + t->fieldName);
+	t->redshifts.resize(nRedshifts);
+	for (size_t i = 0; i < nRedshifts; i++)
+		in >> t->redshifts[i];
+	t->envelope.resize(2 * t->nRedshiftBins() * t->nE * t->nEps);
+	for (size_t i = 0; i < t->envelope.size(); i++)
+		in >> t->envelope[i];
+	if (!in)
+		throw std::runtime_error("PhotoPionProduction: invalid sample table " + filename);
+	t->updateCdf();
+	sampleTable = t;
+	sampleTableMaxRedshift = t->redshifts.back();
 }
 
 ref_ptr<PhotonField> PhotoPionProduction::getPhotonField() const {
@@ -679,4 +897,38 @@ std::string PhotoPionProduction::getInteractionTag() const {
 	return interactionTag;
 }
 
+double PhotoPionProduction::interactionRate(const Candidate *candidate) const {
+	int id = candidate->current.getId();
+	if (!isNucleus(id))
+		return 0;
+
+	int A = massNumber(id);
+	int Z = chargeNumber(id);
+	int N = A - Z;
+	double gamma = candidate->current.getLorentzFactor();
+	double z = candidate->getRedshift();
+
+	double rate = 0;
+	if (Z > 0)
+		rate += nucleiModification(A, Z) / nucleonMFP(gamma, z, true);
+	if (N > 0)
+		rate += nucleiModification(A, N) / nucleonMFP(gamma, z, false);
+	return rate;
+}
+
+void PhotoPionProduction::interact(Candidate *candidate) const {
+	int id = candidate->current.getId();
+	int A = massNumber(id);
+	int Z = chargeNumber(id);
+	int N = A - Z;
+	double gamma = candidate->current.getLorentzFactor();
+	double z = candidate->getRedshift();
+
+	// select the interacting nucleon according to the partial rates
+	double rateProton = (Z > 0) ? nucleiModification(A, Z) / nucleonMFP(gamma, z, true) : 0;
+	double rateNeutron = (N > 0) ? nucleiModification(A, N) / nucleonMFP(gamma, z, false) : 0;
+	bool onProton = Random::instance().rand() * (rateProton + rateNeutron) < rateProton;
+	performInteraction(candidate, onProton);
+}
+
 } // namespace crpropa
@@ -1,5 +1,6 @@
 #include "crpropa/module/PropagationBP.h"
 
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
@@ -124,6 +125,123 @@ namespace crpropa {
 	}
 
 
+	void PropagationBP::propagate(ParticleBatch &batch, double length, double z) const {
+		// chunks of particles that stay in cache for all steps
+		const size_t chunkSize = 256;
+		const long nChunks = (batch.size() + chunkSize - 1) / chunkSize;
+
+#pragma omp parallel for schedule(dynamic)
+		for (long iChunk = 0; iChunk < nChunks; iChunk++) {
+			const size_t begin = iChunk * chunkSize;
+			const size_t n = std::min(chunkSize, batch.size() - begin);
+			double *x = &batch.x[begin], *y = &batch.y[begin], *zz = &batch.z[begin];
+			double *ux = &batch.ux[begin], *uy = &batch.uy[begin], *uz = &batch.uz[begin];
+
+			std::vector<double> remaining(n, 0.), h(n), k(n), bx(n), by(n), bz(n);
+			std::vector<Vector3d> positions, fields;
+			std::vector<size_t> index;
+			positions.reserve(n);
+			index.reserve(n);
+
+			const double radius = batch.getEscapeRadius();
+			const Vector3d center = batch.getEscapeCenter();
+
+			for (size_t i = 0; i < n; i++) {
+				if (not batch.active[begin + i])
+					continue;
+				if (batch.charge[begin + i] != 0) {
+					remaining[i] = length;
+					continue;
+				}
+				// rectilinear propagation for neutral particles
+				x[i] += ux[i] * length;
+				y[i] += uy[i] * length;
+				zz[i] += uz[i] * length;
+				batch.trajectoryLength[begin + i] += length;
+				if ((radius > 0) and ((Vector3d(x[i], y[i], zz[i]) - center).getR2() > radius * radius))
+					batch.active[begin + i] = 0;
+			}
+
+			while (true) {
+				// half leap frog step in the position and gather the positions of the moving particles
+				positions.clear();
+				index.clear();
+				for (size_t i = 0; i < n; i++) {
+					h[i] = std::min(batch.step[begin + i], remaining[i]);
+					if (h[i] <= 0)
+						continue;
+					x[i] += ux[i] * h[i] / 2;
+					y[i] += uy[i] * h[i] / 2;
+					zz[i] += uz[i] * h[i] / 2;
+					positions.push_back(Vector3d(x[i], y[i], zz[i]));
+					index.push_back(i);
+				}
+				if (index.empty())
+					break;
+
+				// B field at the particle positions
+				fields.assign(positions.size(), Vector3d(0.));
+				try {
+					if (field.valid())
+						field->getFieldBatch(positions, fields, z);
+				} catch (std::exception &e) {
+					KISS_LOG_ERROR_LIMITED(100) << "PropagationBP: Exception in PropagationBP::propagate.\n"
+							<< e.what();
+				}
+				std::fill(bx.begin(), bx.end(), 0.);
+				std::fill(by.begin(), by.end(), 0.);
+				std::fill(bz.begin(), bz.end(), 0.);
+				for (size_t j = 0; j < index.size(); j++) {
+					size_t i = index[j];
+					bx[i] = fields[j].x;
+					by[i] = fields[j].y;
+					bz[i] = fields[j].z;
+					// q / 2m * step / c with m = E / c^2
+					k[i] = batch.charge[begin + i] * c_light / 2 / batch.energy[begin + i] * h[i];
+				}
+
+				// Boris push over the contiguous arrays, particles at rest have h = 0
+				for (size_t i = 0; i < n; i++) {
+					double kk = (h[i] > 0) ? k[i] : 0;
+					double tx = bx[i] * kk, ty = by[i] * kk, tz = bz[i] * kk;
+					double f = 2 / (1 + tx * tx + ty * ty + tz * tz);
+					double sx = tx * f, sy = ty * f, sz = tz * f;
+					double vx = ux[i] + (uy[i] * tz - uz[i] * ty);
+					double vy = uy[i] + (uz[i] * tx - ux[i] * tz);
+					double vz = uz[i] + (ux[i] * ty - uy[i] * tx);
+					double wx = ux[i] + (vy * sz - vz * sy);
+					double wy = uy[i] + (vz * sx - vx * sz);
+					double wz = uz[i] + (vx * sy - vy * sx);
+
+					// the other half leap frog step in the position
+					x[i] += wx * h[i] / 2;
+					y[i] += wy * h[i] / 2;
+					zz[i] += wz * h[i] / 2;
+					double norm = 1 / std::sqrt(wx * wx + wy * wy + wz * wz);
+					ux[i] = wx * norm;
+					uy[i] = wy * norm;
+					uz[i] = wz * norm;
+					remaining[i] -= h[i];
+				}
+
+				for (size_t j = 0; j < index.size(); j++)
+					batch.trajectoryLength[begin + index[j]] += h[index[j]];
+
+				// deactivate escaped particles
+				if (radius > 0) {
+					for (size_t j = 0; j < index.size(); j++) {
+						size_t i = index[j];
+						if ((Vector3d(x[i], y[i], zz[i]) - center).getR2() > radius * radius) {
+							batch.active[begin + i] = 0;
+							remaining[i] = 0;
+						}
+					}
+				}
+			}
+		}
+	}
+
+
 	void PropagationBP::setField(ref_ptr<MagneticField> f) {
 		field = f;
 	}
@@ -136,15 +254,10 @@ namespace crpropa {
 
 	Vector3d PropagationBP::getFieldAtPosition(Vector3d pos, double z) const {
 		Vector3d B(0, 0, 0);
-		try {
-			// check if field is valid and use the field vector at the
-			// position pos with the redshift z
-			if (field.valid())
-				B = field->getField(pos, z);
-		} catch (std::exception &e) {
-			KISS_LOG_ERROR 	<< "PropagationBP: Exception in PropagationBP::getFieldAtPosition.\n"
-					<< e.what();
-		}	
+		// check if field is valid and use the field vector at the
+		// position pos with the redshift z, B = 0 where it is not defined
+		if (field.valid())
+			field->tryGetField(pos, z, B);
 		return B;
 	}
 
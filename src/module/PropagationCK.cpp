@@ -145,15 +145,10 @@ ref_ptr<MagneticField> PropagationCK::getField() const {
 
 Vector3d PropagationCK::getFieldAtPosition(Vector3d pos, double z) const {
 	Vector3d B(0, 0, 0);
-	try {
-		// check if field is valid and use the field vector at the
-		// position pos with the redshift z
-		if (field.valid())
-			B = field->getField(pos, z);
-	} catch (std::exception &e) {
-		KISS_LOG_ERROR 	<< "PropagationCK: Exception in PropagationCK::getFieldAtPosition.\n"
-				<< e.what();
-	}	
+	// check if field is valid and use the field vector at the
+	// position pos with the redshift z, B = 0 where it is not defined
+	if (field.valid())
+		field->tryGetField(pos, z, B);
 	return B;
 }
 
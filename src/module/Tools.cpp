@@ -99,7 +99,7 @@ string ParticleFilter::getDescription() const {
 }
 
 // ----------------------------------------------------------------------------
-EmissionMapFiller::EmissionMapFiller(EmissionMap *emissionMap) : emissionMap(emissionMap) {
+EmissionMapFiller::EmissionMapFiller(EmissionMap *emissionMap) : emissionMap(emissionMap), concurrent(false) {
 
 }
 
@@ -107,12 +107,31 @@ void EmissionMapFiller::setEmissionMap(EmissionMap *emissionMap) {
 	this->emissionMap = emissionMap;
 }
 
+void EmissionMapFiller::setConcurrent(bool concurrent) {
+	this->concurrent = concurrent;
+}
+
+bool EmissionMapFiller::isConcurrent() const {
+	return concurrent;
+}
+
+void EmissionMapFiller::mergeThreadMaps() {
+	if (emissionMap)
+		emissionMap->mergeThreadMaps();
+}
+
 void EmissionMapFiller::process(Candidate* candidate) const {
-	if (emissionMap) {
-		#pragma omp critical
-		{
-			emissionMap->fillMap(candidate->source);
-		}
+	if (!emissionMap)
+		return;
+
+	if (concurrent) {
+		emissionMap->fillMapConcurrent(candidate->source);
+		return;
+	}
+
+	#pragma omp critical
+	{
+		emissionMap->fillMap(candidate->source);
 	}
 }
 
@@ -0,0 +1,92 @@
+// Micro-benchmarks of the 3-vector kernels: Vector3d / Vector3f compared to
+// the 4-lane Vector3d4 / Vector3f4. Not part of the test suite, run manually:
+//   ./benchmarkVector3 [iterations]
+
+#include "crpropa/Vector3.h"
+#include "crpropa/Vector3x4.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace crpropa;
+
+namespace {
+
+const size_t nVectors = 1024;
+
+// static storage, std::vector does not honour the alignment before C++17
+Vector3d4 a4[nVectors], b4[nVectors];
+Vector3f4 af4[nVectors];
+
+template<typename F>
+void benchmark(const std::string &name, size_t iterations, F kernel) {
+	double sum = 0;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++)
+		sum += kernel(i % nVectors);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+	// print the sum so that the kernel is not optimized away
+	std::cout << std::setw(28) << std::left << name << std::setw(8) << std::right
+			<< std::fixed << std::setprecision(2) << ns << " ns  (" << std::scientific << sum << ")" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	size_t iterations = (argc > 1) ? atol(argv[1]) : 20000000;
+
+	std::vector<Vector3d> a(nVectors), b(nVectors);
+	std::vector<Vector3f> af(nVectors);
+	for (size_t i = 0; i < nVectors; i++) {
+		a[i] = Vector3d(drand48(), drand48(), drand48());
+		b[i] = Vector3d(drand48(), drand48(), drand48());
+		a4[i] = Vector3d4(a[i]);
+		b4[i] = Vector3d4(b[i]);
+		af[i] = Vector3f(a[i]);
+		af4[i] = Vector3f4(af[i]);
+	}
+	Vector3d axis = Vector3d(1, 2, 3).getUnitVector();
+	Vector3d4 axis4(axis);
+
+	benchmark("Vector3d dot", iterations, [&](size_t i) { return a[i].dot(b[i]); });
+	benchmark("Vector3d4 dot", iterations, [&](size_t i) { return a4[i].dot(b4[i]); });
+	benchmark("Vector3d cross", iterations, [&](size_t i) { return a[i].cross(b[i]).x; });
+	benchmark("Vector3d4 cross", iterations, [&](size_t i) { return a4[i].cross(b4[i]).x(); });
+	benchmark("Vector3d unit vector", iterations, [&](size_t i) { return a[i].getUnitVector().x; });
+	benchmark("Vector3d4 unit vector", iterations, [&](size_t i) { return a4[i].getUnitVector().x(); });
+	benchmark("Vector3d rotation", iterations, [&](size_t i) { return a[i].getRotated(axis, 0.1).x; });
+	benchmark("Vector3d4 rotation", iterations, [&](size_t i) { return a4[i].getRotated(axis4, 0.1).x(); });
+
+	// Boris push as in PropagationBP::dY
+	benchmark("Vector3d Boris push", iterations, [&](size_t i) {
+		Vector3d t = b[i] * 0.01;
+		Vector3d s = t * 2 / (1 + t.dot(t));
+		Vector3d v = a[i] + a[i].cross(t);
+		return (a[i] + v.cross(s)).x;
+	});
+	benchmark("Vector3d4 Boris push", iterations, [&](size_t i) {
+		Vector3d4 t = b4[i] * 0.01;
+		Vector3d4 s = t * (2 / (1 + t.dot(t)));
+		Vector3d4 v = a4[i] + a4[i].cross(t);
+		return (a4[i] + v.cross(s)).x();
+	});
+
+	// weighted sum of 8 corners as in Grid::trilinearInterpolate
+	benchmark("Vector3f trilinear sum", iterations / 8, [&](size_t i) {
+		Vector3f r(0.);
+		for (size_t j = 0; j < 8; j++)
+			r += af[(i + j * 97) % nVectors] * (0.125f + j);
+		return double(r.x);
+	});
+	benchmark("Vector3f4 trilinear sum", iterations / 8, [&](size_t i) {
+		Vector3f4 r;
+		for (size_t j = 0; j < 8; j++)
+			r += af4[(i + j * 97) % nVectors] * (0.125f + j);
+		return double(r.x());
+	});
+	return 0;
+}
@@ -7,6 +7,7 @@
 #include "crpropa/module/RestrictToRegion.h"
 #include "crpropa/ParticleID.h"
 #include "crpropa/Geometry.h"
+#include "crpropa/Random.h"
 
 #include "gtest/gtest.h"
 
@@ -203,6 +204,54 @@ TEST(ObserverFeature, LargeSphere) {
 	EXPECT_FALSE(c.isActive());
 }
 
+TEST(ObserverFeature, Surfaces) {
+	// many spheres: same detections and step limits as one ObserverSurface each
+	Random random(42);
+	ref_ptr<ObserverSurfaces> surfaces = new ObserverSurfaces();
+	std::vector<ref_ptr<ObserverSurface> > single;
+	for (int i = 0; i < 500; i++) {
+		Vector3d center = random.randVector() * random.rand() * 100;
+		double radius = 0.1 + random.rand() * 5;
+		surfaces->addSphere(center, radius);
+		single.push_back(new ObserverSurface(new Sphere(center, radius)));
+	}
+	surfaces->add(new ParaxialBox(Vector3d(-1, -2, -3), Vector3d(2, 4, 6)));
+	single.push_back(new ObserverSurface(new ParaxialBox(Vector3d(-1, -2, -3), Vector3d(2, 4, 6))));
+	EXPECT_EQ(501, surfaces->size());
+	EXPECT_THROW(surfaces->add(new Plane(Vector3d(0, 0, 0), Vector3d(1, 0, 0))), std::runtime_error);
+
+	int nDetected = 0;
+	for (int i = 0; i < 2000; i++) {
+		Candidate c1, c2;
+		Vector3d p = random.randVector() * random.rand() * 110;
+		Vector3d q = p + random.randVector() * random.rand() * 3;
+		c1.previous.setPosition(p);
+		c1.current.setPosition(q);
+		c1.setNextStep(1000);
+		c2.previous.setPosition(p);
+		c2.current.setPosition(q);
+		c2.setNextStep(1000);
+
+		DetectionState expected = NOTHING;
+		for (size_t j = 0; j < single.size(); j++)
+			if (single[j]->checkDetection(&c2) == DETECTED)
+				expected = DETECTED;
+		EXPECT_EQ(expected, surfaces->checkDetection(&c1));
+		EXPECT_DOUBLE_EQ(c2.getNextStep(), c1.getNextStep());
+		nDetected += (expected == DETECTED);
+	}
+	EXPECT_GT(nDetected, 0);
+
+	// in an observer
+	Observer obs;
+	obs.add(new ObserverSurfaces());
+	Candidate c;
+	c.previous.setPosition(Vector3d(0, 0, 0));
+	c.current.setPosition(Vector3d(1, 0, 0));
+	obs.process(&c);
+	EXPECT_TRUE(c.isActive());
+}
+
 TEST(ObserverFeature, Point) {
 	Observer obs;
 	obs.add(new Observer1D());
@@ -304,6 +353,65 @@ TEST(ObserverFeature, TimeEvolutionLog) {
   EXPECT_TRUE(c.hasProperty("Detected"));
 }
 
+TEST(ObserverFeature, TimeEvolutionBatch) {
+  ref_ptr<ObserverTimeEvolution> lin = new ObserverTimeEvolution(1, 1, 1000);
+  ref_ptr<ObserverTimeEvolution> log = new ObserverTimeEvolution(1, 1000, 1000, true);
+  ObserverTimeEvolution list;
+  for (int i = 0; i < 10; i++)
+    list.addTime(i + 1);
+
+  for (int k = 0; k < 3; k++) {
+    ObserverTimeEvolution &obs = (k == 0) ? *lin : ((k == 1) ? *log : list);
+    const std::vector<double> &times = obs.getTimes();
+    obs.setBatchDetection(true);
+    EXPECT_TRUE(obs.getBatchDetection());
+    Candidate c;
+    c.setTrajectoryLength(0.5);
+    c.setNextStep(100);
+    EXPECT_EQ(NOTHING, obs.checkDetection(&c));
+    EXPECT_DOUBLE_EQ(0.5, c.getNextStep());
+
+    // all times passed in one step are detected at once
+    double length = times[6];
+    c.setTrajectoryLength(length);
+    c.setNextStep(100);
+    EXPECT_EQ(DETECTED, obs.checkDetection(&c));
+    EXPECT_EQ(7, obs.getDetectionIndex(&c));
+    std::vector<double> detected = obs.getDetectedTimes(&c);
+    ASSERT_EQ(7, detected.size());
+    EXPECT_DOUBLE_EQ(times[0], detected[0]);
+    EXPECT_DOUBLE_EQ(times[6], detected[6]);
+    EXPECT_NEAR(times[7] - length, c.getNextStep(), 1e-12);
+
+    // no detection again
+    EXPECT_EQ(NOTHING, obs.checkDetection(&c));
+
+    // index from the trajectory length for every time
+    for (size_t i = 7; i < times.size(); i++) {
+      Candidate d;
+      d.setTrajectoryLength(times[i] * (1 + 1e-9));
+      EXPECT_EQ(DETECTED, obs.checkDetection(&d));
+      EXPECT_EQ(i + 1, obs.getDetectionIndex(&d));
+    }
+
+    // all passed
+    c.setTrajectoryLength(2 * times.back());
+    EXPECT_EQ(DETECTED, obs.checkDetection(&c));
+    EXPECT_EQ(times.size(), obs.getDetectionIndex(&c));
+    EXPECT_EQ(NOTHING, obs.checkDetection(&c));
+  }
+
+  // default: one time per step, no property is used
+  ObserverTimeEvolution single(1, 1, 10);
+  Candidate c;
+  c.setTrajectoryLength(5.5);
+  EXPECT_EQ(DETECTED, single.checkDetection(&c));
+  EXPECT_EQ(1, single.getDetectionIndex(&c));
+  EXPECT_EQ(DETECTED, single.checkDetection(&c));
+  EXPECT_EQ(2, single.getDetectionIndex(&c));
+  EXPECT_TRUE(c.properties.empty());
+}
+
 //** ========================= Boundaries =================================== */
 TEST(PeriodicBox, high) {
 	// Tests if the periodical boundaries place the particle back inside the box and translate the initial position accordingly.
@@ -14,14 +14,30 @@
 #include "crpropa/Random.h"
 #include "crpropa/Grid.h"
 #include "crpropa/GridTools.h"
+#include "crpropa/SharedMemory.h"
 #include "crpropa/Geometry.h"
 #include "crpropa/EmissionMap.h"
+#include "crpropa/PerThread.h"
+#include "crpropa/module/Tools.h"
 
 #include <HepPID/ParticleIDMethods.hh>
+#include "kiss/logger.h"
 #include "gtest/gtest.h"
 
+#include <sstream>
+
+#include <unistd.h>
+
 namespace crpropa {
 
+// file in the temporary directory, unique for the test process
+std::string tempFile(const std::string &name) {
+	const char *dir = getenv("TMPDIR");
+	std::stringstream ss;
+	ss << (dir ? dir : "/tmp") << "/crpropa_" << getpid() << "_" << name;
+	return ss.str();
+}
+
 TEST(ParticleState, position) {
 	ParticleState particle;
 	Vector3d v(1, 3, 5);
@@ -197,6 +213,20 @@ TEST(Candidate, property) {
 	EXPECT_EQ("bar", value);
 }
 
+TEST(Candidate, slot) {
+	size_t slot = Candidate::registerSlot("TestSlot");
+	EXPECT_EQ(slot, Candidate::registerSlot("TestSlot"));
+	EXPECT_NE(slot, Candidate::registerSlot("OtherTestSlot"));
+	EXPECT_EQ("TestSlot", Candidate::getSlotName(slot));
+
+	Candidate candidate;
+	EXPECT_EQ(0, candidate.getSlot(slot));
+	candidate.setSlot(slot, 7);
+	EXPECT_EQ(7, candidate.getSlot(slot));
+	EXPECT_EQ(7, candidate.clone()->getSlot(slot));
+	EXPECT_TRUE(candidate.properties.empty());
+}
+
 TEST(Candidate, weight) {
     Candidate candidate;
     EXPECT_EQ (1., candidate.getWeight());
@@ -236,6 +266,86 @@ TEST(Candidate, addSecondary) {
 	EXPECT_EQ(15., s2.getWeight());
 }
 
+TEST(Candidate, populationControl) {
+	ref_ptr<PopulationControl> control = new PopulationControl();
+	control->setRussianRoulette(22, 10, 0.25);
+	control->setSplitting(0, 1000, 4);
+
+	Candidate c;
+	c.setWeight(2.);
+	c.setPopulationControl(control);
+
+	// splitting for all species, the copies share the weight and inherit the control
+	c.addSecondary(nucleusId(1,1), 2000);
+	ASSERT_EQ(4, c.secondaries.size());
+	EXPECT_DOUBLE_EQ(0.5, c.secondaries[0]->getWeight());
+	EXPECT_TRUE(c.secondaries[3]->getPopulationControl() == control);
+
+	// no rule applies
+	c.clearSecondaries();
+	c.addSecondary(11, 5);
+	ASSERT_EQ(1, c.secondaries.size());
+	EXPECT_DOUBLE_EQ(2., c.secondaries[0]->getWeight());
+
+	// Russian roulette of photons, the total weight is conserved on average
+	// This test can stochastically fail.
+	c.clearSecondaries();
+	int n = 10000;
+	for (int i = 0; i < n; i++)
+		c.addSecondary(22, 5, Vector3d(0, 0, 0));
+	double w = 0;
+	for (size_t i = 0; i < c.secondaries.size(); i++)
+		w += c.secondaries[i]->getWeight();
+	EXPECT_NEAR(0.25 * n, c.secondaries.size(), 150);
+	EXPECT_NEAR(2. * n, w, 0.03 * 2 * n);
+	EXPECT_DOUBLE_EQ(8., c.secondaries[0]->getWeight());
+}
+
+TEST(PopulationControl, thinning) {
+	PopulationControl control;
+	control.setThinning(11, 100, 1.);
+	control.setMaximumWeight(10.);
+
+	// above the threshold nothing changes
+	double w = 1;
+	EXPECT_EQ(1, control.sample(11, 200, w));
+	EXPECT_DOUBLE_EQ(1, w);
+
+	// weight increased by the inverse survival probability
+	// This test can stochastically fail.
+	int kept = 0;
+	for (int i = 0; i < 10000; i++) {
+		w = 1;
+		if (control.sample(11, 20, w) > 0) {
+			kept++;
+			EXPECT_DOUBLE_EQ(5., w);
+		}
+	}
+	EXPECT_NEAR(2000, kept, 150);
+
+	// survival probability limited by the maximum weight
+	kept = 0;
+	for (int i = 0; i < 1000; i++) {
+		w = 1;
+		if (control.sample(11, 1, w) > 0) {
+			kept++;
+			EXPECT_DOUBLE_EQ(10., w);
+		}
+	}
+	EXPECT_NEAR(100, kept, 40);
+
+	// secondaries heavier than the maximum weight are split into copies,
+	// also without a rule for the species
+	w = 25;
+	EXPECT_EQ(3, control.sample(11, 200, w));
+	EXPECT_DOUBLE_EQ(25. / 3, w);
+	w = 20;
+	EXPECT_EQ(2, control.sample(22, 200, w));
+	EXPECT_DOUBLE_EQ(10., w);
+
+	EXPECT_THROW(control.setRussianRoulette(11, 10, 0), std::runtime_error);
+}
+
 TEST(Candidate, candidateTag) {
 	Candidate c;
 
@@ -251,6 +361,18 @@ TEST(Candidate, serialNumber) {
 	Candidate::setNextSerialNumber(42);
 	Candidate c;
 	EXPECT_EQ(43, c.getSourceSerialNumber());
+
+	// clones of secondaries keep the serial numbers of their ancestors
+	c.addSecondary(nucleusId(1, 1), 1 * EeV);
+	ref_ptr<Candidate> s = c.secondaries[0];
+	s->addSecondary(nucleusId(1, 1), 1 * EeV);
+	ref_ptr<Candidate> clone = s->secondaries[0]->clone();
+	EXPECT_EQ(43, clone->getSourceSerialNumber());
+	EXPECT_EQ(s->getSerialNumber(), clone->getCreatedSerialNumber());
+	s->detachParent();
+	clone = s->clone();
+	EXPECT_EQ(43, clone->getSourceSerialNumber());
+	EXPECT_EQ(43, clone->getCreatedSerialNumber());
 }
 
 TEST(common, digit) {
@@ -328,6 +450,100 @@ TEST(common, gaussInt)
 	EXPECT_NEAR(gaussInt(([](double x){ return sin(x)*sin(x); }), 0, M_PI), M_PI/2., 1e-4);
 }
 
+TEST(PerThread, local) {
+	PerThread<int> a, b;
+	a.local() = 1;
+	b.local() = 2;
+	EXPECT_EQ(1, a.local());
+	EXPECT_EQ(2, b.local());
+	EXPECT_EQ(1, a.size());
+
+	// a copy starts without values
+	PerThread<int> c(a);
+	EXPECT_EQ(0, c.size());
+	EXPECT_EQ(0, c.local());
+}
+
+TEST(PerThread, recycled) {
+	// later objects reuse the cache entries of destroyed ones, never their values
+	for (int i = 0; i < 1000; i++) {
+		PerThread<int> p;
+		EXPECT_EQ(0, p.local());
+		p.local() = i + 1;
+		EXPECT_EQ(i + 1, p.local());
+		EXPECT_EQ(1, p.size());
+	}
+}
+
+TEST(PerThread, threads) {
+	PerThread<int> counts;
+	#pragma omp parallel for
+	for (int i = 0; i < 1000; i++) {
+		PerThread<int> scratch;
+		scratch.local()++;
+		counts.local() += scratch.local();
+	}
+	int total = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+		total += counts[i];
+	EXPECT_EQ(1000, total);
+}
+
+static void logRepeatedWarning() {
+	KISS_LOG_WARNING_LIMITED(2) << "repeated warning";
+}
+
+TEST(Logger, rateLimit) {
+	std::ostringstream out;
+	kiss::eLogLevel level = kiss::Logger::getLogLevel();
+	kiss::Logger::setLogStream(out);
+	kiss::Logger::setLogLevel(kiss::LOG_LEVEL_WARNING);
+
+	// occurrences 1, 2, 4, 8 are logged
+	for (int i = 0; i < 10; i++)
+		logRepeatedWarning();
+	KISS_LOG_INFO << "not logged";
+
+	kiss::Logger::setLogStream(std::cerr);
+	kiss::Logger::setLogLevel(level);
+
+	std::vector<std::string> lines;
+	std::istringstream in(out.str());
+	std::string line;
+	while (std::getline(in, line))
+		lines.push_back(line);
+	ASSERT_EQ(4, lines.size());
+	EXPECT_NE(std::string::npos, lines[0].find("[WARNING] repeated warning"));
+	EXPECT_EQ(std::string::npos, lines[1].find("suppressed"));
+	EXPECT_NE(std::string::npos, lines[2].find("[occurrence 4, 1 similar messages suppressed]"));
+	EXPECT_NE(std::string::npos, lines[3].find("[occurrence 8, 3 similar messages suppressed]"));
+}
+
+TEST(Logger, async) {
+	std::ostringstream out;
+	kiss::Logger::setLogStream(out);
+	kiss::Logger::setAsync(true);
+	EXPECT_TRUE(kiss::Logger::isAsync());
+
+	const int n = 1000;
+	#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+		KISS_LOG_ERROR << "message " << i;
+	kiss::Logger::flush();
+	kiss::Logger::setAsync(false);
+	kiss::Logger::setLogStream(std::cerr);
+
+	// every message is written as a whole line
+	std::istringstream in(out.str());
+	std::string line;
+	int count = 0;
+	while (std::getline(in, line)) {
+		EXPECT_NE(std::string::npos, line.find("[ ERROR ] message "));
+		count++;
+	}
+	EXPECT_EQ(n, count);
+}
+
 TEST(Random, seed) {
 	Random &a = Random::instance();
 	Random &b = Random::instance();
@@ -819,8 +1035,10 @@ TEST(Grid3f, DumpLoad) {
 			for (int iz = 0; iz < 3; iz++)
 				grid1->get(ix, iy, iz) = Vector3f(1, 2, 3);
 
-	dumpGrid(grid1, "testDump.raw");
-	loadGrid(grid2, "testDump.raw");
+	std::string filename = tempFile("testDump.raw");
+	dumpGrid(grid1, filename);
+	loadGrid(grid2, filename);
+	remove(filename.c_str());
 
 	for (int ix = 0; ix < 3; ix++) {
 		for (int iy = 0; iy < 3; iy++) {
@@ -845,8 +1063,10 @@ TEST(Grid3f, DumpLoadTxt) {
 			for (int iz = 0; iz < 3; iz++)
 				grid1->get(ix, iy, iz) = Vector3f(ix, iy, iz);
 
-	dumpGridToTxt(grid1, "testDump.txt", 1e4);
-	loadGridFromTxt(grid2, "testDump.txt", 1e-4);
+	std::string filename = tempFile("testDump.txt");
+	dumpGridToTxt(grid1, filename, 1e4);
+	loadGridFromTxt(grid2, filename, 1e-4);
+	remove(filename.c_str());
 
 	for (int ix = 0; ix < 3; ix++) {
 		for (int iy = 0; iy < 3; iy++) {
@@ -861,6 +1081,167 @@ TEST(Grid3f, DumpLoadTxt) {
 	}
 }
 
+TEST(Grid3f, ExternalStorage) {
+	// grid using values it does not own
+	std::vector<Vector3f> values(27, Vector3f(1, 2, 3));
+	values[13] = Vector3f(4, 5, 6);
+	GridProperties p(Vector3d(0.), 3, 1);
+	Grid3f grid(p, values.data());
+	EXPECT_TRUE(grid.hasExternalStorage());
+	EXPECT_EQ(values.data(), grid.getData());
+	EXPECT_FLOAT_EQ(5, grid.get(1, 1, 1).y);
+	EXPECT_THROW(grid.getGrid(), std::runtime_error);
+
+	// copies refer to the same values
+	Grid3f copy(grid);
+	EXPECT_EQ(values.data(), copy.getData());
+	values[0] = Vector3f(7, 8, 9);
+	EXPECT_FLOAT_EQ(7, copy.get(0, 0, 0).x);
+
+	// resizing switches to owned values
+	copy.setGridSize(2, 2, 2);
+	EXPECT_FALSE(copy.hasExternalStorage());
+	EXPECT_EQ(8, copy.getGrid().size());
+	EXPECT_FLOAT_EQ(0, copy.get(0, 0, 0).x);
+	EXPECT_FLOAT_EQ(7, values[0].x);
+}
+
+TEST(Grid3f, DumpLoadMapped) {
+	ref_ptr<Grid3f> grid1 = new Grid3f(Vector3d(0.), 3, 1);
+	for (int ix = 0; ix < 3; ix++)
+		for (int iy = 0; iy < 3; iy++)
+			for (int iz = 0; iz < 3; iz++)
+				grid1->get(ix, iy, iz) = Vector3f(ix, iy, iz);
+	std::string filename = tempFile("testDumpMapped.raw");
+	dumpGrid(grid1, filename);
+
+	// conversion is applied to the interpolated values only
+	ref_ptr<Grid3f> grid2 = new Grid3f(Vector3d(0.), 3, 1);
+	loadGridMapped(grid2, filename, 2);
+	EXPECT_TRUE(grid2->hasExternalStorage());
+	EXPECT_DOUBLE_EQ(2, grid2->getValueScale());
+	EXPECT_FLOAT_EQ(2, grid2->get(1, 2, 0).y);
+	Vector3d pos(1.2, 0.7, 2.1);
+	Vector3f b1 = grid1->interpolate(pos);
+	Vector3f b2 = grid2->interpolate(pos);
+	EXPECT_FLOAT_EQ(2 * b1.x, b2.x);
+	EXPECT_FLOAT_EQ(2 * b1.y, b2.y);
+	EXPECT_FLOAT_EQ(2 * b1.z, b2.z);
+
+	// the grid tools include the value scale
+	EXPECT_FLOAT_EQ(2 * meanFieldVector(grid1).y, meanFieldVector(grid2).y);
+	EXPECT_FLOAT_EQ(2 * meanFieldStrength(grid1), meanFieldStrength(grid2));
+	EXPECT_FLOAT_EQ(2 * rmsFieldStrength(grid1), rmsFieldStrength(grid2));
+	EXPECT_FLOAT_EQ(2 * rmsFieldStrengthPerAxis(grid1)[2], rmsFieldStrengthPerAxis(grid2)[2]);
+	std::string scaledFilename = tempFile("testDumpMappedScaled.raw");
+	dumpGrid(grid2, scaledFilename);
+	ref_ptr<Grid3f> grid5 = new Grid3f(Vector3d(0.), 3, 1);
+	loadGrid(grid5, scaledFilename);
+	EXPECT_FLOAT_EQ(4, grid5->get(1, 2, 0).y);
+	remove(scaledFilename.c_str());
+
+	// scaling changes the value scale, not the mapped values
+	scaleGrid(grid2, 0.5);
+	EXPECT_DOUBLE_EQ(1, grid2->getValueScale());
+	EXPECT_FLOAT_EQ(2, grid2->get(1, 2, 0).y);
+	EXPECT_FLOAT_EQ(b1.y, grid2->interpolate(pos).y);
+
+	// modifications are not written to the file
+	grid2->get(0, 0, 0) = Vector3f(5.);
+	ref_ptr<Grid3f> grid3 = new Grid3f(Vector3d(0.), 3, 1);
+	loadGrid(grid3, filename);
+	EXPECT_FLOAT_EQ(0, grid3->get(0, 0, 0).x);
+
+	ref_ptr<Grid3f> grid4 = new Grid3f(Vector3d(0.), 4, 1);
+	EXPECT_THROW(loadGridMapped(grid4, filename), std::runtime_error);
+	remove(filename.c_str());
+}
+
+TEST(Grid3f, SharedGrid) {
+	std::stringstream ss;
+	ss << "testSharedGrid." << getpid();
+	std::string name = ss.str();
+	SharedMemorySegment::remove(name);
+	EXPECT_TRUE(SharedMemorySegment::find(name).get() == NULL);
+
+	ref_ptr<Grid3f> grid = new Grid3f(Vector3d(0.), 3, 1);
+	for (int ix = 0; ix < 3; ix++)
+		for (int iy = 0; iy < 3; iy++)
+			for (int iz = 0; iz < 3; iz++)
+				grid->get(ix, iy, iz) = Vector3f(ix, iy, iz);
+
+	ref_ptr<Grid3f> shared1 = shareGrid(grid, name);
+	EXPECT_TRUE(shared1->hasExternalStorage());
+
+	// attaching again maps the same values without filling them
+	int fillCalls = 0;
+	GridProperties p(Vector3d(0.), 3, 1);
+	ref_ptr<Grid3f> shared2 = sharedGrid3f(name, p, [&](ref_ptr<Grid3f> g) {
+		fillCalls++;
+	});
+	EXPECT_EQ(0, fillCalls);
+
+	Vector3d pos(1.2, 0.7, 2.1);
+	Vector3f b = grid->interpolate(pos);
+	Vector3f b1 = shared1->interpolate(pos);
+	Vector3f b2 = shared2->interpolate(pos);
+	EXPECT_FLOAT_EQ(b.x, b1.x);
+	EXPECT_FLOAT_EQ(b.y, b2.y);
+	EXPECT_FLOAT_EQ(b.z, b2.z);
+
+	ref_ptr<SharedMemorySegment> segment = SharedMemorySegment::find(name);
+	ASSERT_TRUE(segment.valid());
+	EXPECT_EQ(27 * sizeof(Vector3f), segment->getSize());
+	EXPECT_FALSE(segment->isCreator());
+
+	// the shared values are read-only, writing throws instead of crashing
+	EXPECT_TRUE(shared2->isReadOnly());
+	EXPECT_FALSE(grid->isReadOnly());
+	EXPECT_THROW(shared2->get(0, 0, 0), std::runtime_error);
+	EXPECT_THROW(shared2->setValue(0, 0, 0, Vector3f(1.)), std::runtime_error);
+	std::string filename = tempFile("testSharedGrid.raw");
+	dumpGrid(grid, filename);
+	EXPECT_THROW(loadGrid(shared2, filename), std::runtime_error);
+	remove(filename.c_str());
+	EXPECT_FLOAT_EQ(0, shared2->getValue(0, 0, 0).x);
+	EXPECT_FLOAT_EQ(meanFieldVector(grid).y, meanFieldVector(shared2).y);
+
+	// a different size is rejected
+	EXPECT_THROW(sharedGrid3f(name, GridProperties(Vector3d(0.), 4, 1),
+			[](ref_ptr<Grid3f> g) {}), std::runtime_error);
+
+	// a stale segment with the same size but a different content key is rejected
+	EXPECT_THROW(shareGrid(grid, name, "other.raw"), std::runtime_error);
+	EXPECT_TRUE(SharedMemorySegment::remove(name));
+	ref_ptr<Grid3f> shared3 = shareGrid(grid, name, "field.raw");
+	EXPECT_FLOAT_EQ(b.x, shared3->interpolate(pos).x);
+	EXPECT_THROW(sharedGrid3f(name, p, [](ref_ptr<Grid3f> g) {}), std::runtime_error);
+	EXPECT_TRUE(sharedGrid3f(name, p, [&](ref_ptr<Grid3f> g) {
+		fillCalls++;
+	}, 600, "field.raw").valid());
+	EXPECT_EQ(0, fillCalls);
+
+	// a failing creation removes the segment
+	EXPECT_TRUE(SharedMemorySegment::remove(name));
+	EXPECT_THROW(sharedGrid3f(name, p, [](ref_ptr<Grid3f> g) {
+		throw std::runtime_error("fill failed");
+	}), std::runtime_error);
+	EXPECT_FALSE(SharedMemorySegment::remove(name));
+
+	// the mapping stays valid after removing the name
+	EXPECT_FLOAT_EQ(2, shared2->getValue(1, 2, 0).y);
+
+	// the value scale is kept, scaling the read-only values only changes it
+	grid->setValueScale(2);
+	ref_ptr<Grid3f> shared4 = shareGrid(grid, name);
+	EXPECT_DOUBLE_EQ(2, shared4->getValueScale());
+	EXPECT_FLOAT_EQ(2 * b.y, shared4->interpolate(pos).y);
+	scaleGrid(shared4, 3);
+	EXPECT_DOUBLE_EQ(6, shared4->getValueScale());
+	EXPECT_FLOAT_EQ(2, shared4->getValue(1, 2, 0).y);
+	EXPECT_TRUE(SharedMemorySegment::remove(name));
+}
+
 TEST(Grid3f, Speed) {
 	// Dump and load a field grid
 	Grid3f grid(Vector3d(0.), 3, 3);
@@ -928,6 +1309,63 @@ TEST(EmissionMap, merge) {
 	EXPECT_TRUE(cpm->getPdf()[bin] > 0);
 }
 
+TEST(EmissionMap, mergeEnergyBin) {
+	EmissionMap em1(36, 18, 100, 1 * EeV, 100 * EeV);
+	ref_ptr<EmissionMap> em2 = em1.createEmpty();
+	em2->fillMap(1, 3 * EeV, Vector3d(1.0, 0.0, 0.0));
+
+	em1.merge(em2);
+	EXPECT_EQ(em1.getMaps().size(), 1);
+	EXPECT_TRUE(em1.hasMap(1, 3 * EeV));
+
+	Vector3d d;
+	em1.updateCdf();
+	EXPECT_TRUE(em1.drawDirection(1, 3 * EeV, d));
+	EXPECT_TRUE(d.getAngleTo(Vector3d(1.0, 0.0, 0.0)) < (20. * M_PI / 180.));
+}
+
+TEST(EmissionMapFiller, concurrent) {
+	ref_ptr<EmissionMap> em = new EmissionMap(36, 18, 10);
+	ref_ptr<EmissionMapFiller> filler = new EmissionMapFiller(em);
+	filler->setConcurrent(true);
+
+	int n = 1000;
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		ref_ptr<Candidate> c = new Candidate(22, (i % 2) ? 1 * EeV : 100 * EeV);
+		filler->process(c);
+	}
+
+	// the thread maps are merged on access
+	EXPECT_EQ(em->getMaps().size(), 2);
+	EXPECT_TRUE(em->hasMap(22, 1 * EeV));
+
+	double sum = 0;
+	for (EmissionMap::map_t::iterator i = em->getMaps().begin(); i != em->getMaps().end(); i++) {
+		const std::vector<double> &pdf = i->second->getPdf();
+		for (size_t k = 0; k < pdf.size(); k++)
+			sum += pdf[k];
+	}
+	EXPECT_DOUBLE_EQ(sum, n);
+
+	// filling again, e.g. in nested parallel regions
+	ref_ptr<EmissionMap> em2 = new EmissionMap(36, 18, 10);
+	filler->setEmissionMap(em2);
+#pragma omp parallel for
+	for (int i = 0; i < 10; i++) {
+#pragma omp parallel for
+		for (int j = 0; j < 10; j++) {
+			ref_ptr<Candidate> c = new Candidate(22, 1 * EeV);
+			filler->process(c);
+		}
+	}
+	ref_ptr<CylindricalProjectionMap> map = em2->getMap(22, 1 * EeV);
+	sum = 0;
+	for (size_t k = 0; k < map->getPdf().size(); k++)
+		sum += map->getPdf()[k];
+	EXPECT_DOUBLE_EQ(sum, 100);
+}
+
 
 TEST(Variant, copyToBuffer)
 {
@@ -2,7 +2,9 @@
 #include "crpropa/Units.h"
 #include "crpropa/ParticleID.h"
 #include "crpropa/PhotonBackground.h"
+#include "crpropa/Random.h"
 #include "crpropa/module/ElectronPairProduction.h"
+#include "crpropa/module/ContinuousLosses.h"
 #include "crpropa/module/NuclearDecay.h"
 #include "crpropa/module/PhotoDisintegration.h"
 #include "crpropa/module/ElasticScattering.h"
@@ -13,12 +15,86 @@
 #include "crpropa/module/EMTripletPairProduction.h"
 #include "crpropa/module/EMInverseComptonScattering.h"
 #include "crpropa/module/SynchrotronRadiation.h"
+#include "crpropa/module/InteractionScheduler.h"
 #include "gtest/gtest.h"
+#include "sophia.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
+#include <sstream>
+
+#include <unistd.h>
 
 namespace crpropa {
 
+// unique file name in the temporary directory
+static std::string tempFile(const std::string &name) {
+	const char *dir = getenv("TMPDIR");
+	std::stringstream ss;
+	ss << (dir ? dir : "/tmp") << "/crpropa_" << getpid() << "_" << name;
+	return ss.str();
+}
+
+// PhotonField ----------------------------------------------------------------
+static std::vector<double> readColumn(const std::string &filename) {
+	std::vector<double> values;
+	std::ifstream infile(getDataPath("Scaling/" + filename).c_str());
+	std::string line;
+	while (std::getline(infile, line))
+		if ((line.size() > 0) && (line[0] != '#'))
+			values.push_back(std::stod(line));
+	return values;
+}
+
+TEST(PhotonField, tabularLookup) {
+	// Test the lookup against the interpolation of the tables.
+	ref_ptr<PhotonField> irb = new IRB_Gilmore12();
+	std::vector<double> energies = readColumn("IRB_Gilmore12_photonEnergy.txt");
+	std::vector<double> redshifts = readColumn("IRB_Gilmore12_redshift.txt");
+	std::vector<double> densities = readColumn("IRB_Gilmore12_photonDensity.txt");
+	ASSERT_GE(energies.size(), 2);
+	ASSERT_GE(redshifts.size(), 2);
+
+	Random random(1);
+	double logEMin = log(energies.front()), logEMax = log(energies.back());
+	std::vector<double> ePhotons;
+	for (int i = 0; i < 1000; i++)
+		ePhotons.push_back(exp(logEMin + random.rand() * (logEMax - logEMin)));
+	double z = random.rand() * redshifts.back();
+	std::vector<double> batch;
+	irb->getPhotonDensities(ePhotons, batch, z);
+	ASSERT_EQ(ePhotons.size(), batch.size());
+	for (size_t i = 0; i < ePhotons.size(); i++) {
+		double expected = interpolate2d(ePhotons[i], z, energies, redshifts, densities);
+		EXPECT_NEAR(expected, irb->getPhotonDensity(ePhotons[i], z), 1e-10 * expected);
+		EXPECT_DOUBLE_EQ(irb->getPhotonDensity(ePhotons[i], z), batch[i]);
+	}
+
+	// tabulated values and outside of the table
+	EXPECT_DOUBLE_EQ(densities[redshifts.size() + 1], irb->getPhotonDensity(energies[1], redshifts[1]));
+	EXPECT_DOUBLE_EQ(densities.back(), irb->getPhotonDensity(energies.back(), redshifts.back()));
+	EXPECT_EQ(0, irb->getPhotonDensity(energies.front() / 2, 0));
+	EXPECT_EQ(0, irb->getPhotonDensity(energies.back() * 2, 0));
+	EXPECT_EQ(0, irb->getPhotonDensity(energies[1], redshifts.back() + 1));
+	EXPECT_DOUBLE_EQ(1, irb->getRedshiftScaling(0));
+}
+
+TEST(PhotonField, blackbodyBatch) {
+	// Test the batch evaluation of the Planck spectrum.
+	CMB cmb;
+	std::vector<double> ePhotons, densities;
+	for (int i = 0; i < 100; i++)
+		ePhotons.push_back(pow(10, -6 + 0.05 * i) * eV);
+	cmb.getPhotonDensities(ePhotons, densities);
+	for (size_t i = 0; i < ePhotons.size(); i++) {
+		double E = ePhotons[i];
+		double expected = 8 * M_PI * pow(E / (h_planck * c_light), 3) / std::expm1(E / (k_boltzmann * 2.73));
+		EXPECT_NEAR(expected, densities[i], 1e-12 * expected);
+		EXPECT_DOUBLE_EQ(cmb.getPhotonDensity(E), densities[i]);
+	}
+}
+
 // ElectronPairProduction -----------------------------------------------------
 TEST(ElectronPairProduction, allBackgrounds) {
 	// Test if interaction data files are loaded.
@@ -668,6 +744,154 @@ TEST(PhotoPionProduction, interactionTag) {
 	EXPECT_TRUE(ppp.getInteractionTag() == "myTag");
 }
 
+// sorted log10(eps / eV) of photon energies sampled for protons
+static std::vector<double> sampleLogEps(const PhotoPionProduction &ppp, double E, int n) {
+	std::vector<double> x(n);
+	for (int i = 0; i < n; i++)
+		x[i] = std::log10(ppp.sampleEps(true, E, 0) / eV);
+	std::sort(x.begin(), x.end());
+	return x;
+}
+
+// two-sample Kolmogorov-Smirnov statistic of sorted samples
+static double ksStatistic(const std::vector<double> &a, const std::vector<double> &b) {
+	size_t i = 0, j = 0;
+	double d = 0;
+	while (i < a.size() && j < b.size()) {
+		double x = std::min(a[i], b[j]);
+		while (i < a.size() && a[i] <= x)
+			i++;
+		while (j < b.size() && b[j] <= x)
+			j++;
+		d = std::max(d, std::fabs(double(i) / a.size() - double(j) / b.size()));
+	}
+	return d;
+}
+
+// two-sample chi-square of sorted samples, binned in quantiles of a
+static double chiSquare(const std::vector<double> &a, const std::vector<double> &b, int bins) {
+	double ra = std::sqrt(double(b.size()) / a.size()), rb = 1 / ra;
+	double chi2 = 0;
+	for (int k = 0; k < bins; k++) {
+		double lo = (k == 0) ? -HUGE_VAL : a[k * a.size() / bins];
+		double hi = (k == bins - 1) ? HUGE_VAL : a[(k + 1) * a.size() / bins];
+		double na = std::lower_bound(a.begin(), a.end(), hi) - std::lower_bound(a.begin(), a.end(), lo);
+		double nb = std::lower_bound(b.begin(), b.end(), hi) - std::lower_bound(b.begin(), b.end(), lo);
+		if (na + nb > 0)
+			chi2 += (ra * na - rb * nb) * (ra * na - rb * nb) / (na + nb);
+	}
+	return chi2;
+}
+
+TEST(PhotoPionProduction, sampleTable) {
+	// photon energies sampled from the table follow the distribution of the
+	// direct method, which is slow, hence the larger sample from the table
+	PhotoPionProduction direct(new CMB());
+	PhotoPionProduction ppp(new CMB());
+	ppp.setSampleTable(true);
+	EXPECT_TRUE(ppp.getSampleTable());
+	int n = 4000, m = 40000;
+	for (int j = 0; j < 2; j++) {
+		double E = (j == 0) ? 1e20 * eV : 1e21 * eV;
+		Random::instance().seed(1);
+		std::vector<double> a = sampleLogEps(direct, E, n);
+		Random::instance().seed(2);
+		std::vector<double> b = sampleLogEps(ppp, E, m);
+
+		// Kolmogorov-Smirnov: critical value for a significance of 0.001
+		EXPECT_LT(ksStatistic(a, b), 1.95 * std::sqrt((n + m) / (double(n) * m))) << "E = " << E / eV << " eV";
+		// chi-square in 20 bins of equal probability, 19 degrees of freedom: 43.8 for 0.001
+		EXPECT_LT(chiSquare(a, b, 20), 43.8) << "E = " << E / eV << " eV";
+	}
+
+	// save and load
+	std::string filename = tempFile("ppp_sample_table.txt");
+	ppp.saveSampleTable(filename);
+	PhotoPionProduction ppp2(new CMB());
+	ppp2.loadSampleTable(filename);
+	EXPECT_TRUE(ppp2.getSampleTable());
+	double eps = ppp2.sampleEps(false, 1e20 * eV, 0);
+	EXPECT_GT(eps, 0);
+
+	// the table belongs to another photon field
+	PhotoPionProduction ppp3(new IRB_Gilmore12());
+	EXPECT_THROW(ppp3.loadSampleTable(filename), std::runtime_error);
+	remove(filename.c_str());
+
+	ppp.setSampleTable(false);
+	EXPECT_FALSE(ppp.getSampleTable());
+}
+
+#ifdef CRPROPA_HAVE_REENTRANT_SOPHIA
+// spectra of SOPHIA secondaries for protons on 1 GeV photons at 10^20 eV,
+// binned in log10(E / Ein) from -5 to 0, nucleons and other particles separately
+static const int sophiaBins = 10;
+
+static void sophiaSpectra(bool parallel, int n, std::vector<double> &nucleons, std::vector<double> &others, int &violations) {
+	nucleons.assign(sophiaBins, 0);
+	others.assign(sophiaBins, 0);
+	int nViolations = 0;
+#pragma omp parallel if(parallel)
+	{
+		std::vector<double> n1(sophiaBins, 0), n2(sophiaBins, 0);
+#pragma omp for reduction(+: nViolations)
+		for (int i = 0; i < n; i++) {
+			int nature = 0;
+			double Ein = 1e11;
+			double eps = 1e-11;
+			double outputEnergy[5][2000];
+			int outPartID[2000];
+			int nParticles;
+			sophiaevent_(nature, Ein, eps, outputEnergy, outPartID, nParticles);
+
+			double Esum = 0;
+			for (int j = 0; j < nParticles; j++) {
+				double E = outputEnergy[3][j];
+				Esum += E;
+				int bin = std::floor((std::log10(E / Ein) + 5) * sophiaBins / 5.);
+				bin = std::min(std::max(bin, 0), sophiaBins - 1);
+				if (abs(outPartID[j]) == 13 || abs(outPartID[j]) == 14)
+					n1[bin]++;
+				else
+					n2[bin]++;
+			}
+			// energy is conserved in every event
+			if (std::fabs(Esum - Ein) > 1e-3 * Ein)
+				nViolations++;
+		}
+#pragma omp critical
+		for (int j = 0; j < sophiaBins; j++) {
+			nucleons[j] += n1[j];
+			others[j] += n2[j];
+		}
+	}
+	violations = nViolations;
+}
+
+TEST(PhotoPionProduction, sophiaParallel) {
+	// SOPHIA events generated in parallel follow the same distributions
+	int n = 20000;
+	std::vector<double> nucleons1, others1, nucleons2, others2;
+	int v1, v2;
+	sophiaSpectra(false, n, nucleons1, others1, v1);
+	sophiaSpectra(true, n, nucleons2, others2, v2);
+
+	EXPECT_EQ(0, v1);
+	EXPECT_EQ(0, v2);
+	double sum1 = 0, sum2 = 0;
+	for (int i = 0; i < sophiaBins; i++) {
+		// bin contents agree within 5 sigma of the counting statistics
+		EXPECT_NEAR(nucleons1[i], nucleons2[i], 5 * std::sqrt(nucleons1[i] + nucleons2[i]) + 1) << "nucleon bin " << i;
+		EXPECT_NEAR(others1[i], others2[i], 5 * std::sqrt(others1[i] + others2[i]) + 1) << "secondary bin " << i;
+		sum1 += nucleons1[i] + others1[i];
+		sum2 += nucleons2[i] + others2[i];
+	}
+	// one nucleon and at least one more particle per event
+	EXPECT_GE(sum1, 2 * n);
+	EXPECT_NEAR(sum1, sum2, 0.05 * sum1);
+}
+#endif
+
 // Redshift -------------------------------------------------------------------
 TEST(Redshift, simpleTest) {
 	// Test if redshift is decreased and adiabatic energy loss is applied.
@@ -695,6 +919,173 @@ TEST(Redshift, limitRedshiftDecrease) {
 	EXPECT_DOUBLE_EQ(0, c.getRedshift());
 }
 
+// ContinuousLosses -----------------------------------------------------------
+TEST(ContinuousLosses, electronPairProduction) {
+	// Test if one long step agrees with many small steps of ElectronPairProduction.
+	ref_ptr<PhotonField> CMB_instance = new CMB();
+	ElectronPairProduction epp(CMB_instance);
+	ContinuousLosses cl;
+	cl.addPhotonField(CMB_instance);
+
+	Candidate c1(nucleusId(1, 1), 100 * EeV);
+	c1.setCurrentStep(100 * kpc);
+	for (int i = 0; i < 5000; i++)
+		epp.process(&c1);
+
+	Candidate c2(nucleusId(1, 1), 100 * EeV);
+	c2.setCurrentStep(500 * Mpc);
+	cl.process(&c2);
+	EXPECT_NEAR(c1.current.getEnergy(), c2.current.getEnergy(), 1e-3 * c1.current.getEnergy());
+	EXPECT_LT(c2.current.getEnergy(), 100 * EeV);
+	EXPECT_LT(c2.getNextStep(), std::numeric_limits<double>::max());
+
+	// nuclei
+	ElectronPairProduction epp2(CMB_instance);
+	Candidate c3(nucleusId(56, 26), 1000 * EeV);
+	c3.setCurrentStep(10 * kpc);
+	for (int i = 0; i < 20000; i++)
+		epp2.process(&c3);
+	Candidate c4(nucleusId(56, 26), 1000 * EeV);
+	c4.setCurrentStep(200 * Mpc);
+	cl.process(&c4);
+	EXPECT_NEAR(c3.current.getEnergy(), c4.current.getEnergy(), 1e-3 * c3.current.getEnergy());
+
+	// the result does not depend on the step size
+	Candidate c6(nucleusId(56, 26), 1000 * EeV);
+	c6.setCurrentStep(2 * Mpc);
+	for (int i = 0; i < 100; i++)
+		cl.process(&c6);
+	EXPECT_NEAR(c4.current.getEnergy(), c6.current.getEnergy(), 1e-6 * c4.current.getEnergy());
+
+	// no losses for neutral particles
+	Candidate c5(nucleusId(1, 0), 100 * EeV);
+	c5.setCurrentStep(100 * Mpc);
+	cl.process(&c5);
+	EXPECT_DOUBLE_EQ(100 * EeV, c5.current.getEnergy());
+}
+
+TEST(ContinuousLosses, redshift) {
+	// Test if one long step agrees with many small steps of Redshift.
+	ContinuousLosses cl;
+	Redshift redshift;
+
+	Candidate c1(nucleusId(1, 0), 100 * EeV);
+	c1.setRedshift(1);
+	c1.setCurrentStep(100 * kpc);
+	for (int i = 0; i < 10000; i++)
+		redshift.process(&c1);
+
+	Candidate c2(nucleusId(1, 0), 100 * EeV);
+	c2.setRedshift(1);
+	c2.setCurrentStep(1000 * Mpc);
+	cl.process(&c2);
+	EXPECT_NEAR(c1.getRedshift(), c2.getRedshift(), 1e-3);
+	EXPECT_NEAR(c1.current.getEnergy(), c2.current.getEnergy(), 1e-3 * c1.current.getEnergy());
+
+	// the redshift does not decrease below 0
+	c2.setCurrentStep(10 * Gpc);
+	cl.process(&c2);
+	EXPECT_DOUBLE_EQ(0, c2.getRedshift());
+}
+
+// InteractionScheduler -------------------------------------------------------
+// interaction with a constant rate, counting the interactions in a candidate property
+class ConstantInteraction: public StochasticInteraction {
+	double rate;
+	std::string name;
+public:
+	ConstantInteraction(double rate, std::string name) : rate(rate), name(name) {
+	}
+	double interactionRate(const Candidate *candidate) const {
+		return rate;
+	}
+	void interact(Candidate *candidate) const {
+		int n = candidate->hasProperty(name) ? candidate->getProperty(name).toInt32() : 0;
+		candidate->setProperty(name, n + 1);
+	}
+	void process(Candidate *candidate) const {
+	}
+};
+
+TEST(InteractionScheduler, limitNextStep) {
+	// The next step is limited to the distance to the next interaction.
+	InteractionScheduler scheduler;
+	scheduler.add(new ConstantInteraction(1 / Mpc, "A"));
+	scheduler.add(new ConstantInteraction(3 / Mpc, "B"));
+	EXPECT_DOUBLE_EQ(4 / Mpc, scheduler.interactionRate(NULL));
+
+	Candidate c;
+	scheduler.setOpticalDepth(&c, 2.);
+	c.setCurrentStep(0);
+	c.setNextStep(std::numeric_limits<double>::max());
+	scheduler.process(&c);
+	EXPECT_DOUBLE_EQ(0.5 * Mpc, c.getNextStep());
+
+	// the optical depth is reduced by the step
+	c.setCurrentStep(0.25 * Mpc);
+	c.setNextStep(std::numeric_limits<double>::max());
+	scheduler.process(&c);
+	EXPECT_DOUBLE_EQ(1., scheduler.getOpticalDepth(&c));
+	EXPECT_FALSE(c.hasProperty("OpticalDepth"));
+	EXPECT_DOUBLE_EQ(0.25 * Mpc, c.getNextStep());
+	EXPECT_FALSE(c.hasProperty("A"));
+	EXPECT_FALSE(c.hasProperty("B"));
+}
+
+TEST(InteractionScheduler, empty) {
+	// Without interactions the candidate is not changed.
+	InteractionScheduler scheduler;
+	EXPECT_EQ("OpticalDepth", scheduler.getSlotName());
+	Candidate c;
+	c.setCurrentStep(1 * Mpc);
+	c.setNextStep(std::numeric_limits<double>::max());
+	scheduler.process(&c);
+	EXPECT_EQ(0, scheduler.getOpticalDepth(&c));
+	EXPECT_EQ(std::numeric_limits<double>::max(), c.getNextStep());
+}
+
+TEST(InteractionScheduler, sampling) {
+	// Number of interactions follows the total rate, the channels the partial rates.
+	// This test can stochastically fail.
+	InteractionScheduler scheduler;
+	scheduler.add(new ConstantInteraction(1 / Mpc, "A"));
+	scheduler.add(new ConstantInteraction(3 / Mpc, "B"));
+
+	int nA = 0, nB = 0;
+	int n = 2000;
+	for (int i = 0; i < n; i++) {
+		Candidate c;
+		// optical depth carried over between several steps
+		for (int j = 0; j < 10; j++) {
+			c.setCurrentStep(1 * Mpc);
+			scheduler.process(&c);
+		}
+		nA += c.hasProperty("A") ? c.getProperty("A").toInt32() : 0;
+		nB += c.hasProperty("B") ? c.getProperty("B").toInt32() : 0;
+	}
+	EXPECT_NEAR(40, double(nA + nB) / n, 0.6);
+	EXPECT_NEAR(0.25, double(nA) / (nA + nB), 0.02);
+}
+
+TEST(InteractionScheduler, photoPionProduction) {
+	// The interaction rate of the module agrees with its mean free path.
+	ref_ptr<PhotonField> CMB_instance = new CMB();
+	ref_ptr<PhotoPionProduction> ppp = new PhotoPionProduction(CMB_instance);
+	Candidate c(nucleusId(1, 1), 200 * EeV);
+	double gamma = c.current.getLorentzFactor();
+	EXPECT_DOUBLE_EQ(1. / ppp->nucleonMFP(gamma, 0, true), ppp->interactionRate(&c));
+
+	// interaction point is reached within the step limit
+	InteractionScheduler scheduler;
+	scheduler.add(ppp);
+	c.setNextStep(std::numeric_limits<double>::max());
+	c.setCurrentStep(0);
+	scheduler.process(&c);
+	c.setCurrentStep(c.getNextStep() * 1.000001);
+	scheduler.process(&c);
+	EXPECT_LT(c.current.getEnergy(), 200 * EeV);
+}
+
 // EMPairProduction -----------------------------------------------------------
 TEST(EMPairProduction, allBackgrounds) {
 	// Test if interaction data files are loaded.
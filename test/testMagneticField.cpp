@@ -1,9 +1,12 @@
 #include <stdexcept>
+#include <limits>
 
 #include "crpropa/magneticField/MagneticFieldGrid.h"
 #include "crpropa/magneticField/CMZField.h"
 #include "crpropa/magneticField/PolarizedSingleModeMagneticField.h"
 #include "crpropa/magneticField/GalacticMagneticField.h"
+#include "crpropa/magneticField/JF12Field.h"
+#include "crpropa/magneticField/turbulentField/PlaneWaveTurbulence.h"
 #include "crpropa/Grid.h"
 #include "crpropa/Units.h"
 #include "crpropa/Common.h"
@@ -55,6 +58,100 @@ TEST(testMagneticFieldList, SimpleTest) {
 	EXPECT_DOUBLE_EQ(b.z, 3);
 }
 
+class ThrowingMagneticField: public MagneticField {
+public:
+	Vector3d getField(const Vector3d &position) const {
+		if (position.x > 0)
+			throw std::runtime_error("ThrowingMagneticField: x > 0");
+		return Vector3d(1, 0, 0);
+	}
+};
+
+TEST(testMagneticField, tryGetField) {
+	Vector3d nan(std::numeric_limits<double>::quiet_NaN(), 0, 0);
+	Vector3d b;
+
+	// default implementation catches the exceptions of getField
+	ref_ptr<ThrowingMagneticField> throwing = new ThrowingMagneticField();
+	EXPECT_TRUE(throwing->tryGetField(Vector3d(-1, 0, 0), 0, b));
+	EXPECT_DOUBLE_EQ(1, b.x);
+	EXPECT_FALSE(throwing->tryGetField(Vector3d(1, 0, 0), 0, b));
+	EXPECT_DOUBLE_EQ(0, b.getR());
+
+	// grid: non-finite positions are rejected
+	ref_ptr<Grid3f> grid = new Grid3f(Vector3d(0.), 2, 1);
+	grid->get(0, 0, 0) = Vector3f(2, 0, 0);
+	MagneticFieldGrid gridField(grid);
+	EXPECT_TRUE(gridField.tryGetField(Vector3d(0.5), 0, b));
+	EXPECT_DOUBLE_EQ(gridField.getField(Vector3d(0.5)).x, b.x);
+	EXPECT_FALSE(gridField.tryGetField(nan, 0, b));
+	EXPECT_DOUBLE_EQ(0, b.getR());
+#ifndef HAVE_SIMD
+	// tricubic interpolation of vector grids is rejected instead of giving a zero field
+	EXPECT_THROW(grid->setInterpolationType(TRICUBIC), std::runtime_error);
+	GridProperties properties(Vector3d(0.), 2, 1);
+	properties.setInterpolationType(TRICUBIC);
+	EXPECT_THROW(Grid3f g(properties), std::runtime_error);
+#endif
+
+	// JF12
+	JF12Field jf12;
+	Vector3d pos(-8 * kpc, 1 * kpc, 0.1 * kpc);
+	EXPECT_TRUE(jf12.tryGetField(pos, 0, b));
+	EXPECT_DOUBLE_EQ(jf12.getField(pos).x, b.x);
+	EXPECT_FALSE(jf12.tryGetField(nan, 0, b));
+
+	// plane wave turbulence
+	PlaneWaveTurbulence waves(TurbulenceSpectrum(muG, pc, 100 * pc), 10, 1);
+	EXPECT_TRUE(waves.tryGetField(pos, 0, b));
+	EXPECT_DOUBLE_EQ(waves.getField(pos).y, b.y);
+	EXPECT_FALSE(waves.tryGetField(nan, 0, b));
+
+	// list: the valid fields are summed
+	MagneticFieldList list;
+	list.addField(new UniformMagneticField(Vector3d(0, 2, 0)));
+	list.addField(throwing);
+	EXPECT_FALSE(list.tryGetField(Vector3d(1, 0, 0), 0, b));
+	EXPECT_DOUBLE_EQ(0, b.x);
+	EXPECT_DOUBLE_EQ(2, b.y);
+
+	// batch: only the failing position is zero
+	std::vector<Vector3d> positions, fields;
+	positions.push_back(Vector3d(-1, 0, 0));
+	positions.push_back(Vector3d(1, 0, 0));
+	throwing->getFieldBatch(positions, fields);
+	EXPECT_DOUBLE_EQ(1, fields[0].x);
+	EXPECT_DOUBLE_EQ(0, fields[1].x);
+}
+
+// grid field with a scaled or redshift dependent field on top
+class ScaledFieldGrid: public MagneticFieldGrid {
+public:
+	ScaledFieldGrid(ref_ptr<Grid3f> grid) : MagneticFieldGrid(grid) {
+	}
+	Vector3d getField(const Vector3d &position) const {
+		return MagneticFieldGrid::getField(position) * 3;
+	}
+	Vector3d getField(const Vector3d &position, double z) const {
+		if (position.x > 1)
+			throw std::runtime_error("ScaledFieldGrid: x > 1");
+		return getField(position) * (1 + z);
+	}
+};
+
+TEST(testMagneticField, tryGetFieldOverridden) {
+	// overrides of getField are not bypassed
+	ref_ptr<Grid3f> grid = new Grid3f(Vector3d(0.), 2, 1);
+	grid->get(0, 0, 0) = Vector3f(2, 0, 0);
+	ref_ptr<MagneticField> field = new ScaledFieldGrid(grid);
+	Vector3d b;
+	EXPECT_TRUE(field->tryGetField(Vector3d(0.5), 1, b));
+	EXPECT_DOUBLE_EQ(field->getField(Vector3d(0.5), 1).x, b.x);
+	EXPECT_DOUBLE_EQ(6 * grid->interpolate(Vector3d(0.5)).x, b.x);
+	EXPECT_FALSE(field->tryGetField(Vector3d(1.5, 0, 0), 0, b));
+	EXPECT_DOUBLE_EQ(0, b.getR());
+}
+
 TEST(testMagneticFieldEvolution, SimpleTest) {
 	// Test if this decorator scales the underlying field as (1+z)^m
 	ref_ptr<UniformMagneticField> B = new UniformMagneticField(Vector3d(1,0,0));
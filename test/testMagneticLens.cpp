@@ -100,6 +100,152 @@ TEST(MagneticLens, OutOfBoundsEnergy)
 }
 
 
+TEST(MagneticLens, transformModelVectors)
+{
+	MagneticLens magneticLens(5);
+	Pixelization P(5);
+	ModelMatrixType M;
+	M.resize(P.nPix(), P.nPix());
+	M.reserve(P.nPix());
+
+	// Map any direction (p,t) to (p, -t)
+	for (uint32_t i=0;i<P.nPix();i++)
+	{
+		double theta, phi;
+		P.pix2Direction(i, phi, theta);
+		int j = P.direction2Pix(phi, -theta);
+		M.insert(j,i) = 1;
+	}
+	magneticLens.setLensPart(M, 10 * EeV, 100 * EeV);
+
+	// more vectors than in one batch of prod_up (32)
+	size_t n = 35;
+	std::vector<std::vector<double> > models(n, std::vector<double>(P.nPix()));
+	std::vector<std::vector<double> > expected = models;
+	std::vector<double*> pointers(n);
+	for (size_t k = 0; k < n; k++)
+	{
+		for (size_t i = 0; i < P.nPix(); i++)
+			models[k][i] = (i * 7 + k) % 13;
+		expected[k] = models[k];
+		magneticLens.transformModelVector(&expected[k][0], 20 * EeV);
+		pointers[k] = &models[k][0];
+	}
+
+	std::vector<double> buffer;
+	magneticLens.transformModelVectors(&pointers[0], n, 20 * EeV, buffer);
+	for (size_t k = 0; k < n; k++)
+		for (size_t i = 0; i < P.nPix(); i++)
+			EXPECT_DOUBLE_EQ(models[k][i], expected[k][i]);
+}
+
+TEST(MagneticLens, serializeCompressed)
+{
+	ModelMatrixType M;
+	M.resize(48, 48);
+	for (int i = 0; i < 48; i++)
+	{
+		M.insert(i, i) = 0.5 + i;
+		M.insert((i * 7) % 48, i) += 1. / 3;
+	}
+
+	serializeCompressed("testLensCompressed.dat", M);
+	ModelMatrixType M2;
+	deserialize("testLensCompressed.dat", M2);
+	EXPECT_EQ(M2.rows(), 48);
+	EXPECT_EQ(M2.cols(), 48);
+	EXPECT_EQ(M2.nonZeros(), M.nonZeros());
+	EXPECT_DOUBLE_EQ((M - M2).norm(), 0);
+
+	serializeCompressed("testLensCompressed.dat", M, true);
+	deserialize("testLensCompressed.dat", M2);
+	EXPECT_NEAR((M - M2).norm(), 0, 1E-5);
+
+	uint32_t rows, cols;
+	deserializeSize("testLensCompressed.dat", rows, cols);
+	EXPECT_EQ(rows, 48);
+	EXPECT_EQ(cols, 48);
+	remove("testLensCompressed.dat");
+}
+
+TEST(MagneticLens, lazyLoading)
+{
+	Pixelization P(2);
+	ModelMatrixType M;
+	M.resize(P.nPix(), P.nPix());
+	for (uint32_t i = 0; i < P.nPix(); i++)
+		M.insert(i, i) = 2;
+
+	// lens with three parts, one in the old format
+	serializeCompressed("testLensPart0.dat", M);
+	serializeCompressed("testLensPart1.dat", M, true);
+	serialize("testLensPart2.dat", M);
+	{
+		std::ofstream lensfile("testLens.cfg");
+		lensfile << "# parts\n";
+		lensfile << "testLensPart0.dat 18 19\n";
+		lensfile << "testLensPart1.dat 19 20\n";
+		lensfile << "testLensPart2.dat 20 21\n";
+	}
+
+	MagneticLens lens("testLens.cfg");
+	ASSERT_EQ(lens.getLensParts().size(), 3);
+	for (size_t i = 0; i < 3; i++)
+		EXPECT_FALSE(lens.getLensParts()[i]->isLoaded());
+	EXPECT_EQ(lens.getMemoryUsage(), 0);
+
+	// the budget is exceeded by the second part
+	LensPart *part0 = lens.getLensParts()[0];
+	LensPart *part1 = lens.getLensParts()[1];
+	part0->getMatrix();
+	size_t budget = part0->getMemoryUsage();
+	lens.setMemoryBudget(budget);
+	EXPECT_EQ(lens.getMemoryUsage(), part0->getMemoryUsage());
+	part1->getMatrix();
+	EXPECT_FALSE(part0->isLoaded());
+	EXPECT_TRUE(part1->isLoaded());
+	EXPECT_EQ(lens.getMemoryUsage(), part1->getMemoryUsage());
+
+	// normalization is applied again after reloading
+	lens.normalizeLens();
+	EXPECT_DOUBLE_EQ(lens.getNorm(), 2);
+	EXPECT_DOUBLE_EQ(part0->getMatrix().coeff(3, 3), 1);
+	EXPECT_FALSE(part1->isLoaded());
+	EXPECT_DOUBLE_EQ(lens.getLensParts()[2]->getMatrix().coeff(5, 5), 1);
+
+	std::vector<double> model(P.nPix(), 1.);
+	lens.transformModelVector(&model[0], pow(10, 19.5) * eV);
+	EXPECT_DOUBLE_EQ(model[7], 1);
+
+	// parts in use are not unloaded
+	{
+		LensPartMatrix matrix0(part0);
+		LensPartMatrix matrix1(part1);
+		EXPECT_TRUE(part0->isLoaded());
+		EXPECT_TRUE(part1->isLoaded());
+	}
+	EXPECT_EQ(lens.getMemoryUsage(), budget);
+
+	// the budget is kept when loading in parallel
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < 30; i++)
+	{
+		std::vector<double> m(P.nPix(), 1.);
+		lens.transformModelVector(&m[0], pow(10, 18.5 + i % 3) * eV);
+		EXPECT_DOUBLE_EQ(m[7], 1);
+	}
+	EXPECT_LE(lens.getMemoryUsage(), budget);
+
+	// load errors are thrown to the caller
+	LensPart missing("testLensMissing.dat", 1, 2);
+	EXPECT_THROW(missing.getMatrix(), std::runtime_error);
+
+	remove("testLensPart0.dat");
+	remove("testLensPart1.dat");
+	remove("testLensPart2.dat");
+	remove("testLens.cfg");
+}
+
 TEST(Pixelization, angularDistance)
 {
 	// test for correct angular distance in case of same vectors 
@@ -151,6 +297,71 @@ TEST(ParticleMapsContainer, getRandomParticles)
 
 }
 
+TEST(ParticleMapsContainer, addParticles)
+{
+  ParticleMapsContainer maps;
+  size_t N = 1000;
+  std::vector<int> ids(N);
+  std::vector<double> energies(N), lons(N, 0.1), lats(N, -0.2), weights(N, 0.5);
+  for(size_t i = 0; i < N; i++)
+  {
+    ids[i] = (i % 2) ? 1000010010 : 1000020040;
+    energies[i] = (i % 3 + 1) * EeV;
+  }
+  maps.addParticles(N, &ids[0], &energies[0], &lons[0], &lats[0], &weights[0]);
+
+  EXPECT_EQ(maps.getParticleIds().size(), 2);
+  EXPECT_EQ(maps.getEnergies(1000010010).size(), 3);
+  EXPECT_NEAR(maps.getSumOfWeights(), 500, 1E-9);
+
+  // same as filling the particles one by one
+  ParticleMapsContainer maps2;
+  for(size_t i = 0; i < N; i++)
+    maps2.addParticle(ids[i], energies[i], lons[i], lats[i], weights[i]);
+  double *m1 = maps.getMap(1000020040, 2 * EeV);
+  double *m2 = maps2.getMap(1000020040, 2 * EeV);
+  ASSERT_TRUE(m1 != NULL);
+  for(size_t j = 0; j < maps.getNumberOfPixels(); j++)
+    EXPECT_DOUBLE_EQ(m1[j], m2[j]);
+  EXPECT_DOUBLE_EQ(maps.getWeight(1000020040, 2 * EeV), maps2.getWeight(1000020040, 2 * EeV));
+
+  // weights are not accumulated in repeated updates
+  maps.forceWeightUpdate();
+  EXPECT_NEAR(maps.getSumOfWeights(), 500, 1E-9);
+}
+
+TEST(ParticleMapsContainer, applyLens)
+{
+  MagneticLens lens(6);
+  Pixelization P(6);
+  ModelMatrixType M;
+  M.resize(P.nPix(), P.nPix());
+  M.reserve(P.nPix());
+  // Map any direction (p,t) to (p, -t)
+  for (uint32_t i = 0; i < P.nPix(); i++)
+  {
+    double theta, phi;
+    P.pix2Direction(i, phi, theta);
+    M.insert(P.direction2Pix(phi, -theta), i) = 1;
+  }
+  lens.setLensPart(M, 10 * EeV, 100 * EeV);
+
+  ParticleMapsContainer maps;
+  const double lat0 = 0.5;
+  maps.addParticle(1000010010, 20 * EeV, 0.3, lat0);
+  maps.addParticle(1000020040, 60 * EeV, 0.3, lat0);
+  maps.addParticle(1000260560, 60 * EeV, 0.3, lat0); // not covered
+  maps.applyLens(lens);
+
+  double lon, lat;
+  EXPECT_TRUE(maps.placeOnMap(1000010010, 20 * EeV, lon, lat));
+  EXPECT_NEAR(lat, -lat0, 0.05);
+  EXPECT_TRUE(maps.placeOnMap(1000020040, 60 * EeV, lon, lat));
+  EXPECT_NEAR(lat, -lat0, 0.05);
+  EXPECT_TRUE(maps.placeOnMap(1000260560, 60 * EeV, lon, lat));
+  EXPECT_NEAR(lat, lat0, 0.05);
+}
+
 TEST(Pixelization, randomDirectionInPixel)
 {
   Pixelization p(6);
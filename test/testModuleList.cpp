@@ -3,6 +3,9 @@
 #include "crpropa/ParticleID.h"
 #include "crpropa/module/SimplePropagation.h"
 #include "crpropa/module/BreakCondition.h"
+#include "crpropa/module/InteractionScheduler.h"
+#include "crpropa/module/Observer.h"
+#include "crpropa/module/ParticleCollector.h"
 
 #include "gtest/gtest.h"
 
@@ -55,6 +58,304 @@ TEST(ModuleList, runSource) {
 	modules.run(&source, 100, false);
 }
 
+// splits the candidate once into two secondaries with half the energy, down to 1 EeV
+class SplitTree: public Module {
+public:
+	void process(Candidate *c) const {
+		double E = c->current.getEnergy();
+		if ((E < 2 * EeV) or c->hasProperty("split"))
+			return;
+		c->addSecondary(c->current.getId(), E / 2);
+		c->addSecondary(c->current.getId(), E / 2);
+		c->setProperty("split", true);
+	}
+};
+
+TEST(ModuleList, releaseSecondaries) {
+	ref_ptr<ParticleCollector> collector = new ParticleCollector();
+	ModuleList modules;
+	modules.add(new SimplePropagation(1 * Mpc, 1 * Mpc));
+	modules.add(new SplitTree());
+	MaximumTrajectoryLength *maxLength = new MaximumTrajectoryLength(10 * Mpc);
+	maxLength->onReject(collector);
+	modules.add(maxLength);
+
+	// full tree of 2 + 4 + ... + 64 secondaries
+	ref_ptr<Candidate> c = new Candidate(nucleusId(1, 1), 64 * EeV);
+	modules.run(c);
+	EXPECT_EQ(2, c->secondaries.size());
+	EXPECT_EQ(126, modules.getPeakLiveCandidates());
+	EXPECT_EQ(127, collector->size());
+
+	// released secondaries, the collected ones are detached
+	collector->clearContainer();
+	modules.resetStatistics();
+	modules.setReleaseSecondaries(true);
+	c = new Candidate(nucleusId(1, 1), 64 * EeV);
+	modules.run(c);
+	EXPECT_EQ(0, c->secondaries.size());
+	EXPECT_EQ(12, modules.getPeakLiveCandidates());
+	ASSERT_EQ(127, collector->size());
+	for (size_t i = 1; i < collector->size(); i++) {
+		ref_ptr<Candidate> s = (*collector)[i];
+		EXPECT_TRUE(s->parent == NULL);
+		EXPECT_EQ(c->getSerialNumber(), s->getSourceSerialNumber());
+		EXPECT_NE(s->getSerialNumber(), s->getCreatedSerialNumber());
+	}
+
+	// depth-first above the limit
+	collector->clearContainer();
+	modules.resetStatistics();
+	modules.setMaximumLiveCandidates(4);
+	c = new Candidate(nucleusId(1, 1), 64 * EeV);
+	modules.run(c);
+	EXPECT_EQ(127, collector->size());
+	EXPECT_LE(modules.getPeakLiveCandidates(), 12);
+}
+
+// deactivates all particles beyond x, counting the calls
+class StopBeyond: public BatchModule {
+public:
+	double x;
+	mutable size_t calls, particles;
+	StopBeyond(double x) : x(x), calls(0), particles(0) {
+	}
+	void processBatch(ParticleBatch &batch) const {
+		calls++;
+		particles += batch.size();
+		for (size_t i = 0; i < batch.size(); i++)
+			if (batch.x[i] > x)
+				batch.active[i] = 0;
+	}
+};
+
+TEST(ModuleList, runBatch) {
+	ref_ptr<StopBeyond> stop = new StopBeyond(10 * Mpc);
+	ref_ptr<ParticleCollector> collector = new ParticleCollector();
+	ModuleList modules;
+	modules.add(new SimplePropagation(1 * Mpc, 1 * Mpc));
+	modules.add(new SplitTree());
+	modules.add(stop);
+	modules.add(collector);
+	modules.setBatchSize(10);
+
+	ModuleList::candidate_vector_t candidates;
+	for (int i = 0; i < 20; i++)
+		candidates.push_back(new Candidate(nucleusId(1, 1), 4 * EeV, Vector3d(0.), Vector3d(1, 0, 0)));
+	modules.run(&candidates);
+
+	// 2 batches of 3 generations, created after the first step of their parent
+	EXPECT_EQ(2 * (11 + 10 + 9), stop->calls);
+	EXPECT_EQ(20 * 11 + 40 * 10 + 80 * 9, stop->particles);
+	EXPECT_EQ(stop->particles, collector->size());
+	for (size_t i = 0; i < candidates.size(); i++) {
+		EXPECT_FALSE(candidates[i]->isActive());
+		EXPECT_DOUBLE_EQ(11 * Mpc, candidates[i]->current.getPosition().x);
+		EXPECT_EQ(2, candidates[i]->secondaries.size());
+		EXPECT_FALSE(candidates[i]->secondaries[0]->isActive());
+	}
+	// all secondaries of a batch are kept
+	EXPECT_EQ(10 * (2 + 4), modules.getPeakLiveCandidates());
+
+	// outside of a batched run
+	ref_ptr<Candidate> c = new Candidate();
+	c->current.setPosition(Vector3d(20 * Mpc, 0, 0));
+	stop->process(c);
+	EXPECT_FALSE(c->isActive());
+}
+
+// keeps a reference to the last batch, as the arrays of a Python module may do
+class KeepBatch: public BatchModule {
+public:
+	mutable ref_ptr<ParticleBatch> last;
+	void processBatch(ParticleBatch &batch) const {
+		last = &batch;
+	}
+};
+
+TEST(ModuleList, batchKeptAlive) {
+	ref_ptr<KeepBatch> keep = new KeepBatch();
+	ref_ptr<Candidate> c = new Candidate(nucleusId(1, 1), 4 * EeV, Vector3d(1, 2, 3));
+	keep->process(c);
+	ASSERT_TRUE(keep->last.valid());
+	EXPECT_EQ(1, keep->last->getReferenceCount());
+	EXPECT_DOUBLE_EQ(2, keep->last->y[0]);
+}
+
+// throws for particles beyond x
+class ThrowBeyond: public Module {
+public:
+	double x;
+	ThrowBeyond(double x) : x(x) {
+	}
+	void process(Candidate *c) const {
+		if (c->current.getPosition().x > x)
+			throw std::runtime_error("ThrowBeyond");
+	}
+};
+
+TEST(ModuleList, runBatchException) {
+	// exceptions of modules stop the run instead of terminating
+	ModuleList modules;
+	modules.add(new SimplePropagation(1 * Mpc, 1 * Mpc));
+	modules.add(new ThrowBeyond(2.5 * Mpc));
+	modules.setBatchSize(10);
+
+	ModuleList::candidate_vector_t candidates;
+	for (int i = 0; i < 30; i++)
+		candidates.push_back(new Candidate(nucleusId(1, 1), 4 * EeV, Vector3d(0.), Vector3d(1, 0, 0)));
+	modules.run(&candidates);
+
+	// the first batch is stopped at the throwing step, the others are not run
+	for (size_t i = 0; i < candidates.size(); i++) {
+		if (i < 10) {
+			EXPECT_FALSE(candidates[i]->isActive());
+			EXPECT_DOUBLE_EQ(3 * Mpc, candidates[i]->current.getPosition().x);
+		} else {
+			EXPECT_TRUE(candidates[i]->isActive());
+			EXPECT_DOUBLE_EQ(0, candidates[i]->current.getPosition().x);
+		}
+	}
+}
+
+// emits one secondary proton with half the energy in the first step
+class SplitOnce: public Module {
+public:
+	void process(Candidate *c) const {
+		if (c->getTrajectoryLength() > c->getCurrentStep())
+			return;
+		if (c->current.getId() != nucleusId(4, 2))
+			return;
+		c->addSecondary(nucleusId(1, 1), c->current.getEnergy() / 2);
+		c->current.setEnergy(c->current.getEnergy() / 2);
+	}
+};
+
+TEST(ModuleList1D, runCandidate) {
+	// same result as the generic 1D setup
+	ModuleList reference;
+	reference.add(new SimplePropagation(0.1 * kpc, 1 * Mpc));
+	Observer *obs = new Observer();
+	obs->add(new Observer1D());
+	reference.add(obs);
+	ref_ptr<Candidate> c1 = new Candidate(nucleusId(1, 1), 10 * EeV, Vector3d(10.5, 0, 0) * Mpc, Vector3d(-1, 0, 0));
+	reference.run(c1);
+
+	ref_ptr<ParticleCollector> collector = new ParticleCollector();
+	ModuleList1D modules(0.1 * kpc, 1 * Mpc);
+	modules.onDetection(collector);
+	ref_ptr<Candidate> c2 = new Candidate(nucleusId(1, 1), 10 * EeV, Vector3d(10.5, 0, 0) * Mpc, Vector3d(-1, 0, 0));
+	modules.run(c2);
+
+	EXPECT_FALSE(c2->isActive());
+	EXPECT_NEAR(c1->getTrajectoryLength(), c2->getTrajectoryLength(), 1e-6 * Mpc);
+	EXPECT_NEAR(0, c2->current.getPosition().x, 1e-6 * Mpc);
+	EXPECT_EQ(1, modules.getDetectedCount());
+	ASSERT_EQ(1, collector->size());
+	EXPECT_EQ(nucleusId(1, 1), (*collector)[0]->current.getId());
+	EXPECT_DOUBLE_EQ(10 * EeV, (*collector)[0]->source.getEnergy());
+	EXPECT_NEAR(10.5 * Mpc, (*collector)[0]->getTrajectoryLength(), 1e-6 * Mpc);
+}
+
+TEST(ModuleList1D, secondaries) {
+	ref_ptr<ParticleCollector> collector = new ParticleCollector();
+	ModuleList1D modules(0.1 * kpc, 1 * Mpc);
+	modules.add(new SplitOnce());
+	modules.onDetection(collector);
+	ref_ptr<Candidate> c = new Candidate(nucleusId(4, 2), 10 * EeV, Vector3d(5, 0, 0) * Mpc, Vector3d(-1, 0, 0));
+
+	// without secondaries
+	modules.run(c, false);
+	EXPECT_EQ(1, collector->size());
+
+	// with secondaries, source and creation information is kept
+	collector->clearContainer();
+	c = new Candidate(nucleusId(4, 2), 10 * EeV, Vector3d(5, 0, 0) * Mpc, Vector3d(-1, 0, 0));
+	modules.run(c, true);
+	ASSERT_EQ(2, collector->size());
+	EXPECT_EQ(3, modules.getDetectedCount());
+	ref_ptr<Candidate> p = (*collector)[1];
+	EXPECT_EQ(nucleusId(1, 1), p->current.getId());
+	EXPECT_DOUBLE_EQ(5 * EeV, p->current.getEnergy());
+	EXPECT_EQ(nucleusId(4, 2), p->source.getId());
+	EXPECT_DOUBLE_EQ(10 * EeV, p->source.getEnergy());
+	EXPECT_NEAR(5 * Mpc, p->getTrajectoryLength(), 1e-6 * Mpc);
+	EXPECT_EQ("SEC", p->getTagOrigin());
+	EXPECT_EQ(c->getTagOrigin(), (*collector)[0]->getTagOrigin());
+}
+
+// interaction with a rate too small to ever interact
+class RareInteraction: public StochasticInteraction {
+public:
+	double interactionRate(const Candidate *candidate) const {
+		return 1e-10 / Mpc;
+	}
+	void interact(Candidate *candidate) const {
+	}
+	void process(Candidate *candidate) const {
+	}
+};
+
+// records the optical depth of each particle at its first step
+class FirstOpticalDepth: public Module {
+	ref_ptr<InteractionScheduler> scheduler;
+	mutable uint64_t serial;
+public:
+	mutable std::vector<double> depths;
+	FirstOpticalDepth(InteractionScheduler *scheduler) : scheduler(scheduler), serial(0) {
+	}
+	void process(Candidate *c) const {
+		if (c->getSerialNumber() == serial)
+			return;
+		serial = c->getSerialNumber();
+		depths.push_back(scheduler->getOpticalDepth(c));
+	}
+};
+
+TEST(ModuleList1D, freshSlots) {
+	// the secondary reuses the candidate of the primary, but not its optical depth
+	ref_ptr<InteractionScheduler> scheduler = new InteractionScheduler();
+	scheduler->add(new RareInteraction());
+	ref_ptr<FirstOpticalDepth> recorder = new FirstOpticalDepth(scheduler);
+	ModuleList1D modules(0.1 * kpc, 1 * Mpc);
+	modules.add(new SplitOnce());
+	modules.add(recorder);
+	modules.add(scheduler);
+	ref_ptr<Candidate> c = new Candidate(nucleusId(4, 2), 10 * EeV, Vector3d(5, 0, 0) * Mpc, Vector3d(-1, 0, 0));
+	modules.run(c, true);
+	EXPECT_EQ(2, modules.getDetectedCount());
+	ASSERT_EQ(2, recorder->depths.size());
+	EXPECT_EQ(0, recorder->depths[0]);
+	EXPECT_EQ(0, recorder->depths[1]);
+}
+
+TEST(ModuleList1D, breakConditions) {
+	ref_ptr<ParticleCollector> collector = new ParticleCollector();
+	ModuleList1D modules(0.1 * kpc, 1 * Mpc);
+	modules.setMaximumTrajectoryLength(2 * Mpc);
+	modules.onDetection(collector);
+	ref_ptr<Candidate> c = new Candidate(nucleusId(1, 1), 10 * EeV, Vector3d(5, 0, 0) * Mpc, Vector3d(-1, 0, 0));
+	modules.run(c);
+	EXPECT_FALSE(c->isActive());
+	EXPECT_NEAR(3 * Mpc, c->current.getPosition().x, 1 * kpc);
+	EXPECT_EQ(0, collector->size());
+	EXPECT_THROW(modules.setMinimumStep(2 * Mpc), std::runtime_error);
+}
+
+TEST(ModuleList1D, runSource) {
+	ref_ptr<ParticleCollector> collector = new ParticleCollector();
+	ModuleList1D modules;
+	modules.add(new SplitOnce());
+	modules.onDetection(collector);
+	Source source;
+	source.add(new SourcePosition(Vector3d(10, 0, 0) * Mpc));
+	source.add(new SourcePowerLawSpectrum(5 * EeV, 100 * EeV, -2));
+	source.add(new SourceParticleType(nucleusId(4, 2)));
+	modules.run(&source, 100);
+	EXPECT_EQ(200, modules.getDetectedCount());
+	EXPECT_EQ(200, collector->size());
+}
+
 #if _OPENMP
 #include <omp.h>
 TEST(ModuleList, runOpenMP) {
@@ -69,6 +370,18 @@ TEST(ModuleList, runOpenMP) {
 	omp_set_num_threads(2);
 	modules.run(&source, 1000, false);
 }
+
+TEST(ModuleList1D, runCandidateThreads) {
+	// the detected count is shared by concurrent calls
+	ModuleList1D modules(0.1 * kpc, 1 * Mpc);
+	omp_set_num_threads(4);
+#pragma omp parallel for
+	for (int i = 0; i < 400; i++) {
+		ref_ptr<Candidate> c = new Candidate(nucleusId(1, 1), 10 * EeV, Vector3d(0.5, 0, 0) * Mpc, Vector3d(-1, 0, 0));
+		modules.run(c);
+	}
+	EXPECT_EQ(400, modules.getDetectedCount());
+}
 #endif
 
 int main(int argc, char **argv) {
@@ -1,6 +1,8 @@
 /** Unit tests for Output modules of CRPropa
     Output
     TextOutput
+    ColumnarOutput
+    MemoryOutput
     ParticleCollector
  */
 
@@ -8,6 +10,7 @@
 
 #include "gtest/gtest.h"
 #include <iostream>
+#include <sstream>
 #include <string>
 
 
@@ -154,8 +157,275 @@ TEST(HDF5Output, failOnIllegalOutputFile) {
 }
 #endif
 
+//-- ColumnarOutput
+
+TEST(ColumnarOutput, columnNames) {
+	Candidate c;
+	{
+		ColumnarOutput output("ColumnarOutput_NamesTest.crpc", Output::Event1D);
+		output.process(&c);
+	}
+	ColumnarOutputReader reader("ColumnarOutput_NamesTest.crpc");
+	std::vector<std::string> names = reader.getColumnNames();
+	std::string joined;
+	for (size_t i = 0; i < names.size(); i++)
+		joined += names[i] + " ";
+	EXPECT_EQ(joined, "D ID E ID0 E0 tag ");
+	EXPECT_EQ(reader.getNumberOfRows(), 1);
+	EXPECT_EQ(reader.getColumnType("ID"), Variant::TYPE_INT32);
+}
+
+TEST(ColumnarOutput, writeReadChunks) {
+	Candidate c;
+	c.setTagOrigin("TEST");
+	{
+		ColumnarOutput output("ColumnarOutput_ChunkTest.crpc");
+		output.setChunkSize(64); // force many chunks
+		output.enableProperty("foo", 1.5, "Bar");
+		output.enableProperty("bar", Variant::fromInt32(3), "Foo");
+		for (int i = 0; i < 100; i++) {
+			c.current.setEnergy(i * EeV);
+			c.current.setPosition(Vector3d(i, 2 * i, 3 * i) * Mpc);
+			if (i % 2)
+				c.setProperty("foo", i + 0.25);
+			output.process(&c);
+		}
+	}
+
+	ColumnarOutputReader reader("ColumnarOutput_ChunkTest.crpc");
+	EXPECT_EQ(reader.getNumberOfRows(), 100);
+	EXPECT_DOUBLE_EQ(reader.getLengthScale(), Mpc);
+	EXPECT_DOUBLE_EQ(reader.getEnergyScale(), EeV);
+
+	std::vector<double> E = reader.getColumn("E");
+	std::vector<double> Y = reader.getColumn("Y");
+	std::vector<double> foo = reader.getColumn("foo");
+	std::vector<std::string> tag = reader.getStringColumn("tag");
+	const int32_t *bar = static_cast<const int32_t *>(reader.getColumnData("bar"));
+	ASSERT_EQ(E.size(), 100);
+	ASSERT_EQ(tag.size(), 100);
+	for (int i = 0; i < 100; i++) {
+		EXPECT_DOUBLE_EQ(E[i], i);
+		EXPECT_DOUBLE_EQ(Y[i], 2 * i);
+		EXPECT_DOUBLE_EQ(foo[i], (i == 0) ? 1.5 : ((i % 2) ? i + 0.25 : i - 0.75));
+		EXPECT_EQ(bar[i], 3);
+		EXPECT_EQ(tag[i], "TEST");
+	}
+	EXPECT_THROW(reader.getColumn("NOT_A_COLUMN"), std::runtime_error);
+	EXPECT_THROW(reader.getColumn("tag"), std::runtime_error);
+}
+
+TEST(ColumnarOutput, uncompressed) {
+	Candidate c;
+	{
+		ColumnarOutput output("ColumnarOutput_RawTest.crpc", Output::Trajectory1D);
+		output.setCompressionLevel(0);
+		for (int i = 0; i < 10; i++) {
+			c.current.setPosition(Vector3d(i, 0, 0) * Mpc);
+			output.process(&c);
+		}
+	}
+	ColumnarOutputReader reader("ColumnarOutput_RawTest.crpc");
+	const double *X = static_cast<const double *>(reader.getColumnData("X"));
+	for (int i = 0; i < 10; i++)
+		EXPECT_DOUBLE_EQ(X[i], i);
+}
+
+TEST(ColumnarOutput, failOnIllegalFiles) {
+	EXPECT_THROW(ColumnarOutput output("THIS_FOLDER_MUST_NOT_EXISTS_12345+/FILE.crpc"),
+	             std::runtime_error);
+	EXPECT_THROW(ColumnarOutputReader reader("THIS_FILE_MUST_NOT_EXIST_12345.crpc"),
+	             std::runtime_error);
+}
+
+//-- MemoryOutput
+
+TEST(MemoryOutput, columns) {
+	MemoryOutput output(Output::Event3D);
+	output.enableProperty("foo", 1.5, "Bar");
+	output.enableProperty("name", Variant("none"), "Name");
+	Candidate c;
+	for (int i = 0; i < 10; i++) {
+		c.current.setEnergy(i * EeV);
+		c.current.setPosition(Vector3d(i, 2 * i, 3 * i) * Mpc);
+		c.current.setId(nucleusId(1, 1) + i);
+		if (i == 3)
+			c.setProperty("name", "three");
+		output.process(&c);
+	}
+	EXPECT_THROW(output.enable(Output::RedshiftColumn), std::runtime_error);
+
+	EXPECT_EQ(10, output.getNumberOfRows());
+	EXPECT_TRUE(output.hasColumn("X0"));
+	EXPECT_FALSE(output.hasColumn("SN"));
+	EXPECT_EQ(Variant::TYPE_INT32, output.getColumnType("ID"));
+	EXPECT_EQ(Variant::TYPE_STRING, output.getColumnType("name"));
+
+	const double *E = static_cast<const double *>(output.getColumnData("E"));
+	const int32_t *ID = static_cast<const int32_t *>(output.getColumnData("ID"));
+	std::vector<double> Z = output.getColumn("Z");
+	std::vector<double> foo = output.getColumn("foo");
+	std::vector<std::string> name = output.getStringColumn("name");
+	for (int i = 0; i < 10; i++) {
+		EXPECT_DOUBLE_EQ(i, E[i]);
+		EXPECT_EQ(nucleusId(1, 1) + i, ID[i]);
+		EXPECT_DOUBLE_EQ(3 * i, Z[i]);
+		EXPECT_DOUBLE_EQ(1.5, foo[i]);
+		EXPECT_EQ((i < 3) ? "none" : "three", name[i]);
+	}
+	EXPECT_THROW(output.getColumn("NOT_A_COLUMN"), std::runtime_error);
+	EXPECT_THROW(output.getColumnData("tag"), std::runtime_error);
+
+	// reconfigure after clearing
+	output.clear();
+	output.disableAll();
+	output.enable(Output::CurrentEnergyColumn);
+	output.process(&c);
+	EXPECT_EQ(1, output.getNumberOfRows());
+	EXPECT_EQ(3, output.getNumberOfColumns()); // E, foo, name
+}
+
+TEST(HistogramOutput, fill) {
+	HistogramOutput output;
+	output.addLogEnergyAxis(1 * EeV, 100 * EeV, 2);
+	output.addMassNumberAxis(4);
+	output.addAxis(new HistogramQuantityAxis("D", 0, 10 * Mpc, 5));
+	EXPECT_EQ(3, output.getNumberOfAxes());
+	EXPECT_EQ(2 * 5 * 5, output.getNumberOfBins());
+
+	Candidate c(nucleusId(4, 2), 20 * EeV);
+	c.setTrajectoryLength(3 * Mpc);
+	c.setWeight(2);
+	// bins 1, 4, 1
+	EXPECT_EQ((1 * 5 + 4) * 5 + 1, output.getBinIndex(&c));
+	output.process(&c);
+	output.process(&c);
+	Candidate p(nucleusId(1, 1), 5 * EeV);
+	p.setTrajectoryLength(9.5 * Mpc);
+	output.process(&p);
+	// outside
+	Candidate outside(nucleusId(1, 1), 200 * EeV);
+	EXPECT_EQ(-1, output.getBinIndex(&outside));
+	output.process(&outside);
+	Candidate fe(nucleusId(56, 26), 5 * EeV);
+	output.process(&fe);
+
+	std::vector<double> counts = output.getCounts();
+	std::vector<double> squares = output.getSquaredWeights();
+	ASSERT_EQ(50, counts.size());
+	EXPECT_DOUBLE_EQ(4, counts[(1 * 5 + 4) * 5 + 1]);
+	EXPECT_DOUBLE_EQ(8, squares[(1 * 5 + 4) * 5 + 1]);
+	EXPECT_DOUBLE_EQ(1, output.getCount((0 * 5 + 1) * 5 + 4));
+	EXPECT_DOUBLE_EQ(3, output.getNumberOfEntries());
+	EXPECT_EQ(2, output.getNumberOfFilledBins());
+	EXPECT_THROW(output.addLogEnergyAxis(1 * EeV, 10 * EeV, 1), std::runtime_error);
+
+	// unweighted, with a property axis
+	HistogramOutput unweighted;
+	unweighted.setUseWeights(false);
+	unweighted.addAxis(new HistogramQuantityAxis("foo", 0, 1, 2));
+	c.setProperty("foo", 0.75);
+	unweighted.process(&c);
+	unweighted.process(&p); // no property
+	EXPECT_DOUBLE_EQ(0, unweighted.getCount(0));
+	EXPECT_DOUBLE_EQ(1, unweighted.getCount(1));
+}
+
+TEST(HistogramOutput, parallel) {
+	HistogramOutput output;
+	output.addLogEnergyAxis(1 * EeV, 1000 * EeV, 30);
+	std::vector<ref_ptr<Candidate> > candidates;
+	for (int i = 0; i < 3000; i++)
+		candidates.push_back(new Candidate(nucleusId(1, 1), (1 + i % 999) * EeV));
+
+#pragma omp parallel for
+	for (int i = 0; i < 3000; i++)
+		output.process(candidates[i]);
+
+	std::vector<double> counts = output.getCounts();
+	double sum = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+		sum += counts[i];
+	EXPECT_DOUBLE_EQ(3000, sum);
+	EXPECT_EQ(3000, output.size());
+
+	// nested parallel regions, where the inner threads share thread numbers
+	output.clear();
+#pragma omp parallel for num_threads(2)
+	for (int i = 0; i < 2; i++) {
+#pragma omp parallel for num_threads(2)
+		for (int j = 0; j < 1500; j++)
+			output.process(candidates[i * 1500 + j]);
+	}
+	EXPECT_DOUBLE_EQ(3000, output.getNumberOfEntries());
+	EXPECT_EQ(3000, output.size());
+}
+
+TEST(HistogramOutput, saveLoad) {
+	HistogramOutput output;
+	output.addLogEnergyAxis(1 * EeV, 100 * EeV, 4);
+	output.addMassNumberAxis(56);
+	Candidate c(nucleusId(14, 7), 3 * EeV);
+	c.setWeight(0.5);
+	output.process(&c);
+	output.save("HistogramOutput_Test.bin");
+
+	// merge two jobs
+	HistogramOutput merged;
+	merged.addLogEnergyAxis(1 * EeV, 100 * EeV, 4);
+	merged.addMassNumberAxis(56);
+	merged.load("HistogramOutput_Test.bin");
+	merged.load("HistogramOutput_Test.bin");
+	long index = merged.getBinIndex(&c);
+	EXPECT_DOUBLE_EQ(1, merged.getCount(index));
+	EXPECT_DOUBLE_EQ(0.5, merged.getSquaredWeights()[index]);
+	EXPECT_DOUBLE_EQ(2, merged.getNumberOfEntries());
+
+	// different binning
+	HistogramOutput other;
+	other.addLogEnergyAxis(1 * EeV, 100 * EeV, 5);
+	other.addMassNumberAxis(56);
+	EXPECT_THROW(other.load("HistogramOutput_Test.bin"), std::runtime_error);
+}
+
+#ifdef CRPROPA_HAVE_GALACTIC_LENSES
+TEST(HistogramOutput, healpix) {
+	HistogramOutput output;
+	output.addHealpixAxis(2);
+	EXPECT_EQ(192, output.getNumberOfBins());
+	Candidate c;
+	c.current.setDirection(Vector3d(1, 0, 0));
+	long a = output.getBinIndex(&c);
+	c.current.setDirection(Vector3d(-1, 0, 0));
+	long b = output.getBinIndex(&c);
+	EXPECT_NE(a, b);
+	EXPECT_GE(a, 0);
+	EXPECT_LT(a, 192);
+}
+#endif
+
 //-- ParticleCollector
 
+TEST(ParticleCollector, snapshot) {
+	ParticleCollector collector;
+	for (int i = 0; i < 100; i++) {
+		ref_ptr<Candidate> c = new Candidate(nucleusId(1, 1), i * EeV);
+		c->setWeight(i);
+		collector.process(c);
+	}
+
+	MemoryOutput output(Output::Event1D);
+	output.enable(Output::WeightColumn);
+	collector.snapshot(&output);
+	ASSERT_EQ(100, output.getNumberOfRows());
+	const double *E = static_cast<const double *>(output.getColumnData("E"));
+	const double *W = static_cast<const double *>(output.getColumnData("W"));
+	for (int i = 0; i < 100; i++) {
+		EXPECT_DOUBLE_EQ(i, E[i]);
+		EXPECT_DOUBLE_EQ(i, W[i]);
+	}
+}
+
 TEST(ParticleCollector, size) {
 	ref_ptr<Candidate> c = new Candidate();
 	ParticleCollector output;
@@ -211,6 +481,101 @@ TEST(ParticleCollector, dumpload) {
 	EXPECT_EQ(output[3]->getRedshift(), c->getRedshift());
 }
 
+TEST(ParticleCollector, dumploadBinary) {
+	ref_ptr<Candidate> c = new Candidate(11, 1.2345678901234 * EeV);
+	c->current.setPosition(Vector3d(1, 2, 3) * Mpc);
+	c->source.setDirection(Vector3d(0, 1, 0));
+	c->setTrajectoryLength(1.0000000001 * Mpc);
+	c->setRedshift(0.123456789);
+	c->setWeight(0.5);
+	c->setTagOrigin("TEST");
+	c->setProperty("foo", 1.5);
+	c->setProperty("bar", "baz");
+	c->setProperty("n", Variant::fromInt64(-7));
+	c->setSlot(Candidate::registerSlot("DumpBinaryTestSlot"), 42);
+	c->addSecondary(22, 1 * EeV);
+	c->secondaries[0]->addSecondary(11, 0.5 * EeV);
+
+	ParticleCollector input;
+	ParticleCollector output;
+	for (int i = 0; i < 3; ++i)
+		input.process(c);
+
+	input.dumpBinary("ParticleCollector_DumpBinaryTest.bin", true);
+	output.loadBinary("ParticleCollector_DumpBinaryTest.bin");
+
+	ASSERT_EQ(output.size(), 3);
+	ref_ptr<Candidate> o = output[2];
+	EXPECT_EQ(o->current.getId(), 11);
+	EXPECT_EQ(o->current.getEnergy(), c->current.getEnergy());
+	EXPECT_EQ(o->current.getPosition(), c->current.getPosition());
+	EXPECT_EQ(o->source.getDirection(), c->source.getDirection());
+	EXPECT_EQ(o->getTrajectoryLength(), c->getTrajectoryLength());
+	EXPECT_EQ(o->getRedshift(), c->getRedshift());
+	EXPECT_EQ(o->getWeight(), c->getWeight());
+	EXPECT_EQ(o->getTagOrigin(), "TEST");
+	EXPECT_EQ(o->getSerialNumber(), c->getSerialNumber());
+	EXPECT_EQ(o->getProperty("foo").toDouble(), 1.5);
+	EXPECT_EQ(o->getProperty("bar").toString(), "baz");
+	EXPECT_EQ(o->getProperty("n").toInt64(), -7);
+	EXPECT_EQ(o->getSlot(Candidate::registerSlot("DumpBinaryTestSlot")), 42);
+
+	// secondary tree with parent links
+	ASSERT_EQ(o->secondaries.size(), 1);
+	ASSERT_EQ(o->secondaries[0]->secondaries.size(), 1);
+	Candidate *s = o->secondaries[0]->secondaries[0];
+	EXPECT_EQ(s->current.getEnergy(), 0.5 * EeV);
+	EXPECT_EQ(s->getSourceSerialNumber(), c->getSerialNumber());
+	EXPECT_EQ(s->getCreatedSerialNumber(), c->secondaries[0]->getSerialNumber());
+
+	// source and created serial numbers of secondaries written without their parents
+	ParticleCollector secondaries;
+	secondaries.process(c->secondaries[0]->secondaries[0]);
+	secondaries.dumpBinary("ParticleCollector_DumpBinaryTest.bin");
+	ParticleCollector loaded;
+	loaded.loadBinary("ParticleCollector_DumpBinaryTest.bin");
+	ASSERT_EQ(loaded.size(), 1);
+	EXPECT_EQ(loaded[0]->getSerialNumber(), c->secondaries[0]->secondaries[0]->getSerialNumber());
+	EXPECT_EQ(loaded[0]->getSourceSerialNumber(), c->getSerialNumber());
+	EXPECT_EQ(loaded[0]->getCreatedSerialNumber(), c->secondaries[0]->getSerialNumber());
+
+	// only the current record format is read
+	std::stringstream stream;
+	c->serialize(stream);
+	EXPECT_THROW(Candidate::deserialize(stream, Candidate::serializationVersion + 1), std::runtime_error);
+	EXPECT_EQ(Candidate::deserialize(stream)->getSerialNumber(), c->getSerialNumber());
+}
+
+TEST(ParticleCollector, reprocessBinary) {
+	ParticleCollector input;
+	for (int i = 0; i < 25; ++i)
+		input.process(new Candidate(22, i * EeV));
+	input.dumpBinary("ParticleCollector_ReprocessBinaryTest.bin");
+
+	ref_ptr<ParticleCollector> output = new ParticleCollector();
+	ParticleCollector::reprocessBinary("ParticleCollector_ReprocessBinaryTest.bin", output, 10);
+	ASSERT_EQ(output->size(), 25);
+
+	double sum = 0;
+	for (size_t i = 0; i < output->size(); i++)
+		sum += (*output)[i]->current.getEnergy() / EeV;
+	EXPECT_DOUBLE_EQ(sum, 300);
+
+	ParticleCollector parallel;
+	input.reprocessParallel(&parallel);
+	EXPECT_EQ(parallel.size(), 25);
+}
+
+TEST(ParticleCollector, loadBinaryWrongFile) {
+	{
+		TextOutput text("ParticleCollector_NotBinary.txt");
+		Candidate c;
+		text.process(&c);
+	}
+	ParticleCollector collector;
+	EXPECT_THROW(collector.loadBinary("ParticleCollector_NotBinary.txt"), std::runtime_error);
+}
+
 // Just test if the trajectory is on a line for rectilinear propagation
 TEST(ParticleCollector, getTrajectory) {
 	int pos_x[10];
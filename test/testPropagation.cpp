@@ -1,4 +1,5 @@
 #include "crpropa/Candidate.h"
+#include "crpropa/ParticleBatch.h"
 #include "crpropa/ParticleID.h"
 #include "crpropa/module/SimplePropagation.h"
 #include "crpropa/module/PropagationBP.h"
@@ -549,6 +550,96 @@ TEST(testPropagationBP, neutron) {
 }
 
 
+// The batch mode gives the same trajectories as the fixed step Boris push
+TEST(testPropagationBP, batch) {
+	double step = 10 * pc;
+	ref_ptr<MagneticField> field = new PlaneWaveTurbulence(TurbulenceSpectrum(muG, pc, 100 * pc), 10, 1);
+	PropagationBP propa(field, step);
+
+	ParticleBatch batch;
+	std::vector<ref_ptr<Candidate> > candidates;
+	for (int i = 0; i < 300; i++) {
+		ParticleState p(nucleusId(1, 1), (1 + i) * EeV, Vector3d(i * pc, 0, 0),
+				Vector3d(1, 0.01 * i, -0.5));
+		batch.add(p, step);
+		candidates.push_back(new Candidate(p));
+	}
+
+	batch.setEscapeSphere(Vector3d(0.), 1 * Gpc);
+	propa.propagate(batch, 1 * kpc);
+	EXPECT_EQ(300, batch.countActive());
+
+	for (int i = 0; i < 300; i++) {
+		for (int j = 0; j < 100; j++)
+			propa.process(candidates[i]);
+		ParticleState p = batch.get(i);
+		Vector3d pos = candidates[i]->current.getPosition();
+		Vector3d dir = candidates[i]->current.getDirection();
+		EXPECT_NEAR(0, (p.getPosition() - pos).getR(), 1e-9 * kpc);
+		EXPECT_NEAR(0, (p.getDirection() - dir).getR(), 1e-9);
+		EXPECT_DOUBLE_EQ(1 * kpc, batch.trajectoryLength[i]);
+	}
+}
+
+// The batch mode converges to the Cash-Karp solution
+TEST(testPropagationBP, batchAccuracy) {
+	ref_ptr<MagneticField> field = new PlaneWaveTurbulence(TurbulenceSpectrum(muG, 10 * pc, 1 * kpc), 10, 1);
+	ParticleState p(nucleusId(1, 1), 1 * EeV, Vector3d(0.), Vector3d(1, 1, 0));
+
+	PropagationCK propaCK(field, 1e-10, 0.1 * pc, 1 * pc);
+	Candidate c(p);
+	c.setNextStep(0.1 * pc);
+	while (c.getTrajectoryLength() < 2 * kpc) {
+		c.limitNextStep(2 * kpc - c.getTrajectoryLength());
+		propaCK.process(&c);
+	}
+
+	PropagationBP propa(field);
+	ParticleBatch batch;
+	batch.add(p, 0.1 * pc);
+	propa.propagate(batch, 2 * kpc);
+
+	// gyroradius ~ 1 kpc: deviation of the direction far below a degree
+	EXPECT_NEAR(0, (batch.get(0).getPosition() - c.current.getPosition()).getR(), 1e-3 * kpc);
+	EXPECT_NEAR(0, (batch.get(0).getDirection() - c.current.getDirection()).getR(), 1e-3);
+}
+
+TEST(testPropagationBP, batchStepsAndEscape) {
+	PropagationBP propa(new UniformMagneticField(Vector3d(0, 0, 1 * muG)));
+	ParticleBatch batch;
+	batch.add(ParticleState(nucleusId(1, 1), 1 * EeV, Vector3d(0.), Vector3d(1, 0, 0)), 1 * kpc);
+	batch.add(ParticleState(nucleusId(4, 2), 4 * EeV, Vector3d(0.), Vector3d(1, 0, 0)), 1 * kpc);
+	batch.add(ParticleState(nucleusId(1, 0), 1 * EeV, Vector3d(0.), Vector3d(0, 1, 0)), 1 * kpc);
+	EXPECT_THROW(batch.add(ParticleState(), 0), std::runtime_error);
+
+	// steps proportional to the rigidity E / Z
+	batch.setRigidityScaledSteps(1 * pc, 1e18 * volt);
+	EXPECT_DOUBLE_EQ(1 * pc, batch.step[0]);
+	EXPECT_DOUBLE_EQ(2 * pc, batch.step[1]);
+	EXPECT_DOUBLE_EQ(1 * kpc, batch.step[2]);
+
+	// the neutron leaves the sphere, the charged particles gyrate inside
+	batch.setEscapeSphere(Vector3d(0.), 10 * kpc);
+	propa.propagate(batch, 100 * kpc);
+	EXPECT_EQ(2, batch.countActive());
+	EXPECT_EQ(0, batch.active[2]);
+	EXPECT_DOUBLE_EQ(100 * kpc, batch.get(2).getPosition().y);
+	EXPECT_EQ(nucleusId(4, 2), batch.get(1).getId());
+	EXPECT_DOUBLE_EQ(100 * kpc, batch.trajectoryLength[0]);
+
+	// the size is fixed while views on the arrays exist
+	batch.addView();
+	EXPECT_THROW(batch.add(ParticleState(), 1 * kpc), std::runtime_error);
+	EXPECT_THROW(batch.resize(5), std::runtime_error);
+	EXPECT_THROW(batch.clear(), std::runtime_error);
+	EXPECT_EQ(3, batch.size());
+	batch.removeView();
+	EXPECT_EQ(0, batch.getViewCount());
+	batch.add(ParticleState(), 1 * kpc);
+	EXPECT_EQ(4, batch.size());
+	EXPECT_THROW(batch.removeView(), std::runtime_error);
+}
+
 int main(int argc, char **argv) {
 	::testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();
@@ -1,3 +1,4 @@
+import os
 import sys
 
 try:
@@ -96,6 +97,65 @@ class testCrossLanguagePolymorphism(unittest.TestCase):
         self.assertEqual(fieldAtPos, propCK.getFieldAtPosition(pos, z))
         self.assertEqual(fieldAtPos, propSDE.getMagneticFieldAtPosition(pos, z))
 
+    @unittest.skipIf(not numpy_available, "numpy not available")
+    def testBatchModule(self):
+        class StopBeyond(crp.BatchModule):
+            def __init__(self, x):
+                crp.BatchModule.__init__(self)
+                self.x = x
+                self.calls = 0
+
+            def processBatch(self, batch):
+                self.calls += 1
+                x = batch.getColumn_numpyArray('x')
+                active = batch.getColumn_numpyArray('active')
+                active[x > self.x] = False
+
+        stop = StopBeyond(10 * crp.Mpc)
+        sim = crp.ModuleList()
+        sim.add(crp.SimplePropagation(1 * crp.Mpc, 1 * crp.Mpc))
+        sim.add(stop)
+        sim.setBatchSize(100)
+        candidates = crp.CandidateVector()
+        for i in range(100):
+            c = crp.Candidate()
+            c.current.setDirection(crp.Vector3d(1, 0, 0))
+            candidates.push_back(crp.CandidateRefPtr(c))
+        sim.run(candidates)
+        for c in candidates:
+            self.assertFalse(c.isActive())
+            self.assertAlmostEqual(c.current.getPosition().x / crp.Mpc, 11)
+        # one call per step for the whole batch
+        self.assertEqual(stop.calls, 11)
+
+    @unittest.skipIf(not numpy_available, "numpy not available")
+    def testCustomMagneticFieldBatch(self):
+        class BatchField(crp.MagneticField):
+            def __init__(self):
+                crp.MagneticField.__init__(self)
+                self.calls = 0
+
+            def getFieldBatch(self, positions, fields, z):
+                self.calls += 1
+                fields[:, 2] = 1 * crp.nG
+
+        field = BatchField()
+        batch = crp.ParticleBatch()
+        for i in range(10):
+            batch.add(crp.ParticleState(crp.nucleusId(1, 1), crp.EeV,
+                crp.Vector3d(0.), crp.Vector3d(1, 0, 0)), 1 * crp.kpc)
+        propa = crp.PropagationBP(field)
+        propa.propagate(batch, 10 * crp.kpc)
+        self.assertEqual(field.calls, 10)
+        uy = batch.getColumn_numpyArray('uy')
+        self.assertTrue(np.all(uy < 0))
+        # the arrays cannot be reallocated under the view
+        with self.assertRaises(RuntimeError):
+            batch.add(crp.ParticleState(), 1 * crp.kpc)
+        del uy
+        batch.add(crp.ParticleState(), 1 * crp.kpc)
+        self.assertEqual(batch.size(), 11)
+
     def testCustomAdvectionField(self):
         class CustomAdvectionField(crp.AdvectionField):
             def __init__(self, val):
@@ -325,6 +385,24 @@ class testParticleCollector(unittest.TestCase):
         collector[0].getTrajectoryLength(),
         3.14, places=2)
 
+  @unittest.skipIf(not numpy_available, "numpy not available")
+  def testParticleCollectorSnapshot(self):
+    collector = crp.ParticleCollector()
+    for i in range(10):
+        collector.process(crp.Candidate(crp.nucleusId(1, 1), i * crp.EeV))
+    output = crp.MemoryOutput(crp.Output.Event1D)
+    collector.snapshot(output)
+    E = output.getColumn_numpyArray('E')
+    ID = output.getColumn_numpyArray('ID')
+    self.assertEqual(E.dtype, np.float64)
+    self.assertEqual(ID.dtype, np.int32)
+    self.assertTrue(np.allclose(E, np.arange(10)))
+    # the arrays are copies and stay valid when rows are added
+    collector.snapshot(output)
+    output.clear()
+    self.assertTrue(np.allclose(E, np.arange(10)))
+    self.assertEqual(E.shape, (10,))
+
 class testGrid(unittest.TestCase):
   def testGridPropertiesConstructor(self):
     N = 32
@@ -332,6 +410,37 @@ class testGrid(unittest.TestCase):
     grid = crp.Grid1f(gp)
     self.assertEqual(grid.getNx(), 32)
 
+  @unittest.skipIf(not numpy_available, "numpy not available")
+  def testNumpyStorage(self):
+    gp = crp.GridProperties(crp.Vector3d(0), 4, 1.)
+    grid = crp.Grid3f(gp)
+    values = np.zeros((4, 4, 4, 3), dtype=np.float32)
+    values[:, :, :, 1] = 2.
+    grid.setExternalStorage_numpyArray(values)
+    del values
+    self.assertTrue(grid.hasExternalStorage())
+    self.assertAlmostEqual(grid.interpolate(crp.Vector3d(1.3, 2.1, 0.7)).y, 2.)
+    view = grid.getData_numpyArray()
+    view[:, :, :, 1] = 3.
+    self.assertAlmostEqual(grid.interpolate(crp.Vector3d(1.3, 2.1, 0.7)).y, 3.)
+    with self.assertRaises(RuntimeError):
+      grid.setExternalStorage_numpyArray(np.zeros((3, 3, 3, 3), dtype=np.float32))
+
+  @unittest.skipIf(not numpy_available, "numpy not available")
+  def testSharedGridReadOnly(self):
+    name = "testSharedGridReadOnly.%i" % os.getpid()
+    crp.SharedMemorySegment.remove(name)
+    grid = crp.Grid3f(crp.GridProperties(crp.Vector3d(0), 4, 1.))
+    shared = crp.shareGrid(grid, name)
+    crp.SharedMemorySegment.remove(name)
+    self.assertTrue(shared.isReadOnly())
+    view = shared.getData_numpyArray()
+    self.assertFalse(view.flags.writeable)
+    with self.assertRaises(ValueError):
+      view[0, 0, 0, 0] = 1.
+    with self.assertRaises(RuntimeError):
+      shared.setValue(0, 0, 0, crp.Vector3f(1.))
+
 if hasattr(crp, 'GridTurbulence'):
     class testTurbulentField(unittest.TestCase):
       #check problems brought up in https://github.com/CRPropa/CRPropa3/issues/322
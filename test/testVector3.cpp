@@ -1,4 +1,5 @@
 #include "crpropa/Vector3.h"
+#include "crpropa/Vector3x4.h"
 #include "gtest/gtest.h"
 
 namespace crpropa {
@@ -154,6 +155,60 @@ TEST(Vector3, parallelPerpendicular) {
 	EXPECT_DOUBLE_EQ(vperp.z, 1);
 }
 
+TEST(Vector3d4, arithmetic) {
+	Vector3d a(1.5, -2, 3), b(-0.5, 4, 2.5);
+	Vector3d4 a4(a), b4(b);
+
+	Vector3d r = (a4 + b4 * 2. - a4 / 4.).toVector3();
+	Vector3d e = a + b * 2. - a / 4.;
+	EXPECT_DOUBLE_EQ(e.x, r.x);
+	EXPECT_DOUBLE_EQ(e.y, r.y);
+	EXPECT_DOUBLE_EQ(e.z, r.z);
+	EXPECT_DOUBLE_EQ(0, (a4 + b4).data[3]);
+
+	EXPECT_DOUBLE_EQ(a.dot(b), a4.dot(b4));
+	EXPECT_DOUBLE_EQ(a.getR(), a4.getR());
+
+	Vector3d c = a4.cross(b4).toVector3();
+	EXPECT_DOUBLE_EQ(a.cross(b).x, c.x);
+	EXPECT_DOUBLE_EQ(a.cross(b).y, c.y);
+	EXPECT_DOUBLE_EQ(a.cross(b).z, c.z);
+
+	EXPECT_DOUBLE_EQ(1, a4.getUnitVector().getR());
+}
+
+TEST(Vector3d4, rotation) {
+	Vector3d v(3, 2, 1);
+	Vector3d axis = Vector3d(1, -1, 2).getUnitVector();
+	Vector3d e = v.getRotated(axis, 0.7);
+	Vector3d r = Vector3d4(v).getRotated(Vector3d4(axis), 0.7).toVector3();
+	EXPECT_NEAR(e.x, r.x, 1e-14);
+	EXPECT_NEAR(e.y, r.y, 1e-14);
+	EXPECT_NEAR(e.z, r.z, 1e-14);
+}
+
+TEST(Vector3f4, arithmetic) {
+	Vector3f a(1.5, -2, 3), b(-0.5, 4, 2.5);
+	Vector3f4 a4(a), b4(b);
+
+	Vector3f r = (a4 - b4 * 2.f).toVector3();
+	EXPECT_FLOAT_EQ(a.x - 2 * b.x, r.x);
+	EXPECT_FLOAT_EQ(a.y - 2 * b.y, r.y);
+	EXPECT_FLOAT_EQ(a.z - 2 * b.z, r.z);
+
+	EXPECT_FLOAT_EQ(a.dot(b), a4.dot(b4));
+	Vector3f c = a4.cross(b4).toVector3();
+	EXPECT_FLOAT_EQ(a.cross(b).x, c.x);
+	EXPECT_FLOAT_EQ(a.cross(b).y, c.y);
+	EXPECT_FLOAT_EQ(a.cross(b).z, c.z);
+
+	Vector3f axis(0, 0, 1);
+	Vector3f q = a4.getRotated(Vector3f4(axis), M_PI / 2).toVector3();
+	EXPECT_NEAR(2, q.x, 1e-6);
+	EXPECT_NEAR(1.5, q.y, 1e-6);
+	EXPECT_NEAR(3, q.z, 1e-6);
+}
+
 int main(int argc, char **argv) {
 	::testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();